@@ -362,4 +362,19 @@ void exit_program(int ret);
  */
 void *grow_array(void *array, int elem_size, int *size, int new_size);
 
+/**
+ * Callbacks for AVCodecContext.get_buffer(), release_buffer() and
+ * reget_buffer() allocating the decoded pictures through
+ * avfilter_get_video_buffer() on the output link of the filter set in
+ * AVCodecContext.opaque, so that they can be fed to the filters without
+ * copying them. The AVFilterBufferRef of each picture is stored in
+ * AVFrame.opaque.
+ *
+ * Pictures whose pixel format does not match the one of the link are
+ * allocated by the default libavcodec functions.
+ */
+int codec_get_buffer(AVCodecContext *codec, AVFrame *pic);
+void codec_release_buffer(AVCodecContext *codec, AVFrame *pic);
+int codec_reget_buffer(AVCodecContext *codec, AVFrame *pic);
+
 #endif /* CMDUTILS_H */
@@ -44,6 +44,8 @@
 #include "libavutil/pixdesc.h"
 #include "libavutil/avstring.h"
 #include "libavutil/libm.h"
+#include "libavutil/threadpool.h"
+#include "libavutil/trace.h"
 #include "libavformat/os_support.h"
 #include "libswresample/swresample.h"
 
@@ -132,6 +134,9 @@ static const char *subtitle_codec_name = NULL;
 
 static int file_overwrite = 0;
 static int do_benchmark = 0;
+static int thread_pool_size = 0;
+static AVThreadPool *thread_pool;
+static char *trace_filename;
 static int do_hex_dump = 0;
 static int do_pkt_dump = 0;
 static int do_pass = 0;
@@ -186,6 +191,7 @@ typedef struct InputStream {
     double ts_scale;
     int is_start;            /* is 1 at the start and after a discontinuity */
     int showed_multi_packet_warning;
+    int use_dr1;             /* true if the decoded frames are allocated by the filters */
     AVDictionary *opts;
 } InputStream;
 
@@ -434,6 +440,20 @@ static void reset_options(OptionsContext *o, int is_input)
     init_opts();
 }
 
+/* the threads of all codecs and filter graphs share one pool if
+ * -thread_pool was given */
+static AVThreadPool *get_thread_pool(void)
+{
+    if (thread_pool_size > 0 && !thread_pool) {
+        thread_pool = av_threadpool_alloc(thread_pool_size);
+        if (!thread_pool) {
+            av_log(NULL, AV_LOG_FATAL, "Could not create the thread pool\n");
+            exit_program(1);
+        }
+    }
+    return thread_pool;
+}
+
 #if CONFIG_AVFILTER
 
 static int configure_video_filters(InputStream *ist, OutputStream *ost)
@@ -449,6 +469,7 @@ static int configure_video_filters(InputStream *ist, OutputStream *ost)
     int ret;
 
     ost->graph = avfilter_graph_alloc();
+    ost->graph->thread_pool = get_thread_pool();
 
     if (ist->st->sample_aspect_ratio.num){
         sample_aspect_ratio = ist->st->sample_aspect_ratio;
@@ -648,11 +669,24 @@ void exit_program(int ret)
         avformat_free_context(s);
         av_dict_free(&output_files[i].opts);
     }
+    /* frame threads keep their worker of the pool until the decoder is closed */
+    if (thread_pool)
+        for (i = 0; i < nb_input_streams; i++)
+            if (input_streams[i].decoding_needed)
+                avcodec_close(input_streams[i].st->codec);
     for(i=0;i<nb_input_files;i++) {
         av_close_input_file(input_files[i].ctx);
     }
     for (i = 0; i < nb_input_streams; i++)
         av_dict_free(&input_streams[i].opts);
+    av_threadpool_free(&thread_pool);
+
+    if (trace_filename) {
+        av_trace_stop();
+        if (av_trace_dump(trace_filename) < 0)
+            av_log(NULL, AV_LOG_ERROR, "Could not write trace to %s\n", trace_filename);
+        av_freep(&trace_filename);
+    }
 
     if (vstats_file)
         fclose(vstats_file);
@@ -678,9 +712,11 @@ void exit_program(int ret)
     if (received_sigterm) {
         av_log(NULL, AV_LOG_INFO, "Received signal %d: terminating.\n",
                (int) received_sigterm);
+        av_log_flush();
         exit (255);
     }
 
+    av_log_flush();
     exit(ret); /* not all OS-es handle main() return value */
 }
 
@@ -1772,7 +1808,23 @@ static int output_packet(InputStream *ist, int ist_index,
                         decoded_frame->sample_aspect_ratio = ist->st->sample_aspect_ratio;
                     decoded_frame->pts = ist->pts;
 
-                    av_vsrc_buffer_add_frame(ost->input_video_filter, decoded_frame, AV_VSRC_BUF_FLAG_OVERWRITE);
+                    /* only the graph whose buffer source allocated the frame may
+                     * get it without a copy, other graphs fed by the same
+                     * stream do not own the buffer */
+                    if (ist->use_dr1 && ost->input_video_filter == ist->st->codec->opaque &&
+                        decoded_frame->type == FF_BUFFER_TYPE_USER &&
+                        decoded_frame->data[0] == ((AVFilterBufferRef *)decoded_frame->opaque)->data[0]) {
+                        /* the frame was allocated by the filters, pass a reference to it */
+                        AVFilterBufferRef *fb = avfilter_ref_buffer(decoded_frame->opaque, ~0);
+                        if (!fb)
+                            exit_program(1);
+                        avfilter_copy_frame_props(fb, decoded_frame);
+                        av_vsrc_buffer_add_video_buffer_ref(ost->input_video_filter, fb,
+                                                            AV_VSRC_BUF_FLAG_OVERWRITE |
+                                                            AV_VSRC_BUF_FLAG_NO_COPY);
+                        avfilter_unref_buffer(fb);
+                    } else
+                        av_vsrc_buffer_add_frame(ost->input_video_filter, decoded_frame, AV_VSRC_BUF_FLAG_OVERWRITE);
                 }
             }
         }
@@ -2017,6 +2069,25 @@ static void print_sdp(OutputFile *output_files, int n)
     av_freep(&avc);
 }
 
+#if CONFIG_AVFILTER
+/**
+ * Tell if the buffers handed to a decoder by the filter feeding on src can
+ * hold the decoder edges. The default buffers are allocated with the size
+ * asked for by codec_get_buffer(), edges included, but filters with their
+ * own get_video_buffer(), like pad, lay out the buffer themselves and may
+ * use the area around the picture.
+ */
+static int filter_supplies_edges(AVFilterContext *src)
+{
+    AVFilterLink *link = src->outputs[0];
+
+    while (link && link->dstpad->get_video_buffer == avfilter_null_get_video_buffer)
+        link = link->dst->output_count ? link->dst->outputs[0] : NULL;
+
+    return !link || !link->dstpad->get_video_buffer;
+}
+#endif
+
 static int init_input_stream(int ist_index, OutputStream *output_streams, int nb_output_streams,
                              char *error, int error_len)
 {
@@ -2028,6 +2099,27 @@ static int init_input_stream(int ist_index, OutputStream *output_streams, int nb
                     avcodec_get_name(ist->st->codec->codec_id), ist->file_index, ist->st->index);
             return AVERROR(EINVAL);
         }
+#if CONFIG_AVFILTER
+        /* decode directly into the buffers of the first filter graph fed
+         * by this stream, so that it does not have to copy the frames */
+        if (codec->type == AVMEDIA_TYPE_VIDEO && codec->capabilities & CODEC_CAP_DR1) {
+            int i;
+            for (i = 0; i < nb_output_streams; i++) {
+                OutputStream *ost = &output_streams[i];
+                if (ost->source_index == ist_index && ost->input_video_filter) {
+                    ist->st->codec->opaque         = ost->input_video_filter;
+                    ist->st->codec->get_buffer     = codec_get_buffer;
+                    ist->st->codec->release_buffer = codec_release_buffer;
+                    ist->st->codec->reget_buffer   = codec_reget_buffer;
+                    if (!filter_supplies_edges(ost->input_video_filter))
+                        ist->st->codec->flags |= CODEC_FLAG_EMU_EDGE;
+                    ist->use_dr1 = 1;
+                    break;
+                }
+            }
+        }
+#endif
+        ist->st->codec->thread_pool = get_thread_pool();
         if (avcodec_open2(ist->st->codec, codec, &ist->opts) < 0) {
             snprintf(error, error_len, "Error while opening decoder for input stream #%d.%d",
                     ist->file_index, ist->st->index);
@@ -2343,6 +2435,7 @@ static int transcode_init(OutputFile *output_files, int nb_output_files,
                 memcpy(ost->st->codec->subtitle_header, dec->subtitle_header, dec->subtitle_header_size);
                 ost->st->codec->subtitle_header_size = dec->subtitle_header_size;
             }
+            ost->st->codec->thread_pool = get_thread_pool();
             if (avcodec_open2(ost->st->codec, codec, &ost->opts) < 0) {
                 snprintf(error, sizeof(error), "Error while opening encoder for output stream #%d.%d - maybe incorrect parameters such as bit_rate, rate, width or height",
                         ost->file_index, ost->index);
@@ -3187,6 +3280,7 @@ static void assert_file_overwrite(const char *filename)
          av_strstart(filename, "file:", NULL))) {
         if (avio_check(filename, 0) == 0) {
             if (!using_stdin) {
+                av_log_flush();
                 fprintf(stderr,"File '%s' already exists. Overwrite ? [y/N] ", filename);
                 fflush(stderr);
                 term_exit();
@@ -4451,6 +4545,37 @@ static int opt_audio_frames(OptionsContext *o, const char *opt, const char *arg)
     return parse_option(o, "frames:a", arg, options);
 }
 
+static int opt_dsp_tune(const char *opt, const char *arg)
+{
+    int ret = avcodec_dsp_tune(strcmp(arg, "-") ? arg : NULL);
+    if (ret < 0)
+        av_log(NULL, AV_LOG_WARNING, "DSP function benchmark not supported on this platform\n");
+    return 0;
+}
+
+static int opt_trace(const char *opt, const char *arg)
+{
+    av_free(trace_filename);
+    trace_filename = av_strdup(arg);
+    if (!trace_filename || av_trace_start(1 << 16) < 0) {
+        av_log(NULL, AV_LOG_FATAL, "Could not start tracing\n");
+        exit_program(1);
+    }
+    return 0;
+}
+
+static int opt_log_async(const char *opt, const char *arg)
+{
+    av_log_set_flags(AV_LOG_SKIP_REPEATED | AV_LOG_ASYNC);
+    return 0;
+}
+
+static int opt_log_rate(const char *opt, const char *arg)
+{
+    av_log_set_rate_limit(parse_number_or_die(opt, arg, OPT_INT, 0, INT_MAX));
+    return 0;
+}
+
 static int opt_data_frames(OptionsContext *o, const char *opt, const char *arg)
 {
     return parse_option(o, "frames:d", arg, options);
@@ -4563,6 +4688,11 @@ static const OptionDef options[] = {
     { "benchmark", OPT_BOOL | OPT_EXPERT, {(void*)&do_benchmark},
       "add timings for benchmarking" },
     { "timelimit", HAS_ARG, {(void*)opt_timelimit}, "set max runtime in seconds", "limit" },
+    { "dsp_tune", HAS_ARG | OPT_EXPERT, {(void*)opt_dsp_tune}, "select the DSP functions by benchmark, caching the result in a file ('-' for none)", "file" },
+    { "log_async", OPT_EXPERT, {(void*)opt_log_async}, "write the log from a separate thread" },
+    { "log_rate", HAS_ARG | OPT_EXPERT, {(void*)opt_log_rate}, "output at most this many log lines per second and context", "number" },
+    { "trace", HAS_ARG | OPT_EXPERT, {(void*)opt_trace}, "record the time spent in codecs, filters and muxers by each thread and write it to a Chrome trace file", "file" },
+    { "thread_pool", HAS_ARG | OPT_INT | OPT_EXPERT, {(void*)&thread_pool_size}, "run the threads of all codecs and filters on one pool of this many threads", "number" },
     { "dump", OPT_BOOL | OPT_EXPERT, {(void*)&do_pkt_dump},
       "dump each input packet" },
     { "hex", OPT_BOOL | OPT_EXPERT, {(void*)&do_hex_dump},
@@ -3005,6 +3005,18 @@ typedef struct AVCodecContext {
     int64_t pts_correction_last_pts;       /// PTS of the last frame
     int64_t pts_correction_last_dts;       /// DTS of the last frame
 
+    /**
+     * Thread pool to run the threads of this context on, see
+     * libavutil/threadpool.h. If set, no threads are created for this
+     * context: at most thread_count threads of the pool work on one
+     * execute() call, and frame threads each keep a worker reserved until
+     * the codec is closed; thread_count is lowered if fewer workers are
+     * free. The pool must outlive the codec context.
+     * - encoding: Set by user.
+     * - decoding: Set by user.
+     */
+    struct AVThreadPool *thread_pool;
+
 } AVCodecContext;
 
 /**
@@ -3869,6 +3881,23 @@ int avcodec_thread_init(AVCodecContext *s, int thread_count);
 
 int avcodec_default_execute(AVCodecContext *c, int (*func)(AVCodecContext *c2, void *arg2),void *arg, int *ret, int count, int size);
 int avcodec_default_execute2(AVCodecContext *c, int (*func)(AVCodecContext *c2, void *arg2, int, int),void *arg, int *ret, int count);
+
+/**
+ * Select the DSP functions by timing the available implementations on
+ * this CPU instead of by CPU flags alone.
+ *
+ * This runs a short benchmark of every function with more than one
+ * implementation and logs the timings and the choices at AV_LOG_VERBOSE.
+ * All codec contexts opened afterwards use the fastest implementations.
+ * Must be called before any codec is opened, and not concurrently with
+ * any other libavcodec call.
+ *
+ * @param cache_file if not NULL, the results are loaded from this file if it
+ *                   was written on the same CPU by the same libavcodec
+ *                   version, otherwise the benchmark result is stored in it
+ * @return 0 on success, a negative AVERROR code if no timer is available
+ */
+int avcodec_dsp_tune(const char *cache_file);
 //FIXME func typedef
 
 #if FF_API_AVCODEC_OPEN
@@ -73,25 +73,45 @@ static av_always_inline void dnxhd_10bit_get_pixels_8x4_sym(DCTELEM *restrict bl
     }
 }
 
-static int dnxhd_10bit_dct_quantize(MpegEncContext *ctx, DCTELEM *block,
-                                    int n, int qscale, int *overflow)
+static int dnxhd_8bit_quantize_c(DNXHDEncContext *ctx, DCTELEM *dst, const DCTELEM *src,
+                                 int chroma, int qscale)
 {
-    const uint8_t *scantable= ctx->intra_scantable.scantable;
-    const int *qmat = n<4 ? ctx->q_intra_matrix[qscale] : ctx->q_chroma_intra_matrix[qscale];
+    const uint8_t *scantable = ctx->m.intra_scantable.scantable;
+    const int *qmat = chroma ? ctx->qmatrix_c[qscale] : ctx->qmatrix_l[qscale];
+    int bias = ctx->m.intra_quant_bias << (QMAT_SHIFT - QUANT_BIAS_SHIFT);
     int last_non_zero = 0;
     int i;
 
-    ctx->dsp.fdct(block);
+    dst[0] = src[0];
+    for (i = 1; i < 64; i++) {
+        int j = scantable[i];
+        int level = src[j] * qmat[j];
+        int sign = level >> 31;
+
+        level = (bias + ((level ^ sign) - sign)) >> QMAT_SHIFT;
+        dst[j] = (level ^ sign) - sign;
+        if (level)
+            last_non_zero = i;
+    }
 
-    // Divide by 4 with rounding, to compensate scaling of DCT coefficients
-    block[0] = (block[0] + 2) >> 2;
+    return last_non_zero;
+}
+
+static int dnxhd_10bit_quantize_c(DNXHDEncContext *ctx, DCTELEM *dst, const DCTELEM *src,
+                                  int chroma, int qscale)
+{
+    const uint8_t *scantable = ctx->m.intra_scantable.scantable;
+    const int *qmat = chroma ? ctx->qmatrix_c[qscale] : ctx->qmatrix_l[qscale];
+    int last_non_zero = 0;
+    int i;
 
-    for (i = 1; i < 64; ++i) {
+    dst[0] = src[0];
+    for (i = 1; i < 64; i++) {
         int j = scantable[i];
-        int sign = block[j] >> 31;
-        int level = (block[j] ^ sign) - sign;
+        int sign = src[j] >> 31;
+        int level = (src[j] ^ sign) - sign;
         level = level * qmat[j] >> DNX10BIT_QMAT_SHIFT;
-        block[j] = (level ^ sign) - sign;
+        dst[j] = (level ^ sign) - sign;
         if (level)
             last_non_zero = i;
     }
@@ -204,6 +224,9 @@ static int dnxhd_init_qmat(DNXHDEncContext *ctx, int lbias, int cbias)
                 // For 10-bit samples, p / s == 2
                 ctx->qmatrix_l[qscale][j] = (1 << (DNX10BIT_QMAT_SHIFT + 1)) / (qscale * luma_weight_table[i]);
                 ctx->qmatrix_c[qscale][j] = (1 << (DNX10BIT_QMAT_SHIFT + 1)) / (qscale * chroma_weight_table[i]);
+                // the weights are at least 31, so the factors fit in 16 bits for SIMD
+                ctx->qmatrix_l16[qscale][0][j] = ctx->qmatrix_l[qscale][j];
+                ctx->qmatrix_c16[qscale][0][j] = ctx->qmatrix_c[qscale][j];
             }
         }
     }
@@ -267,14 +290,13 @@ static int dnxhd_encode_init(AVCodecContext *avctx)
 
     dsputil_init(&ctx->m.dsp, avctx);
     ff_dct_common_init(&ctx->m);
-    if (!ctx->m.dct_quantize)
-        ctx->m.dct_quantize = dct_quantize_c;
 
     if (ctx->cid_table->bit_depth == 10) {
-       ctx->m.dct_quantize = dnxhd_10bit_dct_quantize;
+       ctx->quantize = dnxhd_10bit_quantize_c;
        ctx->get_pixels_8x4_sym = dnxhd_10bit_get_pixels_8x4_sym;
        ctx->block_width_l2 = 4;
     } else {
+       ctx->quantize = dnxhd_8bit_quantize_c;
        ctx->get_pixels_8x4_sym = dnxhd_8bit_get_pixels_8x4_sym;
        ctx->block_width_l2 = 3;
     }
@@ -311,6 +333,8 @@ static int dnxhd_encode_init(AVCodecContext *avctx)
     FF_ALLOCZ_OR_GOTO(ctx->m.avctx, ctx->slice_offs, ctx->m.mb_height*sizeof(uint32_t), fail);
     FF_ALLOCZ_OR_GOTO(ctx->m.avctx, ctx->mb_bits,    ctx->m.mb_num   *sizeof(uint16_t), fail);
     FF_ALLOCZ_OR_GOTO(ctx->m.avctx, ctx->mb_qscale,  ctx->m.mb_num   *sizeof(uint8_t),  fail);
+    FF_ALLOCZ_OR_GOTO(ctx->m.avctx, ctx->mb_coeffs,  ctx->m.mb_num   *sizeof(*ctx->mb_coeffs),    fail);
+    FF_ALLOCZ_OR_GOTO(ctx->m.avctx, ctx->mb_base_bits, ctx->m.mb_num *sizeof(*ctx->mb_base_bits), fail);
 
     ctx->frame.key_frame = 1;
     ctx->frame.pict_type = AV_PICTURE_TYPE_I;
@@ -385,7 +409,7 @@ static av_always_inline void dnxhd_encode_block(DNXHDEncContext *ctx, DCTELEM *b
     ctx->m.last_dc[n] = block[0];
 
     for (i = 1; i <= last_index; i++) {
-        j = ctx->m.intra_scantable.permutated[i];
+        j = ctx->m.intra_scantable.scantable[i];
         slevel = block[j];
         if (slevel) {
             int run_level = i - last_non_zero - 1;
@@ -455,7 +479,7 @@ static av_always_inline int dnxhd_calc_ac_bits(DNXHDEncContext *ctx, DCTELEM *bl
     int bits = 0;
     int i, j, level;
     for (i = 1; i <= last_index; i++) {
-        j = ctx->m.intra_scantable.permutated[i];
+        j = ctx->m.intra_scantable.scantable[i];
         level = block[j];
         if (level) {
             int run_level = i - last_non_zero - 1;
@@ -466,7 +490,7 @@ static av_always_inline int dnxhd_calc_ac_bits(DNXHDEncContext *ctx, DCTELEM *bl
     return bits;
 }
 
-static av_always_inline void dnxhd_get_blocks(DNXHDEncContext *ctx, int mb_x, int mb_y)
+static av_always_inline void dnxhd_get_blocks(DNXHDEncContext *ctx, DCTELEM (*blocks)[64], int mb_x, int mb_y)
 {
     const int bs = ctx->block_width_l2;
     const int bw = 1 << bs;
@@ -475,28 +499,28 @@ static av_always_inline void dnxhd_get_blocks(DNXHDEncContext *ctx, int mb_x, in
     const uint8_t *ptr_v = ctx->thread[0]->src[2] + ((mb_y << 4) * ctx->m.uvlinesize) + (mb_x << bs);
     DSPContext *dsp = &ctx->m.dsp;
 
-    dsp->get_pixels(ctx->blocks[0], ptr_y,      ctx->m.linesize);
-    dsp->get_pixels(ctx->blocks[1], ptr_y + bw, ctx->m.linesize);
-    dsp->get_pixels(ctx->blocks[2], ptr_u,      ctx->m.uvlinesize);
-    dsp->get_pixels(ctx->blocks[3], ptr_v,      ctx->m.uvlinesize);
+    dsp->get_pixels(blocks[0], ptr_y,      ctx->m.linesize);
+    dsp->get_pixels(blocks[1], ptr_y + bw, ctx->m.linesize);
+    dsp->get_pixels(blocks[2], ptr_u,      ctx->m.uvlinesize);
+    dsp->get_pixels(blocks[3], ptr_v,      ctx->m.uvlinesize);
 
     if (mb_y+1 == ctx->m.mb_height && ctx->m.avctx->height == 1080) {
         if (ctx->interlaced) {
-            ctx->get_pixels_8x4_sym(ctx->blocks[4], ptr_y + ctx->dct_y_offset,      ctx->m.linesize);
-            ctx->get_pixels_8x4_sym(ctx->blocks[5], ptr_y + ctx->dct_y_offset + bw, ctx->m.linesize);
-            ctx->get_pixels_8x4_sym(ctx->blocks[6], ptr_u + ctx->dct_uv_offset,     ctx->m.uvlinesize);
-            ctx->get_pixels_8x4_sym(ctx->blocks[7], ptr_v + ctx->dct_uv_offset,     ctx->m.uvlinesize);
+            ctx->get_pixels_8x4_sym(blocks[4], ptr_y + ctx->dct_y_offset,      ctx->m.linesize);
+            ctx->get_pixels_8x4_sym(blocks[5], ptr_y + ctx->dct_y_offset + bw, ctx->m.linesize);
+            ctx->get_pixels_8x4_sym(blocks[6], ptr_u + ctx->dct_uv_offset,     ctx->m.uvlinesize);
+            ctx->get_pixels_8x4_sym(blocks[7], ptr_v + ctx->dct_uv_offset,     ctx->m.uvlinesize);
         } else {
-            dsp->clear_block(ctx->blocks[4]);
-            dsp->clear_block(ctx->blocks[5]);
-            dsp->clear_block(ctx->blocks[6]);
-            dsp->clear_block(ctx->blocks[7]);
+            dsp->clear_block(blocks[4]);
+            dsp->clear_block(blocks[5]);
+            dsp->clear_block(blocks[6]);
+            dsp->clear_block(blocks[7]);
         }
     } else {
-        dsp->get_pixels(ctx->blocks[4], ptr_y + ctx->dct_y_offset,      ctx->m.linesize);
-        dsp->get_pixels(ctx->blocks[5], ptr_y + ctx->dct_y_offset + bw, ctx->m.linesize);
-        dsp->get_pixels(ctx->blocks[6], ptr_u + ctx->dct_uv_offset,     ctx->m.uvlinesize);
-        dsp->get_pixels(ctx->blocks[7], ptr_v + ctx->dct_uv_offset,     ctx->m.uvlinesize);
+        dsp->get_pixels(blocks[4], ptr_y + ctx->dct_y_offset,      ctx->m.linesize);
+        dsp->get_pixels(blocks[5], ptr_y + ctx->dct_y_offset + bw, ctx->m.linesize);
+        dsp->get_pixels(blocks[6], ptr_u + ctx->dct_uv_offset,     ctx->m.uvlinesize);
+        dsp->get_pixels(blocks[7], ptr_v + ctx->dct_uv_offset,     ctx->m.uvlinesize);
     }
 }
 
@@ -506,12 +530,28 @@ static av_always_inline int dnxhd_switch_matrix(DNXHDEncContext *ctx, int i)
     return component[i];
 }
 
-static int dnxhd_calc_bits_thread(AVCodecContext *avctx, void *arg, int jobnr, int threadnr)
+static av_always_inline int dnxhd_calc_dc_bits(DNXHDEncContext *ctx, int diff)
+{
+    int nbits;
+    if (diff < 0) nbits = av_log2_16bit(-2*diff);
+    else          nbits = av_log2_16bit( 2*diff);
+
+    assert(nbits < ctx->cid_table->bit_depth + 4);
+    return ctx->cid_table->dc_bits[nbits] + nbits;
+}
+
+/**
+ * Transform the macroblocks of a row once for all the qscales tried by the
+ * rate control and the final encoding. The DC coefficients do not depend on
+ * qscale, so they are quantised and counted here already.
+ */
+static int dnxhd_dct_thread(AVCodecContext *avctx, void *arg, int jobnr, int threadnr)
 {
     DNXHDEncContext *ctx = avctx->priv_data;
+    const uint8_t *scantable = ctx->m.intra_scantable.scantable;
+    int dc_shift = ctx->cid_table->bit_depth == 10 ? 2 : 3;
+    int hist = avctx->mb_decision != FF_MB_DECISION_RD;
     int mb_y = jobnr, mb_x;
-    int qscale = ctx->qscale;
-    LOCAL_ALIGNED_16(DCTELEM, block, [64]);
     ctx = ctx->thread[threadnr];
 
     ctx->m.last_dc[0] =
@@ -520,39 +560,85 @@ static int dnxhd_calc_bits_thread(AVCodecContext *avctx, void *arg, int jobnr, i
 
     for (mb_x = 0; mb_x < ctx->m.mb_width; mb_x++) {
         unsigned mb = mb_y * ctx->m.mb_width + mb_x;
-        int ssd     = 0;
-        int ac_bits = 0;
-        int dc_bits = 0;
-        int i;
+        DCTELEM (*blocks)[64] = ctx->mb_coeffs[mb];
+        int bits = 12 + 8*ctx->vlc_bits[0];
+        int i, j;
 
-        dnxhd_get_blocks(ctx, mb_x, mb_y);
+        dnxhd_get_blocks(ctx, blocks, mb_x, mb_y);
 
         for (i = 0; i < 8; i++) {
-            DCTELEM *src_block = ctx->blocks[i];
-            int overflow, nbits, diff, last_index;
             int n = dnxhd_switch_matrix(ctx, i);
 
-            memcpy(block, src_block, 64*sizeof(*block));
-            last_index = ctx->m.dct_quantize(&ctx->m, block, 4&(2*i), qscale, &overflow);
-            ac_bits += dnxhd_calc_ac_bits(ctx, block, last_index);
+            ctx->m.dsp.fdct(blocks[i]);
+            // compensate the scaling of the DCT, the DC is not quantised
+            blocks[i][0] = (blocks[i][0] + (1 << dc_shift - 1)) >> dc_shift;
+            bits += dnxhd_calc_dc_bits(ctx, blocks[i][0] - ctx->m.last_dc[n]);
+            ctx->m.last_dc[n] = blocks[i][0];
+
+            if (hist) {
+                int last_index = ctx->quantize(ctx, ctx->levels, blocks[i], i & 2, 1);
+                for (j = 1; j <= last_index; j++) {
+                    int level = FFABS(ctx->levels[scantable[j]]);
+                    if (level)
+                        ctx->level_hist[FFMIN(level, DNXHD_HIST_SIZE - 1)]++;
+                }
+            }
+        }
+        ctx->mb_base_bits[mb] = bits;
+    }
+    return 0;
+}
+
+static av_always_inline void dnxhd_permute_block(DNXHDEncContext *ctx, DCTELEM *block,
+                                                 const DCTELEM *levels, int last_index)
+{
+    int i;
+
+    ctx->m.dsp.clear_block(block);
+    for (i = 0; i <= last_index; i++)
+        block[ctx->m.intra_scantable.permutated[i]] = levels[ctx->m.intra_scantable.scantable[i]];
+}
+
+/**
+ * Count the bits of the macroblocks of a row for every qscale in the range
+ * given by arg, quantising the transformed blocks again for each.
+ */
+static int dnxhd_calc_bits_thread(AVCodecContext *avctx, void *arg, int jobnr, int threadnr)
+{
+    DNXHDEncContext *ctx = avctx->priv_data;
+    const int *qrange = arg;
+    int rd = avctx->mb_decision == FF_MB_DECISION_RD || !RC_VARIANCE;
+    int mb_y = jobnr, mb_x, qscale;
+    LOCAL_ALIGNED_16(DCTELEM, block, [64]);
+    ctx = ctx->thread[threadnr];
+
+    for (mb_x = 0; mb_x < ctx->m.mb_width; mb_x++) {
+        unsigned mb = mb_y * ctx->m.mb_width + mb_x;
+        DCTELEM (*coeffs)[64] = ctx->mb_coeffs[mb];
 
-            diff = block[0] - ctx->m.last_dc[n];
-            if (diff < 0) nbits = av_log2_16bit(-2*diff);
-            else          nbits = av_log2_16bit( 2*diff);
+        if (rd)
+            dnxhd_get_blocks(ctx, ctx->blocks, mb_x, mb_y);
 
-            assert(nbits < ctx->cid_table->bit_depth + 4);
-            dc_bits += ctx->cid_table->dc_bits[nbits] + nbits;
+        for (qscale = qrange[0]; qscale <= qrange[1]; qscale++) {
+            int ssd     = 0;
+            int ac_bits = 0;
+            int i;
 
-            ctx->m.last_dc[n] = block[0];
+            for (i = 0; i < 8; i++) {
+                int last_index = ctx->quantize(ctx, ctx->levels, coeffs[i], i & 2, qscale);
 
-            if (avctx->mb_decision == FF_MB_DECISION_RD || !RC_VARIANCE) {
-                dnxhd_unquantize_c(ctx, block, i, qscale, last_index);
-                ctx->m.dsp.idct(block);
-                ssd += dnxhd_ssd_block(block, src_block);
+                ac_bits += dnxhd_calc_ac_bits(ctx, ctx->levels, last_index);
+
+                if (rd) {
+                    dnxhd_permute_block(ctx, block, ctx->levels, last_index);
+                    dnxhd_unquantize_c(ctx, block, i, qscale, last_index);
+                    ctx->m.dsp.idct(block);
+                    ssd += dnxhd_ssd_block(block, ctx->blocks[i]);
+                }
             }
+            ctx->mb_rc[qscale][mb].ssd = ssd;
+            ctx->mb_rc[qscale][mb].bits = ac_bits + ctx->mb_base_bits[mb];
         }
-        ctx->mb_rc[qscale][mb].ssd = ssd;
-        ctx->mb_rc[qscale][mb].bits = ac_bits+dc_bits+12+8*ctx->vlc_bits[0];
     }
     return 0;
 }
@@ -574,16 +660,10 @@ static int dnxhd_encode_thread(AVCodecContext *avctx, void *arg, int jobnr, int
 
         put_bits(&ctx->m.pb, 12, qscale<<1);
 
-        dnxhd_get_blocks(ctx, mb_x, mb_y);
-
         for (i = 0; i < 8; i++) {
-            DCTELEM *block = ctx->blocks[i];
-            int last_index, overflow;
             int n = dnxhd_switch_matrix(ctx, i);
-            last_index = ctx->m.dct_quantize(&ctx->m, block, 4&(2*i), qscale, &overflow);
-            //START_TIMER;
-            dnxhd_encode_block(ctx, block, last_index, n);
-            //STOP_TIMER("encode_block");
+            int last_index = ctx->quantize(ctx, ctx->levels, ctx->mb_coeffs[mb][i], i & 2, qscale);
+            dnxhd_encode_block(ctx, ctx->levels, last_index, n);
         }
     }
     if (put_bits_count(&ctx->m.pb)&31)
@@ -659,11 +739,9 @@ static int dnxhd_encode_rdo(AVCodecContext *avctx, DNXHDEncContext *ctx)
     int lambda, up_step, down_step;
     int last_lower = INT_MAX, last_higher = 0;
     int x, y, q;
+    int qrange[2] = { 1, avctx->qmax - 1 };
 
-    for (q = 1; q < avctx->qmax; q++) {
-        ctx->qscale = q;
-        avctx->execute2(avctx, dnxhd_calc_bits_thread, NULL, NULL, ctx->m.mb_height);
-    }
+    avctx->execute2(avctx, dnxhd_calc_bits_thread, qrange, NULL, ctx->m.mb_height);
     up_step = down_step = 2<<LAMBDA_FRAC_BITS;
     lambda = ctx->lambda;
 
@@ -729,61 +807,83 @@ static int dnxhd_encode_rdo(AVCodecContext *avctx, DNXHDEncContext *ctx)
     return 0;
 }
 
-static int dnxhd_find_qscale(DNXHDEncContext *ctx)
+static int dnxhd_frame_bits(DNXHDEncContext *ctx, int qscale)
 {
     int bits = 0;
-    int up_step = 1;
-    int down_step = 1;
-    int last_higher = 0;
-    int last_lower = INT_MAX;
-    int qscale;
     int x, y;
 
-    qscale = ctx->qscale;
-    for (;;) {
-        bits = 0;
-        ctx->qscale = qscale;
-        // XXX avoid recalculating bits
-        ctx->m.avctx->execute2(ctx->m.avctx, dnxhd_calc_bits_thread, NULL, NULL, ctx->m.mb_height);
-        for (y = 0; y < ctx->m.mb_height; y++) {
-            for (x = 0; x < ctx->m.mb_width; x++)
-                bits += ctx->mb_rc[qscale][y*ctx->m.mb_width+x].bits;
-            bits = (bits+31)&~31; // padding
-            if (bits > ctx->frame_bits)
-                break;
-        }
-        //av_dlog(ctx->m.avctx, "%d, qscale %d, bits %d, frame %d, higher %d, lower %d\n",
-        //        ctx->m.avctx->frame_number, qscale, bits, ctx->frame_bits, last_higher, last_lower);
-        if (bits < ctx->frame_bits) {
-            if (qscale == 1)
-                return 1;
-            if (last_higher == qscale - 1) {
-                qscale = last_higher;
+    for (y = 0; y < ctx->m.mb_height; y++) {
+        for (x = 0; x < ctx->m.mb_width; x++)
+            bits += ctx->mb_rc[qscale][y*ctx->m.mb_width+x].bits;
+        bits = (bits+31)&~31; // padding
+    }
+    return bits;
+}
+
+/**
+ * Find the qscale which does not fit the frame while qscale + 1 does.
+ * The histogram of the levels at qscale 1 gives the number of non-zero
+ * levels at any qscale. With the bits per level measured at the last
+ * qscale counted, it predicts the qscale to count next; the prediction and
+ * its neighbours are counted exactly in one pass.
+ * @return 1 if qscale 1 fits, 0 if the qscale was found, -1 otherwise
+ */
+static int dnxhd_find_qscale(DNXHDEncContext *ctx)
+{
+    AVCodecContext *avctx = ctx->m.avctx;
+    unsigned nz[DNXHD_HIST_SIZE + 1] = { 0 };
+    int64_t base_bits = 0;
+    int lower = 0, higher = avctx->qmax; // qscales known not to fit and to fit
+    int qscale = ctx->qscale;
+    int pass, i, mb;
+
+    for (i = DNXHD_HIST_SIZE - 1; i >= 0; i--) {
+        int t;
+        nz[i] = nz[i + 1];
+        for (t = 0; t < avctx->thread_count; t++)
+            nz[i] += ctx->thread[t]->level_hist[i];
+    }
+    for (mb = 0; mb < ctx->m.mb_num; mb++)
+        base_bits += ctx->mb_base_bits[mb];
+
+    for (pass = 0; higher - lower > 1; pass++) {
+        int qrange[2], bits = 0, last = 0;
+
+        qrange[0] = FFMAX(qscale - 1, lower  + 1);
+        qrange[1] = FFMIN(qscale + 1, higher - 1);
+        avctx->execute2(avctx, dnxhd_calc_bits_thread, qrange, NULL, ctx->m.mb_height);
+        for (i = qrange[0]; i <= qrange[1]; i++) {
+            last = i;
+            bits = dnxhd_frame_bits(ctx, i);
+            //av_dlog(avctx, "%d, qscale %d, bits %d, frame %d\n",
+            //        avctx->frame_number, i, bits, ctx->frame_bits);
+            if (bits < ctx->frame_bits) {
+                higher = i;
                 break;
             }
-            last_lower = FFMIN(qscale, last_lower);
-            if (last_higher != 0)
-                qscale = (qscale+last_higher)>>1;
-            else
-                qscale -= down_step++;
-            if (qscale < 1)
-                qscale = 1;
-            up_step = 1;
+            lower = i;
+        }
+        if (higher - lower <= 1)
+            break;
+
+        if (pass < 2 && bits > base_bits && last < DNXHD_HIST_SIZE && nz[last]) {
+            // bits(q) ~ base_bits + nz[q] * (bits - base_bits) / nz[last]
+            int64_t target = nz[last] * (ctx->frame_bits - base_bits) / (bits - base_bits);
+            for (qscale = lower + 1; qscale < higher - 1; qscale++)
+                if (qscale < DNXHD_HIST_SIZE && nz[qscale] < target)
+                    break;
         } else {
-            if (last_lower == qscale + 1)
-                break;
-            last_higher = FFMAX(qscale, last_higher);
-            if (last_lower != INT_MAX)
-                qscale = (qscale+last_lower)>>1;
-            else
-                qscale += up_step++;
-            down_step = 1;
-            if (qscale >= ctx->m.avctx->qmax)
-                return -1;
+            qscale = (lower + higher) >> 1;
         }
     }
-    //av_dlog(ctx->m.avctx, "out qscale %d\n", qscale);
-    ctx->qscale = qscale;
+    //av_dlog(avctx, "out qscale %d\n", lower);
+    if (higher == avctx->qmax)
+        return -1;
+    if (!lower) {
+        ctx->qscale = 1;
+        return 1;
+    }
+    ctx->qscale = lower;
     return 0;
 }
 
@@ -922,6 +1022,10 @@ static int dnxhd_encode_picture(AVCodecContext *avctx, unsigned char *buf, int b
 
     dnxhd_write_header(avctx, buf);
 
+    for (i = 0; i < avctx->thread_count; i++)
+        memset(ctx->thread[i]->level_hist, 0, sizeof(ctx->level_hist));
+    avctx->execute2(avctx, dnxhd_dct_thread, NULL, NULL, ctx->m.mb_height);
+
     if (avctx->mb_decision == FF_MB_DECISION_RD)
         ret = dnxhd_encode_rdo(avctx, ctx);
     else
@@ -974,6 +1078,8 @@ static int dnxhd_encode_end(AVCodecContext *avctx)
 
     av_freep(&ctx->mb_bits);
     av_freep(&ctx->mb_qscale);
+    av_freep(&ctx->mb_coeffs);
+    av_freep(&ctx->mb_base_bits);
     av_freep(&ctx->mb_rc);
     av_freep(&ctx->mb_cmp);
     av_freep(&ctx->slice_size);
@@ -29,6 +29,8 @@
 #include "mpegvideo.h"
 #include "dnxhddata.h"
 
+#define DNXHD_HIST_SIZE 128
+
 typedef struct {
     uint16_t mb;
     int value;
@@ -65,6 +67,11 @@ typedef struct DNXHDEncContext {
     unsigned min_padding;
 
     DECLARE_ALIGNED(16, DCTELEM, blocks)[8][64];
+    DECLARE_ALIGNED(16, DCTELEM, levels)[64];
+
+    /** Transformed blocks of the coding unit, with the DC already quantised */
+    DCTELEM (*mb_coeffs)[8][64];
+    uint16_t *mb_base_bits; ///< bits of a macroblock that do not depend on qscale
 
     int      (*qmatrix_c)     [64];
     int      (*qmatrix_l)     [64];
@@ -92,7 +99,18 @@ typedef struct DNXHDEncContext {
     RCCMPEntry *mb_cmp;
     RCEntry   (*mb_rc)[8160];
 
+    /** Histogram of the AC levels at qscale 1, for the fast qscale search */
+    unsigned level_hist[DNXHD_HIST_SIZE];
+
     void (*get_pixels_8x4_sym)(DCTELEM */*align 16*/, const uint8_t *, int);
+
+    /**
+     * Quantise the AC coefficients of a transformed block, in natural order.
+     * The DC coefficient is copied as is.
+     * @return scan index of the last non-zero level, 0 if there is none
+     */
+    int (*quantize)(struct DNXHDEncContext *ctx, DCTELEM *dst /*align 16*/,
+                    const DCTELEM *src /*align 16*/, int chroma, int qscale);
 } DNXHDEncContext;
 
 void ff_dnxhd_init_mmx(DNXHDEncContext *ctx);
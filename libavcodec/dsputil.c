@@ -3181,6 +3181,8 @@ av_cold void dsputil_init(DSPContext* c, AVCodecContext *avctx)
     if (ARCH_SH4)        dsputil_init_sh4   (c, avctx);
     if (ARCH_BFIN)       dsputil_init_bfin  (c, avctx);
 
+    ff_dsputil_apply_tuning(c, avctx);
+
     for(i=0; i<64; i++){
         if(!c->put_2tap_qpel_pixels_tab[0][i])
             c->put_2tap_qpel_pixels_tab[0][i]= c->put_h264_qpel_pixels_tab[0][i];
@@ -567,6 +567,12 @@ typedef struct DSPContext {
 void dsputil_static_init(void);
 void dsputil_init(DSPContext* p, AVCodecContext *avctx);
 
+/**
+ * Replace the function pointers for which avcodec_dsp_tune() found a
+ * faster implementation than the default one.
+ */
+void ff_dsputil_apply_tuning(DSPContext *c, AVCodecContext *avctx);
+
 int ff_check_alignment(void);
 
 /**
@@ -0,0 +1,447 @@
+/*
+ * DSP function selection by benchmarking
+ *
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file
+ * DSP function selection by benchmarking.
+ *
+ * The architecture specific dsputil_init functions pick the kernel of the
+ * newest instruction set the CPU supports. On some CPUs an older kernel
+ * is faster. avcodec_dsp_tune() initializes a DSPContext once per
+ * instruction set level, times every distinct implementation of each
+ * function pointer listed below and remembers the fastest; dsputil_init()
+ * then takes those pointers from a context initialized at the chosen level.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "libavutil/avassert.h"
+#include "libavutil/avstring.h"
+#include "libavutil/cpu.h"
+#include "libavutil/lfg.h"
+#include "libavutil/timer.h"
+#include "avcodec.h"
+#include "dsputil.h"
+
+enum TuneType {
+    TUNE_OP_PIXELS,
+    TUNE_QPEL,
+    TUNE_CHROMA,
+    TUNE_CMP,
+    TUNE_GET_PIXELS,
+    TUNE_DIFF_PIXELS,
+    TUNE_CLAMPED,
+    TUNE_CLEAR_BLOCK,
+    TUNE_ADD_BYTES,
+    TUNE_DIFF_BYTES,
+    TUNE_FMUL,
+    TUNE_SCALARPRODUCT,
+    TUNE_BUTTERFLIES,
+    TUNE_CLIPF,
+};
+
+typedef struct TuneGroup {
+    const char *name;
+    int offset;         ///< offset of the first pointer in DSPContext
+    int rows, cols;     ///< array dimensions, 1 for scalars
+    enum TuneType type;
+    int size;           ///< block size of row 0, halved for each further row
+} TuneGroup;
+
+#define GROUP(field, rows, cols, type, size) \
+    { #field, offsetof(DSPContext, field), rows, cols, type, size }
+
+static const TuneGroup groups[] = {
+    GROUP(put_pixels_tab,              4,  4, TUNE_OP_PIXELS,     16),
+    GROUP(avg_pixels_tab,              4,  4, TUNE_OP_PIXELS,     16),
+    GROUP(put_no_rnd_pixels_tab,       4,  4, TUNE_OP_PIXELS,     16),
+    GROUP(avg_no_rnd_pixels_tab,       4,  4, TUNE_OP_PIXELS,     16),
+    GROUP(put_qpel_pixels_tab,         2, 16, TUNE_QPEL,          16),
+    GROUP(avg_qpel_pixels_tab,         2, 16, TUNE_QPEL,          16),
+    GROUP(put_no_rnd_qpel_pixels_tab,  2, 16, TUNE_QPEL,          16),
+    GROUP(put_h264_qpel_pixels_tab,    4, 16, TUNE_QPEL,          16),
+    GROUP(avg_h264_qpel_pixels_tab,    4, 16, TUNE_QPEL,          16),
+    GROUP(put_h264_chroma_pixels_tab,  3,  1, TUNE_CHROMA,         8),
+    GROUP(avg_h264_chroma_pixels_tab,  3,  1, TUNE_CHROMA,         8),
+    GROUP(sad,                         2,  1, TUNE_CMP,           16),
+    GROUP(sse,                         3,  1, TUNE_CMP,           16),
+    GROUP(pix_abs,                     2,  4, TUNE_CMP,           16),
+    GROUP(get_pixels,                  1,  1, TUNE_GET_PIXELS,     8),
+    GROUP(diff_pixels,                 1,  1, TUNE_DIFF_PIXELS,    8),
+    GROUP(put_pixels_clamped,          1,  1, TUNE_CLAMPED,        8),
+    GROUP(put_signed_pixels_clamped,   1,  1, TUNE_CLAMPED,        8),
+    GROUP(add_pixels_clamped,          1,  1, TUNE_CLAMPED,        8),
+    GROUP(clear_block,                 1,  1, TUNE_CLEAR_BLOCK,    1),
+    GROUP(clear_blocks,                1,  1, TUNE_CLEAR_BLOCK,    6),
+    GROUP(add_bytes,                   1,  1, TUNE_ADD_BYTES,   1024),
+    GROUP(diff_bytes,                  1,  1, TUNE_DIFF_BYTES,  1024),
+    GROUP(vector_fmul,                 1,  1, TUNE_FMUL,         256),
+    GROUP(vector_fmul_reverse,         1,  1, TUNE_FMUL,         256),
+    GROUP(scalarproduct_float,         1,  1, TUNE_SCALARPRODUCT, 256),
+    GROUP(butterflies_float,           1,  1, TUNE_BUTTERFLIES,  256),
+    GROUP(vector_clipf,                1,  1, TUNE_CLIPF,        256),
+};
+
+/**
+ * Instruction set levels, as CPU flags masked out through
+ * AVCodecContext.dsp_mask. Level 0 is the normal selection.
+ */
+static const struct {
+    const char *name;
+    int mask;
+} levels[] = {
+    { "default", 0 },
+    { "c",       0xffff },
+    { "mmx",     0xffff & ~AV_CPU_FLAG_MMX },
+    { "mmx2",    0xffff & ~(AV_CPU_FLAG_MMX | AV_CPU_FLAG_MMX2) },
+    { "sse2",    0xffff & ~(AV_CPU_FLAG_MMX | AV_CPU_FLAG_MMX2 |
+                            AV_CPU_FLAG_SSE | AV_CPU_FLAG_SSE2) },
+    { "ssse3",   0xffff & ~(AV_CPU_FLAG_MMX | AV_CPU_FLAG_MMX2 |
+                            AV_CPU_FLAG_SSE | AV_CPU_FLAG_SSE2 |
+                            AV_CPU_FLAG_SSE3 | AV_CPU_FLAG_SSSE3) },
+};
+#define NB_LEVELS FF_ARRAY_ELEMS(levels)
+
+#define MAX_SLOTS 512
+
+static uint8_t choice[MAX_SLOTS];   ///< chosen level per function pointer
+static int nb_slots;
+static int tuned;
+
+typedef struct BenchData {
+    DECLARE_ALIGNED(16, uint8_t, src)[64 * 64];
+    DECLARE_ALIGNED(16, uint8_t, dst)[64 * 64];
+    DECLARE_ALIGNED(16, DCTELEM, block)[6 * 64];
+    DECLARE_ALIGNED(16, float, f0)[256];
+    DECLARE_ALIGNED(16, float, f1)[256];
+    DECLARE_ALIGNED(16, float, f2)[256];
+} BenchData;
+
+#define BENCH_CALLS 32
+
+static void run(const TuneGroup *g, int row, const void *fp, BenchData *d)
+{
+    int size = g->size >> row;
+    uint8_t *src = d->src + 3 * 64 + 16;
+    int i;
+
+    for (i = 0; i < BENCH_CALLS; i++) {
+        switch (g->type) {
+        case TUNE_OP_PIXELS: {
+            op_pixels_func f; memcpy(&f, fp, sizeof(f));
+            f(d->dst, src, 64, size);
+            break; }
+        case TUNE_QPEL: {
+            qpel_mc_func f; memcpy(&f, fp, sizeof(f));
+            f(d->dst, src, 64);
+            break; }
+        case TUNE_CHROMA: {
+            h264_chroma_mc_func f; memcpy(&f, fp, sizeof(f));
+            f(d->dst, src, 64, size, 3, 5);
+            break; }
+        case TUNE_CMP: {
+            me_cmp_func f; memcpy(&f, fp, sizeof(f));
+            f(NULL, d->dst, src, 64, size);
+            break; }
+        case TUNE_GET_PIXELS: {
+            void (*f)(DCTELEM *, const uint8_t *, int); memcpy(&f, fp, sizeof(f));
+            f(d->block, d->src, 64);
+            break; }
+        case TUNE_DIFF_PIXELS: {
+            void (*f)(DCTELEM *, const uint8_t *, const uint8_t *, int); memcpy(&f, fp, sizeof(f));
+            f(d->block, d->src, d->dst, 64);
+            break; }
+        case TUNE_CLAMPED: {
+            void (*f)(const DCTELEM *, uint8_t *, int); memcpy(&f, fp, sizeof(f));
+            f(d->block, d->dst, 64);
+            break; }
+        case TUNE_CLEAR_BLOCK: {
+            void (*f)(DCTELEM *); memcpy(&f, fp, sizeof(f));
+            f(d->block);
+            break; }
+        case TUNE_ADD_BYTES: {
+            void (*f)(uint8_t *, uint8_t *, int); memcpy(&f, fp, sizeof(f));
+            f(d->dst, d->src, size);
+            break; }
+        case TUNE_DIFF_BYTES: {
+            void (*f)(uint8_t *, uint8_t *, uint8_t *, int); memcpy(&f, fp, sizeof(f));
+            f(d->dst, d->src, d->src + 2048, size);
+            break; }
+        case TUNE_FMUL: {
+            void (*f)(float *, const float *, const float *, int); memcpy(&f, fp, sizeof(f));
+            f(d->f0, d->f1, d->f2, size);
+            break; }
+        case TUNE_SCALARPRODUCT: {
+            float (*f)(const float *, const float *, int); memcpy(&f, fp, sizeof(f));
+            d->f0[i] = f(d->f1, d->f2, size);
+            break; }
+        case TUNE_BUTTERFLIES: {
+            void (*f)(float *, float *, int); memcpy(&f, fp, sizeof(f));
+            f(d->f1, d->f2, size);
+            break; }
+        case TUNE_CLIPF: {
+            void (*f)(float *, const float *, float, float, int); memcpy(&f, fp, sizeof(f));
+            f(d->f0, d->f1, -1.0, 1.0, size);
+            break; }
+        }
+    }
+    emms_c();
+}
+
+#ifdef AV_READ_TIME
+static uint64_t bench(const TuneGroup *g, int row, const void *fp, BenchData *d)
+{
+    uint64_t best = UINT64_MAX;
+    int i;
+
+    run(g, row, fp, d);
+    for (i = 0; i < 16; i++) {
+        uint64_t t = AV_READ_TIME();
+        run(g, row, fp, d);
+        t = AV_READ_TIME() - t;
+        best = FFMIN(best, t);
+    }
+    return best;
+}
+#endif
+
+static void slot_name(char *buf, int size, const TuneGroup *g, int row, int col)
+{
+    if (g->rows == 1 && g->cols == 1)
+        snprintf(buf, size, "%s", g->name);
+    else if (g->cols == 1)
+        snprintf(buf, size, "%s[%d]", g->name, row);
+    else
+        snprintf(buf, size, "%s[%d][%d]", g->name, row, col);
+}
+
+static int count_slots(void)
+{
+    int i, n = 0;
+    for (i = 0; i < FF_ARRAY_ELEMS(groups); i++)
+        n += groups[i].rows * groups[i].cols;
+    return n;
+}
+
+static void init_level(DSPContext *c, AVCodecContext *avctx, int level)
+{
+    avctx->dsp_mask = levels[level].mask;
+    dsputil_init(c, avctx);
+}
+
+static int find_level(const char *name)
+{
+    int i;
+    for (i = 0; i < NB_LEVELS; i++)
+        if (!strcmp(levels[i].name, name))
+            return i;
+    return -1;
+}
+
+static int load_cache(const char *filename, const char *header)
+{
+    char line[256], name[128], level[32];
+    FILE *f = fopen(filename, "r");
+    int i, g, n = 0;
+
+    if (!f)
+        return AVERROR(ENOENT);
+    if (!fgets(line, sizeof(line), f) || strcmp(line, header)) {
+        fclose(f);
+        return AVERROR_INVALIDDATA;
+    }
+    memset(choice, 0, sizeof(choice));
+    while (fgets(line, sizeof(line), f)) {
+        char slot[128];
+        int l, s = 0, found = 0;
+
+        if (sscanf(line, "%127s %31s", name, level) != 2 || (l = find_level(level)) < 0)
+            continue;
+        for (g = 0; g < FF_ARRAY_ELEMS(groups) && !found; g++)
+            for (i = 0; i < groups[g].rows * groups[g].cols; i++, s++) {
+                slot_name(slot, sizeof(slot), &groups[g], i / groups[g].cols, i % groups[g].cols);
+                if (!strcmp(slot, name)) {
+                    choice[s] = l;
+                    found = 1;
+                    break;
+                }
+            }
+        if (found) {
+            av_log(NULL, AV_LOG_VERBOSE, "%-36s %s (cached)\n", name, level);
+            n++;
+        }
+    }
+    fclose(f);
+    return n;
+}
+
+static void save_cache(const char *filename, const char *header)
+{
+    char line[256], name[128];
+    FILE *f = fopen(filename, "w");
+    int g, i, s = 0;
+
+    if (!f) {
+        av_log(NULL, AV_LOG_WARNING, "Cannot write DSP tuning cache %s\n", filename);
+        return;
+    }
+    fputs(header, f);
+    for (g = 0; g < FF_ARRAY_ELEMS(groups); g++)
+        for (i = 0; i < groups[g].rows * groups[g].cols; i++, s++) {
+            if (!choice[s])
+                continue;
+            slot_name(name, sizeof(name), &groups[g], i / groups[g].cols, i % groups[g].cols);
+            snprintf(line, sizeof(line), "%s %s\n", name, levels[choice[s]].name);
+            fputs(line, f);
+        }
+    fclose(f);
+}
+
+int avcodec_dsp_tune(const char *cache_file)
+{
+#ifdef AV_READ_TIME
+    AVCodecContext *avctx;
+    DSPContext *ctx;
+    BenchData *d;
+    char header[64];
+    AVLFG lfg;
+    void (*null_func)(void) = NULL;
+    int g, i, l, s, ret = 0;
+
+    nb_slots = count_slots();
+    av_assert0(nb_slots <= MAX_SLOTS);
+    snprintf(header, sizeof(header), "dsptune %d %x\n",
+             LIBAVCODEC_VERSION_INT, av_get_cpu_flags());
+    if (cache_file && load_cache(cache_file, header) >= 0) {
+        tuned = 1;
+        return 0;
+    }
+
+    avctx = avcodec_alloc_context3(NULL);
+    ctx   = av_malloc(NB_LEVELS * sizeof(*ctx));
+    d     = av_malloc(sizeof(*d));
+    if (!avctx || !ctx || !d) {
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
+    av_lfg_init(&lfg, 1);
+    for (i = 0; i < sizeof(d->src); i++) {
+        d->src[i] = av_lfg_get(&lfg);
+        d->dst[i] = av_lfg_get(&lfg);
+    }
+    for (i = 0; i < 6 * 64; i++)
+        d->block[i] = (int)(av_lfg_get(&lfg) % 512) - 256;
+    for (i = 0; i < 256; i++) {
+        d->f0[i] = 0;
+        d->f1[i] = (float)av_lfg_get(&lfg) / UINT_MAX - 0.5;
+        d->f2[i] = (float)av_lfg_get(&lfg) / UINT_MAX - 0.5;
+    }
+
+    tuned = 0;
+    for (l = 0; l < NB_LEVELS; l++)
+        init_level(&ctx[l], avctx, l);
+
+    memset(choice, 0, sizeof(choice));
+    for (g = s = 0; g < FF_ARRAY_ELEMS(groups); g++) {
+        const TuneGroup *grp = &groups[g];
+
+        for (i = 0; i < grp->rows * grp->cols; i++, s++) {
+            int offset = grp->offset + i * sizeof(null_func);
+            uint64_t times[NB_LEVELS], best;
+            char name[128], report[256];
+            int row = i / grp->cols, n = 0;
+
+            slot_name(name, sizeof(name), grp, row, i % grp->cols);
+            snprintf(report, sizeof(report), "%-36s", name);
+            for (l = 0; l < NB_LEVELS; l++) {
+                const uint8_t *fp = (const uint8_t *)&ctx[l] + offset;
+                int prev;
+
+                times[l] = UINT64_MAX;
+                if (!memcmp(fp, &null_func, sizeof(null_func)))
+                    continue;
+                /* time each distinct implementation only once */
+                for (prev = 0; prev < l; prev++)
+                    if (!memcmp(fp, (const uint8_t *)&ctx[prev] + offset, sizeof(null_func)))
+                        break;
+                if (prev < l) {
+                    times[l] = times[prev];
+                    continue;
+                }
+                times[l] = bench(grp, row, fp, d);
+                av_strlcatf(report, sizeof(report), " %s:%"PRIu64, levels[l].name, times[l]);
+                n++;
+            }
+            if (n <= 1 || times[0] == UINT64_MAX)
+                continue;
+            /* only switch if it is clearly faster, timing noise is a few % */
+            best = times[0] - times[0] / 16;
+            for (l = 1; l < NB_LEVELS; l++)
+                if (times[l] < best) {
+                    best      = times[l];
+                    choice[s] = l;
+                }
+            av_log(NULL, AV_LOG_VERBOSE, "%s -> %s\n", report, levels[choice[s]].name);
+        }
+    }
+    tuned = 1;
+    if (cache_file)
+        save_cache(cache_file, header);
+
+end:
+    av_free(avctx);
+    av_free(ctx);
+    av_free(d);
+    return ret;
+#else
+    return AVERROR(ENOSYS);
+#endif
+}
+
+void ff_dsputil_apply_tuning(DSPContext *c, AVCodecContext *avctx)
+{
+    AVCodecContext tmp;
+    DSPContext alt;
+    void (*null_func)(void) = NULL;
+    int g, i, l, s;
+
+    /* dsp_mask is how the levels are initialized, and a user who sets it
+     * wants exactly those kernels */
+    if (!tuned || avctx->dsp_mask)
+        return;
+
+    tmp = *avctx;
+    for (l = 1; l < NB_LEVELS; l++) {
+        for (s = 0; s < nb_slots; s++)
+            if (choice[s] == l)
+                break;
+        if (s == nb_slots)
+            continue;
+        init_level(&alt, &tmp, l);
+        for (g = s = 0; g < FF_ARRAY_ELEMS(groups); g++)
+            for (i = 0; i < groups[g].rows * groups[g].cols; i++, s++) {
+                int offset = groups[g].offset + i * sizeof(null_func);
+                if (choice[s] == l &&
+                    memcmp((uint8_t *)&alt + offset, &null_func, sizeof(null_func)))
+                    memcpy((uint8_t *)c + offset, (uint8_t *)&alt + offset,
+                           sizeof(null_func));
+            }
+    }
+}
@@ -390,3 +390,39 @@ void ff_j2k_cleanup(J2kComponent *comp, J2kCodingStyle *codsty)
     av_freep(&comp->reslevel);
     av_freep(&comp->data);
 }
+
+static void ict_decode_c(int *src0, int *src1, int *src2, int csize)
+{
+    int i, i0, i1, i2;
+
+    for (i = 0; i < csize; i++){
+        i0 = *src0 + (*src2 * 46802 >> 16);
+        i1 = *src0 - (*src1 * 22553 + *src2 * 46802 >> 16);
+        i2 = *src0 + (116130 * *src1 >> 16);
+        *src0++ = i0;
+        *src1++ = i1;
+        *src2++ = i2;
+    }
+}
+
+static void rct_decode_c(int *src0, int *src1, int *src2, int csize)
+{
+    int i, i0, i1, i2;
+
+    for (i = 0; i < csize; i++){
+        i1 = *src0 - (*src2 + *src1 >> 2);
+        i0 = i1 + *src2;
+        i2 = i1 + *src1;
+        *src0++ = i0;
+        *src1++ = i1;
+        *src2++ = i2;
+    }
+}
+
+void ff_j2k_dsp_init(J2kDSPContext *c)
+{
+    c->mct_decode[FF_DWT97] = ict_decode_c;
+    c->mct_decode[FF_DWT53] = rct_decode_c;
+    if (HAVE_MMX)
+        ff_j2k_dsp_init_x86(c);
+}
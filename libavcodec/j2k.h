@@ -227,6 +227,19 @@ static inline int ff_j2k_getsgnctxno(int flag, int *xorbit)
     return  ff_j2k_sgnctxno_lut[flag&15][(flag>>8)&15];
 }
 
+/* multi-component transform routines */
+typedef struct {
+    /**
+     * inverse multi-component transform of csize samples in place,
+     * indexed by the DWT type: irreversible (ICT) for 9/7, reversible (RCT)
+     * for 5/3
+     */
+    void (*mct_decode[2])(int *src0, int *src1, int *src2, int csize);
+} J2kDSPContext;
+
+void ff_j2k_dsp_init(J2kDSPContext *c);
+void ff_j2k_dsp_init_x86(J2kDSPContext *c);
+
 int ff_j2k_init_component(J2kComponent *comp, J2kCodingStyle *codsty, J2kQuantStyle *qntsty, int cbps, int dx, int dy);
 void ff_j2k_reinit(J2kComponent *comp, J2kCodingStyle *codsty);
 void ff_j2k_cleanup(J2kComponent *comp, J2kCodingStyle *codsty);
@@ -29,12 +29,35 @@
 
 const static float scale97[] = {1.625786, 1.230174};
 
+/* Copy sample vector (4 interleaved lines) src to dst. */
+#define COPY4(p, dst, src) memcpy((p) + 4*(dst), (p) + 4*(src), 4 * sizeof(*(p)))
+
+static void lift53_c(int *p, int n, int shift, int rnd, int sub)
+{
+    int j, k;
+
+    for (j = 0; j < n; j++, p += 8)
+        for (k = 0; k < 4; k++){
+            int d = (p[k - 4] + p[k + 4] + rnd) >> shift;
+            p[k] = sub ? p[k] - d : p[k] + d;
+        }
+}
+
+static void lift97_c(float *p, int n, double c)
+{
+    int j, k;
+
+    for (j = 0; j < n; j++, p += 8)
+        for (k = 0; k < 4; k++)
+            p[k] += c * (p[k - 4] + p[k + 4]);
+}
+
 static inline void extend53(int *p, int i0, int i1)
 {
-    p[i0 - 1] = p[i0 + 1];
-    p[i1    ] = p[i1 - 2];
-    p[i0 - 2] = p[i0 + 2];
-    p[i1 + 1] = p[i1 - 3];
+    COPY4(p, i0 - 1, i0 + 1);
+    COPY4(p, i1    , i1 - 2);
+    COPY4(p, i0 - 2, i0 + 2);
+    COPY4(p, i1 + 1, i1 - 3);
 }
 
 static inline void extend97(float *p, int i0, int i1)
@@ -42,24 +65,26 @@ static inline void extend97(float *p, int i0, int i1)
     int i;
 
     for (i = 1; i <= 4; i++){
-        p[i0 - i] = p[i0 + i];
-        p[i1 + i - 1] = p[i1 - i - 1];
+        COPY4(p, i0 - i, i0 + i);
+        COPY4(p, i1 + i - 1, i1 - i - 1);
     }
 }
 
-static void sd_1d53(int *p, int i0, int i1)
-{
-    int i;
+/* Run the lifting step for positions 2*i + odd, i in [a, b). */
+#define LIFT53(s, p, a, b, odd, shift, rnd, sub) \
+    (s)->lift53((p) + 4*(2*(a) + (odd)), (b) - (a), shift, rnd, sub)
+#define LIFT97(s, p, a, b, odd, c) \
+    (s)->lift97((p) + 4*(2*(a) + (odd)), (b) - (a), c)
 
+static void sd_1d53(DWTContext *s, int *p, int i0, int i1)
+{
     if (i1 == i0 + 1)
         return;
 
     extend53(p, i0, i1);
 
-    for (i = (i0+1)/2 - 1; i < (i1+1)/2; i++)
-        p[2*i+1] -= (p[2*i] + p[2*i+2]) >> 1;
-    for (i = (i0+1)/2; i < (i1+1)/2; i++)
-        p[2*i] += (p[2*i-1] + p[2*i+1] + 2) >> 2;
+    LIFT53(s, p, (i0+1)/2 - 1, (i1+1)/2, 1, 1, 0, 1);
+    LIFT53(s, p, (i0+1)/2,     (i1+1)/2, 0, 2, 2, 0);
 }
 
 static void dwt_encode53(DWTContext *s, int *t)
@@ -67,7 +92,7 @@ static void dwt_encode53(DWTContext *s, int *t)
     int lev,
         w = s->linelen[s->ndeclevels-1][0];
     int *line = s->linebuf;
-    line += 3;
+    line += 4*3;
 
     for (lev = s->ndeclevels-1; lev >= 0; lev--){
         int lh = s->linelen[lev][0],
@@ -78,59 +103,60 @@ static void dwt_encode53(DWTContext *s, int *t)
         int *l;
 
         // HOR_SD
-        l = line + mh;
-        for (lp = 0; lp < lv; lp++){
-            int i, j = 0;
+        l = line + 4*mh;
+        for (lp = 0; lp < lv; lp += 4){
+            int i, j, n, nb = FFMIN(4, lv - lp);
 
-            for (i = 0; i < lh; i++)
-                l[i] = t[w*lp + i];
+            for (n = 0; n < 4; n++)
+                for (i = 0; i < lh; i++)
+                    l[4*i + n] = n < nb ? t[w*(lp+n) + i] : 0;
 
-            sd_1d53(line, mh, mh + lh);
+            sd_1d53(s, line, mh, mh + lh);
 
             // copy back and deinterleave
-            for (i =   mh; i < lh; i+=2, j++)
-                t[w*lp + j] = l[i];
-            for (i = 1-mh; i < lh; i+=2, j++)
-                t[w*lp + j] = l[i];
+            for (n = 0; n < nb; n++){
+                j = 0;
+                for (i =   mh; i < lh; i+=2, j++)
+                    t[w*(lp+n) + j] = l[4*i + n];
+                for (i = 1-mh; i < lh; i+=2, j++)
+                    t[w*(lp+n) + j] = l[4*i + n];
+            }
         }
 
         // VER_SD
-        l = line + mv;
-        for (lp = 0; lp < lh; lp++) {
-            int i, j = 0;
+        l = line + 4*mv;
+        for (lp = 0; lp < lh; lp += 4){
+            int i, j = 0, n, nb = FFMIN(4, lh - lp);
 
             for (i = 0; i < lv; i++)
-                l[i] = t[w*i + lp];
+                for (n = 0; n < 4; n++)
+                    l[4*i + n] = n < nb ? t[w*i + lp + n] : 0;
 
-            sd_1d53(line, mv, mv + lv);
+            sd_1d53(s, line, mv, mv + lv);
 
             // copy back and deinterleave
             for (i =   mv; i < lv; i+=2, j++)
-                t[w*j + lp] = l[i];
+                for (n = 0; n < nb; n++)
+                    t[w*j + lp + n] = l[4*i + n];
             for (i = 1-mv; i < lv; i+=2, j++)
-                t[w*j + lp] = l[i];
+                for (n = 0; n < nb; n++)
+                    t[w*j + lp + n] = l[4*i + n];
         }
     }
 }
 
-static void sd_1d97(float *p, int i0, int i1)
+static void sd_1d97(DWTContext *s, float *p, int i0, int i1)
 {
-    int i;
-
     if (i1 == i0 + 1)
         return;
 
     extend97(p, i0, i1);
     i0++; i1++;
 
-    for (i = i0/2 - 2; i < i1/2 + 1; i++)
-        p[2*i+1] -= 1.586134 * (p[2*i] + p[2*i+2]);
-    for (i = i0/2 - 1; i < i1/2 + 1; i++)
-        p[2*i] -= 0.052980 * (p[2*i-1] + p[2*i+1]);
-    for (i = i0/2 - 1; i < i1/2; i++)
-        p[2*i+1] += 0.882911 * (p[2*i] + p[2*i+2]);
-    for (i = i0/2; i < i1/2; i++)
-        p[2*i] += 0.443506 * (p[2*i-1] + p[2*i+1]);
+    LIFT97(s, p, i0/2 - 2, i1/2 + 1, 1, -1.586134);
+    LIFT97(s, p, i0/2 - 1, i1/2 + 1, 0, -0.052980);
+    LIFT97(s, p, i0/2 - 1, i1/2,     1,  0.882911);
+    LIFT97(s, p, i0/2,     i1/2,     0,  0.443506);
 }
 
 static void dwt_encode97(DWTContext *s, int *t)
@@ -138,7 +164,7 @@ static void dwt_encode97(DWTContext *s, int *t)
     int lev,
         w = s->linelen[s->ndeclevels-1][0];
     float *line = s->linebuf;
-    line += 5;
+    line += 4*5;
 
     for (lev = s->ndeclevels-1; lev >= 0; lev--){
         int lh = s->linelen[lev][0],
@@ -149,54 +175,57 @@ static void dwt_encode97(DWTContext *s, int *t)
         float *l;
 
         // HOR_SD
-        l = line + mh;
-        for (lp = 0; lp < lv; lp++){
-            int i, j = 0;
+        l = line + 4*mh;
+        for (lp = 0; lp < lv; lp += 4){
+            int i, j, n, nb = FFMIN(4, lv - lp);
 
-            for (i = 0; i < lh; i++)
-                l[i] = t[w*lp + i];
+            for (n = 0; n < 4; n++)
+                for (i = 0; i < lh; i++)
+                    l[4*i + n] = n < nb ? t[w*(lp+n) + i] : 0;
 
-            sd_1d97(line, mh, mh + lh);
+            sd_1d97(s, line, mh, mh + lh);
 
             // copy back and deinterleave
-            for (i =   mh; i < lh; i+=2, j++)
-                t[w*lp + j] = scale97[mh] * l[i] / 2;
-            for (i = 1-mh; i < lh; i+=2, j++)
-                t[w*lp + j] = scale97[mh] * l[i] / 2;
+            for (n = 0; n < nb; n++){
+                j = 0;
+                for (i =   mh; i < lh; i+=2, j++)
+                    t[w*(lp+n) + j] = scale97[mh] * l[4*i + n] / 2;
+                for (i = 1-mh; i < lh; i+=2, j++)
+                    t[w*(lp+n) + j] = scale97[mh] * l[4*i + n] / 2;
+            }
         }
 
         // VER_SD
-        l = line + mv;
-        for (lp = 0; lp < lh; lp++) {
-            int i, j = 0;
+        l = line + 4*mv;
+        for (lp = 0; lp < lh; lp += 4){
+            int i, j = 0, n, nb = FFMIN(4, lh - lp);
 
             for (i = 0; i < lv; i++)
-                l[i] = t[w*i + lp];
+                for (n = 0; n < 4; n++)
+                    l[4*i + n] = n < nb ? t[w*i + lp + n] : 0;
 
-            sd_1d97(line, mv, mv + lv);
+            sd_1d97(s, line, mv, mv + lv);
 
             // copy back and deinterleave
             for (i =   mv; i < lv; i+=2, j++)
-                t[w*j + lp] = scale97[mv] * l[i] / 2;
+                for (n = 0; n < nb; n++)
+                    t[w*j + lp + n] = scale97[mv] * l[4*i + n] / 2;
             for (i = 1-mv; i < lv; i+=2, j++)
-                t[w*j + lp] = scale97[mv] * l[i] / 2;
+                for (n = 0; n < nb; n++)
+                    t[w*j + lp + n] = scale97[mv] * l[4*i + n] / 2;
         }
     }
 }
 
-static void sr_1d53(int *p, int i0, int i1)
+static void sr_1d53(DWTContext *s, int *p, int i0, int i1)
 {
-    int i;
-
     if (i1 == i0 + 1)
         return;
 
     extend53(p, i0, i1);
 
-    for (i = i0/2; i < i1/2 + 1; i++)
-        p[2*i] -= (p[2*i-1] + p[2*i+1] + 2) >> 2;
-    for (i = i0/2; i < i1/2; i++)
-        p[2*i+1] += (p[2*i] + p[2*i+2]) >> 1;
+    LIFT53(s, p, i0/2, i1/2 + 1, 0, 2, 2, 1);
+    LIFT53(s, p, i0/2, i1/2,     1, 1, 0, 0);
 }
 
 static void dwt_decode53(DWTContext *s, int *t)
@@ -204,7 +233,7 @@ static void dwt_decode53(DWTContext *s, int *t)
     int lev,
         w = s->linelen[s->ndeclevels-1][0];
     int *line = s->linebuf;
-    line += 3;
+    line += 4*3;
 
     for (lev = 0; lev < s->ndeclevels; lev++){
         int lh = s->linelen[lev][0],
@@ -215,56 +244,57 @@ static void dwt_decode53(DWTContext *s, int *t)
         int *l;
 
         // HOR_SD
-        l = line + mh;
-        for (lp = 0; lp < lv; lp++){
-            int i, j = 0;
+        l = line + 4*mh;
+        for (lp = 0; lp < lv; lp += 4){
+            int i, j, n, nb = FFMIN(4, lv - lp);
             // copy with interleaving
-            for (i =   mh; i < lh; i+=2, j++)
-                l[i] = t[w*lp + j];
-            for (i = 1-mh; i < lh; i+=2, j++)
-                l[i] = t[w*lp + j];
-
-            sr_1d53(line, mh, mh + lh);
-
-            for (i = 0; i < lh; i++)
-                t[w*lp + i] = l[i];
+            for (n = 0; n < 4; n++){
+                j = 0;
+                for (i =   mh; i < lh; i+=2, j++)
+                    l[4*i + n] = n < nb ? t[w*(lp+n) + j] : 0;
+                for (i = 1-mh; i < lh; i+=2, j++)
+                    l[4*i + n] = n < nb ? t[w*(lp+n) + j] : 0;
+            }
+
+            sr_1d53(s, line, mh, mh + lh);
+
+            for (n = 0; n < nb; n++)
+                for (i = 0; i < lh; i++)
+                    t[w*(lp+n) + i] = l[4*i + n];
         }
 
         // VER_SD
-        l = line + mv;
-        for (lp = 0; lp < lh; lp++){
-            int i, j = 0;
+        l = line + 4*mv;
+        for (lp = 0; lp < lh; lp += 4){
+            int i, j = 0, n, nb = FFMIN(4, lh - lp);
             // copy with interleaving
             for (i =   mv; i < lv; i+=2, j++)
-                l[i] = t[w*j + lp];
+                for (n = 0; n < 4; n++)
+                    l[4*i + n] = n < nb ? t[w*j + lp + n] : 0;
             for (i = 1-mv; i < lv; i+=2, j++)
-                l[i] = t[w*j + lp];
+                for (n = 0; n < 4; n++)
+                    l[4*i + n] = n < nb ? t[w*j + lp + n] : 0;
 
-            sr_1d53(line, mv, mv + lv);
+            sr_1d53(s, line, mv, mv + lv);
 
             for (i = 0; i < lv; i++)
-                t[w*i + lp] = l[i];
+                for (n = 0; n < nb; n++)
+                    t[w*i + lp + n] = l[4*i + n];
         }
     }
 }
 
-static void sr_1d97(float *p, int i0, int i1)
+static void sr_1d97(DWTContext *s, float *p, int i0, int i1)
 {
-    int i;
-
     if (i1 == i0 + 1)
         return;
 
     extend97(p, i0, i1);
 
-    for (i = i0/2 - 1; i < i1/2 + 2; i++)
-        p[2*i] -= 0.443506 * (p[2*i-1] + p[2*i+1]);
-    for (i = i0/2 - 1; i < i1/2 + 1; i++)
-        p[2*i+1] -= 0.882911 * (p[2*i] + p[2*i+2]);
-    for (i = i0/2; i < i1/2 + 1; i++)
-        p[2*i] += 0.052980 * (p[2*i-1] + p[2*i+1]);
-    for (i = i0/2; i < i1/2; i++)
-        p[2*i+1] += 1.586134 * (p[2*i] + p[2*i+2]);
+    LIFT97(s, p, i0/2 - 1, i1/2 + 2, 0, -0.443506);
+    LIFT97(s, p, i0/2 - 1, i1/2 + 1, 1, -0.882911);
+    LIFT97(s, p, i0/2,     i1/2 + 1, 0,  0.052980);
+    LIFT97(s, p, i0/2,     i1/2,     1,  1.586134);
 }
 
 static void dwt_decode97(DWTContext *s, int *t)
@@ -272,7 +302,7 @@ static void dwt_decode97(DWTContext *s, int *t)
     int lev,
         w = s->linelen[s->ndeclevels-1][0];
     float *line = s->linebuf;
-    line += 5;
+    line += 4*5;
 
     for (lev = 0; lev < s->ndeclevels; lev++){
         int lh = s->linelen[lev][0],
@@ -283,35 +313,42 @@ static void dwt_decode97(DWTContext *s, int *t)
         float *l;
 
         // HOR_SD
-        l = line + mh;
-        for (lp = 0; lp < lv; lp++){
-            int i, j = 0;
+        l = line + 4*mh;
+        for (lp = 0; lp < lv; lp += 4){
+            int i, j, n, nb = FFMIN(4, lv - lp);
             // copy with interleaving
-            for (i =   mh; i < lh; i+=2, j++)
-                l[i] = scale97[1-mh] * t[w*lp + j];
-            for (i = 1-mh; i < lh; i+=2, j++)
-                l[i] = scale97[1-mh] * t[w*lp + j];
-
-            sr_1d97(line, mh, mh + lh);
-
-            for (i = 0; i < lh; i++)
-                t[w*lp + i] = l[i];
+            for (n = 0; n < 4; n++){
+                j = 0;
+                for (i =   mh; i < lh; i+=2, j++)
+                    l[4*i + n] = n < nb ? scale97[1-mh] * t[w*(lp+n) + j] : 0;
+                for (i = 1-mh; i < lh; i+=2, j++)
+                    l[4*i + n] = n < nb ? scale97[1-mh] * t[w*(lp+n) + j] : 0;
+            }
+
+            sr_1d97(s, line, mh, mh + lh);
+
+            for (n = 0; n < nb; n++)
+                for (i = 0; i < lh; i++)
+                    t[w*(lp+n) + i] = l[4*i + n];
         }
 
         // VER_SD
-        l = line + mv;
-        for (lp = 0; lp < lh; lp++){
-            int i, j = 0;
+        l = line + 4*mv;
+        for (lp = 0; lp < lh; lp += 4){
+            int i, j = 0, n, nb = FFMIN(4, lh - lp);
             // copy with interleaving
             for (i =   mv; i < lv; i+=2, j++)
-                l[i] = scale97[1-mv] * t[w*j + lp];
+                for (n = 0; n < 4; n++)
+                    l[4*i + n] = n < nb ? scale97[1-mv] * t[w*j + lp + n] : 0;
             for (i = 1-mv; i < lv; i+=2, j++)
-                l[i] = scale97[1-mv] * t[w*j + lp];
+                for (n = 0; n < 4; n++)
+                    l[4*i + n] = n < nb ? scale97[1-mv] * t[w*j + lp + n] : 0;
 
-            sr_1d97(line, mv, mv + lv);
+            sr_1d97(s, line, mv, mv + lv);
 
             for (i = 0; i < lv; i++)
-                t[w*i + lp] = l[i];
+                for (n = 0; n < nb; n++)
+                    t[w*i + lp + n] = l[4*i + n];
         }
     }
 }
@@ -342,15 +379,20 @@ int ff_j2k_dwt_init(DWTContext *s, uint16_t border[2][2], int decomp_levels, int
         }
     }
     if (type == FF_DWT97)
-        s->linebuf = av_malloc((maxlen + 12) * sizeof(float));
+        s->linebuf = av_malloc(4 * (maxlen + 12) * sizeof(float));
     else if (type == FF_DWT53)
-        s->linebuf = av_malloc((maxlen + 6) * sizeof(int));
+        s->linebuf = av_malloc(4 * (maxlen + 6) * sizeof(int));
     else
         return -1;
 
     if (!s->linebuf)
         return AVERROR(ENOMEM);
 
+    s->lift53 = lift53_c;
+    s->lift97 = lift97_c;
+    if (HAVE_MMX)
+        ff_j2k_dwt_init_x86(s);
+
     return 0;
 }
 
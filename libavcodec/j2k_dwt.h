@@ -44,6 +44,18 @@ typedef struct {
     uint8_t  ndeclevels;                 ///< number of decomposition levels
     uint8_t  type;                       ///< 0 for 9/7; 1 for 5/3
     void     *linebuf;                   ///< buffer used by transform (int or float)
+
+    /**
+     * Lifting steps. The 1-D transforms run on 4 lines at once, which are
+     * interleaved in the line buffer: sample i of line n is at p[4*i + n].
+     * Each function updates the samples of n consecutive odd or even
+     * positions starting at p, i.e. p[8*j + k] for j < n and k < 4, from
+     * their neighbours p[8*j + k - 4] and p[8*j + k + 4].
+     */
+    /** p += (left + right + rnd) >> shift, or -= if sub is set */
+    void (*lift53)(int *p, int n, int shift, int rnd, int sub);
+    /** p += c * (left + right), computed in double precision */
+    void (*lift97)(float *p, int n, double c);
 } DWTContext;
 
 /**
@@ -60,4 +72,6 @@ int ff_j2k_dwt_decode(DWTContext *s, int *t);
 
 void ff_j2k_dwt_destroy(DWTContext *s);
 
+void ff_j2k_dwt_init_x86(DWTContext *s);
+
 #endif /* AVCODEC_DWT_H */
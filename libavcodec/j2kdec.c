@@ -37,11 +37,20 @@
 #define HAD_COC 0x01
 #define HAD_QCC 0x02
 
+typedef struct {
+    J2kCblk *cblk;
+    J2kBand *band;
+    int compno, bandpos;
+    int xx0, xx1, yy0, yy1; ///< position in the component data
+} J2kCblkJob;
+
 typedef struct {
    J2kComponent *comp;
    uint8_t properties[4];
    J2kCodingStyle codsty[4];
    J2kQuantStyle  qntsty[4];
+   J2kCblkJob *cblk_job;
+   int ncblk_jobs;
 } J2kTile;
 
 typedef struct {
@@ -72,6 +81,8 @@ typedef struct {
     int16_t curtileno;
 
     J2kTile *tile;
+
+    J2kDSPContext dsp;
 } J2kDecoderContext;
 
 static int get_bits(J2kDecoderContext *s, int n)
@@ -733,41 +744,73 @@ static int decode_cblk(J2kDecoderContext *s, J2kCodingStyle *codsty, J2kT1Contex
 
 static void mct_decode(J2kDecoderContext *s, J2kTile *tile)
 {
-    int i, *src[3], i0, i1, i2, csize = 1;
-
-    for (i = 0; i < 3; i++)
-        src[i] = tile->comp[i].data;
+    int i, csize = 1;
 
     for (i = 0; i < 2; i++)
         csize *= tile->comp[0].coord[i][1] - tile->comp[0].coord[i][0];
 
-    if (tile->codsty[0].transform == FF_DWT97){
-        for (i = 0; i < csize; i++){
-            i0 = *src[0] + (*src[2] * 46802 >> 16);
-            i1 = *src[0] - (*src[1] * 22553 + *src[2] * 46802 >> 16);
-            i2 = *src[0] + (116130 * *src[1] >> 16);
-            *src[0]++ = i0;
-            *src[1]++ = i1;
-            *src[2]++ = i2;
+    s->dsp.mct_decode[tile->codsty[0].transform](tile->comp[0].data,
+                                                 tile->comp[1].data,
+                                                 tile->comp[2].data, csize);
+}
+
+static int decode_cblk_job(AVCodecContext *avctx, void *arg, int jobnr, int threadnr)
+{
+    J2kDecoderContext *s = avctx->priv_data;
+    J2kTile *tile = arg;
+    J2kCblkJob *job = tile->cblk_job + jobnr;
+    J2kComponent *comp = tile->comp + job->compno;
+    J2kCodingStyle *codsty = tile->codsty + job->compno;
+    int x, y, w = comp->coord[0][1] - comp->coord[0][0];
+    J2kT1Context t1;
+
+    decode_cblk(s, codsty, &t1, job->cblk, job->xx1 - job->xx0, job->yy1 - job->yy0, job->bandpos);
+    if (codsty->transform == FF_DWT53){
+        for (y = job->yy0; y < job->yy1; y+=s->cdy[job->compno]){
+            int *ptr = t1.data[y-job->yy0];
+            for (x = job->xx0; x < job->xx1; x+=s->cdx[job->compno]){
+                comp->data[w * y + x] = *ptr++ >> 1;
+            }
         }
     } else{
-        for (i = 0; i < csize; i++){
-            i1 = *src[0] - (*src[2] + *src[1] >> 2);
-            i0 = i1 + *src[2];
-            i2 = i1 + *src[1];
-            *src[0]++ = i0;
-            *src[1]++ = i1;
-            *src[2]++ = i2;
+        for (y = job->yy0; y < job->yy1; y+=s->cdy[job->compno]){
+            int *ptr = t1.data[y-job->yy0];
+            for (x = job->xx0; x < job->xx1; x+=s->cdx[job->compno]){
+                int tmp = ((int64_t)*ptr++) * ((int64_t)job->band->stepsize) >> 13, tmp2;
+                tmp2 = FFABS(tmp>>1) + FFABS(tmp&1);
+                comp->data[w * y + x] = tmp < 0 ? -tmp2 : tmp2;
+            }
         }
     }
+    return 0;
 }
 
-static int decode_tile(J2kDecoderContext *s, J2kTile *tile)
+static int dwt_decode_job(AVCodecContext *avctx, void *arg, int compno, int threadnr)
 {
-    int compno, reslevelno, bandno;
-    int x, y, *src[4];
-    uint8_t *line;
-    J2kT1Context t1;
+    J2kTile *tile = arg;
+
+    ff_j2k_dwt_decode(&tile->comp[compno].dwt, tile->comp[compno].data);
+    return 0;
+}
+
+/**
+ * Collect the code-blocks of a tile with their position in the component
+ * data, so that they can be decoded independently.
+ */
+static int get_cblk_jobs(J2kDecoderContext *s, J2kTile *tile)
+{
+    int compno, reslevelno, bandno, ncblks = 0;
+    J2kCblkJob *job;
+
+    for (compno = 0; compno < s->ncomponents; compno++)
+        for (reslevelno = 0; reslevelno < tile->codsty[compno].nreslevels; reslevelno++){
+            J2kResLevel *rlevel = tile->comp[compno].reslevel + reslevelno;
+            for (bandno = 0; bandno < rlevel->nbands; bandno++)
+                ncblks += rlevel->band[bandno].cblknx * rlevel->band[bandno].cblkny;
+        }
+    job = tile->cblk_job = av_malloc(ncblks * sizeof(*tile->cblk_job));
+    if (!job && ncblks)
+        return AVERROR(ENOMEM);
 
     for (compno = 0; compno < s->ncomponents; compno++){
         J2kComponent *comp = tile->comp + compno;
@@ -798,26 +841,13 @@ static int decode_tile(J2kDecoderContext *s, J2kTile *tile)
                     xx1 = FFMIN(ff_j2k_ceildiv(band->coord[0][0] + 1, band->codeblock_width) * band->codeblock_width,
                                 band->coord[0][1]) - band->coord[0][0] + xx0;
 
-                    for (cblkx = 0; cblkx < band->cblknx; cblkx++, cblkno++){
-                        int y, x;
-                        decode_cblk(s, codsty, &t1, band->cblk + cblkno, xx1 - xx0, yy1 - yy0, bandpos);
-                        if (codsty->transform == FF_DWT53){
-                            for (y = yy0; y < yy1; y+=s->cdy[compno]){
-                                int *ptr = t1.data[y-yy0];
-                                for (x = xx0; x < xx1; x+=s->cdx[compno]){
-                                    comp->data[(comp->coord[0][1] - comp->coord[0][0]) * y + x] = *ptr++ >> 1;
-                                }
-                            }
-                        } else{
-                            for (y = yy0; y < yy1; y+=s->cdy[compno]){
-                                int *ptr = t1.data[y-yy0];
-                                for (x = xx0; x < xx1; x+=s->cdx[compno]){
-                                    int tmp = ((int64_t)*ptr++) * ((int64_t)band->stepsize) >> 13, tmp2;
-                                    tmp2 = FFABS(tmp>>1) + FFABS(tmp&1);
-                                    comp->data[(comp->coord[0][1] - comp->coord[0][0]) * y + x] = tmp < 0 ? -tmp2 : tmp2;
-                                }
-                            }
-                        }
+                    for (cblkx = 0; cblkx < band->cblknx; cblkx++, cblkno++, job++){
+                        job->cblk    = band->cblk + cblkno;
+                        job->band    = band;
+                        job->compno  = compno;
+                        job->bandpos = bandpos;
+                        job->xx0 = xx0; job->xx1 = xx1;
+                        job->yy0 = yy0; job->yy1 = yy1;
                         xx0 = xx1;
                         xx1 = FFMIN(xx1 + band->codeblock_width, band->coord[0][1] - band->coord[0][0] + x0);
                     }
@@ -826,9 +856,37 @@ static int decode_tile(J2kDecoderContext *s, J2kTile *tile)
                 }
             }
         }
-        ff_j2k_dwt_decode(&comp->dwt, comp->data);
-        src[compno] = comp->data;
     }
+    tile->ncblk_jobs = job - tile->cblk_job;
+    return 0;
+}
+
+/**
+ * Decode a tile into the picture.
+ * @param threaded decode the code-blocks and transform the components of
+ *                 the tile on the slice threads
+ */
+static int decode_tile(J2kDecoderContext *s, J2kTile *tile, int threaded)
+{
+    int compno, i, ret;
+    int x, y, *src[4];
+    uint8_t *line;
+
+    if ((ret = get_cblk_jobs(s, tile)) < 0)
+        return ret;
+    if (threaded){
+        s->avctx->execute2(s->avctx, decode_cblk_job, tile, NULL, tile->ncblk_jobs);
+        s->avctx->execute2(s->avctx, dwt_decode_job,  tile, NULL, s->ncomponents);
+    } else{
+        for (i = 0; i < tile->ncblk_jobs; i++)
+            decode_cblk_job(s->avctx, tile, i, 0);
+        for (compno = 0; compno < s->ncomponents; compno++)
+            dwt_decode_job(s->avctx, tile, compno, 0);
+    }
+    av_freep(&tile->cblk_job);
+
+    for (compno = 0; compno < s->ncomponents; compno++)
+        src[compno] = tile->comp[compno].data;
     if (tile->codsty[0].mct)
         mct_decode(s, tile);
 
@@ -895,6 +953,13 @@ static void cleanup(J2kDecoderContext *s)
     av_freep(&s->tile);
 }
 
+static int decode_tile_job(AVCodecContext *avctx, void *arg, int tileno, int threadnr)
+{
+    J2kDecoderContext *s = avctx->priv_data;
+
+    return decode_tile(s, s->tile + tileno, 0);
+}
+
 static int decode_codestream(J2kDecoderContext *s)
 {
     J2kCodingStyle *codsty = s->codsty;
@@ -993,7 +1058,7 @@ static int decode_frame(AVCodecContext *avctx,
 {
     J2kDecoderContext *s = avctx->priv_data;
     AVFrame *picture = data;
-    int tileno, ret;
+    int tileno, ntiles, ret;
 
     s->avctx = avctx;
     av_log(s->avctx, AV_LOG_DEBUG, "start\n");
@@ -1025,9 +1090,23 @@ static int decode_frame(AVCodecContext *avctx,
     if (ret = decode_codestream(s))
         return ret;
 
-    for (tileno = 0; tileno < s->numXtiles * s->numYtiles; tileno++)
-        if (ret = decode_tile(s, s->tile + tileno))
+    ntiles = s->numXtiles * s->numYtiles;
+    if (ntiles >= avctx->thread_count){
+        // enough tiles to keep all threads busy
+        int *tile_ret = av_malloc(ntiles * sizeof(*tile_ret));
+        if (!tile_ret)
+            return AVERROR(ENOMEM);
+        avctx->execute2(avctx, decode_tile_job, NULL, tile_ret, ntiles);
+        for (tileno = 0; tileno < ntiles && !ret; tileno++)
+            ret = tile_ret[tileno];
+        av_free(tile_ret);
+        if (ret)
             return ret;
+    } else{
+        for (tileno = 0; tileno < ntiles; tileno++)
+            if (ret = decode_tile(s, s->tile + tileno, 1))
+                return ret;
+    }
 
     cleanup(s);
     av_log(s->avctx, AV_LOG_DEBUG, "end\n");
@@ -1044,6 +1123,7 @@ static av_cold int j2kdec_init(AVCodecContext *avctx)
 
     avcodec_get_frame_defaults((AVFrame*)&s->picture);
     avctx->coded_frame = (AVFrame*)&s->picture;
+    ff_j2k_dsp_init(&s->dsp);
     return 0;
 }
 
@@ -1066,7 +1146,7 @@ AVCodec ff_jpeg2000_decoder = {
     NULL,
     decode_end,
     decode_frame,
-    .capabilities = CODEC_CAP_EXPERIMENTAL,
+    .capabilities = CODEC_CAP_EXPERIMENTAL | CODEC_CAP_SLICE_THREADS,
     .long_name = NULL_IF_CONFIG_SMALL("JPEG 2000"),
     .pix_fmts =
         (enum PixelFormat[]) {PIX_FMT_GRAY8, PIX_FMT_RGB24, -1}
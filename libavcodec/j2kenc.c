@@ -53,8 +53,17 @@ static const int dwt_norms[2][4][10] = { // [dwt_type][band][rlevel] (multiplied
      { 7186,  9218, 15860, 30430,  60190, 120100, 240000, 479700,  959300}}
 };
 
+typedef struct {
+    J2kCblk *cblk;
+    J2kBand *band;
+    int compno, bandpos, lev;
+    int xx0, xx1, yy0, yy1; ///< position in the component data
+} J2kCblkJob;
+
 typedef struct {
    J2kComponent *comp;
+   J2kCblkJob *cblk_job;
+   int ncblk_jobs;
 } J2kTile;
 
 typedef struct {
@@ -344,6 +353,75 @@ static uint8_t *put_sot(J2kEncoderContext *s, int tileno)
     return psotptr;
 }
 
+/**
+ * Collect the code-blocks of a tile with their position in the component
+ * data, so that they can be encoded independently.
+ */
+static int get_cblk_jobs(J2kEncoderContext *s, J2kTile *tile)
+{
+    int compno, reslevelno, bandno, ncblks = 0;
+    J2kCodingStyle *codsty = &s->codsty;
+    J2kCblkJob *job;
+
+    for (compno = 0; compno < s->ncomponents; compno++)
+        for (reslevelno = 0; reslevelno < codsty->nreslevels; reslevelno++){
+            J2kResLevel *reslevel = tile->comp[compno].reslevel + reslevelno;
+            for (bandno = 0; bandno < reslevel->nbands; bandno++)
+                ncblks += reslevel->band[bandno].cblknx * reslevel->band[bandno].cblkny;
+        }
+    job = tile->cblk_job = av_malloc(ncblks * sizeof(*tile->cblk_job));
+    if (!job && ncblks)
+        return AVERROR(ENOMEM);
+
+    for (compno = 0; compno < s->ncomponents; compno++){
+        J2kComponent *comp = tile->comp + compno;
+
+        for (reslevelno = 0; reslevelno < codsty->nreslevels; reslevelno++){
+            J2kResLevel *reslevel = comp->reslevel + reslevelno;
+
+            for (bandno = 0; bandno < reslevel->nbands ; bandno++){
+                J2kBand *band = reslevel->band + bandno;
+                int cblkx, cblky, cblkno=0, xx0, x0, xx1, y0, yy0, yy1, bandpos;
+                yy0 = bandno == 0 ? 0 : comp->reslevel[reslevelno-1].coord[1][1] - comp->reslevel[reslevelno-1].coord[1][0];
+                y0 = yy0;
+                yy1 = FFMIN(ff_j2k_ceildiv(band->coord[1][0] + 1, band->codeblock_height) * band->codeblock_height,
+                            band->coord[1][1]) - band->coord[1][0] + yy0;
+
+                if (band->coord[0][0] == band->coord[0][1] || band->coord[1][0] == band->coord[1][1])
+                    continue;
+
+                bandpos = bandno + (reslevelno > 0);
+
+                for (cblky = 0; cblky < band->cblkny; cblky++){
+                    if (reslevelno == 0 || bandno == 1)
+                        xx0 = 0;
+                    else
+                        xx0 = comp->reslevel[reslevelno-1].coord[0][1] - comp->reslevel[reslevelno-1].coord[0][0];
+                    x0 = xx0;
+                    xx1 = FFMIN(ff_j2k_ceildiv(band->coord[0][0] + 1, band->codeblock_width) * band->codeblock_width,
+                                band->coord[0][1]) - band->coord[0][0] + xx0;
+
+                    for (cblkx = 0; cblkx < band->cblknx; cblkx++, cblkno++, job++){
+                        job->cblk    = band->cblk + cblkno;
+                        job->band    = band;
+                        job->compno  = compno;
+                        job->bandpos = bandpos;
+                        job->lev     = codsty->nreslevels - reslevelno - 1;
+                        job->xx0 = xx0; job->xx1 = xx1;
+                        job->yy0 = yy0; job->yy1 = yy1;
+                        xx0 = xx1;
+                        xx1 = FFMIN(xx1 + band->codeblock_width, band->coord[0][1] - band->coord[0][0] + x0);
+                    }
+                    yy0 = yy1;
+                    yy1 = FFMIN(yy1 + band->codeblock_height, band->coord[1][1] - band->coord[1][0] + y0);
+                }
+            }
+        }
+    }
+    tile->ncblk_jobs = job - tile->cblk_job;
+    return 0;
+}
+
 /**
  * compute the sizes of tiles, resolution levels, bands, etc.
  * allocate memory for them
@@ -351,14 +429,14 @@ static uint8_t *put_sot(J2kEncoderContext *s, int tileno)
  */
 static int init_tiles(J2kEncoderContext *s)
 {
-    int tileno, tilex, tiley, compno;
+    int tileno, tilex, tiley, compno, ret;
     J2kCodingStyle *codsty = &s->codsty;
     J2kQuantStyle  *qntsty = &s->qntsty;
 
     s->numXtiles = ff_j2k_ceildiv(s->width, s->tile_width);
     s->numYtiles = ff_j2k_ceildiv(s->height, s->tile_height);
 
-    s->tile = av_malloc(s->numXtiles * s->numYtiles * sizeof(J2kTile));
+    s->tile = av_mallocz(s->numXtiles * s->numYtiles * sizeof(J2kTile));
     if (!s->tile)
         return AVERROR(ENOMEM);
     for (tileno = 0, tiley = 0; tiley < s->numYtiles; tiley++)
@@ -370,7 +448,7 @@ static int init_tiles(J2kEncoderContext *s)
                 return AVERROR(ENOMEM);
             for (compno = 0; compno < s->ncomponents; compno++){
                 J2kComponent *comp = tile->comp + compno;
-                int ret, i, j;
+                int i, j;
 
                 comp->coord[0][0] = tilex * s->tile_width;
                 comp->coord[0][1] = FFMIN((tilex+1)*s->tile_width, s->width);
@@ -384,6 +462,8 @@ static int init_tiles(J2kEncoderContext *s)
                 if (ret = ff_j2k_init_component(comp, codsty, qntsty, s->cbps[compno], compno?1<<s->chroma_shift[0]:1, compno?1<<s->chroma_shift[1]:1))
                     return ret;
             }
+            if ((ret = get_cblk_jobs(s, tile)) < 0)
+                return ret;
         }
     return 0;
 }
@@ -817,83 +897,80 @@ static void truncpasses(J2kEncoderContext *s, J2kTile *tile)
     }
 }
 
-static int encode_tile(J2kEncoderContext *s, J2kTile *tile, int tileno)
+static int dwt_encode_job(AVCodecContext *avctx, void *arg, int compno, int threadnr)
 {
-    int compno, reslevelno, bandno, ret;
-    J2kT1Context t1;
-    J2kCodingStyle *codsty = &s->codsty;
-    for (compno = 0; compno < s->ncomponents; compno++){
-        J2kComponent *comp = s->tile[tileno].comp + compno;
+    J2kTile *tile = arg;
 
-        av_log(s->avctx, AV_LOG_DEBUG,"dwt\n");
-        if (ret = ff_j2k_dwt_encode(&comp->dwt, comp->data))
-            return ret;
-        av_log(s->avctx, AV_LOG_DEBUG,"after dwt -> tier1\n");
-
-        for (reslevelno = 0; reslevelno < codsty->nreslevels; reslevelno++){
-            J2kResLevel *reslevel = comp->reslevel + reslevelno;
+    return ff_j2k_dwt_encode(&tile->comp[compno].dwt, tile->comp[compno].data);
+}
 
-            for (bandno = 0; bandno < reslevel->nbands ; bandno++){
-                J2kBand *band = reslevel->band + bandno;
-                int cblkx, cblky, cblkno=0, xx0, x0, xx1, y0, yy0, yy1, bandpos;
-                yy0 = bandno == 0 ? 0 : comp->reslevel[reslevelno-1].coord[1][1] - comp->reslevel[reslevelno-1].coord[1][0];
-                y0 = yy0;
-                yy1 = FFMIN(ff_j2k_ceildiv(band->coord[1][0] + 1, band->codeblock_height) * band->codeblock_height,
-                            band->coord[1][1]) - band->coord[1][0] + yy0;
+static int encode_cblk_job(AVCodecContext *avctx, void *arg, int jobnr, int threadnr)
+{
+    J2kEncoderContext *s = avctx->priv_data;
+    J2kTile *tile = arg;
+    J2kCblkJob *job = tile->cblk_job + jobnr;
+    J2kComponent *comp = tile->comp + job->compno;
+    int x, y, w = comp->coord[0][1] - comp->coord[0][0];
+    J2kT1Context t1;
 
-                if (band->coord[0][0] == band->coord[0][1] || band->coord[1][0] == band->coord[1][1])
-                    continue;
+    if (s->codsty.transform == FF_DWT53){
+        for (y = job->yy0; y < job->yy1; y++){
+            int *ptr = t1.data[y-job->yy0];
+            for (x = job->xx0; x < job->xx1; x++){
+                *ptr++ = comp->data[w * y + x] << NMSEDEC_FRACBITS;
+            }
+        }
+    } else{
+        for (y = job->yy0; y < job->yy1; y++){
+            int *ptr = t1.data[y-job->yy0];
+            for (x = job->xx0; x < job->xx1; x++){
+                int64_t v = comp->data[w * y + x];
+                *ptr = v * (int64_t)(8192 * 8192 / job->band->stepsize) >> 13 - NMSEDEC_FRACBITS;
+                ptr++;
+            }
+        }
+    }
+    encode_cblk(s, &t1, job->cblk, tile, job->xx1 - job->xx0, job->yy1 - job->yy0,
+                job->bandpos, job->lev);
+    return 0;
+}
 
-                bandpos = bandno + (reslevelno > 0);
+/**
+ * Transform the components of a tile and code its code-blocks.
+ * @param threaded run the transforms and the code-blocks on the slice threads
+ */
+static int encode_tile_tier1(J2kEncoderContext *s, J2kTile *tile, int threaded)
+{
+    int compno, i, ret[4] = { 0 };
 
-                for (cblky = 0; cblky < band->cblkny; cblky++){
-                    if (reslevelno == 0 || bandno == 1)
-                        xx0 = 0;
-                    else
-                        xx0 = comp->reslevel[reslevelno-1].coord[0][1] - comp->reslevel[reslevelno-1].coord[0][0];
-                    x0 = xx0;
-                    xx1 = FFMIN(ff_j2k_ceildiv(band->coord[0][0] + 1, band->codeblock_width) * band->codeblock_width,
-                                band->coord[0][1]) - band->coord[0][0] + xx0;
+    if (threaded){
+        s->avctx->execute2(s->avctx, dwt_encode_job, tile, ret, s->ncomponents);
+    } else{
+        for (compno = 0; compno < s->ncomponents; compno++)
+            ret[compno] = dwt_encode_job(s->avctx, tile, compno, 0);
+    }
+    for (compno = 0; compno < s->ncomponents; compno++)
+        if (ret[compno])
+            return ret[compno];
 
-                    for (cblkx = 0; cblkx < band->cblknx; cblkx++, cblkno++){
-                        int y, x;
-                        if (codsty->transform == FF_DWT53){
-                            for (y = yy0; y < yy1; y++){
-                                int *ptr = t1.data[y-yy0];
-                                for (x = xx0; x < xx1; x++){
-                                    *ptr++ = comp->data[(comp->coord[0][1] - comp->coord[0][0]) * y + x] << NMSEDEC_FRACBITS;
-                                }
-                            }
-                        } else{
-                            for (y = yy0; y < yy1; y++){
-                                int *ptr = t1.data[y-yy0];
-                                for (x = xx0; x < xx1; x++){
-                                    *ptr = (comp->data[(comp->coord[0][1] - comp->coord[0][0]) * y + x]);
-                                    *ptr++ = (int64_t)*ptr * (int64_t)(8192 * 8192 / band->stepsize) >> 13 - NMSEDEC_FRACBITS;
-                                }
-                            }
-                        }
-                        encode_cblk(s, &t1, band->cblk + cblkno, tile, xx1 - xx0, yy1 - yy0,
-                                    bandpos, codsty->nreslevels - reslevelno - 1);
-                        xx0 = xx1;
-                        xx1 = FFMIN(xx1 + band->codeblock_width, band->coord[0][1] - band->coord[0][0] + x0);
-                    }
-                    yy0 = yy1;
-                    yy1 = FFMIN(yy1 + band->codeblock_height, band->coord[1][1] - band->coord[1][0] + y0);
-                }
-            }
-        }
-        av_log(s->avctx, AV_LOG_DEBUG, "after tier1\n");
+    if (threaded){
+        s->avctx->execute2(s->avctx, encode_cblk_job, tile, NULL, tile->ncblk_jobs);
+    } else{
+        for (i = 0; i < tile->ncblk_jobs; i++)
+            encode_cblk_job(s->avctx, tile, i, 0);
     }
 
-    av_log(s->avctx, AV_LOG_DEBUG, "rate control\n");
     truncpasses(s, tile);
-    if (ret = encode_packets(s, tile, tileno))
-        return ret;
-    av_log(s->avctx, AV_LOG_DEBUG, "after rate control\n");
     return 0;
 }
 
+static int encode_tile_job(AVCodecContext *avctx, void *arg, int tileno, int threadnr)
+{
+    J2kEncoderContext *s = avctx->priv_data;
+
+    return encode_tile_tier1(s, s->tile + tileno, 0);
+}
+
 static void cleanup(J2kEncoderContext *s)
 {
     int tileno, compno;
@@ -905,6 +982,7 @@ static void cleanup(J2kEncoderContext *s)
             ff_j2k_cleanup(comp, codsty);
         }
         av_freep(&s->tile[tileno].comp);
+        av_freep(&s->tile[tileno].cblk_job);
     }
     av_freep(&s->tile);
 }
@@ -923,7 +1001,7 @@ static int encode_frame(AVCodecContext *avctx,
                         uint8_t *buf, int buf_size,
                         void *data)
 {
-    int tileno, ret;
+    int tileno, ntiles, ret;
     J2kEncoderContext *s = avctx->priv_data;
 
     // init:
@@ -948,14 +1026,32 @@ static int encode_frame(AVCodecContext *avctx,
     if (ret = put_qcd(s, 0))
         return ret;
 
-    for (tileno = 0; tileno < s->numXtiles * s->numYtiles; tileno++){
+    ntiles = s->numXtiles * s->numYtiles;
+    if (ntiles >= avctx->thread_count){
+        // enough tiles to keep all threads busy
+        int *tile_ret = av_malloc(ntiles * sizeof(*tile_ret));
+        if (!tile_ret)
+            return AVERROR(ENOMEM);
+        avctx->execute2(avctx, encode_tile_job, NULL, tile_ret, ntiles);
+        for (tileno = 0, ret = 0; tileno < ntiles && !ret; tileno++)
+            ret = tile_ret[tileno];
+        av_free(tile_ret);
+        if (ret)
+            return ret;
+    } else{
+        for (tileno = 0; tileno < ntiles; tileno++)
+            if (ret = encode_tile_tier1(s, s->tile + tileno, 1))
+                return ret;
+    }
+
+    for (tileno = 0; tileno < ntiles; tileno++){
         uint8_t *psotptr;
         if (!(psotptr = put_sot(s, tileno)))
             return -1;
         if (s->buf_end - s->buf < 2)
             return -1;
         bytestream_put_be16(&s->buf, J2K_SOD);
-        if (ret = encode_tile(s, s->tile + tileno, tileno))
+        if (ret = encode_packets(s, s->tile + tileno, tileno))
             return ret;
         bytestream_put_be32(&psotptr, s->buf - psotptr + 6);
     }
@@ -1042,7 +1138,7 @@ AVCodec ff_jpeg2000_encoder = {
     j2kenc_init,
     encode_frame,
     j2kenc_destroy,
-    .capabilities= CODEC_CAP_EXPERIMENTAL,
+    .capabilities= CODEC_CAP_EXPERIMENTAL | CODEC_CAP_SLICE_THREADS,
     .long_name = NULL_IF_CONFIG_SMALL("JPEG 2000"),
     .pix_fmts =
         (enum PixelFormat[]) {PIX_FMT_RGB24, PIX_FMT_YUV444P, PIX_FMT_GRAY8,
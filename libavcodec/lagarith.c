@@ -30,6 +30,7 @@
 #include "mathops.h"
 #include "dsputil.h"
 #include "lagarithrac.h"
+#include "thread.h"
 
 enum LagarithFrameType {
     FRAME_RAW           = 1,    /**< uncompressed */
@@ -45,12 +46,20 @@ enum LagarithFrameType {
     FRAME_REDUCED_RES   = 11,   /**< reduced resolution YV12 frame */
 };
 
+typedef struct LagarithPlane {
+    uint8_t *dst;
+    int width, height, stride;
+    const uint8_t *src;
+    int src_size;
+    int zeros;                  /**< number of consecutive zero bytes encountered */
+    int zeros_rem;              /**< number of zero bytes remaining to output */
+} LagarithPlane;
+
 typedef struct LagarithContext {
     AVCodecContext *avctx;
     AVFrame picture;
     DSPContext dsp;
-    int zeros;                  /**< number of consecutive zero bytes encountered */
-    int zeros_rem;              /**< number of zero bytes remaining to output */
+    LagarithPlane planes[3];    /**< planes of the current frame, decoded in parallel */
 } LagarithContext;
 
 /**
@@ -265,7 +274,7 @@ static void lag_pred_line(LagarithContext *l, uint8_t *buf,
                               width, &L, &TL);
 }
 
-static int lag_decode_line(LagarithContext *l, lag_rac *rac,
+static int lag_decode_line(LagarithPlane *p, lag_rac *rac,
                            uint8_t *dst, int width, int stride,
                            int esc_count)
 {
@@ -277,11 +286,11 @@ static int lag_decode_line(LagarithContext *l, lag_rac *rac,
 
     /* Output any zeros remaining from the previous run */
 handle_zeros:
-    if (l->zeros_rem) {
-        int count = FFMIN(l->zeros_rem, width - i);
+    if (p->zeros_rem) {
+        int count = FFMIN(p->zeros_rem, width - i);
         memset(dst + i, 0, count);
         i += count;
-        l->zeros_rem -= count;
+        p->zeros_rem -= count;
     }
 
     while (i < width) {
@@ -289,25 +298,25 @@ handle_zeros:
         ret++;
 
         if (dst[i])
-            l->zeros = 0;
+            p->zeros = 0;
         else
-            l->zeros++;
+            p->zeros++;
 
         i++;
-        if (l->zeros == esc_count) {
+        if (p->zeros == esc_count) {
             int index = lag_get_rac(rac);
             ret++;
 
-            l->zeros = 0;
+            p->zeros = 0;
 
-            l->zeros_rem = lag_calc_zero_run(index);
+            p->zeros_rem = lag_calc_zero_run(index);
             goto handle_zeros;
         }
     }
     return ret;
 }
 
-static int lag_decode_zero_run_line(LagarithContext *l, uint8_t *dst,
+static int lag_decode_zero_run_line(LagarithPlane *p, uint8_t *dst,
                                     const uint8_t *src, int width,
                                     int esc_count)
 {
@@ -320,10 +329,10 @@ static int lag_decode_zero_run_line(LagarithContext *l, uint8_t *dst,
     uint8_t *end = dst + (width - 2);
 
 output_zeros:
-    if (l->zeros_rem) {
-        count = FFMIN(l->zeros_rem, width - i);
+    if (p->zeros_rem) {
+        count = FFMIN(p->zeros_rem, width - i);
         memset(dst, 0, count);
-        l->zeros_rem -= count;
+        p->zeros_rem -= count;
         dst += count;
     }
 
@@ -339,7 +348,7 @@ output_zeros:
             i += esc_count;
             memcpy(dst, src, i);
             dst += i;
-            l->zeros_rem = lag_calc_zero_run(src[i]);
+            p->zeros_rem = lag_calc_zero_run(src[i]);
 
             src += i + 1;
             goto output_zeros;
@@ -353,10 +362,14 @@ output_zeros:
 
 
 
-static int lag_decode_arith_plane(LagarithContext *l, uint8_t *dst,
-                                  int width, int height, int stride,
-                                  const uint8_t *src, int src_size)
+static int lag_decode_arith_plane(AVCodecContext *avctx, void *arg,
+                                  int jobnr, int threadnr)
 {
+    LagarithContext *l = avctx->priv_data;
+    LagarithPlane *p = &l->planes[jobnr];
+    uint8_t *dst = p->dst;
+    const uint8_t *src = p->src;
+    const int width = p->width, height = p->height, stride = p->stride;
     int i = 0;
     int read = 0;
     uint32_t length;
@@ -365,8 +378,9 @@ static int lag_decode_arith_plane(LagarithContext *l, uint8_t *dst,
     GetBitContext gb;
     lag_rac rac;
 
-    rac.avctx = l->avctx;
-    l->zeros = 0;
+    rac.avctx = avctx;
+    p->zeros     = 0;
+    p->zeros_rem = 0;
 
     if (esc_count < 4) {
         length = width * height;
@@ -375,7 +389,7 @@ static int lag_decode_arith_plane(LagarithContext *l, uint8_t *dst,
             offset += 4;
         }
 
-        init_get_bits(&gb, src + offset, src_size * 8);
+        init_get_bits(&gb, src + offset, p->src_size * 8);
 
         if (lag_read_prob_header(&rac, &gb) < 0)
             return -1;
@@ -383,11 +397,11 @@ static int lag_decode_arith_plane(LagarithContext *l, uint8_t *dst,
         lag_rac_init(&rac, &gb, length - stride);
 
         for (i = 0; i < height; i++)
-            read += lag_decode_line(l, &rac, dst + (i * stride), width,
+            read += lag_decode_line(p, &rac, dst + (i * stride), width,
                                     stride, esc_count);
 
         if (read > length)
-            av_log(l->avctx, AV_LOG_WARNING,
+            av_log(avctx, AV_LOG_WARNING,
                    "Output more bytes than length (%d of %d)\n", read,
                    length);
     } else if (esc_count < 8) {
@@ -395,7 +409,7 @@ static int lag_decode_arith_plane(LagarithContext *l, uint8_t *dst,
         if (esc_count > 0) {
             /* Zero run coding only, no range coding. */
             for (i = 0; i < height; i++)
-                src += lag_decode_zero_run_line(l, dst + (i * stride), src,
+                src += lag_decode_zero_run_line(p, dst + (i * stride), src,
                                                 width, esc_count);
         } else {
             /* Plane is stored uncompressed */
@@ -413,7 +427,7 @@ static int lag_decode_arith_plane(LagarithContext *l, uint8_t *dst,
            and applying prediction gives the same result. */
         return 0;
     } else {
-        av_log(l->avctx, AV_LOG_ERROR,
+        av_log(avctx, AV_LOG_ERROR,
                "Invalid zero run escape code! (%#x)\n", esc_count);
         return -1;
     }
@@ -426,6 +440,17 @@ static int lag_decode_arith_plane(LagarithContext *l, uint8_t *dst,
     return 0;
 }
 
+static void set_plane(LagarithPlane *p, uint8_t *dst, int width, int height,
+                      int stride, const uint8_t *src, int src_size)
+{
+    p->dst      = dst;
+    p->width    = width;
+    p->height   = height;
+    p->stride   = stride;
+    p->src      = src;
+    p->src_size = src_size;
+}
+
 /**
  * Decode a frame.
  * @param avctx codec context
@@ -447,7 +472,7 @@ static int lag_decode_frame(AVCodecContext *avctx,
     AVFrame *picture = data;
 
     if (p->data[0])
-        avctx->release_buffer(avctx, p);
+        ff_thread_release_buffer(avctx, p);
 
     p->reference = 0;
     p->key_frame = 1;
@@ -461,20 +486,21 @@ static int lag_decode_frame(AVCodecContext *avctx,
     case FRAME_ARITH_YV12:
         avctx->pix_fmt = PIX_FMT_YUV420P;
 
-        if (avctx->get_buffer(avctx, p) < 0) {
+        if (ff_thread_get_buffer(avctx, p) < 0) {
             av_log(avctx, AV_LOG_ERROR, "get_buffer() failed\n");
             return -1;
         }
-
-        lag_decode_arith_plane(l, p->data[0], avctx->width, avctx->height,
-                               p->linesize[0], buf + offset_ry,
-                               buf_size);
-        lag_decode_arith_plane(l, p->data[2], avctx->width / 2,
-                               avctx->height / 2, p->linesize[2],
-                               buf + offset_gu, buf_size);
-        lag_decode_arith_plane(l, p->data[1], avctx->width / 2,
-                               avctx->height / 2, p->linesize[1],
-                               buf + offset_bv, buf_size);
+        /* frames do not depend on each other */
+        ff_thread_finish_setup(avctx);
+
+        set_plane(&l->planes[0], p->data[0], avctx->width, avctx->height,
+                  p->linesize[0], buf + offset_ry, buf_size);
+        set_plane(&l->planes[1], p->data[2], avctx->width / 2,
+                  avctx->height / 2, p->linesize[2], buf + offset_gu, buf_size);
+        set_plane(&l->planes[2], p->data[1], avctx->width / 2,
+                  avctx->height / 2, p->linesize[1], buf + offset_bv, buf_size);
+        /* each plane has its own range coder */
+        avctx->execute2(avctx, lag_decode_arith_plane, NULL, NULL, 3);
         break;
     default:
         av_log(avctx, AV_LOG_ERROR,
@@ -503,8 +529,17 @@ static av_cold int lag_decode_end(AVCodecContext *avctx)
     LagarithContext *l = avctx->priv_data;
 
     if (l->picture.data[0])
-        avctx->release_buffer(avctx, &l->picture);
+        ff_thread_release_buffer(avctx, &l->picture);
+
+    return 0;
+}
 
+static av_cold int lag_decode_init_thread_copy(AVCodecContext *avctx)
+{
+    LagarithContext *l = avctx->priv_data;
+
+    l->avctx = avctx;
+    memset(&l->picture, 0, sizeof(l->picture));
     return 0;
 }
 
@@ -516,6 +551,8 @@ AVCodec ff_lagarith_decoder = {
     .init           = lag_decode_init,
     .close          = lag_decode_end,
     .decode         = lag_decode_frame,
-    .capabilities   = CODEC_CAP_DR1,
+    .capabilities   = CODEC_CAP_DR1 | CODEC_CAP_SLICE_THREADS |
+                      CODEC_CAP_FRAME_THREADS,
+    .init_thread_copy = ONLY_IF_THREADS_ENABLED(lag_decode_init_thread_copy),
     .long_name = NULL_IF_CONFIG_SMALL("Lagarith lossless"),
 };
@@ -25,6 +25,7 @@
 #include <stdint.h>
 #include <zlib.h>
 
+#include "libavutil/ringbuffer.h"
 #include "avcodec.h"
 
 #define PNG_COLOR_MASK_PALETTE    1
@@ -44,6 +45,7 @@
 #define PNG_FILTER_VALUE_AVG   3
 #define PNG_FILTER_VALUE_PAETH 4
 #define PNG_FILTER_VALUE_MIXED 5
+#define PNG_FILTER_VALUE_FAST  6
 
 #define PNG_IHDR      0x0001
 #define PNG_IDAT      0x0002
@@ -103,10 +105,25 @@ typedef struct PNGDecContext {
     int y;
     z_stream zstream;
 
+    /* pipelined decoding: one job inflates the rows into a ring buffer,
+       another one unfilters them */
+    AVRingBuffer *rows;
+    uint8_t *inflate_row;
+    int inflate_y;
+
     void (*add_bytes_l2)(uint8_t *dst, uint8_t *src1, uint8_t *src2, int w);
     void (*add_paeth_prediction)(uint8_t *dst, uint8_t *src, uint8_t *top, int w, int bpp);
 } PNGDecContext;
 
 void ff_png_init_mmx(PNGDecContext *s);
 
+typedef struct PNGEncDSPContext {
+    /* sum of the absolute values of the filtered bytes taken as signed */
+    int  (*filter_cost)(const uint8_t *buf, int size);
+    /* w must be a multiple of 8 */
+    void (*sub_paeth_prediction)(uint8_t *dst, uint8_t *src, uint8_t *top, int w, int bpp);
+} PNGEncDSPContext;
+
+void ff_png_enc_init_mmx(PNGEncDSPContext *c);
+
 #endif /* AVCODEC_PNG_H */
@@ -22,6 +22,7 @@
 //#define DEBUG
 
 #include "libavutil/imgutils.h"
+#include "libavutil/threadpool.h"
 #include "avcodec.h"
 #include "bytestream.h"
 #include "png.h"
@@ -32,6 +33,9 @@
 
 #include <zlib.h>
 
+/* number of rows queued between the inflating and the unfiltering thread */
+#define PNG_RING_ROWS 64
+
 /* Mask to determine which y pixels can be written in a pass */
 static const uint8_t png_pass_dsp_ymask[NB_PASSES] = {
     0xff, 0xff, 0x0f, 0xcc, 0x33, 0xff, 0x55,
@@ -372,7 +376,7 @@ static int png_decode_idat(PNGDecContext *s, int length)
 {
     int ret;
     s->zstream.avail_in = length;
-    s->zstream.next_in = s->bytestream;
+    s->zstream.next_in = (uint8_t *)s->bytestream;
     s->bytestream += length;
 
     if(s->bytestream > s->bytestream_end)
@@ -395,6 +399,119 @@ static int png_decode_idat(PNGDecContext *s, int length)
     return 0;
 }
 
+/* Inflate the IDAT chunk at the current position and all IDAT chunks
+   directly following it. The complete rows are queued for
+   png_unfilter_rows() running on another thread if threaded is set, and
+   unfiltered directly otherwise. The bytestream is left at the next
+   chunk. */
+static int png_inflate_rows(PNGDecContext *s, int length, int threaded)
+{
+    int ret;
+
+    for(;;) {
+        s->zstream.avail_in = length;
+        s->zstream.next_in = (uint8_t *)s->bytestream;
+        s->bytestream += length;
+
+        if(s->bytestream > s->bytestream_end)
+            return -1;
+
+        while (s->zstream.avail_in > 0) {
+            ret = inflate(&s->zstream, Z_PARTIAL_FLUSH);
+            if (ret != Z_OK && ret != Z_STREAM_END) {
+                return -1;
+            }
+            if (s->zstream.avail_out == 0) {
+                if (s->inflate_y < s->height) {
+                    if (threaded) {
+                        /* the unfiltering side only stops once it got all
+                           rows, a short wait is a wake left over from an
+                           earlier IDAT run */
+                        while (av_ringbuffer_wait_write(s->rows, s->crow_size, -1) < s->crow_size)
+                            ;
+                        av_ringbuffer_write(s->rows, s->inflate_row, s->crow_size);
+                    } else {
+                        memcpy(s->crow_buf, s->inflate_row, s->crow_size);
+                        png_handle_row(s);
+                    }
+                    s->inflate_y++;
+                }
+                s->zstream.avail_out = s->crow_size;
+                s->zstream.next_out = s->inflate_row;
+            }
+        }
+        s->bytestream += 4; /* crc */
+
+        if (s->bytestream_end - s->bytestream < 8 ||
+            AV_RB32(s->bytestream + 4) != MKBETAG('I', 'D', 'A', 'T'))
+            return 0;
+        length = bytestream_get_be32(&s->bytestream);
+        if (length > 0x7fffffff)
+            return -1;
+        s->bytestream += 4; /* tag */
+    }
+}
+
+static int png_unfilter_rows(PNGDecContext *s)
+{
+    while (!(s->state & PNG_ALLIMAGE)) {
+        /* the wait only comes back short once inflating has stopped */
+        if (av_ringbuffer_wait_read(s->rows, s->crow_size, -1) < s->crow_size)
+            break;
+        av_ringbuffer_read(s->rows, s->crow_buf, s->crow_size);
+        png_handle_row(s);
+    }
+    return 0;
+}
+
+static int png_decode_idat_job(AVCodecContext *avctx, void *arg, int jobnr, int threadnr)
+{
+    PNGDecContext *s = avctx->priv_data;
+    int ret;
+
+    if (jobnr)
+        return png_unfilter_rows(s);
+
+    ret = png_inflate_rows(s, *(uint32_t *)arg, 1);
+    av_ringbuffer_wake(s->rows);
+    return ret;
+}
+
+static void *png_unfilter_task(void *arg)
+{
+    png_unfilter_rows(arg);
+    return NULL;
+}
+
+/* The ring buffer only holds a few rows, so the unfiltering must run on a
+   second thread while the rows are inflated, never after it on the same
+   thread. The codec's own slice threads run the two jobs on two different
+   threads, from a shared pool a worker has to be reserved for it. */
+static int png_decode_idat_threaded(AVCodecContext *avctx, int length)
+{
+    PNGDecContext *s = avctx->priv_data;
+    AVThreadPoolTask *task;
+    int ret;
+
+    if (!avctx->thread_pool) {
+        int job_ret[2];
+
+        avctx->execute2(avctx, png_decode_idat_job, &length, job_ret, 2);
+        return job_ret[0];
+    }
+
+    if (av_threadpool_reserve(avctx->thread_pool, 1) < 1)
+        return png_inflate_rows(s, length, 0);
+    if (av_threadpool_start(avctx->thread_pool, &task, png_unfilter_task, s) < 0) {
+        av_threadpool_release(avctx->thread_pool, 1);
+        return png_inflate_rows(s, length, 0);
+    }
+    ret = png_inflate_rows(s, length, 1);
+    av_ringbuffer_wake(s->rows);
+    av_threadpool_join(avctx->thread_pool, &task);
+    return ret;
+}
+
 static int decode_frame(AVCodecContext *avctx,
                         void *data, int *data_size,
                         AVPacket *avpkt)
@@ -551,8 +668,27 @@ static int decode_frame(AVCodecContext *avctx,
                 s->crow_buf = crow_buf_base + 15;
                 s->zstream.avail_out = s->crow_size;
                 s->zstream.next_out = s->crow_buf;
+
+                /* inflating and unfiltering are done in parallel for
+                   non-interlaced images with slice threading */
+                if (!s->interlace_type &&
+                    avctx->active_thread_type & FF_THREAD_SLICE &&
+                    avctx->thread_count > 1 &&
+                    s->crow_size <= INT_MAX / 2 / PNG_RING_ROWS) {
+                    s->rows = av_ringbuffer_alloc(s->crow_size * FFMIN(s->height, PNG_RING_ROWS));
+                    s->inflate_row = av_malloc(s->crow_size);
+                    if (!s->rows || !s->inflate_row)
+                        goto fail;
+                    s->inflate_y = 0;
+                    s->zstream.next_out = s->inflate_row;
+                }
             }
             s->state |= PNG_IDAT;
+            if (s->rows) {
+                if (png_decode_idat_threaded(avctx, length) < 0)
+                    goto fail;
+                break;
+            }
             if (png_decode_idat(s, length) < 0)
                 goto fail;
             s->bytestream += 4; /* crc */
@@ -660,6 +796,8 @@ static int decode_frame(AVCodecContext *avctx,
     s->crow_buf = NULL;
     av_freep(&s->last_row);
     av_freep(&s->tmp_row);
+    av_ringbuffer_free(&s->rows);
+    av_freep(&s->inflate_row);
     return ret;
  fail:
     ret = -1;
@@ -707,6 +845,6 @@ AVCodec ff_png_decoder = {
     .init           = png_dec_init,
     .close          = png_dec_end,
     .decode         = decode_frame,
-    .capabilities   = CODEC_CAP_DR1 /*| CODEC_CAP_DRAW_HORIZ_BAND*/,
+    .capabilities   = CODEC_CAP_DR1 | CODEC_CAP_SLICE_THREADS /*| CODEC_CAP_DRAW_HORIZ_BAND*/,
     .long_name = NULL_IF_CONFIG_SMALL("PNG image"),
 };
@@ -33,8 +33,22 @@
 
 #define IOBUF_SIZE 4096
 
+/* amount of filtered data compressed by one slice job */
+#define SLICE_SIZE (128 * 1024)
+
+/* the fast filter heuristic tries all filters every FAST_SEARCH_INTERVAL rows */
+#define FAST_SEARCH_INTERVAL 16
+
+typedef struct PNGEncSlice {
+    int y_start, y_end;
+    uint8_t *out;
+    int out_size;
+    uLong adler;
+} PNGEncSlice;
+
 typedef struct PNGEncContext {
     DSPContext dsp;
+    PNGEncDSPContext pngdsp;
 
     uint8_t *bytestream;
     uint8_t *bytestream_start;
@@ -45,6 +59,15 @@ typedef struct PNGEncContext {
 
     z_stream zstream;
     uint8_t buf[IOBUF_SIZE];
+
+    /* slice threaded encoding */
+    int compression_level;
+    int color_type;
+    int bits_per_pixel;
+    int row_size;
+    uint8_t *filtered;                  ///< filtered rows of the whole image
+    PNGEncSlice *slices;
+    int nb_slices;
 } PNGEncContext;
 
 static void png_get_interlaced_row(uint8_t *dst, int row_size,
@@ -112,10 +135,19 @@ static void sub_png_paeth_prediction(uint8_t *dst, uint8_t *src, uint8_t *top, i
     }
 }
 
-static void png_filter_row(DSPContext *dsp, uint8_t *dst, int filter_type,
+static int filter_cost_c(const uint8_t *buf, int size)
+{
+    int i, cost = 0;
+    for(i = 0; i < size; i++)
+        cost += abs((int8_t)buf[i]);
+    return cost;
+}
+
+static void png_filter_row(PNGEncContext *s, uint8_t *dst, int filter_type,
                            uint8_t *src, uint8_t *top, int size, int bpp)
 {
-    int i;
+    DSPContext *dsp = &s->dsp;
+    int i, w;
 
     switch(filter_type) {
     case PNG_FILTER_VALUE_NONE:
@@ -137,36 +169,53 @@ static void png_filter_row(DSPContext *dsp, uint8_t *dst, int filter_type,
     case PNG_FILTER_VALUE_PAETH:
         for(i = 0; i < bpp; i++)
             dst[i] = src[i] - top[i];
+        w = (size - i) & ~7;
+        s->pngdsp.sub_paeth_prediction(dst+i, src+i, top+i, w, bpp);
+        i += w;
         sub_png_paeth_prediction(dst+i, src+i, top+i, size-i, bpp);
         break;
     }
 }
 
+/**
+ * Filter one row.
+ * @param y         index of the row in the image or pass
+ * @param last_pred filter chosen for the previous row by the fast
+ *                  heuristic, -1 if none
+ */
 static uint8_t *png_choose_filter(PNGEncContext *s, uint8_t *dst,
-                                  uint8_t *src, uint8_t *top, int size, int bpp)
+                                  uint8_t *src, uint8_t *top, int size, int bpp,
+                                  int y, int *last_pred)
 {
     int pred = s->filter_type;
     assert(bpp || !pred);
     if(!top && pred)
         pred = PNG_FILTER_VALUE_SUB;
-    if(pred == PNG_FILTER_VALUE_MIXED) {
-        int i;
-        int cost, bcost = INT_MAX;
+    if(pred == PNG_FILTER_VALUE_MIXED || pred == PNG_FILTER_VALUE_FAST) {
+        int cost, bcost = INT_MAX, best = 0;
+        int candidates = 0x1f;
         uint8_t *buf1 = dst, *buf2 = dst + size + 16;
+        /* the best filter rarely changes from one row to the next, so only
+           it and the cheap SUB and UP filters are tried in between full
+           searches */
+        if (pred == PNG_FILTER_VALUE_FAST && y % FAST_SEARCH_INTERVAL && *last_pred >= 0)
+            candidates = 1 << PNG_FILTER_VALUE_SUB | 1 << PNG_FILTER_VALUE_UP | 1 << *last_pred;
         for(pred=0; pred<5; pred++) {
-            png_filter_row(&s->dsp, buf1+1, pred, src, top, size, bpp);
+            if (!(candidates & 1 << pred))
+                continue;
+            png_filter_row(s, buf1+1, pred, src, top, size, bpp);
             buf1[0] = pred;
-            cost = 0;
-            for(i=0; i<=size; i++)
-                cost += abs((int8_t)buf1[i]);
+            cost = s->pngdsp.filter_cost(buf1, size + 1);
             if(cost < bcost) {
                 bcost = cost;
+                best = pred;
                 FFSWAP(uint8_t*, buf1, buf2);
             }
         }
+        *last_pred = best;
         return buf2;
     } else {
-        png_filter_row(&s->dsp, dst+1, pred, src, top, size, bpp);
+        png_filter_row(s, dst+1, pred, src, top, size, bpp);
         dst[0] = pred;
         return dst;
     }
@@ -229,6 +278,177 @@ static int png_write_row(PNGEncContext *s, const uint8_t *data, int size)
     return 0;
 }
 
+static int filter_slice_job(AVCodecContext *avctx, void *arg, int jobnr, int threadnr)
+{
+    PNGEncContext *s = avctx->priv_data;
+    PNGEncSlice *sl = &s->slices[jobnr];
+    AVFrame * const p = &s->picture;
+    int bpp = s->bits_per_pixel >> 3;
+    int last_pred = -1, y, ret = 0;
+    uint8_t *ptr, *top = NULL;
+    uint8_t *crow_base, *crow_buf, *crow;
+    uint8_t *rgba_buf = NULL;
+    uint8_t *top_buf = NULL;
+
+    crow_base = av_malloc((s->row_size + 32) << (s->filter_type >= PNG_FILTER_VALUE_MIXED));
+    if (!crow_base)
+        return AVERROR(ENOMEM);
+    crow_buf = crow_base + 15;
+    if (s->color_type == PNG_COLOR_TYPE_RGB_ALPHA) {
+        rgba_buf = av_malloc(s->row_size + 1);
+        top_buf = av_malloc(s->row_size + 1);
+        if (!rgba_buf || !top_buf) {
+            ret = AVERROR(ENOMEM);
+            goto end;
+        }
+    }
+
+    /* the row above the slice is the prediction for its first row */
+    if (sl->y_start > 0) {
+        top = p->data[0] + (sl->y_start - 1) * p->linesize[0];
+        if (s->color_type == PNG_COLOR_TYPE_RGB_ALPHA) {
+            convert_from_rgb32(rgba_buf, top, avctx->width);
+            top = rgba_buf;
+        }
+    }
+    for(y = sl->y_start; y < sl->y_end; y++) {
+        ptr = p->data[0] + y * p->linesize[0];
+        if (s->color_type == PNG_COLOR_TYPE_RGB_ALPHA) {
+            FFSWAP(uint8_t*, rgba_buf, top_buf);
+            convert_from_rgb32(rgba_buf, ptr, avctx->width);
+            ptr = rgba_buf;
+        }
+        crow = png_choose_filter(s, crow_buf, ptr, top, s->row_size, bpp, y, &last_pred);
+        memcpy(s->filtered + y * (s->row_size + 1), crow, s->row_size + 1);
+        top = ptr;
+    }
+ end:
+    av_free(crow_base);
+    av_free(rgba_buf);
+    av_free(top_buf);
+    return ret;
+}
+
+/* Compress the filtered rows of one slice into deflate blocks ending on a
+   byte boundary, so that the outputs of all slices form one stream. */
+static int deflate_slice_job(AVCodecContext *avctx, void *arg, int jobnr, int threadnr)
+{
+    PNGEncContext *s = avctx->priv_data;
+    PNGEncSlice *sl = &s->slices[jobnr];
+    int stride = s->row_size + 1;
+    int size = (sl->y_end - sl->y_start) * stride;
+    int last = jobnr == s->nb_slices - 1;
+    uint8_t *data = s->filtered + sl->y_start * stride;
+    z_stream zstream;
+    int max_size, ret;
+
+    zstream.zalloc = ff_png_zalloc;
+    zstream.zfree = ff_png_zfree;
+    zstream.opaque = NULL;
+    if (deflateInit2(&zstream, s->compression_level,
+                     Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+        return -1;
+    /* let matches reach back into the previous slices */
+    if (sl->y_start > 0) {
+        int dict_size = FFMIN(sl->y_start * stride, 32768);
+        deflateSetDictionary(&zstream, data - dict_size, dict_size);
+    }
+
+    /* room for the sync flush marker, and for the zlib header and
+       trailer written around the slice data */
+    max_size = deflateBound(&zstream, size) + 64;
+    sl->out = av_malloc(max_size + 6);
+    if (!sl->out) {
+        deflateEnd(&zstream);
+        return AVERROR(ENOMEM);
+    }
+    zstream.next_in = data;
+    zstream.avail_in = size;
+    zstream.next_out = sl->out + 2;
+    zstream.avail_out = max_size;
+    ret = deflate(&zstream, last ? Z_FINISH : Z_SYNC_FLUSH);
+    sl->out_size = max_size - zstream.avail_out;
+    deflateEnd(&zstream);
+    if (ret != (last ? Z_STREAM_END : Z_OK) ||
+        zstream.avail_in || !zstream.avail_out)
+        return -1;
+
+    sl->adler = adler32(adler32(0, Z_NULL, 0), data, size);
+    return 0;
+}
+
+/* Write the image data with the slices filtered and compressed in
+   parallel. The output only depends on the image and the options, not on
+   the number of threads. */
+static int png_write_slices(AVCodecContext *avctx)
+{
+    PNGEncContext *s = avctx->priv_data;
+    int stride = s->row_size + 1;
+    int slice_rows = FFMAX(1, SLICE_SIZE / stride);
+    int i, len, level, header, ret = 0;
+    int *job_ret;
+    uLong adler = adler32(0, Z_NULL, 0);
+    uint8_t *start;
+
+    s->nb_slices = (avctx->height + slice_rows - 1) / slice_rows;
+    s->filtered = av_malloc(stride * avctx->height);
+    s->slices = av_mallocz(s->nb_slices * sizeof(*s->slices));
+    job_ret = av_malloc(s->nb_slices * sizeof(*job_ret));
+    if (!s->filtered || !s->slices || !job_ret) {
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
+    for(i = 0; i < s->nb_slices; i++) {
+        s->slices[i].y_start = i * slice_rows;
+        s->slices[i].y_end = FFMIN(s->slices[i].y_start + slice_rows, avctx->height);
+    }
+
+    avctx->execute2(avctx, filter_slice_job, NULL, job_ret, s->nb_slices);
+    for(i = 0; i < s->nb_slices; i++)
+        if ((ret = job_ret[i]) < 0)
+            goto end;
+    avctx->execute2(avctx, deflate_slice_job, NULL, job_ret, s->nb_slices);
+    for(i = 0; i < s->nb_slices; i++)
+        if ((ret = job_ret[i]) < 0)
+            goto end;
+
+    /* zlib header, see RFC 1950 */
+    level = s->compression_level == Z_DEFAULT_COMPRESSION ? 6 : s->compression_level;
+    header = 0x7800 | (level < 2 ? 0 : level < 6 ? 1 : level == 6 ? 2 : 3) << 6;
+    header += 31 - header % 31;
+    AV_WB16(s->slices[0].out, header);
+
+    for(i = 0; i < s->nb_slices; i++) {
+        PNGEncSlice *sl = &s->slices[i];
+
+        start = sl->out + 2;
+        len = sl->out_size;
+        adler = adler32_combine(adler, sl->adler, (sl->y_end - sl->y_start) * stride);
+        if (i == 0) {
+            start -= 2;
+            len += 2;
+        }
+        if (i == s->nb_slices - 1) {
+            AV_WB32(start + len, adler);
+            len += 4;
+        }
+        if (s->bytestream_end - s->bytestream < len + 100) {
+            av_log(avctx, AV_LOG_ERROR, "output buffer too small\n");
+            ret = -1;
+            goto end;
+        }
+        png_write_chunk(&s->bytestream, MKTAG('I', 'D', 'A', 'T'), start, len);
+    }
+ end:
+    if (s->slices)
+        for(i = 0; i < s->nb_slices; i++)
+            av_free(s->slices[i].out);
+    av_freep(&s->slices);
+    av_freep(&s->filtered);
+    av_free(job_ret);
+    return ret;
+}
+
 static int encode_frame(AVCodecContext *avctx, unsigned char *buf, int buf_size, void *data){
     PNGEncContext *s = avctx->priv_data;
     AVFrame *pict = data;
@@ -277,6 +497,9 @@ static int encode_frame(AVCodecContext *avctx, unsigned char *buf, int buf_size,
     }
     bits_per_pixel = ff_png_get_nb_channels(color_type) * bit_depth;
     row_size = (avctx->width * bits_per_pixel + 7) >> 3;
+    s->color_type = color_type;
+    s->bits_per_pixel = bits_per_pixel;
+    s->row_size = row_size;
 
     s->zstream.zalloc = ff_png_zalloc;
     s->zstream.zfree = ff_png_zfree;
@@ -284,11 +507,12 @@ static int encode_frame(AVCodecContext *avctx, unsigned char *buf, int buf_size,
     compression_level = avctx->compression_level == FF_COMPRESSION_DEFAULT ?
                             Z_DEFAULT_COMPRESSION :
                             av_clip(avctx->compression_level, 0, 9);
+    s->compression_level = compression_level;
     ret = deflateInit2(&s->zstream, compression_level,
                        Z_DEFLATED, 15, 8, Z_DEFAULT_STRATEGY);
     if (ret != Z_OK)
         return -1;
-    crow_base = av_malloc((row_size + 32) << (s->filter_type == PNG_FILTER_VALUE_MIXED));
+    crow_base = av_malloc((row_size + 32) << (s->filter_type >= PNG_FILTER_VALUE_MIXED));
     if (!crow_base)
         goto fail;
     crow_buf = crow_base + 15; // pixel data should be aligned, but there's a control byte before it
@@ -347,6 +571,13 @@ static int encode_frame(AVCodecContext *avctx, unsigned char *buf, int buf_size,
         }
     }
 
+    if (!is_progressive &&
+        avctx->active_thread_type & FF_THREAD_SLICE && avctx->thread_count > 1) {
+        if (png_write_slices(avctx) < 0)
+            goto fail;
+        goto write_end;
+    }
+
     /* now put each row */
     s->zstream.avail_out = IOBUF_SIZE;
     s->zstream.next_out = s->buf;
@@ -358,6 +589,7 @@ static int encode_frame(AVCodecContext *avctx, unsigned char *buf, int buf_size,
                output */
             pass_row_size = ff_png_pass_row_size(pass, bits_per_pixel, avctx->width);
             if (pass_row_size > 0) {
+                int last_pred = -1, pass_y = 0;
                 top = NULL;
                 for(y = 0; y < avctx->height; y++) {
                     if ((ff_png_pass_ymask[pass] << (y & 7)) & 0x80) {
@@ -370,7 +602,8 @@ static int encode_frame(AVCodecContext *avctx, unsigned char *buf, int buf_size,
                         png_get_interlaced_row(progressive_buf, pass_row_size,
                                                bits_per_pixel, pass,
                                                ptr, avctx->width);
-                        crow = png_choose_filter(s, crow_buf, progressive_buf, top, pass_row_size, bits_per_pixel>>3);
+                        crow = png_choose_filter(s, crow_buf, progressive_buf, top, pass_row_size, bits_per_pixel>>3,
+                                                 pass_y++, &last_pred);
                         png_write_row(s, crow, pass_row_size + 1);
                         top = progressive_buf;
                     }
@@ -378,6 +611,7 @@ static int encode_frame(AVCodecContext *avctx, unsigned char *buf, int buf_size,
             }
         }
     } else {
+        int last_pred = -1;
         top = NULL;
         for(y = 0; y < avctx->height; y++) {
             ptr = p->data[0] + y * p->linesize[0];
@@ -386,7 +620,8 @@ static int encode_frame(AVCodecContext *avctx, unsigned char *buf, int buf_size,
                 convert_from_rgb32(rgba_buf, ptr, avctx->width);
                 ptr = rgba_buf;
             }
-            crow = png_choose_filter(s, crow_buf, ptr, top, row_size, bits_per_pixel>>3);
+            crow = png_choose_filter(s, crow_buf, ptr, top, row_size, bits_per_pixel>>3,
+                                     y, &last_pred);
             png_write_row(s, crow, row_size + 1);
             top = ptr;
         }
@@ -407,6 +642,7 @@ static int encode_frame(AVCodecContext *avctx, unsigned char *buf, int buf_size,
             goto fail;
         }
     }
+ write_end:
     png_write_chunk(&s->bytestream, MKTAG('I', 'E', 'N', 'D'), NULL, 0);
 
     ret = s->bytestream - s->bytestream_start;
@@ -429,7 +665,13 @@ static av_cold int png_enc_init(AVCodecContext *avctx){
     avctx->coded_frame= &s->picture;
     dsputil_init(&s->dsp, avctx);
 
-    s->filter_type = av_clip(avctx->prediction_method, PNG_FILTER_VALUE_NONE, PNG_FILTER_VALUE_MIXED);
+    s->pngdsp.filter_cost = filter_cost_c;
+    s->pngdsp.sub_paeth_prediction = sub_png_paeth_prediction;
+#if HAVE_MMX
+    ff_png_enc_init_mmx(&s->pngdsp);
+#endif
+
+    s->filter_type = av_clip(avctx->prediction_method, PNG_FILTER_VALUE_NONE, PNG_FILTER_VALUE_FAST);
     if(avctx->pix_fmt == PIX_FMT_MONOBLACK)
         s->filter_type = PNG_FILTER_VALUE_NONE;
 
@@ -443,6 +685,7 @@ AVCodec ff_png_encoder = {
     .priv_data_size = sizeof(PNGEncContext),
     .init           = png_enc_init,
     .encode         = encode_frame,
+    .capabilities   = CODEC_CAP_SLICE_THREADS,
     .pix_fmts= (const enum PixelFormat[]){PIX_FMT_RGB24, PIX_FMT_RGB32, PIX_FMT_PAL8, PIX_FMT_GRAY8, PIX_FMT_MONOBLACK, PIX_FMT_NONE},
     .long_name= NULL_IF_CONFIG_SMALL("PNG image"),
 };
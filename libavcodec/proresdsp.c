@@ -51,9 +51,32 @@ static void prores_idct_put_c(uint16_t *out, int linesize, DCTELEM *block, const
     put_pixels(out, linesize >> 1, block);
 }
 
+static void prores_fdct_c(const uint16_t *src, int linesize, DCTELEM *block)
+{
+    int x, y;
+
+    linesize >>= 1;
+    for (y = 0; y < 8; y++) {
+        for (x = 0; x < 8; x++)
+            block[(y << 3) + x] = src[x];
+        src += linesize;
+    }
+    ff_jpeg_fdct_islow_10(block);
+}
+
+static void prores_quant_c(DCTELEM *dst, const DCTELEM *src, int nb_blocks, const int *qmat)
+{
+    int i;
+
+    for (i = 0; i < nb_blocks << 6; i++)
+        dst[i] = src[i] / qmat[i & 63];
+}
+
 void ff_proresdsp_init(ProresDSPContext *dsp, AVCodecContext *avctx)
 {
     dsp->idct_put = prores_idct_put_c;
+    dsp->fdct     = prores_fdct_c;
+    dsp->quant    = prores_quant_c;
     dsp->idct_permutation_type = FF_NO_IDCT_PERM;
 
     if (HAVE_MMX) ff_proresdsp_x86_init(dsp, avctx);
@@ -31,10 +31,21 @@ typedef struct {
     int idct_permutation_type;
     uint8_t idct_permutation[64];
     void (* idct_put) (uint16_t *out, int linesize, DCTELEM *block, const int16_t *qmat);
+    /**
+     * Forward DCT of a block of 10-bit samples, scaled like
+     * ff_jpeg_fdct_islow_10().
+     */
+    void (* fdct) (const uint16_t *src, int linesize, DCTELEM *block);
+    /**
+     * Divide the coefficients of nb_blocks blocks by qmat, rounding
+     * towards zero.
+     */
+    void (* quant) (DCTELEM *dst, const DCTELEM *src, int nb_blocks, const int *qmat);
 } ProresDSPContext;
 
 void ff_proresdsp_init(ProresDSPContext *dsp, AVCodecContext *avctx);
 
 void ff_proresdsp_x86_init(ProresDSPContext *dsp, AVCodecContext *avctx);
+void ff_proresdsp_init_mmx(ProresDSPContext *dsp);
 
 #endif /* AVCODEC_PRORESDSP_H */
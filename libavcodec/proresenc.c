@@ -29,8 +29,10 @@
 #include "put_bits.h"
 #include "bytestream.h"
 #include "dsputil.h"
+#include "proresdsp.h"
 
 #define DEFAULT_SLICE_MB_WIDTH 8
+#define MAX_SLICE_SIZE         65536 ///< slice sizes are coded in 16 bits
 
 #define FF_PROFILE_PRORES_PROXY     0
 #define FF_PROFILE_PRORES_LT        1
@@ -142,12 +144,24 @@ static const uint8_t QMAT_CHROMA[4][64] = {
 
 
 typedef struct {
-    uint8_t* fill_y;
-    uint8_t* fill_u;
-    uint8_t* fill_v;
+    int mb_x, mb_y;
+    unsigned mb_count;
+    int unsafe;             ///< the slice crosses the right or bottom edge
+    int qp;                 ///< quantiser of the last frame, start of the next search
+    uint8_t *data;
+    unsigned data_alloc;
+    int size;
+} ProresSlice;
 
+typedef struct {
     int qmat_luma[16][64];
     int qmat_chroma[16][64];
+
+    ProresDSPContext dsp;
+    ProresSlice *slices;
+    int nb_slices;
+    int slice_per_line;
+    uint8_t *slice_buf;     ///< MAX_SLICE_SIZE bytes of scratch per thread
 } ProresContext;
 
 static void encode_codeword(PutBitContext *pb, int val, int codebook)
@@ -229,7 +243,7 @@ static const uint8_t lev_to_cb[10] = { 0x04, 0x0A, 0x05, 0x06, 0x04, 0x28,
         0x28, 0x28, 0x28, 0x4C };
 
 static void encode_ac_coeffs(AVCodecContext *avctx, PutBitContext *pb,
-        DCTELEM *in, int blocks_per_slice, int *qmat)
+        DCTELEM *in, int blocks_per_slice)
 {
     int prev_run = 4;
     int prev_level = 2;
@@ -238,7 +252,7 @@ static void encode_ac_coeffs(AVCodecContext *avctx, PutBitContext *pb,
     for (int i = 1; i < 64; i++) {
         int indp = progressive_scan[i];
         for (int j = 0; j < blocks_per_slice; j++) {
-            int val = QSCALE(qmat, indp, in[(j << 6) + indp]);
+            int val = in[(j << 6) + indp];
             if (val) {
                 encode_codeword(pb, run, run_to_cb[FFMIN(prev_run, 15)]);
 
@@ -259,76 +273,66 @@ static void encode_ac_coeffs(AVCodecContext *avctx, PutBitContext *pb,
     }
 }
 
-static void get(uint8_t *pixels, int stride, DCTELEM* block)
+static void fdct_slice_plane(ProresContext *ctx, int mb_count,
+        uint8_t *src, int src_stride, DCTELEM *blocks, int chroma)
 {
-    int16_t *p = (int16_t*)pixels;
-    int i, j;
+    int i;
 
-    stride >>= 1;
-    for (i = 0; i < 8; i++) {
-        for (j = 0; j < 8; j++) {
-            block[j] = p[j];
+    for (i = 0; i < mb_count; i++) {
+        ctx->dsp.fdct((uint16_t *)src,                     src_stride, blocks + (0 << 6));
+        ctx->dsp.fdct((uint16_t *)(src + 8 * src_stride), src_stride, blocks + ((2 - chroma) << 6));
+        if (!chroma) {
+            ctx->dsp.fdct((uint16_t *)(src + 16),                  src_stride, blocks + (1 << 6));
+            ctx->dsp.fdct((uint16_t *)(src + 16 + 8 * src_stride), src_stride, blocks + (3 << 6));
         }
-        p += stride;
-        block += 8;
-    }
-}
 
-static void fdct_get(uint8_t *pixels, int stride, DCTELEM* block)
-{
-    get(pixels, stride, block);
-    ff_jpeg_fdct_islow_10(block);
+        blocks += (256 >> chroma);
+        src    += (32  >> chroma);
+    }
 }
 
 static int encode_slice_plane(AVCodecContext *avctx, int mb_count,
-        uint8_t *src, int src_stride, uint8_t *buf, unsigned buf_size,
+        DCTELEM *blocks, DCTELEM *qblocks, uint8_t *buf, unsigned buf_size,
         int *qmat, int chroma)
 {
-    DECLARE_ALIGNED(16, DCTELEM, blocks)[DEFAULT_SLICE_MB_WIDTH << 8], *block;
-    int i, blocks_per_slice;
+    ProresContext *ctx = avctx->priv_data;
+    int blocks_per_slice = mb_count << (2 - chroma);
     PutBitContext pb;
 
-    block = blocks;
-    for (i = 0; i < mb_count; i++) {
-        fdct_get(src,                  src_stride, block + (0 << 6));
-        fdct_get(src + 8 * src_stride, src_stride, block + ((2 - chroma) << 6));
-        if (!chroma) {
-            fdct_get(src + 16,                  src_stride, block + (1 << 6));
-            fdct_get(src + 16 + 8 * src_stride, src_stride, block + (3 << 6));
-        }
-
-        block += (256 >> chroma);
-        src   += (32  >> chroma);
-    }
+    ctx->dsp.quant(qblocks, blocks, blocks_per_slice, qmat);
 
-    blocks_per_slice = mb_count << (2 - chroma);
     init_put_bits(&pb, buf, buf_size << 3);
 
     encode_dc_coeffs(&pb, blocks, blocks_per_slice, qmat);
-    encode_ac_coeffs(avctx, &pb, blocks, blocks_per_slice, qmat);
+    encode_ac_coeffs(avctx, &pb, qblocks, blocks_per_slice);
 
     flush_put_bits(&pb);
     return put_bits_ptr(&pb) - pb.buf;
 }
 
+/**
+ * Entropy code the transformed planes of a slice with the given quantiser.
+ * blocks holds the luma and both chroma coefficients one after the other.
+ */
 static av_always_inline unsigned encode_slice_data(AVCodecContext *avctx,
-        uint8_t *dest_y, uint8_t *dest_u, uint8_t *dest_v, int luma_stride,
-        int chroma_stride, unsigned mb_count, uint8_t *buf, unsigned data_size,
-        unsigned* y_data_size, unsigned* u_data_size, unsigned* v_data_size,
-        int qp)
+        DCTELEM *blocks, DCTELEM *qblocks, unsigned mb_count, uint8_t *buf,
+        unsigned data_size, unsigned* y_data_size, unsigned* u_data_size,
+        unsigned* v_data_size, int qp)
 {
     ProresContext* ctx = avctx->priv_data;
+    DCTELEM *blocks_u = blocks   + (mb_count << 8);
+    DCTELEM *blocks_v = blocks_u + (mb_count << 7);
 
-    *y_data_size = encode_slice_plane(avctx, mb_count, dest_y, luma_stride,
+    *y_data_size = encode_slice_plane(avctx, mb_count, blocks, qblocks,
             buf, data_size, ctx->qmat_luma[qp - 1], 0);
 
     if (!(avctx->flags & CODEC_FLAG_GRAY)) {
-        *u_data_size = encode_slice_plane(avctx, mb_count, dest_u,
-                chroma_stride, buf + *y_data_size, data_size - *y_data_size,
+        *u_data_size = encode_slice_plane(avctx, mb_count, blocks_u, qblocks,
+                buf + *y_data_size, data_size - *y_data_size,
                 ctx->qmat_chroma[qp - 1], 1);
 
-        *v_data_size = encode_slice_plane(avctx, mb_count, dest_v,
-                chroma_stride, buf + *y_data_size + *u_data_size,
+        *v_data_size = encode_slice_plane(avctx, mb_count, blocks_v, qblocks,
+                buf + *y_data_size + *u_data_size,
                 data_size - *y_data_size - *u_data_size,
                 ctx->qmat_chroma[qp - 1], 1);
     }
@@ -366,15 +370,29 @@ static void subimage_with_fill(uint16_t *src, unsigned x, unsigned y,
     }
 }
 
-static int encode_slice(AVCodecContext *avctx, AVFrame *pic, int mb_x,
-        int mb_y, unsigned mb_count, uint8_t *buf, unsigned data_size,
-        int unsafe, int *qp)
+/**
+ * Transform a slice once, then search its quantiser starting from the one
+ * it got in the previous frame; every step only requantises and entropy
+ * codes the coefficients again.
+ */
+static int encode_slice(AVCodecContext *avctx, AVFrame *pic,
+        ProresSlice *slice, uint8_t *buf, unsigned data_size)
 {
+    DECLARE_ALIGNED(16, DCTELEM, blocks)[DEFAULT_SLICE_MB_WIDTH << 9];
+    DECLARE_ALIGNED(16, DCTELEM, qblocks)[DEFAULT_SLICE_MB_WIDTH << 8];
+    DECLARE_ALIGNED(16, uint16_t, fill_y)[DEFAULT_SLICE_MB_WIDTH << 8];
+    DECLARE_ALIGNED(16, uint16_t, fill_u)[DEFAULT_SLICE_MB_WIDTH << 7];
+    DECLARE_ALIGNED(16, uint16_t, fill_v)[DEFAULT_SLICE_MB_WIDTH << 7];
     int luma_stride, chroma_stride;
     int hdr_size = 6, slice_size;
     uint8_t *dest_y, *dest_u, *dest_v;
     unsigned y_data_size = 0, u_data_size = 0, v_data_size = 0;
     ProresContext* ctx = avctx->priv_data;
+    int mb_x = slice->mb_x, mb_y = slice->mb_y;
+    unsigned mb_count = slice->mb_count;
+    int qp = slice->qp;
+    int qp_start   = qp_start_table[avctx->profile];
+    int qp_end     = qp_end_table[avctx->profile];
     int tgt_bits   = (mb_count * bitrate_table[avctx->profile]) >> 2;
     int low_bytes  = (tgt_bits - (tgt_bits >> 3)) >> 3; // 12% bitrate fluctuation
     int high_bytes = (tgt_bits + (tgt_bits >> 3)) >> 3;
@@ -386,102 +404,119 @@ static int encode_slice(AVCodecContext *avctx, AVFrame *pic, int mb_x,
     dest_u = pic->data[1] + (mb_y << 4) * chroma_stride + (mb_x << 4);
     dest_v = pic->data[2] + (mb_y << 4) * chroma_stride + (mb_x << 4);
 
-    if (unsafe) {
+    if (slice->unsafe) {
 
         subimage_with_fill((uint16_t *) pic->data[0], mb_x << 4, mb_y << 4,
                 luma_stride, avctx->width, avctx->height,
-                (uint16_t *) ctx->fill_y, mb_count << 4, 16);
+                fill_y, mb_count << 4, 16);
         subimage_with_fill((uint16_t *) pic->data[1], mb_x << 3, mb_y << 4,
                 chroma_stride, avctx->width >> 1, avctx->height,
-                (uint16_t *) ctx->fill_u, mb_count << 3, 16);
+                fill_u, mb_count << 3, 16);
         subimage_with_fill((uint16_t *) pic->data[2], mb_x << 3, mb_y << 4,
                 chroma_stride, avctx->width >> 1, avctx->height,
-                (uint16_t *) ctx->fill_v, mb_count << 3, 16);
+                fill_v, mb_count << 3, 16);
 
-        encode_slice_data(avctx, ctx->fill_y, ctx->fill_u, ctx->fill_v,
-                mb_count << 5, mb_count << 4, mb_count, buf + hdr_size,
-                data_size - hdr_size, &y_data_size, &u_data_size, &v_data_size,
-                *qp);
-    } else {
-        slice_size = encode_slice_data(avctx, dest_y, dest_u, dest_v,
-                luma_stride, chroma_stride, mb_count, buf + hdr_size,
-                data_size - hdr_size, &y_data_size, &u_data_size, &v_data_size,
-                *qp);
-
-        if (slice_size > high_bytes && *qp < qp_end_table[avctx->profile]) {
-            do {
-                *qp += 1;
-                slice_size = encode_slice_data(avctx, dest_y, dest_u, dest_v,
-                        luma_stride, chroma_stride, mb_count, buf + hdr_size,
-                        data_size - hdr_size, &y_data_size, &u_data_size,
-                        &v_data_size, *qp);
-            } while (slice_size > high_bytes && *qp < qp_end_table[avctx->profile]);
-        } else if (slice_size < low_bytes && *qp
-                > qp_start_table[avctx->profile]) {
-            do {
-                *qp -= 1;
-                slice_size = encode_slice_data(avctx, dest_y, dest_u, dest_v,
-                        luma_stride, chroma_stride, mb_count, buf + hdr_size,
-                        data_size - hdr_size, &y_data_size, &u_data_size,
-                        &v_data_size, *qp);
-            } while (slice_size < low_bytes && *qp > qp_start_table[avctx->profile]);
-        }
+        dest_y = (uint8_t *) fill_y;
+        dest_u = (uint8_t *) fill_u;
+        dest_v = (uint8_t *) fill_v;
+        luma_stride   = mb_count << 5;
+        chroma_stride = mb_count << 4;
+    }
+
+    fdct_slice_plane(ctx, mb_count, dest_y, luma_stride, blocks, 0);
+    if (!(avctx->flags & CODEC_FLAG_GRAY)) {
+        fdct_slice_plane(ctx, mb_count, dest_u, chroma_stride,
+                blocks + (mb_count << 8), 1);
+        fdct_slice_plane(ctx, mb_count, dest_v, chroma_stride,
+                blocks + (mb_count << 8) + (mb_count << 7), 1);
     }
 
+    slice_size = encode_slice_data(avctx, blocks, qblocks, mb_count,
+            buf + hdr_size, data_size - hdr_size,
+            &y_data_size, &u_data_size, &v_data_size, qp);
+
+    if (slice_size > high_bytes && qp < qp_end) {
+        do {
+            qp += 1;
+            slice_size = encode_slice_data(avctx, blocks, qblocks, mb_count,
+                    buf + hdr_size, data_size - hdr_size,
+                    &y_data_size, &u_data_size, &v_data_size, qp);
+        } while (slice_size > high_bytes && qp < qp_end);
+    } else if (slice_size < low_bytes && qp > qp_start) {
+        do {
+            qp -= 1;
+            slice_size = encode_slice_data(avctx, blocks, qblocks, mb_count,
+                    buf + hdr_size, data_size - hdr_size,
+                    &y_data_size, &u_data_size, &v_data_size, qp);
+        } while (slice_size < low_bytes && qp > qp_start);
+    }
+    slice->qp = qp;
+
     buf[0] = hdr_size << 3;
-    buf[1] = *qp;
+    buf[1] = qp;
     AV_WB16(buf + 2, y_data_size);
     AV_WB16(buf + 4, u_data_size);
 
     return hdr_size + y_data_size + u_data_size + v_data_size;
 }
 
+static int encode_slice_job(AVCodecContext *avctx, void *arg, int jobnr, int threadnr)
+{
+    ProresContext *ctx = avctx->priv_data;
+    ProresSlice *slice = &ctx->slices[jobnr];
+    uint8_t *buf = ctx->slice_buf + threadnr * MAX_SLICE_SIZE;
+    int size = encode_slice(avctx, arg, slice, buf, MAX_SLICE_SIZE);
+
+    /* the slices are put together in order once all are done */
+    av_fast_malloc(&slice->data, &slice->data_alloc, size);
+    if (!slice->data) {
+        slice->data_alloc = 0;
+        return AVERROR(ENOMEM);
+    }
+    memcpy(slice->data, buf, size);
+    slice->size = size;
+    return 0;
+}
+
 static int prores_encode_picture(AVCodecContext *avctx, AVFrame *pic,
         uint8_t *buf, const int buf_size)
 {
-    int mb_width = (avctx->width + 15) >> 4;
+    ProresContext *ctx = avctx->priv_data;
     int mb_height = (avctx->height + 15) >> 4;
-    int hdr_size, sl_size;
-    int mb_y, sl_data_size, qp;
-    int unsafe_bot, unsafe_right;
+    int hdr_size, i;
     uint8_t *sl_data, *sl_data_sizes;
-    int slice_per_line = 0, rem = mb_width;
 
-    for (int i = av_log2(DEFAULT_SLICE_MB_WIDTH); i >= 0; --i) {
-        slice_per_line += rem >> i;
-        rem &= (1 << i) - 1;
-    }
+    for (i = 0; i < ctx->nb_slices; i++)
+        ctx->slices[i].size = -1;
+    avctx->execute2(avctx, encode_slice_job, pic, NULL, ctx->nb_slices);
 
-    qp = qp_start_table[avctx->profile];
-    hdr_size = 8; sl_data_size = buf_size - hdr_size;
+    hdr_size = 8;
     sl_data_sizes = buf + hdr_size;
-    sl_data = sl_data_sizes + (slice_per_line * mb_height * 2);
-    for (mb_y = 0; mb_y < mb_height; mb_y++) {
-        int mb_x = 0;
-        int slice_mb_count = DEFAULT_SLICE_MB_WIDTH;
-        while (mb_x < mb_width) {
-            while (mb_width - mb_x < slice_mb_count)
-                slice_mb_count >>= 1;
-
-            unsafe_bot = (avctx->height & 0xf) && (mb_y == mb_height - 1);
-            unsafe_right = (avctx->width & 0xf) && (mb_x + slice_mb_count == mb_width);
+    sl_data = sl_data_sizes + ctx->nb_slices * 2;
+    if (sl_data > buf + buf_size)
+        goto too_small;
+    for (i = 0; i < ctx->nb_slices; i++) {
+        ProresSlice *slice = &ctx->slices[i];
 
-            sl_size = encode_slice(avctx, pic, mb_x, mb_y, slice_mb_count,
-                    sl_data, sl_data_size, unsafe_bot || unsafe_right, &qp);
-
-            bytestream_put_be16(&sl_data_sizes, sl_size);
-            sl_data           += sl_size;
-            sl_data_size      -= sl_size;
-            mb_x              += slice_mb_count;
-        }
+        if (slice->size < 0)
+            return AVERROR(ENOMEM);
+        if (slice->size > buf + buf_size - sl_data)
+            goto too_small;
+        bytestream_put_be16(&sl_data_sizes, slice->size);
+        memcpy(sl_data, slice->data, slice->size);
+        sl_data += slice->size;
     }
 
     buf[0] = hdr_size << 3;
     AV_WB32(buf + 1, sl_data - buf);
-    AV_WB16(buf + 5, slice_per_line * mb_height);
+    AV_WB16(buf + 5, ctx->slice_per_line * mb_height);
     buf[7] = av_log2(DEFAULT_SLICE_MB_WIDTH) << 4;
 
     return sl_data - buf;
+
+too_small:
+    av_log(avctx, AV_LOG_ERROR, "output buffer too small\n");
+    return -1;
 }
 
 static int prores_encode_frame(AVCodecContext *avctx, unsigned char *buf,
@@ -490,8 +525,16 @@ static int prores_encode_frame(AVCodecContext *avctx, unsigned char *buf,
     AVFrame *pic = data;
 
     int header_size = 148;
-    int pic_size = prores_encode_picture(avctx, pic, buf + header_size + 8,
+    int pic_size;
+
+    if (buf_size < header_size + 8) {
+        av_log(avctx, AV_LOG_ERROR, "output buffer too small\n");
+        return -1;
+    }
+    pic_size = prores_encode_picture(avctx, pic, buf + header_size + 8,
             buf_size - header_size - 8);
+    if (pic_size < 0)
+        return pic_size;
 
     bytestream_put_be32(&buf, pic_size + 8 + header_size);
     bytestream_put_buffer(&buf, "icpf", 4);
@@ -523,9 +566,25 @@ static void scale_mat(const uint8_t* src, int* dst, int scale)
         dst[i] = src[i] * scale;
 }
 
-static av_cold int prores_encode_init(AVCodecContext *avctx)
+static av_cold int prores_encode_close(AVCodecContext *avctx)
 {
+    ProresContext* ctx = avctx->priv_data;
     int i;
+
+    av_freep(&avctx->coded_frame);
+    for (i = 0; ctx->slices && i < ctx->nb_slices; i++)
+        av_freep(&ctx->slices[i].data);
+    av_freep(&ctx->slices);
+    av_freep(&ctx->slice_buf);
+
+    return 0;
+}
+
+static av_cold int prores_encode_init(AVCodecContext *avctx)
+{
+    int i, mb_x, mb_y, slice_mb_count;
+    int mb_width  = (avctx->width  + 15) >> 4;
+    int mb_height = (avctx->height + 15) >> 4;
     ProresContext* ctx = avctx->priv_data;
 
     if (avctx->pix_fmt != PIX_FMT_YUV422P10) {
@@ -538,14 +597,6 @@ static av_cold int prores_encode_init(AVCodecContext *avctx)
         return -1;
     }
 
-    if ((avctx->height & 0xf) || (avctx->width & 0xf)) {
-        ctx->fill_y = av_malloc(4 * (DEFAULT_SLICE_MB_WIDTH << 8));
-        if (!ctx->fill_y)
-            return AVERROR(ENOMEM);
-        ctx->fill_u = ctx->fill_y + (DEFAULT_SLICE_MB_WIDTH << 9);
-        ctx->fill_v = ctx->fill_u + (DEFAULT_SLICE_MB_WIDTH << 8);
-    }
-
     if (avctx->profile == FF_PROFILE_UNKNOWN) {
         avctx->profile = FF_PROFILE_PRORES_STANDARD;
         av_log(avctx, AV_LOG_INFO,
@@ -568,6 +619,37 @@ static av_cold int prores_encode_init(AVCodecContext *avctx)
         scale_mat(QMAT_CHROMA[avctx->profile], ctx->qmat_chroma[i - 1], i);
     }
 
+    ff_proresdsp_init(&ctx->dsp, avctx);
+
+    /* slices of 8 macroblocks, the rest of a row split into halves */
+    ctx->slice_per_line = 0;
+    for (i = mb_width, slice_mb_count = DEFAULT_SLICE_MB_WIDTH; i; slice_mb_count >>= 1) {
+        ctx->slice_per_line += i / slice_mb_count;
+        i %= slice_mb_count;
+    }
+    ctx->nb_slices = ctx->slice_per_line * mb_height;
+    ctx->slices    = av_mallocz(ctx->nb_slices * sizeof(*ctx->slices));
+    ctx->slice_buf = av_malloc(FFMAX(avctx->thread_count, 1) * MAX_SLICE_SIZE);
+    if (!ctx->slices || !ctx->slice_buf) {
+        prores_encode_close(avctx);
+        return AVERROR(ENOMEM);
+    }
+    for (i = 0, mb_y = 0; mb_y < mb_height; mb_y++) {
+        slice_mb_count = DEFAULT_SLICE_MB_WIDTH;
+        for (mb_x = 0; mb_x < mb_width; mb_x += slice_mb_count, i++) {
+            ProresSlice *slice = &ctx->slices[i];
+
+            while (mb_width - mb_x < slice_mb_count)
+                slice_mb_count >>= 1;
+            slice->mb_x     = mb_x;
+            slice->mb_y     = mb_y;
+            slice->mb_count = slice_mb_count;
+            slice->unsafe   = ((avctx->height & 0xf) && mb_y == mb_height - 1) ||
+                              ((avctx->width  & 0xf) && mb_x + slice_mb_count == mb_width);
+            slice->qp       = qp_start_table[avctx->profile];
+        }
+    }
+
     avctx->coded_frame = avcodec_alloc_frame();
     avctx->coded_frame->key_frame = 1;
     avctx->coded_frame->pict_type = AV_PICTURE_TYPE_I;
@@ -575,14 +657,6 @@ static av_cold int prores_encode_init(AVCodecContext *avctx)
     return 0;
 }
 
-static av_cold int prores_encode_close(AVCodecContext *avctx)
-{
-    ProresContext* ctx = avctx->priv_data;
-    av_freep(&avctx->coded_frame);
-    av_freep(&ctx->fill_y);
-
-    return 0;
-}
 
 AVCodec ff_prores_encoder = {
     .name           = "prores",
@@ -594,6 +668,6 @@ AVCodec ff_prores_encoder = {
     .encode         = prores_encode_frame,
     .pix_fmts       = (const enum PixelFormat[]){PIX_FMT_YUV422P10, PIX_FMT_NONE},
     .long_name      = NULL_IF_CONFIG_SMALL("Apple ProRes"),
-    .capabilities   = 0,
+    .capabilities   = CODEC_CAP_SLICE_THREADS,
     .profiles       = profiles
 };
@@ -30,6 +30,8 @@
  */
 
 #include "config.h"
+#include "libavutil/threadpool.h"
+#include "libavutil/trace.h"
 #include "avcodec.h"
 #include "internal.h"
 #include "thread.h"
@@ -70,6 +72,7 @@ typedef struct PerThreadContext {
     struct FrameThreadContext *parent;
 
     pthread_t      thread;
+    AVThreadPoolTask *task;         ///< Used instead of thread when running on a thread pool.
     pthread_cond_t input_cond;      ///< Used to wait for a new packet from the main thread.
     pthread_cond_t progress_cond;   ///< Used by child threads to wait for progress to change.
     pthread_cond_t output_cond;     ///< Used by the main thread to wait for frames to finish.
@@ -143,6 +146,8 @@ static void* attribute_align_arg worker(void *v)
     pthread_mutex_lock(&c->current_job_lock);
     self_id = c->current_job++;
     for (;;){
+        uint64_t t;
+
         while (our_job >= c->job_count) {
             if (c->current_job == thread_count + c->job_count)
                 pthread_cond_signal(&c->last_job_cond);
@@ -157,8 +162,10 @@ static void* attribute_align_arg worker(void *v)
         }
         pthread_mutex_unlock(&c->current_job_lock);
 
+        t = av_trace_begin();
         c->rets[our_job%c->rets_count] = c->func ? c->func(avctx, (char*)c->args + our_job*c->job_size):
                                                    c->func2(avctx, c->args, our_job, self_id);
+        av_trace_end(t, avctx->codec->name, "slice");
 
         pthread_mutex_lock(&c->current_job_lock);
         our_job = c->current_job++;
@@ -176,6 +183,11 @@ static void thread_free(AVCodecContext *avctx)
     ThreadContext *c = avctx->thread_opaque;
     int i;
 
+    if (avctx->thread_pool) {
+        av_freep(&avctx->thread_opaque);
+        return;
+    }
+
     pthread_mutex_lock(&c->current_job_lock);
     c->done = 1;
     pthread_cond_broadcast(&c->current_job_cond);
@@ -230,6 +242,37 @@ static int avcodec_thread_execute2(AVCodecContext *avctx, action_func2* func2, v
     return avcodec_thread_execute(avctx, NULL, arg, ret, job_count, 0);
 }
 
+static int pool_job(void *ctx, void *arg, int jobnr, int threadnr)
+{
+    AVCodecContext *avctx = ctx;
+    ThreadContext *c = arg;
+    uint64_t t = av_trace_begin();
+    int ret = c->func ? c->func(avctx, (char*)c->args + jobnr*c->job_size):
+                        c->func2(avctx, c->args, jobnr, threadnr);
+
+    av_trace_end(t, avctx->codec->name, "slice");
+    return ret;
+}
+
+static int pool_execute(AVCodecContext *avctx, action_func* func, void *arg, int *ret, int job_count, int job_size)
+{
+    ThreadContext *c = avctx->thread_opaque;
+
+    c->func     = func;
+    c->args     = arg;
+    c->job_size = job_size;
+    return av_threadpool_execute(avctx->thread_pool, pool_job, avctx, c, ret,
+                                 job_count, avctx->thread_count);
+}
+
+static int pool_execute2(AVCodecContext *avctx, action_func2* func2, void *arg, int *ret, int job_count)
+{
+    ThreadContext *c = avctx->thread_opaque;
+
+    c->func2 = func2;
+    return pool_execute(avctx, NULL, arg, ret, job_count, 0);
+}
+
 static int thread_init(AVCodecContext *avctx)
 {
     int i;
@@ -243,6 +286,13 @@ static int thread_init(AVCodecContext *avctx)
     if (!c)
         return -1;
 
+    if (avctx->thread_pool) {
+        avctx->thread_opaque = c;
+        avctx->execute  = pool_execute;
+        avctx->execute2 = pool_execute2;
+        return 0;
+    }
+
     c->workers = av_mallocz(sizeof(pthread_t)*thread_count);
     if (!c->workers) {
         av_free(c);
@@ -289,6 +339,8 @@ static attribute_align_arg void *frame_worker_thread(void *arg)
     AVCodec *codec = avctx->codec;
 
     while (1) {
+        uint64_t t;
+
         if (p->state == STATE_INPUT_READY && !fctx->die) {
             pthread_mutex_lock(&p->mutex);
             while (p->state == STATE_INPUT_READY && !fctx->die)
@@ -304,7 +356,9 @@ static attribute_align_arg void *frame_worker_thread(void *arg)
         pthread_mutex_lock(&p->mutex);
         avcodec_get_frame_defaults(&p->frame);
         p->got_frame = 0;
+        t = av_trace_begin();
         p->result = codec->decode(avctx, &p->frame, &p->got_frame, &p->avpkt);
+        av_trace_end(t, codec->name, "decode");
 
         if (p->state == STATE_SETTING_UP) ff_thread_finish_setup(avctx);
 
@@ -655,7 +709,13 @@ static void frame_thread_free(AVCodecContext *avctx, int thread_count)
         pthread_cond_signal(&p->input_cond);
         pthread_mutex_unlock(&p->mutex);
 
-        pthread_join(p->thread, NULL);
+        if (avctx->thread_pool) {
+            if (p->task)
+                av_threadpool_join(avctx->thread_pool, &p->task);
+            else
+                av_threadpool_release(avctx->thread_pool, 1);
+        } else
+            pthread_join(p->thread, NULL);
 
         if (codec->close)
             codec->close(p->avctx);
@@ -697,6 +757,17 @@ static int frame_thread_init(AVCodecContext *avctx)
     FrameThreadContext *fctx;
     int i, err = 0;
 
+    if (avctx->thread_pool) {
+        /* each frame thread keeps a worker of the pool until it is freed */
+        thread_count = av_threadpool_reserve(avctx->thread_pool, thread_count);
+        if (thread_count <= 1) {
+            av_threadpool_release(avctx->thread_pool, thread_count);
+            av_log(avctx, AV_LOG_VERBOSE,
+                   "No free threads in the pool, frame threading disabled\n");
+        }
+        avctx->thread_count = FFMAX(thread_count, 1);
+    }
+
     if (thread_count <= 1) {
         avctx->active_thread_type = 0;
         return 0;
@@ -743,12 +814,18 @@ static int frame_thread_init(AVCodecContext *avctx)
 
         if (err) goto error;
 
-        pthread_create(&p->thread, NULL, frame_worker_thread, p);
+        if (avctx->thread_pool) {
+            err = av_threadpool_start(avctx->thread_pool, &p->task, frame_worker_thread, p);
+            if (err) goto error;
+        } else
+            pthread_create(&p->thread, NULL, frame_worker_thread, p);
     }
 
     return 0;
 
 error:
+    if (avctx->thread_pool)
+        av_threadpool_release(avctx->thread_pool, thread_count - (i+1));
     frame_thread_free(avctx, i+1);
 
     return err;
@@ -33,6 +33,7 @@
 #include "libavutil/imgutils.h"
 #include "libavutil/samplefmt.h"
 #include "libavutil/dict.h"
+#include "libavutil/trace.h"
 #include "avcodec.h"
 #include "dsputil.h"
 #include "libavutil/opt.h"
@@ -726,7 +727,9 @@ int attribute_align_arg avcodec_encode_audio(AVCodecContext *avctx, uint8_t *buf
         return -1;
     }
     if((avctx->codec->capabilities & CODEC_CAP_DELAY) || samples){
+        uint64_t t = av_trace_begin();
         int ret = avctx->codec->encode(avctx, buf, buf_size, samples);
+        av_trace_end(t, avctx->codec->name, "encode");
         avctx->frame_number++;
         return ret;
     }else
@@ -743,7 +746,9 @@ int attribute_align_arg avcodec_encode_video(AVCodecContext *avctx, uint8_t *buf
     if(av_image_check_size(avctx->width, avctx->height, 0, avctx))
         return -1;
     if((avctx->codec->capabilities & CODEC_CAP_DELAY) || pict){
+        uint64_t t = av_trace_begin();
         int ret = avctx->codec->encode(avctx, buf, buf_size, pict);
+        av_trace_end(t, avctx->codec->name, "encode");
         avctx->frame_number++;
         emms_c(); //needed to avoid an emms_c() call before every return;
 
@@ -809,6 +814,7 @@ int attribute_align_arg avcodec_decode_video2(AVCodecContext *avctx, AVFrame *pi
         return -1;
 
     if((avctx->codec->capabilities & CODEC_CAP_DELAY) || avpkt->size || (avctx->active_thread_type&FF_THREAD_FRAME)){
+        uint64_t t = av_trace_begin();
         av_packet_split_side_data(avpkt);
         avctx->pkt = avpkt;
         if (HAVE_THREADS && avctx->active_thread_type&FF_THREAD_FRAME)
@@ -834,7 +840,7 @@ int attribute_align_arg avcodec_decode_video2(AVCodecContext *avctx, AVFrame *pi
         }
 
         emms_c(); //needed to avoid an emms_c() call before every return;
-
+        av_trace_end(t, avctx->codec->name, "decode");
 
         if (*got_picture_ptr){
             avctx->frame_number++;
@@ -852,6 +858,7 @@ int attribute_align_arg avcodec_decode_audio3(AVCodecContext *avctx, int16_t *sa
                          int *frame_size_ptr,
                          AVPacket *avpkt)
 {
+    uint64_t t;
     int ret;
 
     avctx->pkt = avpkt;
@@ -873,7 +880,9 @@ int attribute_align_arg avcodec_decode_audio3(AVCodecContext *avctx, int16_t *sa
             return -1;
         }
 
+        t   = av_trace_begin();
         ret = avctx->codec->decode(avctx, samples, frame_size_ptr, avpkt);
+        av_trace_end(t, avctx->codec->name, "decode");
         avctx->frame_number++;
     }else{
         ret= 0;
@@ -31,6 +31,7 @@
 #include "bytestream.h"
 #include "get_bits.h"
 #include "dsputil.h"
+#include "thread.h"
 
 enum {
     PRED_NONE = 0,
@@ -39,6 +40,16 @@ enum {
     PRED_MEDIAN,
 };
 
+typedef struct UtvideoPlane {
+    uint8_t *dst;
+    int step, stride;
+    int width, height;
+    int cmask;                  ///< mask applied to the slice boundaries
+    const uint8_t *src;         ///< Huffman table, slice offsets and data
+    VLC vlc;
+    int fsym;                   ///< symbol to fill the plane with, or -1
+} UtvideoPlane;
+
 typedef struct UtvideoContext {
     AVCodecContext *avctx;
     AVFrame pic;
@@ -51,8 +62,13 @@ typedef struct UtvideoContext {
     int interlaced;
     int frame_pred;
 
-    uint8_t *slice_bits;
-    int slice_bits_size;
+    UtvideoPlane plane[4];
+    int slice_ret[4 * 256];
+
+    /* byteswapped slice data, one buffer per slice thread */
+    int nb_slice_bits;
+    uint8_t **slice_bits;
+    unsigned int *slice_bits_size;
 } UtvideoContext;
 
 typedef struct HuffEntry {
@@ -108,120 +124,162 @@ static int build_huff(const uint8_t *src, VLC *vlc, int *fsym)
                            syms,  sizeof(*syms),  sizeof(*syms), 0);
 }
 
-static int decode_plane(UtvideoContext *c, int plane_no,
-                        uint8_t *dst, int step, int stride,
-                        int width, int height,
-                        const uint8_t *src, int src_size, int use_pred)
+/* Undo the left prediction of one line, return the last pixel. */
+static int restore_left(UtvideoContext *c, uint8_t *dst, int step,
+                        int width, int prev)
 {
-    int i, j, slice, pix;
-    int sstart, send;
-    VLC vlc;
-    GetBitContext gb;
-    int prev, fsym;
-    const int cmask = ~(!plane_no && c->avctx->pix_fmt == PIX_FMT_YUV420P);
+    int i;
 
-    if (build_huff(src, &vlc, &fsym)) {
-        av_log(c->avctx, AV_LOG_ERROR, "Cannot build Huffman codes\n");
-        return AVERROR_INVALIDDATA;
+    if (step == 1)
+        return c->dsp.add_hfyu_left_prediction(dst, dst, width, prev);
+    for (i = 0; i < width * step; i += step) {
+        prev  += dst[i];
+        dst[i] = prev;
+    }
+    return prev;
+}
+
+static void restore_median(UtvideoContext *c, uint8_t *bsrc, int step,
+                           int stride, int width, int slice_height)
+{
+    int i, j;
+    int A, B, C;
+
+    // first line - left neighbour prediction
+    A = restore_left(c, bsrc, step, width, 0x80);
+    bsrc += stride;
+    if (slice_height == 1)
+        return;
+    // second line - first element has top predition, the rest uses median
+    C = bsrc[-stride];
+    bsrc[0] += C;
+    A = bsrc[0];
+    if (step == 1) {
+        c->dsp.add_hfyu_median_prediction(bsrc + 1, bsrc + 1 - stride, bsrc + 1,
+                                          width - 1, &A, &C);
+    } else {
+        for (i = step; i < width * step; i += step) {
+            B = bsrc[i - stride];
+            bsrc[i] += mid_pred(A, B, (uint8_t)(A + B - C));
+            C = B;
+            A = bsrc[i];
+        }
     }
-    if (fsym >= 0) { // build_huff reported a symbol to fill slices with
-        send = 0;
-        for (slice = 0; slice < c->slices; slice++) {
-            uint8_t *dest;
-
-            sstart = send;
-            send   = (height * (slice + 1) / c->slices) & cmask;
-            dest   = dst + sstart * stride;
-
-            prev = 0x80;
-            for (j = sstart; j < send; j++) {
-                for (i = 0; i < width * step; i += step) {
-                    pix = fsym;
-                    if (use_pred) {
-                        prev += pix;
-                        pix   = prev;
-                    }
-                    dest[i] = pix;
-                }
-                dest += stride;
+    bsrc += stride;
+    // the rest of lines use continuous median prediction
+    for (j = 2; j < slice_height; j++) {
+        if (step == 1) {
+            c->dsp.add_hfyu_median_prediction(bsrc, bsrc - stride, bsrc,
+                                              width, &A, &C);
+        } else {
+            for (i = 0; i < width * step; i += step) {
+                B = bsrc[i - stride];
+                bsrc[i] += mid_pred(A, B, (uint8_t)(A + B - C));
+                C = B;
+                A = bsrc[i];
             }
         }
-        return 0;
+        bsrc += stride;
     }
+}
 
-    src      += 256;
-    src_size -= 256;
-
-    send = 0;
-    for (slice = 0; slice < c->slices; slice++) {
-        uint8_t *dest;
-        int slice_data_start, slice_data_end, slice_size;
-
-        sstart = send;
-        send   = (height * (slice + 1) / c->slices) & cmask;
-        dest   = dst + sstart * stride;
+/**
+ * Decode one slice of one plane and undo its prediction.
+ * Jobs are numbered plane by plane, slice by slice.
+ */
+static int decode_slice(AVCodecContext *avctx, void *arg, int jobnr, int threadnr)
+{
+    UtvideoContext *c = avctx->priv_data;
+    UtvideoPlane *p = &c->plane[jobnr / c->slices];
+    const int slice = jobnr % c->slices;
+    const int sstart = (p->height *  slice      / c->slices) & p->cmask;
+    const int send   = (p->height * (slice + 1) / c->slices) & p->cmask;
+    const int use_pred = c->frame_pred == PRED_LEFT;
+    uint8_t *dest = p->dst + sstart * p->stride;
+    const uint8_t *src = p->src + 256;
+    int i, j, pix, prev = 0x80;
+    int slice_data_start, slice_data_end, slice_size;
+    uint8_t *slice_bits;
+    GetBitContext gb;
 
-        // slice offset and size validation was done earlier
-        slice_data_start = slice ? AV_RL32(src + slice * 4 - 4) : 0;
-        slice_data_end   = AV_RL32(src + slice * 4);
-        slice_size       = slice_data_end - slice_data_start;
+    if (sstart >= send)
+        return 0;
 
-        if (!slice_size) {
-            for (j = sstart; j < send; j++) {
-                for (i = 0; i < width * step; i += step)
-                    dest[i] = 0x80;
-                dest += stride;
-            }
-            continue;
+    if (p->fsym >= 0) { // build_huff reported a symbol to fill slices with
+        for (j = sstart; j < send; j++) {
+            for (i = 0; i < p->width * p->step; i += p->step)
+                dest[i] = p->fsym;
+            if (use_pred)
+                prev = restore_left(c, dest, p->step, p->width, prev);
+            dest += p->stride;
         }
+        goto end;
+    }
 
-        memcpy(c->slice_bits, src + slice_data_start + c->slices * 4, slice_size);
-        memset(c->slice_bits + slice_size, 0, FF_INPUT_BUFFER_PADDING_SIZE);
-        c->dsp.bswap_buf((uint32_t*)c->slice_bits, (uint32_t*)c->slice_bits,
-                         (slice_data_end - slice_data_start + 3) >> 2);
-        init_get_bits(&gb, c->slice_bits, slice_size * 8);
+    // slice offset and size validation was done earlier
+    slice_data_start = slice ? AV_RL32(src + slice * 4 - 4) : 0;
+    slice_data_end   = AV_RL32(src + slice * 4);
+    slice_size       = slice_data_end - slice_data_start;
 
-        prev = 0x80;
+    if (!slice_size) {
         for (j = sstart; j < send; j++) {
-            for (i = 0; i < width * step; i += step) {
-                if (get_bits_left(&gb) <= 0) {
-                    av_log(c->avctx, AV_LOG_ERROR, "Slice decoding ran out of bits\n");
-                    goto fail;
-                }
-                pix = get_vlc2(&gb, vlc.table, vlc.bits, 4);
-                if (pix < 0) {
-                    av_log(c->avctx, AV_LOG_ERROR, "Decoding error\n");
-                    goto fail;
-                }
-                if (use_pred) {
-                    prev += pix;
-                    pix   = prev;
-                }
-                dest[i] = pix;
-            }
-            dest += stride;
+            for (i = 0; i < p->width * p->step; i += p->step)
+                dest[i] = 0x80;
+            dest += p->stride;
         }
-        if (get_bits_left(&gb) > 32)
-            av_log(c->avctx, AV_LOG_WARNING, "%d bits left after decoding slice\n",
-                   get_bits_left(&gb));
+        goto end;
     }
 
-    free_vlc(&vlc);
-
+    slice_bits = c->slice_bits[threadnr];
+    memcpy(slice_bits, src + slice_data_start + c->slices * 4, slice_size);
+    memset(slice_bits + slice_size, 0, FF_INPUT_BUFFER_PADDING_SIZE);
+    c->dsp.bswap_buf((uint32_t*)slice_bits, (uint32_t*)slice_bits,
+                     (slice_data_end - slice_data_start + 3) >> 2);
+    init_get_bits(&gb, slice_bits, slice_size * 8);
+
+    for (j = sstart; j < send; j++) {
+        for (i = 0; i < p->width * p->step; i += p->step) {
+            if (get_bits_left(&gb) <= 0) {
+                av_log(avctx, AV_LOG_ERROR, "Slice decoding ran out of bits\n");
+                return AVERROR_INVALIDDATA;
+            }
+            pix = get_vlc2(&gb, p->vlc.table, p->vlc.bits, 4);
+            if (pix < 0) {
+                av_log(avctx, AV_LOG_ERROR, "Decoding error\n");
+                return AVERROR_INVALIDDATA;
+            }
+            dest[i] = pix;
+        }
+        if (use_pred)
+            prev = restore_left(c, dest, p->step, p->width, prev);
+        dest += p->stride;
+    }
+    if (get_bits_left(&gb) > 32)
+        av_log(avctx, AV_LOG_WARNING, "%d bits left after decoding slice\n",
+               get_bits_left(&gb));
+
+end:
+    if (c->frame_pred == PRED_MEDIAN)
+        restore_median(c, p->dst + sstart * p->stride, p->step, p->stride,
+                       p->width, send - sstart);
     return 0;
-fail:
-    free_vlc(&vlc);
-    return AVERROR_INVALIDDATA;
 }
 
 static const int rgb_order[4] = { 1, 2, 0, 3 };
 
-static void restore_rgb_planes(uint8_t *src, int step, int stride, int width, int height)
+static int restore_rgb_planes(AVCodecContext *avctx, void *arg, int jobnr, int threadnr)
 {
+    UtvideoContext *c = avctx->priv_data;
+    const int step   = c->planes;
+    const int stride = c->pic.linesize[0];
+    const int width  = avctx->width;
+    const int start  = avctx->height *  jobnr      / c->slices;
+    const int end    = avctx->height * (jobnr + 1) / c->slices;
+    uint8_t *src = c->pic.data[0] + start * stride;
     int i, j;
     uint8_t r, g, b;
 
-    for (j = 0; j < height; j++) {
+    for (j = start; j < end; j++) {
         for (i = 0; i < width * step; i += step) {
             r = src[i];
             g = src[i + 1];
@@ -231,55 +289,19 @@ static void restore_rgb_planes(uint8_t *src, int step, int stride, int width, in
         }
         src += stride;
     }
+    return 0;
 }
 
-static void restore_median(uint8_t *src, int step, int stride,
-                           int width, int height, int slices, int rmode)
+static void set_plane(UtvideoPlane *p, uint8_t *dst, int step, int stride,
+                      int width, int height, int rmode, const uint8_t *src)
 {
-    int i, j, slice;
-    int A, B, C;
-    uint8_t *bsrc;
-    int slice_start, slice_height;
-    const int cmask = ~rmode;
-
-    for (slice = 0; slice < slices; slice++) {
-        slice_start = ((slice * height) / slices) & cmask;
-        slice_height = ((((slice + 1) * height) / slices) & cmask) - slice_start;
-
-        bsrc = src + slice_start * stride;
-
-        // first line - left neighbour prediction
-        bsrc[0] += 0x80;
-        A = bsrc[0];
-        for (i = step; i < width * step; i += step) {
-            bsrc[i] += A;
-            A = bsrc[i];
-        }
-        bsrc += stride;
-        if (slice_height == 1)
-            continue;
-        // second line - first element has top predition, the rest uses median
-        C = bsrc[-stride];
-        bsrc[0] += C;
-        A = bsrc[0];
-        for (i = step; i < width * step; i += step) {
-            B = bsrc[i - stride];
-            bsrc[i] += mid_pred(A, B, (uint8_t)(A + B - C));
-            C = B;
-            A = bsrc[i];
-        }
-        bsrc += stride;
-        // the rest of lines use continuous median prediction
-        for (j = 2; j < slice_height; j++) {
-            for (i = 0; i < width * step; i += step) {
-                B = bsrc[i - stride];
-                bsrc[i] += mid_pred(A, B, (uint8_t)(A + B - C));
-                C = B;
-                A = bsrc[i];
-            }
-            bsrc += stride;
-        }
-    }
+    p->dst    = dst;
+    p->step   = step;
+    p->stride = stride;
+    p->width  = width;
+    p->height = height;
+    p->cmask  = ~rmode;
+    p->src    = src;
 }
 
 static int decode_frame(AVCodecContext *avctx, void *data, int *data_size, AVPacket *avpkt)
@@ -295,15 +317,18 @@ static int decode_frame(AVCodecContext *avctx, void *data, int *data_size, AVPac
     int ret;
 
     if (c->pic.data[0])
-        avctx->release_buffer(avctx, &c->pic);
+        ff_thread_release_buffer(avctx, &c->pic);
 
     c->pic.reference = 1;
     c->pic.buffer_hints = FF_BUFFER_HINTS_VALID;
-    if ((ret = avctx->get_buffer(avctx, &c->pic)) < 0) {
+    if ((ret = ff_thread_get_buffer(avctx, &c->pic)) < 0) {
         av_log(avctx, AV_LOG_ERROR, "get_buffer() failed\n");
         return ret;
     }
 
+    /* frames do not depend on each other */
+    ff_thread_finish_setup(avctx);
+
     /* parse plane structure to retrieve frame flags and validate slice offsets */
     ptr = buf;
     for (i = 0; i < c->planes; i++) {
@@ -347,66 +372,79 @@ static int decode_frame(AVCodecContext *avctx, void *data, int *data_size, AVPac
         return AVERROR_PATCHWELCOME;
     }
 
-    av_fast_malloc(&c->slice_bits, &c->slice_bits_size,
-                   max_slice_size + FF_INPUT_BUFFER_PADDING_SIZE);
-
-    if (!c->slice_bits) {
-        av_log(avctx, AV_LOG_ERROR, "Cannot allocate temporary buffer\n");
-        return AVERROR(ENOMEM);
+    for (i = 0; i < c->nb_slice_bits; i++) {
+        av_fast_malloc(&c->slice_bits[i], &c->slice_bits_size[i],
+                       max_slice_size + FF_INPUT_BUFFER_PADDING_SIZE);
+        if (!c->slice_bits[i]) {
+            av_log(avctx, AV_LOG_ERROR, "Cannot allocate temporary buffer\n");
+            return AVERROR(ENOMEM);
+        }
     }
 
     switch (c->avctx->pix_fmt) {
     case PIX_FMT_RGB24:
     case PIX_FMT_RGBA:
-        for (i = 0; i < c->planes; i++) {
-            ret = decode_plane(c, i, c->pic.data[0] + rgb_order[i], c->planes,
-                               c->pic.linesize[0], avctx->width, avctx->height,
-                               plane_start[i], plane_start[i + 1] - plane_start[i],
-                               c->frame_pred == PRED_LEFT);
-            if (ret)
-                return ret;
-            if (c->frame_pred == PRED_MEDIAN)
-                restore_median(c->pic.data[0] + rgb_order[i], c->planes,
-                               c->pic.linesize[0], avctx->width, avctx->height,
-                               c->slices, 0);
-        }
-        restore_rgb_planes(c->pic.data[0], c->planes, c->pic.linesize[0],
-                           avctx->width, avctx->height);
+        for (i = 0; i < c->planes; i++)
+            set_plane(&c->plane[i], c->pic.data[0] + rgb_order[i], c->planes,
+                      c->pic.linesize[0], avctx->width, avctx->height, 0,
+                      plane_start[i]);
         break;
     case PIX_FMT_YUV420P:
-        for (i = 0; i < 3; i++) {
-            ret = decode_plane(c, i, c->pic.data[i], 1,
-                               c->pic.linesize[i], avctx->width >> !!i, avctx->height >> !!i,
-                               plane_start[i], plane_start[i + 1] - plane_start[i],
-                               c->frame_pred == PRED_LEFT);
-            if (ret)
-                return ret;
-            if (c->frame_pred == PRED_MEDIAN)
-                restore_median(c->pic.data[i], 1, c->pic.linesize[i],
-                               avctx->width >> !!i, avctx->height >> !!i,
-                               c->slices, !i);
-        }
+        for (i = 0; i < 3; i++)
+            set_plane(&c->plane[i], c->pic.data[i], 1, c->pic.linesize[i],
+                      avctx->width >> !!i, avctx->height >> !!i, !i,
+                      plane_start[i]);
         break;
     case PIX_FMT_YUV422P:
-        for (i = 0; i < 3; i++) {
-            ret = decode_plane(c, i, c->pic.data[i], 1,
-                               c->pic.linesize[i], avctx->width >> !!i, avctx->height,
-                               plane_start[i], plane_start[i + 1] - plane_start[i],
-                               c->frame_pred == PRED_LEFT);
-            if (ret)
-                return ret;
-            if (c->frame_pred == PRED_MEDIAN)
-                restore_median(c->pic.data[i], 1, c->pic.linesize[i],
-                               avctx->width >> !!i, avctx->height, c->slices, 0);
-        }
+        for (i = 0; i < 3; i++)
+            set_plane(&c->plane[i], c->pic.data[i], 1, c->pic.linesize[i],
+                      avctx->width >> !!i, avctx->height, 0,
+                      plane_start[i]);
         break;
     }
 
+    for (i = 0; i < c->planes; i++) {
+        memset(&c->plane[i].vlc, 0, sizeof(c->plane[i].vlc));
+        if (build_huff(plane_start[i], &c->plane[i].vlc, &c->plane[i].fsym)) {
+            av_log(avctx, AV_LOG_ERROR, "Cannot build Huffman codes\n");
+            ret = AVERROR_INVALIDDATA;
+            goto end;
+        }
+    }
+
+    /* every slice of every plane is coded independently */
+    avctx->execute2(avctx, decode_slice, NULL, c->slice_ret, c->planes * c->slices);
+    for (i = 0; i < c->planes * c->slices; i++)
+        if (c->slice_ret[i] < 0) {
+            ret = c->slice_ret[i];
+            goto end;
+        }
+
+    if (avctx->pix_fmt == PIX_FMT_RGB24 || avctx->pix_fmt == PIX_FMT_RGBA)
+        avctx->execute2(avctx, restore_rgb_planes, NULL, NULL, c->slices);
+
     *data_size = sizeof(AVFrame);
     *(AVFrame*)data = c->pic;
 
     /* always report that the buffer was completely consumed */
-    return buf_size;
+    ret = buf_size;
+end:
+    for (i = 0; i < c->planes; i++)
+        free_vlc(&c->plane[i].vlc);
+    return ret;
+}
+
+static int alloc_slice_bits(AVCodecContext *avctx)
+{
+    UtvideoContext * const c = avctx->priv_data;
+
+    c->nb_slice_bits   = avctx->active_thread_type & FF_THREAD_SLICE ?
+                         FFMAX(avctx->thread_count, 1) : 1;
+    c->slice_bits      = av_mallocz(c->nb_slice_bits * sizeof(*c->slice_bits));
+    c->slice_bits_size = av_mallocz(c->nb_slice_bits * sizeof(*c->slice_bits_size));
+    if (!c->slice_bits || !c->slice_bits_size)
+        return AVERROR(ENOMEM);
+    return 0;
 }
 
 static av_cold int decode_init(AVCodecContext *avctx)
@@ -437,7 +475,8 @@ static av_cold int decode_init(AVCodecContext *avctx)
     c->compression = c->flags & 1;
     c->interlaced  = c->flags & 0x800;
 
-    c->slice_bits_size = 0;
+    if (alloc_slice_bits(avctx) < 0)
+        return AVERROR(ENOMEM);
 
     switch (avctx->codec_tag) {
     case MKTAG('U', 'L', 'R', 'G'):
@@ -465,14 +504,28 @@ static av_cold int decode_init(AVCodecContext *avctx)
     return 0;
 }
 
+static av_cold int decode_init_thread_copy(AVCodecContext *avctx)
+{
+    UtvideoContext * const c = avctx->priv_data;
+
+    c->avctx = avctx;
+    memset(&c->pic, 0, sizeof(c->pic));
+    return alloc_slice_bits(avctx);
+}
+
 static av_cold int decode_end(AVCodecContext *avctx)
 {
     UtvideoContext * const c = avctx->priv_data;
+    int i;
 
     if (c->pic.data[0])
-        avctx->release_buffer(avctx, &c->pic);
+        ff_thread_release_buffer(avctx, &c->pic);
 
+    if (c->slice_bits)
+        for (i = 0; i < c->nb_slice_bits; i++)
+            av_freep(&c->slice_bits[i]);
     av_freep(&c->slice_bits);
+    av_freep(&c->slice_bits_size);
 
     return 0;
 }
@@ -485,7 +538,9 @@ AVCodec ff_utvideo_decoder = {
     .init           = decode_init,
     .close          = decode_end,
     .decode         = decode_frame,
-    .capabilities   = CODEC_CAP_DR1,
+    .capabilities   = CODEC_CAP_DR1 | CODEC_CAP_SLICE_THREADS |
+                      CODEC_CAP_FRAME_THREADS,
+    .init_thread_copy = ONLY_IF_THREADS_ENABLED(decode_init_thread_copy),
     .long_name      = NULL_IF_CONFIG_SMALL("Ut Video"),
 };
 
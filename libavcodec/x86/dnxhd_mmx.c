@@ -21,9 +21,12 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
  */
 
+#include "libavutil/cpu.h"
 #include "libavutil/x86_cpu.h"
 #include "libavcodec/dnxhdenc.h"
 
+extern uint16_t inv_zigzag_direct16[64];
+
 static void get_pixels_8x4_sym_sse2(DCTELEM *block, const uint8_t *pixels, int line_size)
 {
     __asm__ volatile(
@@ -50,10 +53,104 @@ static void get_pixels_8x4_sym_sse2(DCTELEM *block, const uint8_t *pixels, int l
     );
 }
 
+static void get_pixels_8x4_sym_10_sse2(DCTELEM *block, const uint8_t *pixels, int line_size)
+{
+    __asm__ volatile(
+        "movdqu (%0),        %%xmm0     \n\t"
+        "add    %2,          %0         \n\t"
+        "movdqu (%0),        %%xmm1     \n\t"
+        "movdqu (%0, %2),    %%xmm2     \n\t"
+        "movdqu (%0, %2,2),  %%xmm3     \n\t"
+        "movdqa %%xmm3,        (%1)     \n\t"
+        "movdqa %%xmm2,      16(%1)     \n\t"
+        "movdqa %%xmm1,      32(%1)     \n\t"
+        "movdqa %%xmm0,      48(%1)     \n\t"
+        "movdqa %%xmm0,      64(%1)     \n\t"
+        "movdqa %%xmm1,      80(%1)     \n\t"
+        "movdqa %%xmm2,      96(%1)     \n\t"
+        "movdqa %%xmm3,     112(%1)     \n\t"
+        : "+r" (pixels)
+        : "r" (block), "r" ((x86_reg)line_size)
+        : XMM_CLOBBERS("%xmm0", "%xmm1", "%xmm2", "%xmm3",) "memory"
+    );
+}
+
+/*
+ * Both quantisers work on the coefficients in natural order and keep the
+ * highest scan index + 1 of the non-zero levels like the mpegvideo ones.
+ * The DC lane is quantised as well and copied over afterwards; as its scan
+ * index + 1 is 1, it does not change the last index.
+ */
+#define QUANTIZE(mul)                                                   \
+    __asm__ volatile(                                                   \
+        "pxor          %%xmm7, %%xmm7       \n\t"                        \
+        "pxor          %%xmm4, %%xmm4       \n\t"                        \
+        "1:                                 \n\t"                        \
+        "movdqa      (%1,%0), %%xmm0        \n\t" /* block[i] */         \
+        "pxor          %%xmm1, %%xmm1       \n\t"                        \
+        "pcmpgtw       %%xmm0, %%xmm1       \n\t"                        \
+        "pxor          %%xmm1, %%xmm0       \n\t"                        \
+        "psubw         %%xmm1, %%xmm0       \n\t" /* ABS(block[i]) */    \
+        mul                                                             \
+        "pxor          %%xmm1, %%xmm0       \n\t"                        \
+        "psubw         %%xmm1, %%xmm0       \n\t"                        \
+        "movdqa        %%xmm0, (%3,%0)      \n\t"                        \
+        "pcmpeqw       %%xmm7, %%xmm0       \n\t"                        \
+        "pandn       (%4,%0), %%xmm0        \n\t"                        \
+        "pmaxsw        %%xmm0, %%xmm4       \n\t"                        \
+        "add              $16, %0           \n\t"                        \
+        "js 1b                              \n\t"                        \
+        "pshufd   $0x0E, %%xmm4, %%xmm0     \n\t"                        \
+        "pmaxsw        %%xmm0, %%xmm4       \n\t"                        \
+        "pshufd   $0x01, %%xmm4, %%xmm0     \n\t"                        \
+        "pmaxsw        %%xmm0, %%xmm4       \n\t"                        \
+        "pshuflw  $0x01, %%xmm4, %%xmm0     \n\t"                        \
+        "pmaxsw        %%xmm0, %%xmm4       \n\t"                        \
+        "movd          %%xmm4, %k0          \n\t"                        \
+        : "+r" (i)                                                      \
+        : "r" (src + 64), "r" (qmat + 64), "r" (dst + 64),              \
+          "r" (inv_zigzag_direct16 + 64)                                \
+        : XMM_CLOBBERS("%xmm0", "%xmm1", "%xmm4", "%xmm7",) "memory"    \
+    )
+
+static int dnxhd_8bit_quantize_sse2(DNXHDEncContext *ctx, DCTELEM *dst, const DCTELEM *src,
+                                    int chroma, int qscale)
+{
+    /* the bias follows the factors */
+    const uint16_t *qmat = chroma ? ctx->qmatrix_c16[qscale][0] : ctx->qmatrix_l16[qscale][0];
+    x86_reg i = -128;
+
+    QUANTIZE("paddusw 128(%2,%0), %%xmm0   \n\t"
+             "pmulhw     (%2,%0), %%xmm0   \n\t");
+    dst[0] = src[0];
+    return FFMAX((i & 0xffff) - 1, 0);
+}
+
+static int dnxhd_10bit_quantize_sse2(DNXHDEncContext *ctx, DCTELEM *dst, const DCTELEM *src,
+                                     int chroma, int qscale)
+{
+    const uint16_t *qmat = chroma ? ctx->qmatrix_c16[qscale][0] : ctx->qmatrix_l16[qscale][0];
+    x86_reg i = -128;
+
+    QUANTIZE("pmulhuw    (%2,%0), %%xmm0   \n\t"
+             "psrlw          $2, %%xmm0   \n\t");
+    dst[0] = src[0];
+    return FFMAX((i & 0xffff) - 1, 0);
+}
+
 void ff_dnxhd_init_mmx(DNXHDEncContext *ctx)
 {
     if (av_get_cpu_flags() & AV_CPU_FLAG_SSE2) {
-        if (ctx->cid_table->bit_depth == 8)
+        const int dct_algo = ctx->m.avctx->dct_algo;
+
+        if (ctx->cid_table->bit_depth == 8) {
             ctx->get_pixels_8x4_sym = get_pixels_8x4_sym_sse2;
+            /* same rounding as the mpegvideo quantisers used with the MMX fdct */
+            if (dct_algo == FF_DCT_AUTO || dct_algo == FF_DCT_MMX)
+                ctx->quantize = dnxhd_8bit_quantize_sse2;
+        } else {
+            ctx->get_pixels_8x4_sym = get_pixels_8x4_sym_10_sse2;
+            ctx->quantize = dnxhd_10bit_quantize_sse2;
+        }
     }
 }
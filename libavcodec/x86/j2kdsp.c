@@ -0,0 +1,223 @@
+/*
+ * JPEG 2000 DWT lifting and inverse multi-component transform, SSE2
+ *
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "libavutil/cpu.h"
+#include "libavutil/mem.h"
+#include "libavutil/x86_cpu.h"
+#include "libavcodec/j2k.h"
+#include "libavcodec/j2k_dwt.h"
+
+#if HAVE_SSE
+
+/*
+ * The line buffers of the DWT are aligned and hold one vector of 4 lines
+ * per sample position, so every lifting step is a plain vertical filter on
+ * aligned vectors. The 9/7 steps widen to double precision before the
+ * multiplication like the C code does, which keeps them bit-exact.
+ */
+
+#define LIFT53(op)                                      \
+    __asm__ volatile(                                   \
+        "movd             %2, %%xmm7 \n"                \
+        "movd             %3, %%xmm6 \n"                \
+        "pshufd   $0, %%xmm6, %%xmm6 \n"                \
+        "1:                          \n"                \
+        "movdqa      -16(%0), %%xmm0 \n"                \
+        "paddd        16(%0), %%xmm0 \n"                \
+        "movdqa         (%0), %%xmm1 \n"                \
+        "paddd        %%xmm6, %%xmm0 \n"                \
+        "psrad        %%xmm7, %%xmm0 \n"                \
+        op"           %%xmm0, %%xmm1 \n"                \
+        "movdqa       %%xmm1, (%0)   \n"                \
+        "add             $32, %0     \n"                \
+        "sub              $1, %1     \n"                \
+        "jg 1b                       \n"                \
+        :"+r"(p), "+r"(i)                               \
+        :"r"(shift), "r"(rnd)                           \
+        :XMM_CLOBBERS("%xmm0", "%xmm1", "%xmm6", "%xmm7",) "memory" \
+    )
+
+static void lift53_sse2(int *p, int n, int shift, int rnd, int sub)
+{
+    x86_reg i = n;
+
+    if (n <= 0)
+        return;
+    if (sub)
+        LIFT53("psubd");
+    else
+        LIFT53("paddd");
+}
+
+static void lift97_sse2(float *p, int n, double c)
+{
+    x86_reg i = n;
+
+    if (n <= 0)
+        return;
+    __asm__ volatile(
+        "movsd            %2, %%xmm7 \n"
+        "unpcklpd     %%xmm7, %%xmm7 \n"
+        "1:                          \n"
+        "movaps      -16(%0), %%xmm0 \n"
+        "addps        16(%0), %%xmm0 \n"
+        "cvtps2pd       (%0), %%xmm2 \n"
+        "cvtps2pd      8(%0), %%xmm3 \n"
+        "cvtps2pd     %%xmm0, %%xmm1 \n"
+        "movhlps      %%xmm0, %%xmm0 \n"
+        "cvtps2pd     %%xmm0, %%xmm0 \n"
+        "mulpd        %%xmm7, %%xmm1 \n"
+        "mulpd        %%xmm7, %%xmm0 \n"
+        "addpd        %%xmm2, %%xmm1 \n"
+        "addpd        %%xmm3, %%xmm0 \n"
+        "cvtpd2ps     %%xmm1, %%xmm1 \n"
+        "cvtpd2ps     %%xmm0, %%xmm0 \n"
+        "movlhps      %%xmm0, %%xmm1 \n"
+        "movaps       %%xmm1, (%0)   \n"
+        "add             $32, %0     \n"
+        "sub              $1, %1     \n"
+        "jg 1b                       \n"
+        :"+r"(p), "+r"(i)
+        :"m"(c)
+        :XMM_CLOBBERS("%xmm0", "%xmm1", "%xmm2", "%xmm3", "%xmm7",) "memory"
+    );
+}
+
+DECLARE_ALIGNED(16, static const int32_t, pd_22553)[4]  = { 22553,  22553,  22553,  22553};
+DECLARE_ALIGNED(16, static const int32_t, pd_46802)[4]  = { 46802,  46802,  46802,  46802};
+DECLARE_ALIGNED(16, static const int32_t, pd_116130)[4] = {116130, 116130, 116130, 116130};
+
+/* a *= c on the low 32 bits of each dword, t is a scratch register */
+#define PMULLD(a, c, t)                 \
+    "movdqa    "a", "t"           \n"   \
+    "pmuludq   "c", "a"           \n"   \
+    "psrlq      $32, "t"          \n"   \
+    "pmuludq   "c", "t"           \n"   \
+    "pshufd  $0x08, "a", "a"      \n"   \
+    "pshufd  $0x08, "t", "t"      \n"   \
+    "punpckldq "t", "a"           \n"
+
+static void ict_decode_sse2(int *src0, int *src1, int *src2, int csize)
+{
+    x86_reg i = csize & ~3;
+
+    if (i){
+        src0 += i; src1 += i; src2 += i;
+        i = -4 * i;
+        __asm__ volatile(
+            "1:                                  \n"
+            "movdqu      (%0,%3), %%xmm0         \n"
+            "movdqu      (%1,%3), %%xmm1         \n"
+            "movdqu      (%2,%3), %%xmm3         \n"
+            "movdqa       %%xmm1, %%xmm4         \n"
+            PMULLD("%%xmm3", "%4", "%%xmm6")
+            PMULLD("%%xmm4", "%5", "%%xmm6")
+            PMULLD("%%xmm1", "%6", "%%xmm6")
+            "paddd        %%xmm3, %%xmm4         \n"
+            "psrad           $16, %%xmm3         \n"
+            "psrad           $16, %%xmm4         \n"
+            "psrad           $16, %%xmm1         \n"
+            "movdqa       %%xmm0, %%xmm5         \n"
+            "paddd        %%xmm0, %%xmm3         \n"
+            "psubd        %%xmm4, %%xmm5         \n"
+            "paddd        %%xmm0, %%xmm1         \n"
+            "movdqu       %%xmm3, (%0,%3)        \n"
+            "movdqu       %%xmm5, (%1,%3)        \n"
+            "movdqu       %%xmm1, (%2,%3)        \n"
+            "add             $16, %3             \n"
+            "jl 1b                               \n"
+            :"+r"(src0), "+r"(src1), "+r"(src2), "+r"(i)
+            :"m"(*pd_46802), "m"(*pd_22553), "m"(*pd_116130)
+            :XMM_CLOBBERS("%xmm0", "%xmm1", "%xmm3", "%xmm4", "%xmm5", "%xmm6",) "memory"
+        );
+    }
+    for (i = 0; i < (csize & 3); i++){
+        int i0 = src0[i] + (src2[i] * 46802 >> 16);
+        int i1 = src0[i] - (src1[i] * 22553 + src2[i] * 46802 >> 16);
+        int i2 = src0[i] + (116130 * src1[i] >> 16);
+        src0[i] = i0;
+        src1[i] = i1;
+        src2[i] = i2;
+    }
+}
+
+static void rct_decode_sse2(int *src0, int *src1, int *src2, int csize)
+{
+    x86_reg i = csize & ~3;
+
+    if (i){
+        src0 += i; src1 += i; src2 += i;
+        i = -4 * i;
+        __asm__ volatile(
+            "1:                                  \n"
+            "movdqu      (%0,%3), %%xmm0         \n"
+            "movdqu      (%1,%3), %%xmm1         \n"
+            "movdqu      (%2,%3), %%xmm2         \n"
+            "movdqa       %%xmm1, %%xmm3         \n"
+            "paddd        %%xmm2, %%xmm3         \n"
+            "psrad            $2, %%xmm3         \n"
+            "psubd        %%xmm3, %%xmm0         \n"
+            "paddd        %%xmm0, %%xmm2         \n"
+            "paddd        %%xmm0, %%xmm1         \n"
+            "movdqu       %%xmm2, (%0,%3)        \n"
+            "movdqu       %%xmm0, (%1,%3)        \n"
+            "movdqu       %%xmm1, (%2,%3)        \n"
+            "add             $16, %3             \n"
+            "jl 1b                               \n"
+            :"+r"(src0), "+r"(src1), "+r"(src2), "+r"(i)
+            :
+            :XMM_CLOBBERS("%xmm0", "%xmm1", "%xmm2", "%xmm3",) "memory"
+        );
+    }
+    for (i = 0; i < (csize & 3); i++){
+        int i1 = src0[i] - (src2[i] + src1[i] >> 2);
+        int i0 = i1 + src2[i];
+        int i2 = i1 + src1[i];
+        src0[i] = i0;
+        src1[i] = i1;
+        src2[i] = i2;
+    }
+}
+
+#endif /* HAVE_SSE */
+
+void ff_j2k_dwt_init_x86(DWTContext *s)
+{
+#if HAVE_SSE
+    int mm_flags = av_get_cpu_flags();
+
+    if (mm_flags & AV_CPU_FLAG_SSE2){
+        s->lift53 = lift53_sse2;
+        s->lift97 = lift97_sse2;
+    }
+#endif
+}
+
+void ff_j2k_dsp_init_x86(J2kDSPContext *c)
+{
+#if HAVE_SSE
+    int mm_flags = av_get_cpu_flags();
+
+    if (mm_flags & AV_CPU_FLAG_SSE2){
+        c->mct_decode[FF_DWT97] = ict_decode_sse2;
+        c->mct_decode[FF_DWT53] = rct_decode_sse2;
+    }
+#endif
+}
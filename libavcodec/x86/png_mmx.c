@@ -141,3 +141,111 @@ void ff_png_init_mmx(PNGDecContext *s)
 #endif
     }
 }
+
+#if HAVE_SSE
+static int filter_cost_sse2(const uint8_t *buf, int size)
+{
+    x86_reg i = 0;
+    int cost;
+
+    /* |x| of a signed byte is min(x, -x) taken as unsigned */
+    __asm__ volatile(
+        "pxor      %%xmm6, %%xmm6 \n"
+        "pxor      %%xmm7, %%xmm7 \n"
+        "jmp 2f                   \n"
+        "1:                       \n"
+        "movdqu  (%2,%0), %%xmm0  \n"
+        "pxor      %%xmm1, %%xmm1 \n"
+        "psubb     %%xmm0, %%xmm1 \n"
+        "pminub    %%xmm1, %%xmm0 \n"
+        "psadbw    %%xmm7, %%xmm0 \n"
+        "paddd     %%xmm0, %%xmm6 \n"
+        "add          $16, %0     \n"
+        "2:                       \n"
+        "cmp           %3, %0     \n"
+        "jl 1b                    \n"
+        "pshufd $0xEE, %%xmm6, %%xmm0 \n"
+        "paddd     %%xmm0, %%xmm6 \n"
+        "movd      %%xmm6, %1     \n"
+        : "+r"(i), "=&r"(cost)
+        : "r"(buf), "r"((x86_reg)size & ~15)
+        : XMM_CLOBBERS("%xmm0", "%xmm1", "%xmm6", "%xmm7",) "memory"
+    );
+    for(; i < size; i++)
+        cost += FFABS((int8_t)buf[i]);
+    return cost;
+}
+
+/* Unlike the prediction in the decoder, the one in the encoder only
+   depends on the source, so 8 pixels are predicted at once. */
+static void sub_paeth_prediction_sse2(uint8_t *dst, uint8_t *src, uint8_t *top, int w, int bpp)
+{
+    x86_reg i = 0;
+
+    if (w <= 0)
+        return;
+    __asm__ volatile(
+        "pxor      %%xmm7, %%xmm7 \n"
+        "1:                       \n"
+        "movq    (%3,%0), %%xmm1  \n"
+        "sub           %4, %0     \n"
+        "movq    (%2,%0), %%xmm0  \n"
+        "movq    (%3,%0), %%xmm2  \n"
+        "add           %4, %0     \n"
+        "punpcklbw %%xmm7, %%xmm0 \n" // a
+        "punpcklbw %%xmm7, %%xmm1 \n" // b
+        "punpcklbw %%xmm7, %%xmm2 \n" // c
+        "movdqa    %%xmm1, %%xmm4 \n"
+        "psubw     %%xmm2, %%xmm4 \n" // p = b - c
+        "movdqa    %%xmm0, %%xmm5 \n"
+        "psubw     %%xmm2, %%xmm5 \n" // pc = a - c
+        "movdqa    %%xmm4, %%xmm6 \n"
+        "paddw     %%xmm5, %%xmm6 \n"
+        "pxor      %%xmm3, %%xmm3 \n"
+        "psubw     %%xmm4, %%xmm3 \n"
+        "pmaxsw    %%xmm3, %%xmm4 \n" // pa
+        "pxor      %%xmm3, %%xmm3 \n"
+        "psubw     %%xmm5, %%xmm3 \n"
+        "pmaxsw    %%xmm3, %%xmm5 \n" // pb
+        "pxor      %%xmm3, %%xmm3 \n"
+        "psubw     %%xmm6, %%xmm3 \n"
+        "pmaxsw    %%xmm3, %%xmm6 \n" // pc
+        "movdqa    %%xmm4, %%xmm3 \n"
+        "pcmpgtw   %%xmm5, %%xmm3 \n"
+        "pcmpgtw   %%xmm6, %%xmm4 \n"
+        "por       %%xmm3, %%xmm4 \n" // pa > pb || pa > pc
+        "pcmpgtw   %%xmm6, %%xmm5 \n"
+        "pand      %%xmm4, %%xmm5 \n" // c is chosen
+        "pxor      %%xmm5, %%xmm4 \n" // b is chosen
+        "pand      %%xmm5, %%xmm2 \n"
+        "pand      %%xmm4, %%xmm1 \n"
+        "por       %%xmm5, %%xmm4 \n"
+        "pandn     %%xmm0, %%xmm4 \n"
+        "por       %%xmm1, %%xmm4 \n"
+        "por       %%xmm2, %%xmm4 \n"
+        "packuswb  %%xmm4, %%xmm4 \n"
+        "movq    (%2,%0), %%xmm3  \n"
+        "psubb     %%xmm4, %%xmm3 \n"
+        "movq      %%xmm3, (%1,%0) \n"
+        "add            $8, %0    \n"
+        "cmp            %5, %0    \n"
+        "jl 1b                    \n"
+        : "+r"(i)
+        : "r"(dst), "r"(src), "r"(top), "r"((x86_reg)bpp), "g"((x86_reg)w)
+        : XMM_CLOBBERS("%xmm0", "%xmm1", "%xmm2", "%xmm3",
+                       "%xmm4", "%xmm5", "%xmm6", "%xmm7",) "memory"
+    );
+}
+#endif /* HAVE_SSE */
+
+void ff_png_enc_init_mmx(PNGEncDSPContext *c)
+{
+#if HAVE_SSE
+    int mm_flags = av_get_cpu_flags();
+
+    if (mm_flags & AV_CPU_FLAG_SSE2) {
+        c->filter_cost = filter_cost_sse2;
+        c->sub_paeth_prediction = sub_paeth_prediction_sse2;
+    }
+#endif
+}
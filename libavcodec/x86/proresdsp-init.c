@@ -33,6 +33,12 @@ void ff_proresdsp_x86_init(ProresDSPContext *dsp, AVCodecContext *avctx)
 {
 #if ARCH_X86_64 && HAVE_YASM
     int flags = av_get_cpu_flags();
+#endif
+
+    /* the encoder functions are bitexact */
+    ff_proresdsp_init_mmx(dsp);
+
+#if ARCH_X86_64 && HAVE_YASM
 
     if(avctx->flags & CODEC_FLAG_BITEXACT)
         return;
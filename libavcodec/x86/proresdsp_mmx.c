@@ -0,0 +1,241 @@
+/*
+ * Apple ProRes encoder forward DCT and quantization, SSE2
+ *
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "libavutil/cpu.h"
+#include "libavutil/mem.h"
+#include "libavutil/x86_cpu.h"
+#include "libavcodec/proresdsp.h"
+
+#if HAVE_SSE
+
+#if ARCH_X86_64
+
+/*
+ * The 1-D transform of ff_jpeg_fdct_islow_10() with the products of its
+ * butterfly stages folded into one constant per input: every output is
+ * two pmaddwd of interleaved input pairs, rounded and shifted once. The
+ * sums are exact in 32 bits, so the result is identical to the C code.
+ * Even outputs take (t0, t1), (t2, t3) and odd ones (t4, t5), (t6, t7).
+ */
+#define C2(a, b) { a, b, a, b, a, b, a, b }
+
+DECLARE_ALIGNED(16, static const int16_t, fdct_coeffs)[16][8] = {
+    C2(  8192,   8192), C2(  8192,   8192),
+    C2(  2260,   6437), C2(  9633,  11363),
+    C2( 10703,   4433), C2( -4433, -10703),
+    C2( -6436, -11362), C2( -2259,   9633),
+    C2(  8192,  -8192), C2( -8192,   8192),
+    C2(  9633,   2261), C2(-11362,   6437),
+    C2(  4433, -10704), C2( 10704,  -4433),
+    C2(-11363,   9633), C2( -6436,   2260),
+};
+
+/* rounding of the row pass (>> 12) and of the column pass (>> 15) */
+DECLARE_ALIGNED(16, static const int32_t, fdct_rnd)[2][4] = {
+    {  2048,  2048,  2048,  2048 },
+    { 16384, 16384, 16384, 16384 },
+};
+
+/* rows in xmm0-7 to columns in xmm0, 2, 1, 6, 8, 9, 3, 11 */
+#define TRANSPOSE8                                  \
+    "movdqa      %%xmm0, %%xmm8         \n"         \
+    "punpcklwd   %%xmm1, %%xmm0         \n"         \
+    "punpckhwd   %%xmm1, %%xmm8         \n"         \
+    "movdqa      %%xmm2, %%xmm9         \n"         \
+    "punpcklwd   %%xmm3, %%xmm2         \n"         \
+    "punpckhwd   %%xmm3, %%xmm9         \n"         \
+    "movdqa      %%xmm4, %%xmm10        \n"         \
+    "punpcklwd   %%xmm5, %%xmm4         \n"         \
+    "punpckhwd   %%xmm5, %%xmm10        \n"         \
+    "movdqa      %%xmm6, %%xmm11        \n"         \
+    "punpcklwd   %%xmm7, %%xmm6         \n"         \
+    "punpckhwd   %%xmm7, %%xmm11        \n"         \
+    "movdqa      %%xmm0, %%xmm1         \n"         \
+    "punpckldq   %%xmm2, %%xmm0         \n"         \
+    "punpckhdq   %%xmm2, %%xmm1         \n"         \
+    "movdqa      %%xmm8, %%xmm3         \n"         \
+    "punpckldq   %%xmm9, %%xmm8         \n"         \
+    "punpckhdq   %%xmm9, %%xmm3         \n"         \
+    "movdqa      %%xmm4, %%xmm5         \n"         \
+    "punpckldq   %%xmm6, %%xmm4         \n"         \
+    "punpckhdq   %%xmm6, %%xmm5         \n"         \
+    "movdqa      %%xmm10, %%xmm7        \n"         \
+    "punpckldq   %%xmm11, %%xmm10       \n"         \
+    "punpckhdq   %%xmm11, %%xmm7        \n"         \
+    "movdqa      %%xmm0, %%xmm2         \n"         \
+    "punpcklqdq  %%xmm4, %%xmm0         \n"         \
+    "punpckhqdq  %%xmm4, %%xmm2         \n"         \
+    "movdqa      %%xmm1, %%xmm6         \n"         \
+    "punpcklqdq  %%xmm5, %%xmm1         \n"         \
+    "punpckhqdq  %%xmm5, %%xmm6         \n"         \
+    "movdqa      %%xmm8, %%xmm9         \n"         \
+    "punpcklqdq  %%xmm10, %%xmm8        \n"         \
+    "punpckhqdq  %%xmm10, %%xmm9        \n"         \
+    "movdqa      %%xmm3, %%xmm11        \n"         \
+    "punpcklqdq  %%xmm7, %%xmm3         \n"         \
+    "punpckhqdq  %%xmm7, %%xmm11        \n"
+
+#define FDCT_OUT(out, pl, ph, ql, qh, shift)        \
+    "movdqa      "pl", %%xmm2           \n"         \
+    "movdqa      "ph", %%xmm6           \n"         \
+    "movdqa      "ql", %%xmm4           \n"         \
+    "movdqa      "qh", %%xmm7           \n"         \
+    "pmaddwd     32*"#out"(%2), %%xmm2  \n"         \
+    "pmaddwd     32*"#out"(%2), %%xmm6  \n"         \
+    "pmaddwd     32*"#out"+16(%2), %%xmm4 \n"       \
+    "pmaddwd     32*"#out"+16(%2), %%xmm7 \n"       \
+    "paddd       %%xmm4, %%xmm2         \n"         \
+    "paddd       %%xmm7, %%xmm6         \n"         \
+    "paddd       %%xmm15, %%xmm2        \n"         \
+    "paddd       %%xmm15, %%xmm6        \n"         \
+    "psrad       $"#shift", %%xmm2      \n"         \
+    "psrad       $"#shift", %%xmm6      \n"         \
+    "packssdw    %%xmm6, %%xmm2         \n"         \
+    "movdqa      %%xmm2, 16*"#out"(%1)  \n"
+
+/* transform the columns of the transposed rows, write them as rows */
+#define FDCT_1D(shift)                              \
+    TRANSPOSE8                                      \
+    "movdqa      %%xmm0, %%xmm4         \n"         \
+    "paddw       %%xmm11, %%xmm0        \n" /* t0 */\
+    "psubw       %%xmm11, %%xmm4        \n" /* t7 */\
+    "movdqa      %%xmm2, %%xmm5         \n"         \
+    "paddw       %%xmm3, %%xmm2         \n" /* t1 */\
+    "psubw       %%xmm3, %%xmm5         \n" /* t6 */\
+    "movdqa      %%xmm1, %%xmm7         \n"         \
+    "paddw       %%xmm9, %%xmm1         \n" /* t2 */\
+    "psubw       %%xmm9, %%xmm7         \n" /* t5 */\
+    "movdqa      %%xmm6, %%xmm10        \n"         \
+    "paddw       %%xmm8, %%xmm6         \n" /* t3 */\
+    "psubw       %%xmm8, %%xmm10        \n" /* t4 */\
+    "movdqa      %%xmm0, %%xmm3         \n"         \
+    "punpcklwd   %%xmm2, %%xmm3         \n"         \
+    "punpckhwd   %%xmm2, %%xmm0         \n"         \
+    "movdqa      %%xmm1, %%xmm8         \n"         \
+    "punpcklwd   %%xmm6, %%xmm8         \n"         \
+    "punpckhwd   %%xmm6, %%xmm1         \n"         \
+    "movdqa      %%xmm10, %%xmm9        \n"         \
+    "punpcklwd   %%xmm7, %%xmm9         \n"         \
+    "punpckhwd   %%xmm7, %%xmm10        \n"         \
+    "movdqa      %%xmm5, %%xmm11        \n"         \
+    "punpcklwd   %%xmm4, %%xmm11        \n"         \
+    "punpckhwd   %%xmm4, %%xmm5         \n"         \
+    FDCT_OUT(0, "%%xmm3", "%%xmm0", "%%xmm8", "%%xmm1", shift)   \
+    FDCT_OUT(2, "%%xmm3", "%%xmm0", "%%xmm8", "%%xmm1", shift)   \
+    FDCT_OUT(4, "%%xmm3", "%%xmm0", "%%xmm8", "%%xmm1", shift)   \
+    FDCT_OUT(6, "%%xmm3", "%%xmm0", "%%xmm8", "%%xmm1", shift)   \
+    FDCT_OUT(1, "%%xmm9", "%%xmm10", "%%xmm11", "%%xmm5", shift) \
+    FDCT_OUT(3, "%%xmm9", "%%xmm10", "%%xmm11", "%%xmm5", shift) \
+    FDCT_OUT(5, "%%xmm9", "%%xmm10", "%%xmm11", "%%xmm5", shift) \
+    FDCT_OUT(7, "%%xmm9", "%%xmm10", "%%xmm11", "%%xmm5", shift)
+
+static void prores_fdct_sse2(const uint16_t *src, int linesize, DCTELEM *block)
+{
+    __asm__ volatile(
+        "movdqu        (%0), %%xmm0         \n"
+        "movdqu     (%0,%3), %%xmm1         \n"
+        "lea      (%0,%3,2), %0             \n"
+        "movdqu        (%0), %%xmm2         \n"
+        "movdqu     (%0,%3), %%xmm3         \n"
+        "lea      (%0,%3,2), %0             \n"
+        "movdqu        (%0), %%xmm4         \n"
+        "movdqu     (%0,%3), %%xmm5         \n"
+        "lea      (%0,%3,2), %0             \n"
+        "movdqu        (%0), %%xmm6         \n"
+        "movdqu     (%0,%3), %%xmm7         \n"
+        "movdqa        (%4), %%xmm15        \n"
+        FDCT_1D(12)
+        "movdqa      0*16(%1), %%xmm0       \n"
+        "movdqa      1*16(%1), %%xmm1       \n"
+        "movdqa      2*16(%1), %%xmm2       \n"
+        "movdqa      3*16(%1), %%xmm3       \n"
+        "movdqa      4*16(%1), %%xmm4       \n"
+        "movdqa      5*16(%1), %%xmm5       \n"
+        "movdqa      6*16(%1), %%xmm6       \n"
+        "movdqa      7*16(%1), %%xmm7       \n"
+        "movdqa      16(%4), %%xmm15        \n"
+        FDCT_1D(15)
+        : "+r"(src)
+        : "r"(block), "r"(fdct_coeffs), "r"((x86_reg)linesize), "r"(fdct_rnd)
+        : XMM_CLOBBERS("%xmm0", "%xmm1", "%xmm2", "%xmm3",
+                       "%xmm4", "%xmm5", "%xmm6", "%xmm7",
+                       "%xmm8", "%xmm9", "%xmm10", "%xmm11", "%xmm15",) "memory"
+    );
+}
+
+#endif /* ARCH_X86_64 */
+
+/*
+ * The coefficients fit in 16 bits, so the single precision quotient is
+ * exact enough for its truncation to match the integer division.
+ */
+static void prores_quant_sse2(DCTELEM *dst, const DCTELEM *src, int nb_blocks, const int *qmat)
+{
+    int i;
+
+    for (i = 0; i < nb_blocks; i++) {
+        x86_reg j = 0;
+        __asm__ volatile(
+            "1:                                 \n"
+            "movdqa     (%1,%0), %%xmm0         \n"
+            "movdqa      %%xmm0, %%xmm1         \n"
+            "punpcklwd   %%xmm0, %%xmm0         \n"
+            "punpckhwd   %%xmm1, %%xmm1         \n"
+            "psrad          $16, %%xmm0         \n"
+            "psrad          $16, %%xmm1         \n"
+            "movdqu   (%3,%0,2), %%xmm2         \n"
+            "movdqu 16(%3,%0,2), %%xmm3         \n"
+            "cvtdq2ps    %%xmm0, %%xmm0         \n"
+            "cvtdq2ps    %%xmm1, %%xmm1         \n"
+            "cvtdq2ps    %%xmm2, %%xmm2         \n"
+            "cvtdq2ps    %%xmm3, %%xmm3         \n"
+            "divps       %%xmm2, %%xmm0         \n"
+            "divps       %%xmm3, %%xmm1         \n"
+            "cvttps2dq   %%xmm0, %%xmm0         \n"
+            "cvttps2dq   %%xmm1, %%xmm1         \n"
+            "packssdw    %%xmm1, %%xmm0         \n"
+            "movdqa      %%xmm0, (%2,%0)        \n"
+            "add            $16, %0             \n"
+            "cmp           $128, %0             \n"
+            "jl 1b                              \n"
+            : "+r"(j)
+            : "r"(src), "r"(dst), "r"(qmat)
+            : XMM_CLOBBERS("%xmm0", "%xmm1", "%xmm2", "%xmm3",) "memory"
+        );
+        src += 64;
+        dst += 64;
+    }
+}
+
+#endif /* HAVE_SSE */
+
+void ff_proresdsp_init_mmx(ProresDSPContext *dsp)
+{
+#if HAVE_SSE
+    int mm_flags = av_get_cpu_flags();
+
+    if (mm_flags & AV_CPU_FLAG_SSE2) {
+#if ARCH_X86_64
+        dsp->fdct  = prores_fdct_sse2;
+#endif
+        dsp->quant = prores_quant_sse2;
+    }
+#endif
+}
@@ -25,19 +25,65 @@
  */
 
 #include "libavutil/audioconvert.h"
+#include "libavutil/cpu.h"
 #include "libavutil/eval.h"
 #include "avfilter.h"
+#include "volume.h"
 
-typedef struct {
-    double volume;
-    int    volume_i;
-} VolumeContext;
+void ff_volume_scale_samples_u8_c(uint8_t *p, int nb_samples, int volume_i)
+{
+    int i;
+
+    for (i = 0; i < nb_samples; i++) {
+        int v = (((*p - 128) * volume_i + 128) >> 8) + 128;
+        *p++ = av_clip_uint8(v);
+    }
+}
+
+void ff_volume_scale_samples_s16_c(int16_t *p, int nb_samples, int volume_i)
+{
+    int i;
+
+    for (i = 0; i < nb_samples; i++) {
+        int v = ((int64_t)*p * volume_i + 128) >> 8;
+        *p++ = av_clip_int16(v);
+    }
+}
+
+void ff_volume_scale_samples_s32_c(int32_t *p, int nb_samples, int volume_i)
+{
+    int i;
+
+    for (i = 0; i < nb_samples; i++) {
+        int64_t v = (((int64_t)*p * volume_i + 128) >> 8);
+        *p++ = av_clipl_int32(v);
+    }
+}
+
+void ff_volume_scale_samples_flt_c(float *p, int nb_samples, float volume)
+{
+    int i;
+
+    for (i = 0; i < nb_samples; i++)
+        *p++ *= volume;
+}
+
+void ff_volume_scale_samples_dbl_c(double *p, int nb_samples, double volume)
+{
+    int i;
+
+    for (i = 0; i < nb_samples; i++) {
+        *p *= volume;
+        p++;
+    }
+}
 
 static av_cold int init(AVFilterContext *ctx, const char *args, void *opaque)
 {
     VolumeContext *vol = ctx->priv;
     char *tail;
     int ret = 0;
+    av_unused int cpu_flags = av_get_cpu_flags();
 
     vol->volume = 1.0;
 
@@ -75,6 +121,23 @@ static av_cold int init(AVFilterContext *ctx, const char *args, void *opaque)
     }
 
     vol->volume_i = (int)(vol->volume * 256 + 0.5);
+
+    vol->scale_samples_u8  = ff_volume_scale_samples_u8_c;
+    vol->scale_samples_s16 = ff_volume_scale_samples_s16_c;
+    vol->scale_samples_s32 = ff_volume_scale_samples_s32_c;
+    vol->scale_samples_flt = ff_volume_scale_samples_flt_c;
+    vol->scale_samples_dbl = ff_volume_scale_samples_dbl_c;
+
+    if (HAVE_SSE && cpu_flags & AV_CPU_FLAG_SSE)
+        vol->scale_samples_flt = ff_volume_scale_samples_flt_sse;
+    if (HAVE_SSE && cpu_flags & AV_CPU_FLAG_SSE2) {
+        vol->scale_samples_dbl = ff_volume_scale_samples_dbl_sse2;
+        if (vol->volume_i < 32768) {
+            vol->scale_samples_u8  = ff_volume_scale_samples_u8_sse2;
+            vol->scale_samples_s16 = ff_volume_scale_samples_s16_sse2;
+        }
+    }
+
     av_log(ctx, AV_LOG_INFO, "volume=%f\n", vol->volume);
     return 0;
 }
@@ -90,7 +153,7 @@ static int query_formats(AVFilterContext *ctx)
         AV_SAMPLE_FMT_DBL,
         AV_SAMPLE_FMT_NONE
     };
-    int packing_fmts[] = { AVFILTER_PACKED, -1 };
+    int packing_fmts[] = { AVFILTER_PACKED, AVFILTER_PLANAR, -1 };
 
     formats = avfilter_make_all_channel_layouts();
     if (!formats)
@@ -114,59 +177,23 @@ static void filter_samples(AVFilterLink *inlink, AVFilterBufferRef *insamples)
 {
     VolumeContext *vol = inlink->dst->priv;
     AVFilterLink *outlink = inlink->dst->outputs[0];
-    const int nb_samples = insamples->audio->nb_samples *
+    const int nb_channels =
         av_get_channel_layout_nb_channels(insamples->audio->channel_layout);
-    const double volume   = vol->volume;
-    const int    volume_i = vol->volume_i;
-    int i;
-
-    if (volume_i != 256) {
-        switch (insamples->format) {
-        case AV_SAMPLE_FMT_U8:
-        {
-            uint8_t *p = (void *)insamples->data[0];
-            for (i = 0; i < nb_samples; i++) {
-                int v = (((*p - 128) * volume_i + 128) >> 8) + 128;
-                *p++ = av_clip_uint8(v);
-            }
-            break;
-        }
-        case AV_SAMPLE_FMT_S16:
-        {
-            int16_t *p = (void *)insamples->data[0];
-            for (i = 0; i < nb_samples; i++) {
-                int v = ((int64_t)*p * volume_i + 128) >> 8;
-                *p++ = av_clip_int16(v);
-            }
-            break;
-        }
-        case AV_SAMPLE_FMT_S32:
-        {
-            int32_t *p = (void *)insamples->data[0];
-            for (i = 0; i < nb_samples; i++) {
-                int64_t v = (((int64_t)*p * volume_i + 128) >> 8);
-                *p++ = av_clipl_int32(v);
+    const int nb_planes  = insamples->audio->planar ? nb_channels : 1;
+    const int nb_samples = insamples->audio->nb_samples * (nb_channels / nb_planes);
+    int plane;
+
+    if (vol->volume_i != 256) {
+        for (plane = 0; plane < nb_planes; plane++) {
+            void *p = insamples->data[plane];
+
+            switch (insamples->format) {
+            case AV_SAMPLE_FMT_U8:  vol->scale_samples_u8 (p, nb_samples, vol->volume_i);       break;
+            case AV_SAMPLE_FMT_S16: vol->scale_samples_s16(p, nb_samples, vol->volume_i);       break;
+            case AV_SAMPLE_FMT_S32: vol->scale_samples_s32(p, nb_samples, vol->volume_i);       break;
+            case AV_SAMPLE_FMT_FLT: vol->scale_samples_flt(p, nb_samples, (float)vol->volume);  break;
+            case AV_SAMPLE_FMT_DBL: vol->scale_samples_dbl(p, nb_samples, vol->volume);         break;
             }
-            break;
-        }
-        case AV_SAMPLE_FMT_FLT:
-        {
-            float *p = (void *)insamples->data[0];
-            float scale = (float)volume;
-            for (i = 0; i < nb_samples; i++) {
-                *p++ *= scale;
-            }
-            break;
-        }
-        case AV_SAMPLE_FMT_DBL:
-        {
-            double *p = (void *)insamples->data[0];
-            for (i = 0; i < nb_samples; i++) {
-                *p *= volume;
-                p++;
-            }
-            break;
-        }
         }
     }
     avfilter_filter_samples(outlink, insamples);
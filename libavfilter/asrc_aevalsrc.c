@@ -57,6 +57,7 @@ typedef struct {
     int nb_samples;             ///< number of samples per requested frame
     uint64_t n;
     double var_values[VAR_VARS_NB];
+    double *n_values, *t_values;    ///< per sample values of n and t
 } EvalContext;
 
 #define OFFSET(x) offsetof(EvalContext, x)
@@ -144,6 +145,8 @@ static void uninit(AVFilterContext *ctx)
         eval->expr[i] = NULL;
     }
     av_freep(&eval->sample_rate_str);
+    av_freep(&eval->n_values);
+    av_freep(&eval->t_values);
 }
 
 static int config_props(AVFilterLink *outlink)
@@ -156,6 +159,13 @@ static int config_props(AVFilterLink *outlink)
 
     eval->var_values[VAR_S] = eval->sample_rate;
 
+    av_freep(&eval->n_values);
+    av_freep(&eval->t_values);
+    eval->n_values = av_malloc(eval->nb_samples * sizeof(*eval->n_values));
+    eval->t_values = av_malloc(eval->nb_samples * sizeof(*eval->t_values));
+    if (!eval->n_values || !eval->t_values)
+        return AVERROR(ENOMEM);
+
     av_get_channel_layout_string(buf, sizeof(buf), 0, eval->chlayout);
 
     av_log(outlink->src, AV_LOG_INFO,
@@ -182,20 +192,22 @@ static int request_frame(AVFilterLink *outlink)
 {
     EvalContext *eval = outlink->src->priv;
     AVFilterBufferRef *samplesref;
+    const double *arrays[VAR_VARS_NB] = { NULL };
     int i, j;
 
     samplesref = avfilter_get_audio_buffer(outlink, AV_PERM_WRITE, eval->nb_samples);
 
-    /* evaluate expression for each single sample and for each channel */
+    /* evaluate the expression of each channel for all the samples at once */
     for (i = 0; i < eval->nb_samples; i++, eval->n++) {
-        eval->var_values[VAR_N] = eval->n;
-        eval->var_values[VAR_T] = eval->var_values[VAR_N] * (double)1/eval->sample_rate;
-
-        for (j = 0; j < eval->nb_channels; j++) {
-            *((double *) samplesref->data[j] + i) =
-                av_expr_eval(eval->expr[j], eval->var_values, NULL);
-        }
+        eval->n_values[i] = eval->n;
+        eval->t_values[i] = eval->n_values[i] * (double)1/eval->sample_rate;
     }
+    arrays[VAR_N] = eval->n_values;
+    arrays[VAR_T] = eval->t_values;
+
+    for (j = 0; j < eval->nb_channels; j++)
+        av_expr_eval_batch(eval->expr[j], (double *)samplesref->data[j], eval->nb_samples,
+                           eval->var_values, arrays, NULL);
 
     samplesref->pts = eval->pts;
     samplesref->pos = -1;
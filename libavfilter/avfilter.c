@@ -27,6 +27,7 @@
 #include "libavutil/imgutils.h"
 #include "libavutil/avassert.h"
 #include "libavutil/avstring.h"
+#include "libavutil/trace.h"
 #include "avfilter.h"
 #include "internal.h"
 
@@ -549,6 +550,7 @@ void avfilter_start_frame(AVFilterLink *link, AVFilterBufferRef *picref)
     AVFilterPad *dst = link->dstpad;
     int perms = picref->perms;
     AVFilterCommand *cmd= link->dst->command_queue;
+    uint64_t t;
 
     FF_DPRINTF_START(NULL, start_frame); ff_dlog_link(NULL, link, 0); av_dlog(NULL, " "); ff_dlog_ref(NULL, picref, 1);
 
@@ -580,17 +582,22 @@ void avfilter_start_frame(AVFilterLink *link, AVFilterBufferRef *picref)
         cmd= link->dst->command_queue;
     }
 
+    t = av_trace_begin();
     start_frame(link, link->cur_buf);
+    av_trace_end(t, link->dst->filter->name, "filter");
 }
 
 void avfilter_end_frame(AVFilterLink *link)
 {
     void (*end_frame)(AVFilterLink *);
+    uint64_t t;
 
     if (!(end_frame = link->dstpad->end_frame))
         end_frame = avfilter_default_end_frame;
 
+    t = av_trace_begin();
     end_frame(link);
+    av_trace_end(t, link->dst->filter->name, "filter");
 
     /* unreference the source picture if we're feeding the destination filter
      * a copied version dues to permission issues */
@@ -605,6 +612,7 @@ void avfilter_draw_slice(AVFilterLink *link, int y, int h, int slice_dir)
     uint8_t *src[4], *dst[4];
     int i, j, vsub;
     void (*draw_slice)(AVFilterLink *, int, int, int);
+    uint64_t t;
 
     FF_DPRINTF_START(NULL, draw_slice); ff_dlog_link(NULL, link, 0); av_dlog(NULL, " y:%d h:%d dir:%d\n", y, h, slice_dir);
 
@@ -638,7 +646,9 @@ void avfilter_draw_slice(AVFilterLink *link, int y, int h, int slice_dir)
 
     if (!(draw_slice = link->dstpad->draw_slice))
         draw_slice = avfilter_default_draw_slice;
+    t = av_trace_begin();
     draw_slice(link, y, h, slice_dir);
+    av_trace_end(t, link->dst->filter->name, "filter");
 }
 
 int avfilter_process_command(AVFilterContext *filter, const char *cmd, const char *arg, char *res, int res_len, int flags)
@@ -656,6 +666,7 @@ void avfilter_filter_samples(AVFilterLink *link, AVFilterBufferRef *samplesref)
 {
     void (*filter_samples)(AVFilterLink *, AVFilterBufferRef *);
     AVFilterPad *dst = link->dstpad;
+    uint64_t t;
     int i;
 
     FF_DPRINTF_START(NULL, filter_samples); ff_dlog_link(NULL, link, 1);
@@ -684,7 +695,9 @@ void avfilter_filter_samples(AVFilterLink *link, AVFilterBufferRef *samplesref)
     } else
         link->cur_buf = samplesref;
 
+    t = av_trace_begin();
     filter_samples(link, link->cur_buf);
+    av_trace_end(t, link->dst->filter->name, "filter");
 }
 
 #define MAX_REGISTERED_AVFILTERS_NB 128
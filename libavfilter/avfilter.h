@@ -29,7 +29,7 @@
 #include "libavutil/rational.h"
 
 #define LIBAVFILTER_VERSION_MAJOR  2
-#define LIBAVFILTER_VERSION_MINOR 47
+#define LIBAVFILTER_VERSION_MINOR 50
 #define LIBAVFILTER_VERSION_MICRO  0
 
 #define LIBAVFILTER_VERSION_INT AV_VERSION_INT(LIBAVFILTER_VERSION_MAJOR, \
@@ -606,6 +606,12 @@ struct AVFilterContext {
     void *priv;                     ///< private data for use by the filter
 
     struct AVFilterCommand *command_queue;
+
+    /**
+     * Thread pool of the graph the filter is in, NULL if the filter should
+     * run single-threaded. Set by the graph before the links are configured.
+     */
+    struct AVThreadPool *thread_pool;
 };
 
 enum AVFilterPacking {
@@ -24,6 +24,7 @@
 #include <string.h>
 
 #include "libavutil/audioconvert.h"
+#include "libavutil/pixdesc.h"
 #include "avfilter.h"
 #include "avfiltergraph.h"
 #include "internal.h"
@@ -53,6 +54,7 @@ int avfilter_graph_add_filter(AVFilterGraph *graph, AVFilterContext *filter)
 
     graph->filters = filters;
     graph->filters[graph->filter_count++] = filter;
+    filter->thread_pool = graph->thread_pool;
 
     return 0;
 }
@@ -256,9 +258,145 @@ static void pick_format(AVFilterLink *link)
     }
 }
 
+static int is_scale_filter(AVFilterContext *filter)
+{
+    return !strcmp(filter->filter->name, "scale");
+}
+
+/**
+ * Estimate the cost of converting from src_fmt to dst_fmt, 0 meaning no
+ * conversion and higher values meaning more work or more lost information.
+ */
+static int pix_fmt_conversion_cost(enum PixelFormat src_fmt, enum PixelFormat dst_fmt)
+{
+    const AVPixFmtDescriptor *src = &av_pix_fmt_descriptors[src_fmt];
+    const AVPixFmtDescriptor *dst = &av_pix_fmt_descriptors[dst_fmt];
+    int cost = 1;
+
+    if (src_fmt == dst_fmt)
+        return 0;
+
+    if (dst->nb_components < src->nb_components)
+        cost += 4 * (src->nb_components - dst->nb_components);
+    if (dst->log2_chroma_w > src->log2_chroma_w)
+        cost += 4;
+    if (dst->log2_chroma_h > src->log2_chroma_h)
+        cost += 4;
+    if (dst->comp[0].depth_minus1 < src->comp[0].depth_minus1)
+        cost += 4;
+    else if (dst->comp[0].depth_minus1 > src->comp[0].depth_minus1)
+        cost += 1;
+
+    return cost;
+}
+
+/**
+ * Return the cost of using fmt for all the links sharing the format list
+ * formats, summed over the scale filters at the edges of those links.
+ * known is set to 0 if the format on the other side of one of those scale
+ * filters is not picked yet.
+ */
+static int formats_cost(AVFilterGraph *graph, AVFilterFormats *formats,
+                        enum PixelFormat fmt, int *known)
+{
+    int i, j, cost = 0;
+
+    *known = 1;
+    for (i = 0; i < graph->filter_count; i++) {
+        AVFilterContext *filter = graph->filters[i];
+
+        if (!is_scale_filter(filter))
+            continue;
+        for (j = 0; j < 2; j++) {
+            /* j == 0: the list is on the output link of the scale filter,
+             * j == 1: the list is on its input link */
+            AVFilterLink *link  = j ? filter->inputs[0]  : filter->outputs[0];
+            AVFilterLink *other = j ? filter->outputs[0] : filter->inputs[0];
+
+            if (!link || link->in_formats != formats)
+                continue;
+            if (!other || other->in_formats) {
+                *known = 0;
+                continue;
+            }
+            /* converting upstream counts double: keeping the source format
+             * as long as possible may leave the upstream filter with
+             * nothing to do, and lets the conversion happen after any
+             * downscaling */
+            cost += j ?     pix_fmt_conversion_cost(fmt, other->format)
+                      : 2 * pix_fmt_conversion_cost(other->format, fmt);
+        }
+    }
+
+    return cost;
+}
+
+/**
+ * Pick the format of all the video links sharing the format list of link,
+ * minimizing the conversions done by the scale filters around them.
+ */
+static void pick_video_format(AVFilterGraph *graph, AVFilterLink *link)
+{
+    AVFilterFormats *formats = link->in_formats;
+    int i, j, known, best = 0, best_cost = INT_MAX;
+
+    for (i = 0; i < formats->format_count && best_cost; i++) {
+        int cost = formats_cost(graph, formats, formats->formats[i], &known);
+        if (cost < best_cost) {
+            best      = i;
+            best_cost = cost;
+        }
+    }
+    FFSWAP(int64_t, formats->formats[0], formats->formats[best]);
+
+    for (i = 0; i < graph->filter_count; i++) {
+        AVFilterContext *filter = graph->filters[i];
+        for (j = 0; j < filter->input_count; j++)
+            if (filter->inputs[j] && filter->inputs[j]->in_formats == formats)
+                pick_format(filter->inputs[j]);
+    }
+}
+
+static int video_format_known(AVFilterGraph *graph, AVFilterLink *link)
+{
+    int known;
+
+    if (link->in_formats->format_count == 1)
+        return 1;
+    formats_cost(graph, link->in_formats, link->in_formats->formats[0], &known);
+    return known;
+}
+
 static void pick_formats(AVFilterGraph *graph)
 {
-    int i, j;
+    int i, j, changed;
+
+    /* Pick the video formats first, starting with the links whose
+     * neighbouring conversions are known, so that the choice can avoid
+     * needless conversions. */
+    do {
+        AVFilterLink *fallback = NULL;
+
+        changed = 0;
+        for (i = 0; i < graph->filter_count; i++) {
+            AVFilterContext *filter = graph->filters[i];
+
+            for (j = 0; j < filter->input_count; j++) {
+                AVFilterLink *link = filter->inputs[j];
+                if (!link || !link->in_formats || link->type != AVMEDIA_TYPE_VIDEO)
+                    continue;
+                if (video_format_known(graph, link)) {
+                    pick_video_format(graph, link);
+                    changed = 1;
+                } else if (!fallback)
+                    fallback = link;
+            }
+        }
+        if (!changed && fallback) {
+            pick_video_format(graph, fallback);
+            changed = 1;
+        }
+    } while (changed);
 
     for (i = 0; i < graph->filter_count; i++) {
         AVFilterContext *filter = graph->filters[i];
@@ -270,6 +408,25 @@ static void pick_formats(AVFilterGraph *graph)
     }
 }
 
+static void dump_formats(AVFilterGraph *graph, AVClass *log_ctx)
+{
+    int i, j;
+
+    for (i = 0; i < graph->filter_count; i++) {
+        AVFilterContext *filter = graph->filters[i];
+
+        for (j = 0; j < filter->input_count; j++) {
+            AVFilterLink *link = filter->inputs[j];
+            if (link->type != AVMEDIA_TYPE_VIDEO)
+                continue;
+            av_log(log_ctx, AV_LOG_DEBUG, "link '%s' -> '%s': %s\n",
+                   link->src->name ? link->src->name : link->src->filter->name,
+                   filter->name ? filter->name : filter->filter->name,
+                   av_pix_fmt_descriptors[link->format].name);
+        }
+    }
+}
+
 int ff_avfilter_graph_config_formats(AVFilterGraph *graph, AVClass *log_ctx)
 {
     int ret;
@@ -279,16 +436,20 @@ int ff_avfilter_graph_config_formats(AVFilterGraph *graph, AVClass *log_ctx)
         return ret;
 
     /* Once everything is merged, it's possible that we'll still have
-     * multiple valid media format choices. We pick the first one. */
+     * multiple valid media format choices. We pick the ones needing the
+     * least conversions, or the first one. */
     pick_formats(graph);
+    dump_formats(graph, log_ctx);
 
     return 0;
 }
 
 int avfilter_graph_config(AVFilterGraph *graphctx, void *log_ctx)
 {
-    int ret;
+    int i, ret;
 
+    for (i = 0; i < graphctx->filter_count; i++)
+        graphctx->filters[i]->thread_pool = graphctx->thread_pool;
     if ((ret = ff_avfilter_graph_check_validity(graphctx, log_ctx)))
         return ret;
     if ((ret = ff_avfilter_graph_config_formats(graphctx, log_ctx)))
@@ -29,6 +29,14 @@ typedef struct AVFilterGraph {
     AVFilterContext **filters;
 
     char *scale_sws_opts; ///< sws options to use for the auto-inserted scale filters
+
+    /**
+     * Thread pool the filters of the graph may run their jobs on, see
+     * libavutil/threadpool.h; filters do not create threads of their own.
+     * Set by the user before avfilter_graph_config(), may be NULL. The
+     * pool must outlive the graph.
+     */
+    struct AVThreadPool *thread_pool;
 } AVFilterGraph;
 
 /**
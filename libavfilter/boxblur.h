@@ -0,0 +1,37 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with FFmpeg; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef AVFILTER_BOXBLUR_H
+#define AVFILTER_BOXBLUR_H
+
+#include <stdint.h>
+
+/**
+ * Advance w running column sums by one row and store the blurred row.
+ *
+ * sum[x] += add[x] - sub[x]; dst[x] = (sum[x] * inv + (1<<15)) >> 16
+ *
+ * The sums must fit in 16 bits, i.e. the blur length must be at most 257.
+ */
+void ff_boxblur_blur_row_c(uint8_t *dst, const uint8_t *add, const uint8_t *sub,
+                           uint16_t *sum, int w, int inv);
+
+void ff_boxblur_blur_row_sse2(uint8_t *dst, const uint8_t *add, const uint8_t *sub,
+                              uint16_t *sum, int w, int inv);
+
+#endif /* AVFILTER_BOXBLUR_H */
@@ -0,0 +1,34 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef AVFILTER_DRAWTEXT_H
+#define AVFILTER_DRAWTEXT_H
+
+#include <stdint.h>
+
+/**
+ * Blend color onto the w pixels of dst, weighting the color of each
+ * pixel by alpha times the corresponding mask value. Pixels with a
+ * zero mask value are left untouched.
+ */
+void ff_drawtext_blend_row_c   (uint8_t *dst, const uint8_t *mask, int w,
+                                int color, int alpha);
+void ff_drawtext_blend_row_sse2(uint8_t *dst, const uint8_t *mask, int w,
+                                int color, int alpha);
+
+#endif /* AVFILTER_DRAWTEXT_H */
@@ -0,0 +1,49 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef AVFILTER_OVERLAY_H
+#define AVFILTER_OVERLAY_H
+
+#include <stdint.h>
+
+/**
+ * Blend w pixels of src onto dst, with one alpha value per pixel.
+ */
+void ff_overlay_blend_row_c   (uint8_t *dst, const uint8_t *src, const uint8_t *alpha,
+                               int alpha_linesize, int w);
+void ff_overlay_blend_row_sse2(uint8_t *dst, const uint8_t *src, const uint8_t *alpha,
+                               int alpha_linesize, int w);
+
+/**
+ * Blend w chroma pixels of src onto dst, the alpha of each being the
+ * average of the 2x2 block of alpha samples it covers.
+ */
+void ff_overlay_blend_row_420_c   (uint8_t *dst, const uint8_t *src, const uint8_t *alpha,
+                                   int alpha_linesize, int w);
+void ff_overlay_blend_row_420_sse2(uint8_t *dst, const uint8_t *src, const uint8_t *alpha,
+                                   int alpha_linesize, int w);
+
+/**
+ * Blend w pixels of packed 32-bit src onto dst with alpha compositing,
+ * both pictures having the same component order with alpha in byte
+ * alpha_pos of each pixel.
+ */
+void ff_overlay_blend_rgba_row_c   (uint8_t *dst, const uint8_t *src, int w, int alpha_pos);
+void ff_overlay_blend_rgba_row_sse2(uint8_t *dst, const uint8_t *src, int w, int alpha_pos);
+
+#endif /* AVFILTER_OVERLAY_H */
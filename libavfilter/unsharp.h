@@ -0,0 +1,38 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef AVFILTER_UNSHARP_H
+#define AVFILTER_UNSHARP_H
+
+#include <stdint.h>
+
+/**
+ * One horizontal stage of the unsharp state machine over a padded row:
+ * dst[0] = src[0], dst[x] = src[x] + src[x - 1].
+ */
+void ff_unsharp_hstage_c   (uint32_t *dst, const uint32_t *src, int len);
+void ff_unsharp_hstage_sse2(uint32_t *dst, const uint32_t *src, int len);
+
+/**
+ * One vertical stage of the unsharp state machine over a padded row:
+ * row[x] += state[x], state[x] = the previous value of row[x].
+ */
+void ff_unsharp_vstage_c   (uint32_t *row, uint32_t *state, int len);
+void ff_unsharp_vstage_sse2(uint32_t *row, uint32_t *state, int len);
+
+#endif /* AVFILTER_UNSHARP_H */
@@ -26,9 +26,12 @@
  */
 
 #include "libavutil/avstring.h"
+#include "libavutil/cpu.h"
 #include "libavutil/eval.h"
 #include "libavutil/pixdesc.h"
+#include "libavutil/threadpool.h"
 #include "avfilter.h"
+#include "boxblur.h"
 
 static const char * const var_names[] = {
     "w",
@@ -55,6 +58,18 @@ typedef struct {
     int power;
 } FilterParam;
 
+/* vblur() works on bands of columns so the temporary buffers stay in cache */
+#define BLUR_BLOCK_WIDTH  256
+/* hblur() transposes blocks of rows this high */
+#define BLUR_BLOCK_HEIGHT  16
+
+/** Buffers of one thread. */
+typedef struct {
+    uint8_t *temp[2]; ///< temporary buffers used in hblur() and vblur()
+    int      sum  [BLUR_BLOCK_WIDTH]; ///< per-column running sums used in blur_rows()
+    uint16_t sum16[BLUR_BLOCK_WIDTH]; ///< same as sum, for blur lengths up to 257
+} BlurBuffers;
+
 typedef struct {
     FilterParam luma_param;
     FilterParam chroma_param;
@@ -66,7 +81,11 @@ typedef struct {
     int hsub, vsub;
     int radius[4];
     int power[4];
-    uint8_t *temp[2]; ///< temporary buffer used in blur_power()
+    BlurBuffers *buffers;     ///< one set per thread that may run a job
+    int nb_buffers;
+
+    void (*blur_row)(uint8_t *dst, const uint8_t *add, const uint8_t *sub,
+                     uint16_t *sum, int w, int inv);
 } BoxBlurContext;
 
 #define Y 0
@@ -77,6 +96,7 @@ typedef struct {
 static av_cold int init(AVFilterContext *ctx, const char *args, void *opaque)
 {
     BoxBlurContext *boxblur = ctx->priv;
+    av_unused int cpu_flags = av_get_cpu_flags();
     int e;
 
     if (!args) {
@@ -107,15 +127,28 @@ static av_cold int init(AVFilterContext *ctx, const char *args, void *opaque)
                    sizeof(boxblur->alpha_radius_expr));
     }
 
+    boxblur->blur_row = ff_boxblur_blur_row_c;
+    if (HAVE_SSE && cpu_flags & AV_CPU_FLAG_SSE2)
+        boxblur->blur_row = ff_boxblur_blur_row_sse2;
+
     return 0;
 }
 
-static av_cold void uninit(AVFilterContext *ctx)
+static void free_buffers(BoxBlurContext *boxblur)
 {
-    BoxBlurContext *boxblur = ctx->priv;
+    int i;
 
-    av_freep(&boxblur->temp[0]);
-    av_freep(&boxblur->temp[1]);
+    for (i = 0; i < boxblur->nb_buffers; i++) {
+        av_freep(&boxblur->buffers[i].temp[0]);
+        av_freep(&boxblur->buffers[i].temp[1]);
+    }
+    av_freep(&boxblur->buffers);
+    boxblur->nb_buffers = 0;
+}
+
+static av_cold void uninit(AVFilterContext *ctx)
+{
+    free_buffers(ctx->priv);
 }
 
 static int query_formats(AVFilterContext *ctx)
@@ -142,11 +175,19 @@ static int config_input(AVFilterLink *inlink)
     int cw, ch;
     double var_values[VARS_NB], res;
     char *expr;
-    int ret;
-
-    if (!(boxblur->temp[0] = av_malloc(FFMAX(w, h))) ||
-        !(boxblur->temp[1] = av_malloc(FFMAX(w, h))))
+    int i, ret;
+
+    /* every thread working on a frame, including the calling one, needs
+     * its own temporary buffers */
+    free_buffers(boxblur);
+    boxblur->nb_buffers = ctx->thread_pool ?
+                          av_threadpool_get_nb_threads(ctx->thread_pool) + 1 : 1;
+    if (!(boxblur->buffers = av_mallocz(boxblur->nb_buffers * sizeof(*boxblur->buffers))))
         return AVERROR(ENOMEM);
+    for (i = 0; i < boxblur->nb_buffers; i++)
+        if (!(boxblur->buffers[i].temp[0] = av_malloc(FFMAX(BLUR_BLOCK_WIDTH * h, BLUR_BLOCK_HEIGHT * w))) ||
+            !(boxblur->buffers[i].temp[1] = av_malloc(FFMAX(BLUR_BLOCK_WIDTH * h, BLUR_BLOCK_HEIGHT * w))))
+            return AVERROR(ENOMEM);
 
     boxblur->hsub = desc->log2_chroma_w;
     boxblur->vsub = desc->log2_chroma_h;
@@ -205,11 +246,29 @@ static int config_input(AVFilterLink *inlink)
     return 0;
 }
 
-static inline void blur(uint8_t *dst, int dst_step, const uint8_t *src, int src_step,
-                        int len, int radius)
+void ff_boxblur_blur_row_c(uint8_t *dst, const uint8_t *add, const uint8_t *sub,
+                           uint16_t *sum, int w, int inv)
+{
+    int x;
+
+    for (x = 0; x < w; x++) {
+        sum[x] += add[x] - sub[x];
+        dst[x] = (sum[x]*inv + (1<<15))>>16;
+    }
+}
+
+/**
+ * Blur each of the w columns of src, h pixels high, into dst.
+ *
+ * The columns are processed side by side, one row at a time, so that
+ * memory is accessed linearly and the rows can be handled with SIMD.
+ */
+static void blur_rows(BoxBlurContext *boxblur, BlurBuffers *buf,
+                      uint8_t *dst, int dst_linesize, const uint8_t *src, int src_linesize,
+                      int w, int h, int radius)
 {
-    /* Naive boxblur would sum source pixels from x-radius .. x+radius
-     * for destination pixel x. That would be O(radius*width).
+    /* Naive boxblur would sum source pixels from y-radius .. y+radius
+     * for destination pixel y. That would be O(radius*height).
      * If you now look at what source pixels represent 2 consecutive
      * output pixels, then you see they are almost identical and only
      * differ by 2 pixels, like:
@@ -222,83 +281,202 @@ static inline void blur(uint8_t *dst, int dst_step, const uint8_t *src, int src_
      * and subtracting 1 input pixel.
      * The following code adopts this faster variant.
      */
-    int x, sum = 0;
     const int length = radius*2 + 1;
     const int inv = ((1<<16) + length/2)/length;
+    /* 255 * 257 is the largest sum fitting in 16 bits */
+    const int narrow = length <= 257;
+    int *sum = buf->sum;
+    uint16_t *sum16 = buf->sum16;
+    int x, y;
+
+#define SRC(y) (src + (y)*src_linesize)
+#define BLUR_ROW(add, sub)                                              \
+    do {                                                                \
+        const uint8_t *a = add, *b = sub;                               \
+        uint8_t *d = dst + y*dst_linesize;                              \
+        if (narrow) {                                                   \
+            boxblur->blur_row(d, a, b, sum16, w, inv);                  \
+        } else {                                                        \
+            for (x = 0; x < w; x++) {                                   \
+                sum[x] += a[x] - b[x];                                  \
+                d[x] = (sum[x]*inv + (1<<15))>>16;                      \
+            }                                                           \
+        }                                                               \
+    } while (0)
 
-    for (x = 0; x < radius; x++)
-        sum += src[x*src_step]<<1;
-    sum += src[radius*src_step];
+    for (x = 0; x < w; x++)
+        sum[x] = SRC(radius)[x];
+    for (y = 0; y < radius; y++)
+        for (x = 0; x < w; x++)
+            sum[x] += SRC(y)[x]<<1;
+    if (narrow)
+        for (x = 0; x < w; x++)
+            sum16[x] = sum[x];
+
+    for (y = 0; y <= radius; y++)
+        BLUR_ROW(SRC(radius+y), SRC(radius-y));
+
+    for (; y < h-radius; y++)
+        BLUR_ROW(SRC(radius+y), SRC(y-radius-1));
+
+    for (; y < h; y++)
+        BLUR_ROW(SRC(2*h-radius-y-1), SRC(y-radius-1));
+#undef BLUR_ROW
+#undef SRC
+}
 
-    for (x = 0; x <= radius; x++) {
-        sum += src[(radius+x)*src_step] - src[(radius-x)*src_step];
-        dst[x*dst_step] = (sum*inv + (1<<15))>>16;
-    }
+/**
+ * Apply blur_rows() power times, bouncing between the temporary buffers
+ * (whose linesize is temp_linesize).
+ *
+ * @return the buffer holding the result, which is dst when dst_linesize
+ *         is not 0, and one of the temporary buffers otherwise
+ */
+static uint8_t *blur_rows_power(BoxBlurContext *boxblur, BlurBuffers *buf,
+                                uint8_t *dst, int dst_linesize,
+                                const uint8_t *src, int src_linesize,
+                                int w, int h, int radius, int power, int temp_linesize)
+{
+    int i;
 
-    for (; x < len-radius; x++) {
-        sum += src[(radius+x)*src_step] - src[(x-radius-1)*src_step];
-        dst[x*dst_step] = (sum*inv + (1<<15))>>16;
-    }
+    for (i = 0; i < power; i++) {
+        int last = i == power-1 && dst_linesize;
+        uint8_t *out = last ? dst          : buf->temp[i&1];
+        int out_linesize = last ? dst_linesize : temp_linesize;
 
-    for (; x < len; x++) {
-        sum += src[(2*len-radius-x-1)*src_step] - src[(x-radius-1)*src_step];
-        dst[x*dst_step] = (sum*inv + (1<<15))>>16;
+        blur_rows(boxblur, buf, out, out_linesize, src, src_linesize, w, h, radius);
+        src = out;
+        src_linesize = out_linesize;
     }
+    return (uint8_t *)(intptr_t)src;
 }
 
-static inline void blur_power(uint8_t *dst, int dst_step, const uint8_t *src, int src_step,
-                              int len, int radius, int power, uint8_t *temp[2])
+static void hblur(BoxBlurContext *boxblur, BlurBuffers *buf,
+                  uint8_t *dst, int dst_linesize, const uint8_t *src, int src_linesize,
+                  int w, int h, int radius, int power)
 {
-    uint8_t *a = temp[0], *b = temp[1];
-
-    if (radius && power) {
-        blur(a, 1, src, src_step, len, radius);
-        for (; power > 2; power--) {
-            uint8_t *c;
-            blur(b, 1, a, 1, len, radius);
-            c = a; a = b; b = c;
-        }
-        if (power > 1) {
-            blur(dst, dst_step, a, 1, len, radius);
-        } else {
-            int i;
-            for (i = 0; i < len; i++)
-                dst[i*dst_step] = a[i];
+    int x, y, r;
+
+    if ((radius == 0 || power == 0) && dst == src)
+        return;
+
+    for (y = 0; y < h; y += BLUR_BLOCK_HEIGHT) {
+        const uint8_t *s = src + y*src_linesize;
+        uint8_t       *d = dst + y*dst_linesize;
+        int bh = FFMIN(BLUR_BLOCK_HEIGHT, h - y);
+        uint8_t *res;
+
+        if (!radius || !power) {
+            for (r = 0; r < bh; r++)
+                memcpy(d + r*dst_linesize, s + r*src_linesize, w);
+            continue;
         }
-    } else {
-        int i;
-        for (i = 0; i < len; i++)
-            dst[i*dst_step] = src[i*src_step];
+
+        /* transpose the block so that each image row becomes a column */
+        for (x = 0; x < w; x++)
+            for (r = 0; r < bh; r++)
+                buf->temp[1][x*BLUR_BLOCK_HEIGHT + r] = s[r*src_linesize + x];
+
+        res = blur_rows_power(boxblur, buf, NULL, 0, buf->temp[1], BLUR_BLOCK_HEIGHT,
+                              bh, w, radius, power, BLUR_BLOCK_HEIGHT);
+
+        for (r = 0; r < bh; r++)
+            for (x = 0; x < w; x++)
+                d[r*dst_linesize + x] = res[x*BLUR_BLOCK_HEIGHT + r];
     }
 }
 
-static void hblur(uint8_t *dst, int dst_linesize, const uint8_t *src, int src_linesize,
-                  int w, int h, int radius, int power, uint8_t *temp[2])
+static void vblur(BoxBlurContext *boxblur, BlurBuffers *buf,
+                  uint8_t *dst, int dst_linesize, const uint8_t *src, int src_linesize,
+                  int w, int h, int radius, int power)
 {
-    int y;
+    int x, y;
 
-    if (radius == 0 && dst == src)
+    if ((radius == 0 || power == 0) && dst == src)
         return;
 
-    for (y = 0; y < h; y++)
-        blur_power(dst + y*dst_linesize, 1, src + y*src_linesize, 1,
-                   w, radius, power, temp);
+    for (x = 0; x < w; x += BLUR_BLOCK_WIDTH) {
+        const uint8_t *in = src + x;
+        int in_linesize = src_linesize;
+        int bw = FFMIN(BLUR_BLOCK_WIDTH, w - x);
+
+        if (radius && power) {
+            /* blur_rows() cannot work in place: when dst and src are the
+             * same, the last pass must go to a temporary buffer too */
+            in = blur_rows_power(boxblur, buf, dst + x, dst == src && power == 1 ? 0 : dst_linesize,
+                                 in, in_linesize, bw, h, radius, power, BLUR_BLOCK_WIDTH);
+            if (in == dst + x)
+                continue;
+            in_linesize = BLUR_BLOCK_WIDTH;
+        }
+
+        for (y = 0; y < h; y++)
+            memcpy(dst + x + y*dst_linesize, in + y*in_linesize, bw);
+    }
 }
 
-static void vblur(uint8_t *dst, int dst_linesize, const uint8_t *src, int src_linesize,
-                  int w, int h, int radius, int power, uint8_t *temp[2])
+static void null_draw_slice(AVFilterLink *inlink, int y, int h, int slice_dir) { }
+
+typedef struct {
+    AVFilterBufferRef *in, *out;
+    int w[4], h[4];
+    int first_job[5]; ///< first job of each plane, and the total job count
+} ThreadData;
+
+static int job_plane(ThreadData *td, int jobnr)
 {
-    int x;
+    int plane = 0;
 
-    if (radius == 0 && dst == src)
-        return;
+    while (jobnr >= td->first_job[plane + 1])
+        plane++;
+    return plane;
+}
 
-    for (x = 0; x < w; x++)
-        blur_power(dst + x, dst_linesize, src + x, src_linesize,
-                   h, radius, power, temp);
+/** Horizontal pass over one block of BLUR_BLOCK_HEIGHT rows of a plane. */
+static int hblur_job(void *ctx, void *arg, int jobnr, int threadnr)
+{
+    BoxBlurContext *boxblur = ctx;
+    ThreadData *td = arg;
+    int plane = job_plane(td, jobnr);
+    int y = (jobnr - td->first_job[plane]) * BLUR_BLOCK_HEIGHT;
+
+    hblur(boxblur, &boxblur->buffers[threadnr],
+          td->out->data[plane] + y * td->out->linesize[plane], td->out->linesize[plane],
+          td->in ->data[plane] + y * td->in ->linesize[plane], td->in ->linesize[plane],
+          td->w[plane], FFMIN(BLUR_BLOCK_HEIGHT, td->h[plane] - y),
+          boxblur->radius[plane], boxblur->power[plane]);
+    return 0;
 }
 
-static void null_draw_slice(AVFilterLink *inlink, int y, int h, int slice_dir) { }
+/** Vertical pass, in place, over one band of BLUR_BLOCK_WIDTH columns of a plane. */
+static int vblur_job(void *ctx, void *arg, int jobnr, int threadnr)
+{
+    BoxBlurContext *boxblur = ctx;
+    ThreadData *td = arg;
+    int plane = job_plane(td, jobnr);
+    int x = (jobnr - td->first_job[plane]) * BLUR_BLOCK_WIDTH;
+    uint8_t *data = td->out->data[plane] + x;
+
+    vblur(boxblur, &boxblur->buffers[threadnr],
+          data, td->out->linesize[plane], data, td->out->linesize[plane],
+          FFMIN(BLUR_BLOCK_WIDTH, td->w[plane] - x), td->h[plane],
+          boxblur->radius[plane], boxblur->power[plane]);
+    return 0;
+}
+
+static void run_jobs(AVFilterContext *ctx, AVThreadPoolFunc *func, ThreadData *td, int nb_jobs)
+{
+    BoxBlurContext *boxblur = ctx->priv;
+    int i;
+
+    if (ctx->thread_pool) {
+        av_threadpool_execute(ctx->thread_pool, func, boxblur, td, NULL,
+                              nb_jobs, boxblur->nb_buffers);
+    } else {
+        for (i = 0; i < nb_jobs; i++)
+            func(boxblur, td, i, 0);
+    }
+}
 
 static void end_frame(AVFilterLink *inlink)
 {
@@ -307,22 +485,27 @@ static void end_frame(AVFilterLink *inlink)
     AVFilterLink *outlink = inlink->dst->outputs[0];
     AVFilterBufferRef *inpicref  = inlink ->cur_buf;
     AVFilterBufferRef *outpicref = outlink->out_buf;
-    int plane;
+    int plane, nb_planes;
     int cw = inlink->w >> boxblur->hsub, ch = inlink->h >> boxblur->vsub;
-    int w[4] = { inlink->w, cw, cw, inlink->w };
-    int h[4] = { inlink->h, ch, ch, inlink->h };
-
-    for (plane = 0; inpicref->data[plane] && plane < 4; plane++)
-        hblur(outpicref->data[plane], outpicref->linesize[plane],
-              inpicref ->data[plane], inpicref ->linesize[plane],
-              w[plane], h[plane], boxblur->radius[plane], boxblur->power[plane],
-              boxblur->temp);
-
-    for (plane = 0; inpicref->data[plane] && plane < 4; plane++)
-        vblur(outpicref->data[plane], outpicref->linesize[plane],
-              outpicref->data[plane], outpicref->linesize[plane],
-              w[plane], h[plane], boxblur->radius[plane], boxblur->power[plane],
-              boxblur->temp);
+    ThreadData td = {
+        .in  = inpicref, .out = outpicref,
+        .w   = { inlink->w, cw, cw, inlink->w },
+        .h   = { inlink->h, ch, ch, inlink->h },
+    };
+
+    for (nb_planes = 0; nb_planes < 4 && inpicref->data[nb_planes]; nb_planes++);
+
+    /* The row blocks of hblur() and the column bands of vblur() do not
+     * depend on each other, so each pass runs them as concurrent jobs. */
+    for (plane = 0; plane < nb_planes; plane++)
+        td.first_job[plane + 1] = td.first_job[plane] +
+                                  (td.h[plane] + BLUR_BLOCK_HEIGHT - 1) / BLUR_BLOCK_HEIGHT;
+    run_jobs(ctx, hblur_job, &td, td.first_job[nb_planes]);
+
+    for (plane = 0; plane < nb_planes; plane++)
+        td.first_job[plane + 1] = td.first_job[plane] +
+                                  (td.w[plane] + BLUR_BLOCK_WIDTH - 1) / BLUR_BLOCK_WIDTH;
+    run_jobs(ctx, vblur_job, &td, td.first_job[nb_planes]);
 
     avfilter_draw_slice(outlink, 0, inlink->h, 1);
     avfilter_end_frame(outlink);
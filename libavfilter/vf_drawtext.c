@@ -30,6 +30,7 @@
 #include <time.h>
 
 #include "libavutil/colorspace.h"
+#include "libavutil/cpu.h"
 #include "libavutil/eval.h"
 #include "libavutil/file.h"
 #include "libavutil/opt.h"
@@ -38,6 +39,7 @@
 #include "libavutil/tree.h"
 #include "avfilter.h"
 #include "drawutils.h"
+#include "drawtext.h"
 
 #undef time
 
@@ -95,6 +97,8 @@ typedef struct {
     uint8_t *text;                  ///< text to be drawn
     uint8_t *expanded_text;         ///< used to contain the strftime()-expanded text
     size_t   expanded_text_size;    ///< size in bytes of the expanded_text buffer
+    uint8_t *laid_out_text;         ///< expanded text the positions were computed for
+    int text_w, text_h;             ///< size of the laid out text
     int ft_load_flags;              ///< flags used for loading fonts, see FT_LOAD_*
     FT_Vector *positions;           ///< positions for each element in the text
     size_t nb_positions;            ///< number of elements of positions array
@@ -130,6 +134,9 @@ typedef struct {
     int pixel_step[4];              ///< distance in bytes between the component of each pixel
     uint8_t rgba_map[4];            ///< map RGBA offsets to the positions in the packed RGBA format
     uint8_t *box_line[4];           ///< line used for filling the box background
+    uint8_t *box_mask;              ///< line of opaque mask values used for blending the box
+    uint8_t *sub_mask;              ///< glyph mask line subsampled for the chroma planes
+    void (*blend_row)(uint8_t *dst, const uint8_t *mask, int w, int color, int alpha);
     int64_t basetime;               ///< base pts time in the real world for display
     double var_values[VAR_VARS_NB];
 } DrawTextContext;
@@ -199,9 +206,9 @@ struct ft_error
 #define FT_ERRMSG(e) ft_errors[e].err_msg
 
 typedef struct {
-    FT_Glyph *glyph;
     uint32_t code;
-    FT_Bitmap bitmap; ///< array holding bitmaps of font
+    uint8_t *bitmap;  ///< glyph coverage, one byte per pixel
+    int bitmap_w, bitmap_h;
     FT_BBox bbox;
     int advance;
     int bitmap_left;
@@ -217,38 +224,61 @@ static int glyph_cmp(void *key, const void *b)
 
 /**
  * Load glyphs corresponding to the UTF-32 codepoint code.
+ *
+ * The rendered bitmap is converted to one coverage byte per pixel, so
+ * that drawing the glyph does not depend on the FreeType pixel mode.
  */
 static int load_glyph(AVFilterContext *ctx, Glyph **glyph_ptr, uint32_t code)
 {
     DrawTextContext *dtext = ctx->priv;
+    FT_GlyphSlot slot;
+    FT_Bitmap *bitmap;
+    FT_Glyph ft_glyph;
     Glyph *glyph;
     struct AVTreeNode *node = NULL;
-    int ret;
+    int ret, r, c;
 
     /* load glyph into dtext->face->glyph */
     if (FT_Load_Char(dtext->face, code, dtext->ft_load_flags))
         return AVERROR(EINVAL);
+    slot   = dtext->face->glyph;
+    bitmap = &slot->bitmap;
+
+    if (bitmap->pixel_mode != FT_PIXEL_MODE_MONO &&
+        bitmap->pixel_mode != FT_PIXEL_MODE_GRAY)
+        return AVERROR(EINVAL);
 
     /* save glyph */
     if (!(glyph = av_mallocz(sizeof(*glyph))) ||
-        !(glyph->glyph = av_mallocz(sizeof(*glyph->glyph)))) {
+        !(glyph->bitmap = av_malloc(FFMAX(bitmap->rows * bitmap->width, 1)))) {
         ret = AVERROR(ENOMEM);
         goto error;
     }
-    glyph->code  = code;
-
-    if (FT_Get_Glyph(dtext->face->glyph, glyph->glyph)) {
-        ret = AVERROR(EINVAL);
-        goto error;
+    glyph->code     = code;
+    glyph->bitmap_w = bitmap->width;
+    glyph->bitmap_h = bitmap->rows;
+
+    for (r = 0; r < bitmap->rows; r++) {
+        const uint8_t *src = bitmap->buffer + r * bitmap->pitch;
+        uint8_t *dst = glyph->bitmap + r * bitmap->width;
+        if (bitmap->pixel_mode == FT_PIXEL_MODE_MONO) {
+            for (c = 0; c < bitmap->width; c++)
+                dst[c] = src[c>>3] & (0x80 >> (c&7)) ? 255 : 0;
+        } else
+            memcpy(dst, src, bitmap->width);
     }
 
-    glyph->bitmap      = dtext->face->glyph->bitmap;
-    glyph->bitmap_left = dtext->face->glyph->bitmap_left;
-    glyph->bitmap_top  = dtext->face->glyph->bitmap_top;
-    glyph->advance     = dtext->face->glyph->advance.x >> 6;
+    glyph->bitmap_left = slot->bitmap_left;
+    glyph->bitmap_top  = slot->bitmap_top;
+    glyph->advance     = slot->advance.x >> 6;
 
     /* measure text height to calculate text_height (or the maximum text height) */
-    FT_Glyph_Get_CBox(*glyph->glyph, ft_glyph_bbox_pixels, &glyph->bbox);
+    if (FT_Get_Glyph(slot, &ft_glyph)) {
+        ret = AVERROR(EINVAL);
+        goto error;
+    }
+    FT_Glyph_Get_CBox(ft_glyph, ft_glyph_bbox_pixels, &glyph->bbox);
+    FT_Done_Glyph(ft_glyph);
 
     /* cache the newly created glyph */
     if (!(node = av_mallocz(av_tree_node_size))) {
@@ -263,7 +293,7 @@ static int load_glyph(AVFilterContext *ctx, Glyph **glyph_ptr, uint32_t code)
 
 error:
     if (glyph)
-        av_freep(&glyph->glyph);
+        av_freep(&glyph->bitmap);
     av_freep(&glyph);
     av_freep(&node);
     return ret;
@@ -274,6 +304,11 @@ static av_cold int init(AVFilterContext *ctx, const char *args, void *opaque)
     int err;
     DrawTextContext *dtext = ctx->priv;
     Glyph *glyph;
+    av_unused int cpu_flags = av_get_cpu_flags();
+
+    dtext->blend_row = ff_drawtext_blend_row_c;
+    if (HAVE_SSE && cpu_flags & AV_CPU_FLAG_SSE2)
+        dtext->blend_row = ff_drawtext_blend_row_sse2;
 
     dtext->class = &drawtext_class;
     av_opt_set_defaults(dtext);
@@ -386,6 +421,9 @@ static int query_formats(AVFilterContext *ctx)
 
 static int glyph_enu_free(void *opaque, void *elem)
 {
+    Glyph *glyph = elem;
+
+    av_free(glyph->bitmap);
     av_free(elem);
     return 0;
 }
@@ -400,6 +438,7 @@ static av_cold void uninit(AVFilterContext *ctx)
 
     av_freep(&dtext->boxcolor_string);
     av_freep(&dtext->expanded_text);
+    av_freep(&dtext->laid_out_text);
     av_freep(&dtext->fontcolor_string);
     av_freep(&dtext->fontfile);
     av_freep(&dtext->shadowcolor_string);
@@ -421,6 +460,8 @@ static av_cold void uninit(AVFilterContext *ctx)
         av_freep(&dtext->box_line[i]);
         dtext->pixel_step[i] = 0;
     }
+    av_freep(&dtext->box_mask);
+    av_freep(&dtext->sub_mask);
 }
 
 static int config_input(AVFilterLink *inlink)
@@ -440,6 +481,11 @@ static int config_input(AVFilterLink *inlink)
                                  &dtext->is_packed_rgb, dtext->rgba_map)) < 0)
         return ret;
 
+    if (!(dtext->box_mask = av_malloc(inlink->w)) ||
+        !(dtext->sub_mask = av_malloc(inlink->w)))
+        return AVERROR(ENOMEM);
+    memset(dtext->box_mask, 255, inlink->w);
+
     if (!dtext->is_packed_rgb) {
         uint8_t *rgba = dtext->fontcolor_rgba;
         dtext->fontcolor[0] = RGB_TO_Y_CCIR(rgba[0], rgba[1], rgba[2]);
@@ -490,46 +536,59 @@ static int command(AVFilterContext *ctx, const char *cmd, const char *arg, char
     return AVERROR(ENOSYS);
 }
 
-#define GET_BITMAP_VAL(r, c)                                            \
-    bitmap->pixel_mode == FT_PIXEL_MODE_MONO ?                          \
-        (bitmap->buffer[(r) * bitmap->pitch + ((c)>>3)] & (0x80 >> ((c)&7))) * 255 : \
-         bitmap->buffer[(r) * bitmap->pitch +  (c)]
-
-#define SET_PIXEL_YUV(picref, yuva_color, val, x, y, hsub, vsub) {           \
-    luma_pos    = ((x)          ) + ((y)          ) * picref->linesize[0]; \
-    alpha = yuva_color[3] * (val) * 129;                               \
-    picref->data[0][luma_pos]    = (alpha * yuva_color[0] + (255*255*129 - alpha) * picref->data[0][luma_pos]   ) >> 23; \
-    if (((x) & ((1<<(hsub)) - 1)) == 0 && ((y) & ((1<<(vsub)) - 1)) == 0) {\
-        chroma_pos1 = ((x) >> (hsub)) + ((y) >> (vsub)) * picref->linesize[1]; \
-        chroma_pos2 = ((x) >> (hsub)) + ((y) >> (vsub)) * picref->linesize[2]; \
-        picref->data[1][chroma_pos1] = (alpha * yuva_color[1] + (255*255*129 - alpha) * picref->data[1][chroma_pos1]) >> 23; \
-        picref->data[2][chroma_pos2] = (alpha * yuva_color[2] + (255*255*129 - alpha) * picref->data[2][chroma_pos2]) >> 23; \
-    }\
-}
-
-static inline int draw_glyph_yuv(AVFilterBufferRef *picref, FT_Bitmap *bitmap,
-                                 int x, int y, int width, int height,
-                                 const uint8_t yuva_color[4], int hsub, int vsub)
+void ff_drawtext_blend_row_c(uint8_t *dst, const uint8_t *mask, int w,
+                             int color, int alpha)
 {
-    int r, c, alpha;
-    unsigned int luma_pos, chroma_pos1, chroma_pos2;
-    uint8_t src_val;
+    int k;
 
-    for (r = 0; r < bitmap->rows && r+y < height; r++) {
-        for (c = 0; c < bitmap->width && c+x < width; c++) {
-            if (c+x < 0 || r+y < 0)
-                continue;
-
-            /* get intensity value in the glyph bitmap (source) */
-            src_val = GET_BITMAP_VAL(r, c);
-            if (!src_val)
-                continue;
-
-            SET_PIXEL_YUV(picref, yuva_color, src_val, c+x, y+r, hsub, vsub);
+    for (k = 0; k < w; k++) {
+        if (mask[k]) {
+            int a = alpha * mask[k] * 129;
+            dst[k] = (a * color + (255*255*129 - a) * dst[k]) >> 23;
         }
     }
+}
 
-    return 0;
+/**
+ * Blend yuva_color on picref through a mask of w x h values placed at
+ * (x, y), clipped to the width x height picture. Chroma samples are
+ * blended with the mask value of the luma sample at their top left.
+ */
+static void blend_mask_yuv(DrawTextContext *dtext, AVFilterBufferRef *picref,
+                           const uint8_t *mask, int mask_linesize,
+                           int x, int y, int w, int h, int width, int height,
+                           const uint8_t yuva_color[4])
+{
+    const int hsub = dtext->hsub, vsub = dtext->vsub;
+    const int hmask = (1 << hsub) - 1, vmask = (1 << vsub) - 1;
+    int r, c, c0 = FFMAX(0, -x), c1 = FFMIN(w, width - x);
+    /* first column falling on a chroma sample */
+    int cs = c0 + (-(x + c0) & hmask);
+
+    if (c0 >= c1)
+        return;
+
+    for (r = FFMAX(0, -y); r < h && r+y < height; r++) {
+        const uint8_t *m = mask + r * mask_linesize;
+
+        dtext->blend_row(picref->data[0] + (y+r) * picref->linesize[0] + x + c0,
+                         m + c0, c1 - c0, yuva_color[0], yuva_color[3]);
+
+        if (!((y+r) & vmask) && cs < c1) {
+            const uint8_t *sm = m + cs;
+            int n = c1 - cs;
+
+            if (hsub) {
+                for (c = cs, n = 0; c < c1; c += 1 << hsub)
+                    dtext->sub_mask[n++] = m[c];
+                sm = dtext->sub_mask;
+            }
+            dtext->blend_row(picref->data[1] + ((y+r) >> vsub) * picref->linesize[1] + ((x+cs) >> hsub),
+                             sm, n, yuva_color[1], yuva_color[3]);
+            dtext->blend_row(picref->data[2] + ((y+r) >> vsub) * picref->linesize[2] + ((x+cs) >> hsub),
+                             sm, n, yuva_color[2], yuva_color[3]);
+        }
+    }
 }
 
 #define SET_PIXEL_RGB(picref, rgba_color, val, x, y, pixel_step, r_off, g_off, b_off, a_off) { \
@@ -540,7 +599,7 @@ static inline int draw_glyph_yuv(AVFilterBufferRef *picref, FT_Bitmap *bitmap,
     *(p+b_off) = (alpha * rgba_color[2] + (255*255*129 - alpha) * *(p+b_off)) >> 23; \
 }
 
-static inline int draw_glyph_rgb(AVFilterBufferRef *picref, FT_Bitmap *bitmap,
+static inline int draw_glyph_rgb(AVFilterBufferRef *picref, const Glyph *glyph,
                                  int x, int y, int width, int height, int pixel_step,
                                  const uint8_t rgba_color[4], const uint8_t rgba_map[4])
 {
@@ -548,12 +607,12 @@ static inline int draw_glyph_rgb(AVFilterBufferRef *picref, FT_Bitmap *bitmap,
     uint8_t *p;
     uint8_t src_val;
 
-    for (r = 0; r < bitmap->rows && r+y < height; r++) {
-        for (c = 0; c < bitmap->width && c+x < width; c++) {
+    for (r = 0; r < glyph->bitmap_h && r+y < height; r++) {
+        for (c = 0; c < glyph->bitmap_w && c+x < width; c++) {
             if (c+x < 0 || r+y < 0)
                 continue;
             /* get intensity value in the glyph bitmap (source) */
-            src_val = GET_BITMAP_VAL(r, c);
+            src_val = glyph->bitmap[r * glyph->bitmap_w + c];
             if (!src_val)
                 continue;
 
@@ -565,29 +624,27 @@ static inline int draw_glyph_rgb(AVFilterBufferRef *picref, FT_Bitmap *bitmap,
     return 0;
 }
 
-static inline void drawbox(AVFilterBufferRef *picref, int x, int y,
-                           int width, int height,
-                           uint8_t *line[4], int pixel_step[4], uint8_t color[4],
-                           int hsub, int vsub, int is_rgba_packed, uint8_t rgba_map[4])
+static inline void drawbox(DrawTextContext *dtext, AVFilterBufferRef *picref,
+                           int x, int y, int width, int height,
+                           int pic_width, int pic_height, uint8_t color[4])
 {
     int i, j, alpha;
 
     if (color[3] != 0xFF) {
-        if (is_rgba_packed) {
+        if (dtext->is_packed_rgb) {
+            const uint8_t *rgba_map = dtext->rgba_map;
             uint8_t *p;
             for (j = 0; j < height; j++)
                 for (i = 0; i < width; i++)
-                    SET_PIXEL_RGB(picref, color, 255, i+x, y+j, pixel_step[0],
+                    SET_PIXEL_RGB(picref, color, 255, i+x, y+j, dtext->pixel_step[0],
                                   rgba_map[0], rgba_map[1], rgba_map[2], rgba_map[3]);
         } else {
-            unsigned int luma_pos, chroma_pos1, chroma_pos2;
-            for (j = 0; j < height; j++)
-                for (i = 0; i < width; i++)
-                    SET_PIXEL_YUV(picref, color, 255, i+x, y+j, hsub, vsub);
+            blend_mask_yuv(dtext, picref, dtext->box_mask, 0,
+                           x, y, width, height, pic_width, pic_height, color);
         }
     } else {
         ff_draw_rectangle(picref->data, picref->linesize,
-                          line, pixel_step, hsub, vsub,
+                          dtext->box_line, dtext->pixel_step, dtext->hsub, dtext->vsub,
                           x, y, width, height);
     }
 }
@@ -617,36 +674,34 @@ static int draw_glyphs(DrawTextContext *dtext, AVFilterBufferRef *picref,
         dummy.code = code;
         glyph = av_tree_find(dtext->glyphs, &dummy, (void *)glyph_cmp, NULL);
 
-        if (glyph->bitmap.pixel_mode != FT_PIXEL_MODE_MONO &&
-            glyph->bitmap.pixel_mode != FT_PIXEL_MODE_GRAY)
-            return AVERROR(EINVAL);
-
         x1 = dtext->positions[i].x+dtext->x+x;
         y1 = dtext->positions[i].y+dtext->y+y;
 
         if (dtext->is_packed_rgb) {
-            draw_glyph_rgb(picref, &glyph->bitmap,
+            draw_glyph_rgb(picref, glyph,
                            x1, y1, width, height,
                            dtext->pixel_step[0], rgbcolor, dtext->rgba_map);
         } else {
-            draw_glyph_yuv(picref, &glyph->bitmap,
-                           x1, y1, width, height,
-                           yuvcolor, dtext->hsub, dtext->vsub);
+            blend_mask_yuv(dtext, picref, glyph->bitmap, glyph->bitmap_w,
+                           x1, y1, glyph->bitmap_w, glyph->bitmap_h,
+                           width, height, yuvcolor);
         }
     }
 
     return 0;
 }
 
-static int draw_text(AVFilterContext *ctx, AVFilterBufferRef *picref,
-                     int width, int height)
+/**
+ * Load the glyphs of the expanded text, compute their positions and
+ * set the variables depending on the text size.
+ */
+static int layout_text(AVFilterContext *ctx)
 {
     DrawTextContext *dtext = ctx->priv;
     uint32_t code = 0, prev_code = 0;
-    int x = 0, y = 0, i = 0, ret;
+    int x = 0, y = 0, i = 0;
     int max_text_line_w = 0, len;
-    int box_w, box_h;
-    char *text = dtext->text;
+    char *text = dtext->expanded_text;
     uint8_t *p;
     int y_min = 32000, y_max = -32000;
     int x_min = 32000, x_max = -32000;
@@ -654,37 +709,6 @@ static int draw_text(AVFilterContext *ctx, AVFilterBufferRef *picref,
     Glyph *glyph = NULL, *prev_glyph = NULL;
     Glyph dummy = { 0 };
 
-    time_t now = time(0);
-    struct tm ltime;
-    uint8_t *buf = dtext->expanded_text;
-    int buf_size = dtext->expanded_text_size;
-
-    if(dtext->basetime != AV_NOPTS_VALUE)
-        now= picref->pts*av_q2d(ctx->inputs[0]->time_base) + dtext->basetime/1000000;
-
-    if (!buf) {
-        buf_size = 2*strlen(dtext->text)+1;
-        buf = av_malloc(buf_size);
-    }
-
-#if HAVE_LOCALTIME_R
-    localtime_r(&now, &ltime);
-#else
-    if(strchr(dtext->text, '%'))
-        ltime= *localtime(&now);
-#endif
-
-    do {
-        *buf = 1;
-        if (strftime(buf, buf_size, dtext->text, &ltime) != 0 || *buf == 0)
-            break;
-        buf_size *= 2;
-    } while ((buf = av_realloc(buf, buf_size)));
-
-    if (!buf)
-        return AVERROR(ENOMEM);
-    text = dtext->expanded_text = buf;
-    dtext->expanded_text_size = buf_size;
     if ((len = strlen(text)) > dtext->nb_positions) {
         if (!(dtext->positions =
               av_realloc(dtext->positions, len*sizeof(*dtext->positions))))
@@ -692,9 +716,6 @@ static int draw_text(AVFilterContext *ctx, AVFilterBufferRef *picref,
         dtext->nb_positions = len;
     }
 
-    x = 0;
-    y = 0;
-
     /* load and cache glyphs */
     for (i = 0, p = text; *p; i++) {
         GET_UTF8(code, *p++, continue;);
@@ -750,9 +771,11 @@ static int draw_text(AVFilterContext *ctx, AVFilterBufferRef *picref,
     }
 
     max_text_line_w = FFMAX(x, max_text_line_w);
+    dtext->text_w = max_text_line_w;
+    dtext->text_h = y + dtext->max_glyph_h;
 
-    dtext->var_values[VAR_TW] = dtext->var_values[VAR_TEXT_W] = max_text_line_w;
-    dtext->var_values[VAR_TH] = dtext->var_values[VAR_TEXT_H] = y + dtext->max_glyph_h;
+    dtext->var_values[VAR_TW] = dtext->var_values[VAR_TEXT_W] = dtext->text_w;
+    dtext->var_values[VAR_TH] = dtext->var_values[VAR_TEXT_H] = dtext->text_h;
 
     dtext->var_values[VAR_MAX_GLYPH_W] = dtext->max_glyph_w;
     dtext->var_values[VAR_MAX_GLYPH_H] = dtext->max_glyph_h;
@@ -761,6 +784,59 @@ static int draw_text(AVFilterContext *ctx, AVFilterBufferRef *picref,
 
     dtext->var_values[VAR_LINE_H] = dtext->var_values[VAR_LH] = dtext->max_glyph_h;
 
+    av_free(dtext->laid_out_text);
+    if (!(dtext->laid_out_text = av_strdup(text)))
+        return AVERROR(ENOMEM);
+
+    return 0;
+}
+
+static int draw_text(AVFilterContext *ctx, AVFilterBufferRef *picref,
+                     int width, int height)
+{
+    DrawTextContext *dtext = ctx->priv;
+    int box_w, box_h, ret;
+
+    /* text without conversion specifications only needs to be expanded once */
+    if (!dtext->expanded_text || strchr(dtext->text, '%')) {
+        time_t now = time(0);
+        struct tm ltime;
+        uint8_t *buf = dtext->expanded_text;
+        int buf_size = dtext->expanded_text_size;
+
+        if(dtext->basetime != AV_NOPTS_VALUE)
+            now= picref->pts*av_q2d(ctx->inputs[0]->time_base) + dtext->basetime/1000000;
+
+        if (!buf) {
+            buf_size = 2*strlen(dtext->text)+1;
+            buf = av_malloc(buf_size);
+        }
+
+#if HAVE_LOCALTIME_R
+        localtime_r(&now, &ltime);
+#else
+        if(strchr(dtext->text, '%'))
+            ltime= *localtime(&now);
+#endif
+
+        do {
+            *buf = 1;
+            if (strftime(buf, buf_size, dtext->text, &ltime) != 0 || *buf == 0)
+                break;
+            buf_size *= 2;
+        } while ((buf = av_realloc(buf, buf_size)));
+
+        if (!buf)
+            return AVERROR(ENOMEM);
+        dtext->expanded_text = buf;
+        dtext->expanded_text_size = buf_size;
+    }
+
+    /* the glyph positions are kept as long as the text does not change */
+    if (!dtext->laid_out_text || strcmp(dtext->expanded_text, dtext->laid_out_text))
+        if ((ret = layout_text(ctx)) < 0)
+            return ret;
+
     dtext->x = dtext->var_values[VAR_X] = av_expr_eval(dtext->x_pexpr, dtext->var_values, NULL);
     dtext->y = dtext->var_values[VAR_Y] = av_expr_eval(dtext->y_pexpr, dtext->var_values, NULL);
     dtext->x = dtext->var_values[VAR_X] = av_expr_eval(dtext->x_pexpr, dtext->var_values, NULL);
@@ -768,14 +844,13 @@ static int draw_text(AVFilterContext *ctx, AVFilterBufferRef *picref,
     dtext->x &= ~((1 << dtext->hsub) - 1);
     dtext->y &= ~((1 << dtext->vsub) - 1);
 
-    box_w = FFMIN(width - 1 , max_text_line_w);
-    box_h = FFMIN(height - 1, y + dtext->max_glyph_h);
+    box_w = FFMIN(width - 1 , dtext->text_w);
+    box_h = FFMIN(height - 1, dtext->text_h);
 
     /* draw box */
     if (dtext->draw_box)
-        drawbox(picref, dtext->x, dtext->y, box_w, box_h,
-                dtext->box_line, dtext->pixel_step, dtext->boxcolor_rgba,
-                dtext->hsub, dtext->vsub, dtext->is_packed_rgb, dtext->rgba_map);
+        drawbox(dtext, picref, dtext->x, dtext->y, box_w, box_h,
+                width, height, dtext->boxcolor_rgba);
 
     if (dtext->shadowx || dtext->shadowy) {
         if ((ret = draw_glyphs(dtext, picref, width, height, dtext->shadowcolor_rgba,
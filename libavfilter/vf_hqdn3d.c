@@ -26,15 +26,35 @@
  */
 
 #include "libavutil/pixdesc.h"
+#include "libavutil/intreadwrite.h"
+#include "libavutil/threadpool.h"
 #include "avfilter.h"
 
 typedef struct {
     int Coefs[4][512*16];
-    unsigned int *Line;
-    unsigned short *Frame[3];
+    unsigned int *Line[3];          ///< one line buffer per plane, so that the planes can be filtered concurrently
+    void *Frame[3];                 ///< temporal history, uint16_t for 8-bit input, uint32_t above
+    unsigned int *Spatial[3];       ///< horizontally filtered planes, only used with a thread pool
     int hsub, vsub;
+    int depth;
 } HQDN3DContext;
 
+/**
+ * Internally every sample is kept in 8.16 fixed point relative to an 8-bit
+ * range, whatever the input depth, so that the same coefficient tables
+ * serve all depths. The temporal history keeps 8 fractional bits for 8-bit
+ * input and the full 8.16 value for higher depths.
+ */
+#define INT_SHIFT(depth) (24 - (depth))
+
+#define LOAD(x) (((depth == 8 ? src[x] : AV_RN16A(src + (x) * 2)) << INT_SHIFT(depth)))
+#define STORE(x,val) (depth == 8 ? (dst[x] = ((val) + 0x7FFF) >> 16) \
+                                 : AV_WN16A(dst + (x) * 2, ((val) + (1 << (INT_SHIFT(depth) - 1)) - 1) >> INT_SHIFT(depth)))
+
+#define FRAME_LOAD(i) (depth == 8 ? ((uint16_t *)FrameAnt)[i] << 8 : ((uint32_t *)FrameAnt)[i])
+#define FRAME_STORE(i,val) (depth == 8 ? (((uint16_t *)FrameAnt)[i] = ((val) + 0x7F) >> 8) \
+                                       : (((uint32_t *)FrameAnt)[i] = (val)))
+
 static inline unsigned int LowPassMul(unsigned int PrevMul, unsigned int CurrMul, int *Coef)
 {
     //    int dMul= (PrevMul&0xFFFFFF)-(CurrMul&0xFFFFFF);
@@ -43,135 +63,228 @@ static inline unsigned int LowPassMul(unsigned int PrevMul, unsigned int CurrMul
     return CurrMul + Coef[d];
 }
 
-static void deNoiseTemporal(unsigned char *FrameSrc,
-                            unsigned char *FrameDest,
-                            unsigned short *FrameAnt,
-                            int W, int H, int sStride, int dStride,
-                            int *Temporal)
+/**
+ * Filter H lines of the temporal-only case; FrameAnt and the returned
+ * lines start at the same line.
+ */
+static av_always_inline
+void deNoiseTemporal(const uint8_t *src, uint8_t *dst,
+                     void *FrameAnt, int W, int H, int sStride, int dStride,
+                     int *Temporal, int depth)
 {
     long X, Y;
     unsigned int PixelDst;
 
     for (Y = 0; Y < H; Y++) {
         for (X = 0; X < W; X++) {
-            PixelDst = LowPassMul(FrameAnt[X]<<8, FrameSrc[X]<<16, Temporal);
-            FrameAnt[X] = ((PixelDst+0x1000007F)>>8);
-            FrameDest[X]= ((PixelDst+0x10007FFF)>>16);
+            PixelDst = LowPassMul(FRAME_LOAD(Y*W + X), LOAD(X), Temporal);
+            FRAME_STORE(Y*W + X, PixelDst);
+            STORE(X, PixelDst);
         }
-        FrameSrc  += sStride;
-        FrameDest += dStride;
-        FrameAnt += W;
+        src += sStride;
+        dst += dStride;
     }
 }
 
-static void deNoiseSpacial(unsigned char *Frame,
-                           unsigned char *FrameDest,
-                           unsigned int *LineAnt,
-                           int W, int H, int sStride, int dStride,
-                           int *Horizontal, int *Vertical)
+static av_always_inline
+void deNoiseSpacial(const uint8_t *src, uint8_t *dst,
+                    unsigned int *LineAnt,
+                    int W, int H, int sStride, int dStride,
+                    int *Horizontal, int *Vertical, int depth)
 {
     long X, Y;
-    long sLineOffs = 0, dLineOffs = 0;
     unsigned int PixelAnt;
     unsigned int PixelDst;
 
     /* First pixel has no left nor top neighbor. */
-    PixelDst = LineAnt[0] = PixelAnt = Frame[0]<<16;
-    FrameDest[0]= ((PixelDst+0x10007FFF)>>16);
+    PixelDst = LineAnt[0] = PixelAnt = LOAD(0);
+    STORE(0, PixelDst);
 
     /* First line has no top neighbor, only left. */
     for (X = 1; X < W; X++) {
-        PixelDst = LineAnt[X] = LowPassMul(PixelAnt, Frame[X]<<16, Horizontal);
-        FrameDest[X]= ((PixelDst+0x10007FFF)>>16);
+        PixelDst = LineAnt[X] = LowPassMul(PixelAnt, LOAD(X), Horizontal);
+        STORE(X, PixelDst);
     }
 
     for (Y = 1; Y < H; Y++) {
-        unsigned int PixelAnt;
-        sLineOffs += sStride, dLineOffs += dStride;
+        src += sStride;
+        dst += dStride;
         /* First pixel on each line doesn't have previous pixel */
-        PixelAnt = Frame[sLineOffs]<<16;
+        PixelAnt = LOAD(0);
         PixelDst = LineAnt[0] = LowPassMul(LineAnt[0], PixelAnt, Vertical);
-        FrameDest[dLineOffs]= ((PixelDst+0x10007FFF)>>16);
+        STORE(0, PixelDst);
 
         for (X = 1; X < W; X++) {
-            unsigned int PixelDst;
             /* The rest are normal */
-            PixelAnt = LowPassMul(PixelAnt, Frame[sLineOffs+X]<<16, Horizontal);
+            PixelAnt = LowPassMul(PixelAnt, LOAD(X), Horizontal);
             PixelDst = LineAnt[X] = LowPassMul(LineAnt[X], PixelAnt, Vertical);
-            FrameDest[dLineOffs+X]= ((PixelDst+0x10007FFF)>>16);
+            STORE(X, PixelDst);
         }
     }
 }
 
-static void deNoise(unsigned char *Frame,
-                    unsigned char *FrameDest,
-                    unsigned int *LineAnt,
-                    unsigned short **FrameAntPtr,
-                    int W, int H, int sStride, int dStride,
-                    int *Horizontal, int *Vertical, int *Temporal)
+/**
+ * Horizontal pass of the band-split filter: run the left-to-right lowpass
+ * over H lines into Spatial, which has W entries per line. The lines do
+ * not depend on each other. If first_line is set, the first line is
+ * filtered against its first pixel only, as deNoiseSpacial() does.
+ */
+static av_always_inline
+void deNoiseHorizontal(const uint8_t *src, unsigned int *Spatial,
+                       int W, int H, int sStride, int *Horizontal,
+                       int first_line, int depth)
 {
     long X, Y;
-    long sLineOffs = 0, dLineOffs = 0;
     unsigned int PixelAnt;
+
+    for (Y = 0; Y < H; Y++) {
+        Spatial[0] = PixelAnt = LOAD(0);
+        if (!Y && first_line) {
+            for (X = 1; X < W; X++)
+                Spatial[X] = LowPassMul(PixelAnt, LOAD(X), Horizontal);
+        } else {
+            for (X = 1; X < W; X++)
+                Spatial[X] = PixelAnt = LowPassMul(PixelAnt, LOAD(X), Horizontal);
+        }
+        src     += sStride;
+        Spatial += W;
+    }
+}
+
+/**
+ * Vertical and temporal pass of the band-split filter, over the columns
+ * x0 to x1 of a plane of width W. The top-to-bottom lowpass only carries
+ * state within a column, so column bands do not depend on each other.
+ */
+static av_always_inline
+void deNoiseVertical(const unsigned int *Spatial, uint8_t *dst,
+                     unsigned int *LineAnt, void *FrameAnt,
+                     int x0, int x1, int W, int H, int dStride,
+                     int *Vertical, int *Temporal, int depth)
+{
+    long X, Y;
     unsigned int PixelDst;
-    unsigned short* FrameAnt=(*FrameAntPtr);
-
-    if (!FrameAnt) {
-        (*FrameAntPtr) = FrameAnt = av_malloc(W*H*sizeof(unsigned short));
-        for (Y = 0; Y < H; Y++) {
-            unsigned short* dst=&FrameAnt[Y*W];
-            unsigned char* src=Frame+Y*sStride;
-            for (X = 0; X < W; X++) dst[X]=src[X]<<8;
+
+    dst += x0 * (depth == 8 ? 1 : 2);
+    for (Y = 0; Y < H; Y++) {
+        for (X = x0; X < x1; X++) {
+            PixelDst = LineAnt[X] = Y ? LowPassMul(LineAnt[X], Spatial[X], Vertical)
+                                      : Spatial[X];
+            if (Temporal[0]) {
+                PixelDst = LowPassMul(FRAME_LOAD(Y*W + X), PixelDst, Temporal);
+                FRAME_STORE(Y*W + X, PixelDst);
+            }
+            STORE(X - x0, PixelDst);
         }
+        Spatial += W;
+        dst     += dStride;
+    }
+}
+
+static av_always_inline
+int initFrameAnt(const uint8_t *src, void **FrameAntPtr,
+                 int W, int H, int sStride, int depth)
+{
+    long X, Y;
+    void *FrameAnt = *FrameAntPtr;
+
+    if (FrameAnt)
+        return 0;
+    *FrameAntPtr = FrameAnt = av_malloc(W*H*(depth == 8 ? 2 : 4));
+    if (!FrameAnt)
+        return AVERROR(ENOMEM);
+    for (Y = 0; Y < H; Y++) {
+        for (X = 0; X < W; X++)
+            FRAME_STORE(Y*W + X, LOAD(X));
+        src += sStride;
     }
+    return 0;
+}
+
+static av_always_inline
+int deNoiseDepth(const uint8_t *src, uint8_t *dst,
+                 unsigned int *LineAnt,
+                 void **FrameAntPtr,
+                 int W, int H, int sStride, int dStride,
+                 int *Horizontal, int *Vertical, int *Temporal, int depth)
+{
+    long X, Y;
+    unsigned int PixelAnt;
+    unsigned int PixelDst;
+    void *FrameAnt;
+    int ret;
+
+    if ((ret = initFrameAnt(src, FrameAntPtr, W, H, sStride, depth)) < 0)
+        return ret;
+    FrameAnt = *FrameAntPtr;
 
     if (!Horizontal[0] && !Vertical[0]) {
-        deNoiseTemporal(Frame, FrameDest, FrameAnt,
-                        W, H, sStride, dStride, Temporal);
-        return;
+        deNoiseTemporal(src, dst, FrameAnt,
+                        W, H, sStride, dStride, Temporal, depth);
+        return 0;
     }
     if (!Temporal[0]) {
-        deNoiseSpacial(Frame, FrameDest, LineAnt,
-                       W, H, sStride, dStride, Horizontal, Vertical);
-        return;
+        deNoiseSpacial(src, dst, LineAnt,
+                       W, H, sStride, dStride, Horizontal, Vertical, depth);
+        return 0;
     }
 
     /* First pixel has no left nor top neighbor. Only previous frame */
-    LineAnt[0] = PixelAnt = Frame[0]<<16;
-    PixelDst = LowPassMul(FrameAnt[0]<<8, PixelAnt, Temporal);
-    FrameAnt[0] = ((PixelDst+0x1000007F)>>8);
-    FrameDest[0]= ((PixelDst+0x10007FFF)>>16);
+    LineAnt[0] = PixelAnt = LOAD(0);
+    PixelDst = LowPassMul(FRAME_LOAD(0), PixelAnt, Temporal);
+    FRAME_STORE(0, PixelDst);
+    STORE(0, PixelDst);
 
     /* First line has no top neighbor. Only left one for each pixel and
      * last frame */
     for (X = 1; X < W; X++) {
-        LineAnt[X] = PixelAnt = LowPassMul(PixelAnt, Frame[X]<<16, Horizontal);
-        PixelDst = LowPassMul(FrameAnt[X]<<8, PixelAnt, Temporal);
-        FrameAnt[X] = ((PixelDst+0x1000007F)>>8);
-        FrameDest[X]= ((PixelDst+0x10007FFF)>>16);
+        LineAnt[X] = PixelAnt = LowPassMul(PixelAnt, LOAD(X), Horizontal);
+        PixelDst = LowPassMul(FRAME_LOAD(X), PixelAnt, Temporal);
+        FRAME_STORE(X, PixelDst);
+        STORE(X, PixelDst);
     }
 
     for (Y = 1; Y < H; Y++) {
-        unsigned int PixelAnt;
-        unsigned short* LinePrev=&FrameAnt[Y*W];
-        sLineOffs += sStride, dLineOffs += dStride;
+        src += sStride;
+        dst += dStride;
         /* First pixel on each line doesn't have previous pixel */
-        PixelAnt = Frame[sLineOffs]<<16;
+        PixelAnt = LOAD(0);
         LineAnt[0] = LowPassMul(LineAnt[0], PixelAnt, Vertical);
-        PixelDst = LowPassMul(LinePrev[0]<<8, LineAnt[0], Temporal);
-        LinePrev[0] = ((PixelDst+0x1000007F)>>8);
-        FrameDest[dLineOffs]= ((PixelDst+0x10007FFF)>>16);
+        PixelDst = LowPassMul(FRAME_LOAD(Y*W), LineAnt[0], Temporal);
+        FRAME_STORE(Y*W, PixelDst);
+        STORE(0, PixelDst);
 
         for (X = 1; X < W; X++) {
-            unsigned int PixelDst;
             /* The rest are normal */
-            PixelAnt = LowPassMul(PixelAnt, Frame[sLineOffs+X]<<16, Horizontal);
+            PixelAnt = LowPassMul(PixelAnt, LOAD(X), Horizontal);
             LineAnt[X] = LowPassMul(LineAnt[X], PixelAnt, Vertical);
-            PixelDst = LowPassMul(LinePrev[X]<<8, LineAnt[X], Temporal);
-            LinePrev[X] = ((PixelDst+0x1000007F)>>8);
-            FrameDest[dLineOffs+X]= ((PixelDst+0x10007FFF)>>16);
+            PixelDst = LowPassMul(FRAME_LOAD(Y*W + X), LineAnt[X], Temporal);
+            FRAME_STORE(Y*W + X, PixelDst);
+            STORE(X, PixelDst);
         }
     }
+    return 0;
+}
+
+#define DEPTH_SWITCH(depth, func, ...)      \
+    switch (depth) {                        \
+    case  8: func(__VA_ARGS__,  8); break;  \
+    case  9: func(__VA_ARGS__,  9); break;  \
+    case 10: func(__VA_ARGS__, 10); break;  \
+    default: func(__VA_ARGS__, 16); break;  \
+    }
+
+static int deNoise(const uint8_t *src, uint8_t *dst,
+                   unsigned int *LineAnt,
+                   void **FrameAntPtr,
+                   int W, int H, int sStride, int dStride,
+                   int *Horizontal, int *Vertical, int *Temporal, int depth)
+{
+    int ret;
+
+    DEPTH_SWITCH(depth, ret = deNoiseDepth, src, dst, LineAnt, FrameAntPtr,
+                 W, H, sStride, dStride, Horizontal, Vertical, Temporal)
+    return ret;
 }
 
 static void PrecalcCoefs(int *Ct, double Dist25)
@@ -255,17 +368,23 @@ static int init(AVFilterContext *ctx, const char *args, void *opaque)
 static void uninit(AVFilterContext *ctx)
 {
     HQDN3DContext *hqdn3d = ctx->priv;
+    int i;
 
-    av_freep(&hqdn3d->Line);
-    av_freep(&hqdn3d->Frame[0]);
-    av_freep(&hqdn3d->Frame[1]);
-    av_freep(&hqdn3d->Frame[2]);
+    for (i = 0; i < 3; i++) {
+        av_freep(&hqdn3d->Line[i]);
+        av_freep(&hqdn3d->Frame[i]);
+        av_freep(&hqdn3d->Spatial[i]);
+    }
 }
 
 static int query_formats(AVFilterContext *ctx)
 {
     static const enum PixelFormat pix_fmts[] = {
-        PIX_FMT_YUV420P, PIX_FMT_YUV422P, PIX_FMT_YUV411P, PIX_FMT_NONE
+        PIX_FMT_YUV420P, PIX_FMT_YUV422P, PIX_FMT_YUV411P,
+        PIX_FMT_YUV420P9,  PIX_FMT_YUV422P9,  PIX_FMT_YUV444P9,
+        PIX_FMT_YUV420P10, PIX_FMT_YUV422P10, PIX_FMT_YUV444P10,
+        PIX_FMT_YUV420P16, PIX_FMT_YUV422P16, PIX_FMT_YUV444P16,
+        PIX_FMT_NONE
     };
 
     avfilter_set_common_pixel_formats(ctx, avfilter_make_format_list(pix_fmts));
@@ -276,46 +395,152 @@ static int query_formats(AVFilterContext *ctx)
 static int config_input(AVFilterLink *inlink)
 {
     HQDN3DContext *hqdn3d = inlink->dst->priv;
+    int i;
 
     hqdn3d->hsub = av_pix_fmt_descriptors[inlink->format].log2_chroma_w;
     hqdn3d->vsub = av_pix_fmt_descriptors[inlink->format].log2_chroma_h;
-
-    hqdn3d->Line = av_malloc(inlink->w * sizeof(*hqdn3d->Line));
-    if (!hqdn3d->Line)
-        return AVERROR(ENOMEM);
+    hqdn3d->depth = av_pix_fmt_descriptors[inlink->format].comp[0].depth_minus1+1;
+
+    for (i = 0; i < 3; i++) {
+        int w = i ? inlink->w >> hqdn3d->hsub : inlink->w;
+        int h = i ? inlink->h >> hqdn3d->vsub : inlink->h;
+
+        /* the history is reallocated on the next frame, the size or depth
+         * may have changed */
+        av_freep(&hqdn3d->Frame[i]);
+        av_freep(&hqdn3d->Line[i]);
+        av_freep(&hqdn3d->Spatial[i]);
+        hqdn3d->Line[i] = av_malloc(inlink->w * sizeof(*hqdn3d->Line[i]));
+        if (!hqdn3d->Line[i])
+            return AVERROR(ENOMEM);
+        if (inlink->dst->thread_pool) {
+            hqdn3d->Spatial[i] = av_malloc(w * h * sizeof(*hqdn3d->Spatial[i]));
+            if (!hqdn3d->Spatial[i])
+                return AVERROR(ENOMEM);
+        }
+    }
 
     return 0;
 }
 
 static void null_draw_slice(AVFilterLink *link, int y, int h, int slice_dir) { }
 
+typedef struct {
+    AVFilterBufferRef *in, *out;
+    int nb_bands;
+} ThreadData;
+
+static void get_plane(HQDN3DContext *hqdn3d, AVFilterBufferRef *pic, int c,
+                      int *w, int *h, int **spatial, int **temporal)
+{
+    *w = c ? pic->video->w >> hqdn3d->hsub : pic->video->w;
+    *h = c ? pic->video->h >> hqdn3d->vsub : pic->video->h;
+    *spatial  = hqdn3d->Coefs[c ? 2 : 0];
+    *temporal = hqdn3d->Coefs[c ? 3 : 1];
+}
+
+/**
+ * First pass with a thread pool, job nb_bands*c + band: the horizontal
+ * lowpass of a band of lines of plane c into Spatial, or the whole filter
+ * for those lines if the plane is only filtered temporally.
+ */
+static int filter_rows(void *ctx, void *arg, int jobnr, int threadnr)
+{
+    HQDN3DContext *hqdn3d = ctx;
+    ThreadData *td = arg;
+    int c = jobnr / td->nb_bands, band = jobnr % td->nb_bands;
+    int w, h, y0, y1, *spatial, *temporal;
+    const uint8_t *src;
+
+    get_plane(hqdn3d, td->in, c, &w, &h, &spatial, &temporal);
+    y0  = h *  band      / td->nb_bands;
+    y1  = h * (band + 1) / td->nb_bands;
+    src = td->in->data[c] + y0 * td->in->linesize[c];
+
+    if (spatial[0]) {
+        DEPTH_SWITCH(hqdn3d->depth, deNoiseHorizontal, src,
+                     hqdn3d->Spatial[c] + y0 * w, w, y1 - y0,
+                     td->in->linesize[c], spatial, !temporal[0] && !y0)
+    } else {
+        uint8_t *dst   = td->out->data[c] + y0 * td->out->linesize[c];
+        void *FrameAnt = (uint8_t *)hqdn3d->Frame[c] +
+                         y0 * w * (hqdn3d->depth == 8 ? 2 : 4);
+
+        DEPTH_SWITCH(hqdn3d->depth, deNoiseTemporal, src, dst, FrameAnt,
+                     w, y1 - y0, td->in->linesize[c], td->out->linesize[c],
+                     temporal)
+    }
+    return 0;
+}
+
+/**
+ * Second pass with a thread pool: the vertical and temporal lowpass of a
+ * band of columns of plane c.
+ */
+static int filter_columns(void *ctx, void *arg, int jobnr, int threadnr)
+{
+    HQDN3DContext *hqdn3d = ctx;
+    ThreadData *td = arg;
+    int c = jobnr / td->nb_bands, band = jobnr % td->nb_bands;
+    int w, h, x0, x1, *spatial, *temporal;
+
+    get_plane(hqdn3d, td->in, c, &w, &h, &spatial, &temporal);
+    if (!spatial[0])
+        return 0;
+    /* keep the bands apart by whole cache lines */
+    x0 = band                      ? (w *  band      / td->nb_bands) & ~15 : 0;
+    x1 = band + 1 < td->nb_bands ? (w * (band + 1) / td->nb_bands) & ~15 : w;
+
+    DEPTH_SWITCH(hqdn3d->depth, deNoiseVertical, hqdn3d->Spatial[c],
+                 td->out->data[c], hqdn3d->Line[c], hqdn3d->Frame[c],
+                 x0, x1, w, h, td->out->linesize[c], spatial, temporal)
+    return 0;
+}
+
 static void end_frame(AVFilterLink *inlink)
 {
-    HQDN3DContext *hqdn3d = inlink->dst->priv;
-    AVFilterLink *outlink = inlink->dst->outputs[0];
+    AVFilterContext *ctx = inlink->dst;
+    HQDN3DContext *hqdn3d = ctx->priv;
+    AVFilterLink *outlink = ctx->outputs[0];
     AVFilterBufferRef *inpic  = inlink ->cur_buf;
     AVFilterBufferRef *outpic = outlink->out_buf;
-    int cw = inpic->video->w >> hqdn3d->hsub;
-    int ch = inpic->video->h >> hqdn3d->vsub;
-
-    deNoise(inpic->data[0], outpic->data[0],
-            hqdn3d->Line, &hqdn3d->Frame[0], inpic->video->w, inpic->video->h,
-            inpic->linesize[0], outpic->linesize[0],
-            hqdn3d->Coefs[0],
-            hqdn3d->Coefs[0],
-            hqdn3d->Coefs[1]);
-    deNoise(inpic->data[1], outpic->data[1],
-            hqdn3d->Line, &hqdn3d->Frame[1], cw, ch,
-            inpic->linesize[1], outpic->linesize[1],
-            hqdn3d->Coefs[2],
-            hqdn3d->Coefs[2],
-            hqdn3d->Coefs[3]);
-    deNoise(inpic->data[2], outpic->data[2],
-            hqdn3d->Line, &hqdn3d->Frame[2], cw, ch,
-            inpic->linesize[2], outpic->linesize[2],
-            hqdn3d->Coefs[2],
-            hqdn3d->Coefs[2],
-            hqdn3d->Coefs[3]);
+    int ret = 0, c;
+
+    if (ctx->thread_pool) {
+        /* The horizontal and temporal lowpasses carry no state from one
+         * line to the next and the vertical one none from one column to
+         * the next, so each plane is filtered in two passes over bands. */
+        ThreadData td = { .in = inpic, .out = outpic };
+        int nb_jobs;
+
+        td.nb_bands = av_threadpool_get_nb_threads(ctx->thread_pool) + 1;
+        nb_jobs = 3 * td.nb_bands;
+        for (c = 0; c < 3 && ret >= 0; c++) {
+            int w, h, *spatial, *temporal;
+
+            get_plane(hqdn3d, inpic, c, &w, &h, &spatial, &temporal);
+            DEPTH_SWITCH(hqdn3d->depth, ret = initFrameAnt, inpic->data[c],
+                         &hqdn3d->Frame[c], w, h, inpic->linesize[c])
+        }
+        if (ret >= 0) {
+            av_threadpool_execute(ctx->thread_pool, filter_rows, hqdn3d, &td,
+                                  NULL, nb_jobs, nb_jobs);
+            av_threadpool_execute(ctx->thread_pool, filter_columns, hqdn3d, &td,
+                                  NULL, nb_jobs, nb_jobs);
+        }
+    } else {
+        for (c = 0; c < 3 && ret >= 0; c++) {
+            int w, h, *spatial, *temporal;
+
+            get_plane(hqdn3d, inpic, c, &w, &h, &spatial, &temporal);
+            ret = deNoise(inpic->data[c], outpic->data[c],
+                          hqdn3d->Line[c], &hqdn3d->Frame[c], w, h,
+                          inpic->linesize[c], outpic->linesize[c],
+                          spatial, spatial, temporal, hqdn3d->depth);
+        }
+    }
+    if (ret < 0)
+        av_log(ctx, AV_LOG_ERROR, "Could not allocate temporal buffer.\n");
 
     avfilter_draw_slice(outlink, 0, inpic->video->h, 1);
     avfilter_end_frame(outlink);
@@ -54,7 +54,9 @@ enum var_name {
 
 typedef struct {
     const AVClass *class;
-    uint8_t lut[4][256];  ///< lookup table for each component
+    uint8_t lut[4][256];  ///< lookup table applied for each component
+    uint8_t own_lut[4][256]; ///< lookup table computed from this filter's expressions
+    int configured;       ///< set once own_lut has been computed
     char   *comp_expr_str[4];
     AVExpr *comp_expr[4];
     int hsub, vsub;
@@ -63,6 +65,8 @@ typedef struct {
     int rgba_map[4];
     int step;
     int negate_alpha; /* only used by negate */
+    int is_identity[4];   ///< set for the components whose table maps every value to itself
+    int passthrough;      ///< set when the following lut filter applies this filter's tables
 } LutContext;
 
 #define Y 0
@@ -194,6 +198,52 @@ static const char * const funcs1_names[] = {
     NULL
 };
 
+static int is_lut(AVFilterContext *ctx)
+{
+    return ctx && ctx->filter->uninit == uninit;
+}
+
+/**
+ * Compute the tables applied by this filter. If the input comes straight
+ * from another configured lut filter, compose its tables with ours and let
+ * it pass its input through, so that a chain of lut filters costs a single
+ * lookup per pixel. Both filters work on the same link format, so the
+ * component layout of their tables matches.
+ *
+ * This is redone for the whole rest of the chain whenever a filter of the
+ * chain is (re)configured, so that every table is applied exactly once.
+ */
+static void update_tables(AVFilterContext *ctx)
+{
+    LutContext *lut = ctx->priv;
+    AVFilterContext *prev_ctx = ctx->inputs[0]->src;
+    AVFilterContext *next_ctx = ctx->outputs[0] ? ctx->outputs[0]->dst : NULL;
+    int comp, val;
+
+    if (is_lut(prev_ctx) && ((LutContext *)prev_ctx->priv)->configured) {
+        LutContext *prev = prev_ctx->priv;
+        for (comp = 0; comp < 4; comp++)
+            for (val = 0; val < 256; val++)
+                lut->lut[comp][val] = lut->own_lut[comp][prev->lut[comp][val]];
+        prev->passthrough = 1;
+        av_log(ctx, AV_LOG_DEBUG, "fused with the tables of '%s'\n", prev_ctx->name);
+    } else {
+        memcpy(lut->lut, lut->own_lut, sizeof(lut->lut));
+    }
+
+    for (comp = 0; comp < 4; comp++) {
+        lut->is_identity[comp] = 1;
+        for (val = 0; val < 256; val++)
+            if (lut->lut[comp][val] != val)
+                lut->is_identity[comp] = 0;
+    }
+
+    /* a following lut filter applies our tables, now or once configured */
+    lut->passthrough = is_lut(next_ctx);
+    if (lut->passthrough && ((LutContext *)next_ctx->priv)->configured)
+        update_tables(next_ctx);
+}
+
 static int config_props(AVFilterLink *inlink)
 {
     AVFilterContext *ctx = inlink->dst;
@@ -273,14 +323,28 @@ static int config_props(AVFilterLink *inlink)
                        lut->comp_expr_str[comp], val, comp);
                 return AVERROR(EINVAL);
             }
-            lut->lut[comp][val] = av_clip((int)res, min[comp], max[comp]);
-            av_log(ctx, AV_LOG_DEBUG, "val[%d][%d] = %d\n", comp, val, lut->lut[comp][val]);
+            lut->own_lut[comp][val] = av_clip((int)res, min[comp], max[comp]);
+            av_log(ctx, AV_LOG_DEBUG, "val[%d][%d] = %d\n", comp, val, lut->own_lut[comp][val]);
         }
     }
 
+    lut->configured = 1;
+    update_tables(ctx);
+
     return 0;
 }
 
+static void start_frame(AVFilterLink *inlink, AVFilterBufferRef *picref)
+{
+    LutContext *lut = inlink->dst->priv;
+
+    if (lut->passthrough) {
+        avfilter_start_frame(inlink->dst->outputs[0], avfilter_ref_buffer(picref, ~0));
+        return;
+    }
+    avfilter_default_start_frame(inlink, picref);
+}
+
 static void draw_slice(AVFilterLink *inlink, int y, int h, int slice_dir)
 {
     AVFilterContext *ctx = inlink->dst;
@@ -291,19 +355,42 @@ static void draw_slice(AVFilterLink *inlink, int y, int h, int slice_dir)
     uint8_t *inrow, *outrow, *inrow0, *outrow0;
     int i, j, k, plane;
 
+    if (lut->passthrough) {
+        avfilter_draw_slice(outlink, y, h, slice_dir);
+        return;
+    }
+
     if (lut->is_rgb) {
         /* packed */
+        const uint8_t *tab[4];
+        int w = inlink->w;
+
+        for (k = 0; k < lut->step; k++)
+            tab[k] = lut->lut[lut->rgba_map[k]];
+
         inrow0  = inpic ->data[0] + y * inpic ->linesize[0];
         outrow0 = outpic->data[0] + y * outpic->linesize[0];
 
         for (i = 0; i < h; i ++) {
             inrow  = inrow0;
             outrow = outrow0;
-            for (j = 0; j < inlink->w; j++) {
-                for (k = 0; k < lut->step; k++)
-                    outrow[k] = lut->lut[lut->rgba_map[k]][inrow[k]];
-                outrow += lut->step;
-                inrow  += lut->step;
+            if (lut->step == 4) {
+                for (j = 0; j < w; j++) {
+                    outrow[0] = tab[0][inrow[0]];
+                    outrow[1] = tab[1][inrow[1]];
+                    outrow[2] = tab[2][inrow[2]];
+                    outrow[3] = tab[3][inrow[3]];
+                    outrow += 4;
+                    inrow  += 4;
+                }
+            } else {
+                for (j = 0; j < w; j++) {
+                    outrow[0] = tab[0][inrow[0]];
+                    outrow[1] = tab[1][inrow[1]];
+                    outrow[2] = tab[2][inrow[2]];
+                    outrow += 3;
+                    inrow  += 3;
+                }
             }
             inrow0  += inpic ->linesize[0];
             outrow0 += outpic->linesize[0];
@@ -313,13 +400,25 @@ static void draw_slice(AVFilterLink *inlink, int y, int h, int slice_dir)
         for (plane = 0; plane < 4 && inpic->data[plane]; plane++) {
             int vsub = plane == 1 || plane == 2 ? lut->vsub : 0;
             int hsub = plane == 1 || plane == 2 ? lut->hsub : 0;
+            int w = inlink->w>>hsub;
+            const uint8_t *tab = lut->lut[plane];
 
             inrow  = inpic ->data[plane] + (y>>vsub) * inpic ->linesize[plane];
             outrow = outpic->data[plane] + (y>>vsub) * outpic->linesize[plane];
 
             for (i = 0; i < h>>vsub; i ++) {
-                for (j = 0; j < inlink->w>>hsub; j++)
-                    outrow[j] = lut->lut[plane][inrow[j]];
+                if (lut->is_identity[plane]) {
+                    memcpy(outrow, inrow, w);
+                } else {
+                    for (j = 0; j < w - 3; j += 4) {
+                        outrow[j  ] = tab[inrow[j  ]];
+                        outrow[j+1] = tab[inrow[j+1]];
+                        outrow[j+2] = tab[inrow[j+2]];
+                        outrow[j+3] = tab[inrow[j+3]];
+                    }
+                    for (; j < w; j++)
+                        outrow[j] = tab[inrow[j]];
+                }
                 inrow  += inpic ->linesize[plane];
                 outrow += outpic->linesize[plane];
             }
@@ -341,6 +440,7 @@ static void draw_slice(AVFilterLink *inlink, int y, int h, int slice_dir)
                                                                         \
         .inputs    = (AVFilterPad[]) {{ .name            = "default",   \
                                         .type            = AVMEDIA_TYPE_VIDEO, \
+                                        .start_frame     = start_frame, \
                                         .draw_slice      = draw_slice,  \
                                         .config_props    = config_props, \
                                         .min_perms       = AV_PERM_READ, }, \
@@ -26,6 +26,7 @@
  */
 
 #include "avfilter.h"
+#include "libavutil/cpu.h"
 #include "libavutil/eval.h"
 #include "libavutil/avstring.h"
 #include "libavutil/opt.h"
@@ -34,6 +35,7 @@
 #include "libavutil/mathematics.h"
 #include "internal.h"
 #include "drawutils.h"
+#include "overlay.h"
 
 static const char * const var_names[] = {
     "main_w",    "W", ///< width  of the main    video
@@ -63,6 +65,15 @@ enum var_name {
 #define U 1
 #define V 2
 
+/* width in overlay pixels of the blocks of the opacity map */
+#define OPACITY_BLOCK 16
+
+enum OpacityClass {
+    TRANSPARENT,                ///< all the alpha values are 0
+    OPAQUE,                     ///< all the alpha values are 255
+    TRANSLUCENT,                ///< anything else
+};
+
 typedef struct {
     const AVClass *class;
     int x, y;                   ///< position of overlayed picture
@@ -82,6 +93,21 @@ typedef struct {
     int hsub, vsub;             ///< chroma subsampling values
 
     char *x_expr, *y_expr;
+
+    /**
+     * Opacity class of each OPACITY_BLOCK pixels wide block of each line
+     * of the current overlay picture, used to skip transparent areas
+     * and copy opaque ones.
+     */
+    uint8_t *opacity_map;
+    int opacity_map_linesize;
+
+    void (*blend_row)    (uint8_t *dst, const uint8_t *src, const uint8_t *alpha,
+                          int alpha_linesize, int w);
+    void (*blend_row_420)(uint8_t *dst, const uint8_t *src, const uint8_t *alpha,
+                          int alpha_linesize, int w);
+    void (*blend_rgba_row)(uint8_t *dst, const uint8_t *src, int w, int alpha_pos);
+    int use_rgba_row;           ///< main and overlay are 32-bit RGBA with the same layout
 } OverlayContext;
 
 #define OFFSET(x) offsetof(OverlayContext, x)
@@ -109,8 +135,18 @@ static av_cold int init(AVFilterContext *ctx, const char *args, void *opaque)
     OverlayContext *over = ctx->priv;
     char *args1 = av_strdup(args);
     char *expr, *bufptr = NULL;
+    av_unused int cpu_flags = av_get_cpu_flags();
     int ret = 0;
 
+    over->blend_row     = ff_overlay_blend_row_c;
+    over->blend_row_420 = ff_overlay_blend_row_420_c;
+    over->blend_rgba_row = ff_overlay_blend_rgba_row_c;
+    if (HAVE_SSE && cpu_flags & AV_CPU_FLAG_SSE2) {
+        over->blend_row     = ff_overlay_blend_row_sse2;
+        over->blend_row_420 = ff_overlay_blend_row_420_sse2;
+        over->blend_rgba_row = ff_overlay_blend_rgba_row_sse2;
+    }
+
     over->class = &overlay_class;
     av_opt_set_defaults(over);
 
@@ -141,6 +177,7 @@ static av_cold void uninit(AVFilterContext *ctx)
 
     av_freep(&over->x_expr);
     av_freep(&over->y_expr);
+    av_freep(&over->opacity_map);
 
     if (over->overpicref)
         avfilter_unref_buffer(over->overpicref);
@@ -239,6 +276,15 @@ static int config_input_overlay(AVFilterLink *inlink)
     over->overlay_is_packed_rgb =
         ff_fill_rgba_map(over->overlay_rgba_map, inlink->format) >= 0;
     over->overlay_has_alpha = ff_fmt_is_in(inlink->format, alpha_pix_fmts);
+    over->use_rgba_row = over->main_is_packed_rgb && over->main_has_alpha &&
+                         over->main_pix_step[0] == 4 && over->overlay_pix_step[0] == 4 &&
+                         !memcmp(over->main_rgba_map, over->overlay_rgba_map,
+                                 sizeof(over->main_rgba_map));
+
+    over->opacity_map_linesize = (inlink->w + OPACITY_BLOCK - 1) / OPACITY_BLOCK;
+    av_freep(&over->opacity_map);
+    if (!(over->opacity_map = av_malloc(over->opacity_map_linesize * inlink->h)))
+        return AVERROR(ENOMEM);
 
     av_log(ctx, AV_LOG_INFO,
            "main w:%d h:%d fmt:%s overlay x:%d y:%d w:%d h:%d fmt:%s\n",
@@ -335,6 +381,77 @@ static void start_frame_overlay(AVFilterLink *inlink, AVFilterBufferRef *inpicre
 // apply a fast variant: (X+127)/255 = ((X+127)*257+257)>>16 = ((X+128)*257)>>16
 #define FAST_DIV255(x) ((((x) + 128) * 257) >> 16)
 
+void ff_overlay_blend_row_c(uint8_t *dst, const uint8_t *src, const uint8_t *alpha,
+                            int alpha_linesize, int w)
+{
+    int k;
+
+    for (k = 0; k < w; k++)
+        dst[k] = FAST_DIV255(dst[k] * (255 - alpha[k]) + src[k] * alpha[k]);
+}
+
+void ff_overlay_blend_row_420_c(uint8_t *dst, const uint8_t *src, const uint8_t *alpha,
+                                int alpha_linesize, int w)
+{
+    int k;
+
+    for (k = 0; k < w; k++) {
+        const uint8_t *a = alpha + 2*k;
+        int alpha = (a[0] + a[alpha_linesize] +
+                     a[1] + a[alpha_linesize+1]) >> 2;
+        dst[k] = FAST_DIV255(dst[k] * (255 - alpha) + src[k] * alpha);
+    }
+}
+
+void ff_overlay_blend_rgba_row_c(uint8_t *dst, const uint8_t *src, int w, int alpha_pos)
+{
+    int k, c;
+
+    for (k = 0; k < w; k++) {
+        uint8_t *d = dst + 4*k;
+        const uint8_t *s = src + 4*k;
+        int alpha = s[alpha_pos];
+
+        // un-premultiplied alpha, see the generic path in blend_slice()
+        if (alpha)
+            alpha = 255 * 255 * alpha /
+                    (255 * (alpha + d[alpha_pos]) - d[alpha_pos] * alpha);
+        for (c = 0; c < 4; c++)
+            if (c != alpha_pos)
+                d[c] = FAST_DIV255(d[c] * (255 - alpha) + s[c] * alpha);
+        d[alpha_pos] += FAST_DIV255((255 - d[alpha_pos]) * s[alpha_pos]);
+    }
+}
+
+/**
+ * Blend pixels k0 to k1-1 of line j of a subsampled plane, handling the
+ * right and bottom edges where fewer alpha values are available.
+ */
+static void blend_pixels_sub(uint8_t *dp, const uint8_t *sp, const uint8_t *ap,
+                             int alpha_linesize, int k0, int k1,
+                             int wp, int hp, int j, int hsub, int vsub)
+{
+    int k;
+
+    for (k = k0; k < k1; k++) {
+        const uint8_t *a = ap + (k << hsub);
+        // average alpha for color components, improve quality
+        int alpha_v, alpha_h, alpha;
+        if (hsub && vsub && j+1 < hp && k+1 < wp) {
+            alpha = (a[0] + a[alpha_linesize] +
+                     a[1] + a[alpha_linesize+1]) >> 2;
+        } else if (hsub || vsub) {
+            alpha_h = hsub && k+1 < wp ?
+                (a[0] + a[1]) >> 1 : a[0];
+            alpha_v = vsub && j+1 < hp ?
+                (a[0] + a[alpha_linesize]) >> 1 : a[0];
+            alpha = (alpha_v + alpha_h) >> 1;
+        } else
+            alpha = a[0];
+        dp[k] = FAST_DIV255(dp[k] * (255 - alpha) + sp[k] * alpha);
+    }
+}
+
 static void blend_slice(AVFilterContext *ctx,
                         AVFilterBufferRef *dst, AVFilterBufferRef *src,
                         int x, int y, int w, int h,
@@ -370,9 +487,39 @@ static void blend_slice(AVFilterContext *ctx,
         const int main_has_alpha = over->main_has_alpha;
         if (slice_y > y)
             sp += (slice_y - y) * src->linesize[0];
+        if (over->use_rgba_row) {
+            for (i = 0; i < height; i++) {
+                const uint8_t *map = over->opacity_map +
+                                     (start_y - y + i) * over->opacity_map_linesize;
+                for (j = 0; j < width; j += OPACITY_BLOCK) {
+                    int n = FFMIN(OPACITY_BLOCK, width - j);
+                    switch (map[j / OPACITY_BLOCK]) {
+                    case TRANSPARENT:
+                        break;
+                    case OPAQUE:
+                        memcpy(dp + 4*j, sp + 4*j, 4*n);
+                        break;
+                    default:
+                        over->blend_rgba_row(dp + 4*j, sp + 4*j, n, da);
+                    }
+                }
+                dp += dst->linesize[0];
+                sp += src->linesize[0];
+            }
+            return;
+        }
         for (i = 0; i < height; i++) {
+            const uint8_t *map = over->opacity_map +
+                                 (start_y - y + i) * over->opacity_map_linesize;
             uint8_t *d = dp, *s = sp;
             for (j = 0; j < width; j++) {
+                if (!(j % OPACITY_BLOCK) && map[j / OPACITY_BLOCK] == TRANSPARENT) {
+                    int n = FFMIN(OPACITY_BLOCK, width - j);
+                    d += n * dstep;
+                    s += n * sstep;
+                    j += n - 1;
+                    continue;
+                }
                 alpha = s[sa];
 
                 // if the main channel has an alpha channel, alpha has to be calculated
@@ -423,6 +570,7 @@ static void blend_slice(AVFilterContext *ctx,
             sp += src->linesize[0];
         }
     } else {
+        const int oy = start_y - y; ///< first overlay line of the slice
         for (i = 0; i < 3; i++) {
             int hsub = i ? over->hsub : 0;
             int vsub = i ? over->vsub : 0;
@@ -432,30 +580,40 @@ static void blend_slice(AVFilterContext *ctx,
             uint8_t *ap = src->data[3];
             int wp = FFALIGN(width, 1<<hsub) >> hsub;
             int hp = FFALIGN(height, 1<<vsub) >> vsub;
+            int bw = OPACITY_BLOCK >> hsub;
             if (slice_y > y) {
                 sp += ((slice_y - y) >> vsub) * src->linesize[i];
                 ap += (slice_y - y) * src->linesize[3];
             }
             for (j = 0; j < hp; j++) {
-                uint8_t *d = dp, *s = sp, *a = ap;
-                for (k = 0; k < wp; k++) {
-                    // average alpha for color components, improve quality
-                    int alpha_v, alpha_h, alpha;
-                    if (hsub && vsub && j+1 < hp && k+1 < wp) {
-                        alpha = (a[0] + a[src->linesize[3]] +
-                                 a[1] + a[src->linesize[3]+1]) >> 2;
-                    } else if (hsub || vsub) {
-                        alpha_h = hsub && k+1 < wp ?
-                            (a[0] + a[1]) >> 1 : a[0];
-                        alpha_v = vsub && j+1 < hp ?
-                            (a[0] + a[src->linesize[3]]) >> 1 : a[0];
-                        alpha = (alpha_v + alpha_h) >> 1;
-                    } else
-                        alpha = a[0];
-                    *d = FAST_DIV255(*d * (255 - alpha) + *s * alpha);
-                    s++;
-                    d++;
-                    a += 1 << hsub;
+                /* the opacity map lines covering the alpha values used */
+                const uint8_t *map  = over->opacity_map +
+                                      (oy + (j << vsub)) * over->opacity_map_linesize;
+                const uint8_t *map2 = vsub && j+1 < hp ?
+                                      map + over->opacity_map_linesize : map;
+                for (k = 0; k < wp; k += bw) {
+                    int n = FFMIN(bw, wp - k);
+                    int opacity = map[k / bw] == map2[k / bw] ? map[k / bw] : TRANSLUCENT;
+
+                    if (opacity == TRANSPARENT)
+                        continue;
+                    if (opacity == OPAQUE) {
+                        memcpy(dp + k, sp + k, n);
+                        continue;
+                    }
+                    if (!hsub && !vsub) {
+                        over->blend_row(dp + k, sp + k, ap + k, src->linesize[3], n);
+                    } else {
+                        int n_420 = 0;
+                        /* the last line and column take the edge path */
+                        if (hsub == 1 && vsub == 1 && j+1 < hp) {
+                            n_420 = k + n == wp ? n - 1 : n;
+                            over->blend_row_420(dp + k, sp + k, ap + (k << hsub),
+                                                src->linesize[3], n_420);
+                        }
+                        blend_pixels_sub(dp, sp, ap, src->linesize[3], k + n_420, k + n,
+                                         wp, hp, j, hsub, vsub);
+                    }
                 }
                 dp += dst->linesize[i];
                 sp += src->linesize[i];
@@ -490,7 +648,38 @@ static void end_frame(AVFilterLink *inlink)
 
 static void null_draw_slice(AVFilterLink *inlink, int y, int h, int slice_dir) { }
 
-static void null_end_frame(AVFilterLink *inlink) { }
+static void end_frame_overlay(AVFilterLink *inlink)
+{
+    OverlayContext *over = inlink->dst->priv;
+    AVFilterBufferRef *pic = over->overpicref;
+    const uint8_t *ap;
+    int astep, linesize, i, j, k;
+
+    if (over->overlay_is_packed_rgb) {
+        ap       = pic->data[0] + over->overlay_rgba_map[A];
+        astep    = over->overlay_pix_step[0];
+        linesize = pic->linesize[0];
+    } else {
+        ap       = pic->data[3];
+        astep    = 1;
+        linesize = pic->linesize[3];
+    }
+
+    for (i = 0; i < inlink->h; i++) {
+        uint8_t *map = over->opacity_map + i * over->opacity_map_linesize;
+        for (j = 0; j < inlink->w; j += OPACITY_BLOCK) {
+            const uint8_t *a = ap + j * astep;
+            int n = FFMIN(OPACITY_BLOCK, inlink->w - j);
+            int all = 255, any = 0;
+            for (k = 0; k < n; k++) {
+                all &= a[k * astep];
+                any |= a[k * astep];
+            }
+            *map++ = !any ? TRANSPARENT : all == 255 ? OPAQUE : TRANSLUCENT;
+        }
+        ap += linesize;
+    }
+}
 
 AVFilter avfilter_vf_overlay = {
     .name      = "overlay",
@@ -517,7 +706,7 @@ AVFilter avfilter_vf_overlay = {
                                     .start_frame     = start_frame_overlay,
                                     .config_props    = config_input_overlay,
                                     .draw_slice      = null_draw_slice,
-                                    .end_frame       = null_end_frame,
+                                    .end_frame       = end_frame_overlay,
                                     .min_perms       = AV_PERM_READ,
                                     .rej_perms       = AV_PERM_REUSE2, },
                                   { .name = NULL}},
@@ -101,6 +101,13 @@ typedef struct {
     int      line_step[4];
     int hsub, vsub;         ///< chroma subsampling values
     int needs_copy;
+
+    /**
+     * allocated size of the last buffer returned by get_video_buffer(),
+     * and size of the area in it which was handed to the input
+     */
+    int buf_w, buf_h;
+    int req_w, req_h;
 } PadContext;
 
 static av_cold int init(AVFilterContext *ctx, const char *args, void *opaque)
@@ -261,6 +268,11 @@ static AVFilterBufferRef *get_video_buffer(AVFilterLink *inlink, int perms, int
     picref->video->w = w;
     picref->video->h = h;
 
+    pad->buf_w = picref->buf->w;
+    pad->buf_h = picref->buf->h;
+    pad->req_w = w;
+    pad->req_h = h;
+
     for (plane = 0; plane < 4 && picref->data[plane]; plane++) {
         int hsub = (plane == 1 || plane == 2) ? pad->hsub : 0;
         int vsub = (plane == 1 || plane == 2) ? pad->vsub : 0;
@@ -295,6 +307,24 @@ static int does_clip(PadContext *pad, AVFilterBufferRef *outpicref, int plane, i
     return 0;
 }
 
+/**
+ * Tell if a frame which its producer keeps using, e.g. a decoder reference
+ * frame, can be padded in place. This is only the case if it was allocated
+ * by get_video_buffer() and the area handed to the producer does not extend
+ * into the right or bottom borders, which a decoder may do when it aligns
+ * the picture size to its block size.
+ */
+static int can_pad_preserved(PadContext *pad, AVFilterBufferRef *picref)
+{
+    if (picref->buf->w != pad->buf_w || picref->buf->h != pad->buf_h)
+        return 0;
+    if (pad->req_w > pad->in_w && pad->w > pad->x + pad->in_w)
+        return 0;
+    if (pad->req_h > pad->in_h && pad->h > pad->y + pad->in_h)
+        return 0;
+    return 1;
+}
+
 static void start_frame(AVFilterLink *inlink, AVFilterBufferRef *inpicref)
 {
     PadContext *pad = inlink->dst->priv;
@@ -320,7 +350,8 @@ static void start_frame(AVFilterLink *inlink, AVFilterBufferRef *inpicref)
           )
             break;
     }
-    pad->needs_copy= plane < 4 && outpicref->data[plane];
+    pad->needs_copy= plane < 4 && outpicref->data[plane] ||
+        (outpicref->perms & AV_PERM_PRESERVE && !can_pad_preserved(pad, outpicref));
     if(pad->needs_copy){
         av_log(inlink->dst, AV_LOG_DEBUG, "Direct padding impossible allocating new frame\n");
         avfilter_unref_buffer(outpicref);
@@ -37,9 +37,12 @@
  */
 
 #include "avfilter.h"
+#include "unsharp.h"
 #include "libavutil/common.h"
+#include "libavutil/cpu.h"
 #include "libavutil/mem.h"
 #include "libavutil/pixdesc.h"
+#include "libavutil/threadpool.h"
 
 #define MIN_SIZE 3
 #define MAX_SIZE 13
@@ -55,64 +58,100 @@ typedef struct FilterParam {
     int steps_y;                             ///< vertical step count
     int scalebits;                           ///< bits to shift pixel
     int32_t halfscale;                       ///< amount to add to pixel
-    uint32_t *sc[(MAX_SIZE * MAX_SIZE) - 1]; ///< finite state machine storage
+    /**
+     * One buffer per thread, holding the 2 * steps_y rows of finite state
+     * machine storage followed by the 2 rows of the horizontally padded
+     * row being filtered
+     */
+    uint32_t **buf;
 } FilterParam;
 
 typedef struct {
     FilterParam luma;   ///< luma parameters (width, height, amount)
     FilterParam chroma; ///< chroma parameters (width, height, amount)
     int hsub, vsub;
+    int nb_threads;     ///< number of buffers of each FilterParam
+    int nb_bands;       ///< bands of rows each plane is split in
+    void (*hstage)(uint32_t *dst, const uint32_t *src, int len);
+    void (*vstage)(uint32_t *row, uint32_t *state, int len);
 } UnsharpContext;
 
-static void apply_unsharp(      uint8_t *dst, int dst_stride,
-                          const uint8_t *src, int src_stride,
-                          int width, int height, FilterParam *fp)
+void ff_unsharp_hstage_c(uint32_t *dst, const uint32_t *src, int len)
+{
+    int x;
+
+    dst[0] = src[0];
+    for (x = 1; x < len; x++)
+        dst[x] = src[x] + src[x - 1];
+}
+
+void ff_unsharp_vstage_c(uint32_t *row, uint32_t *state, int len)
 {
-    uint32_t **sc = fp->sc;
-    uint32_t sr[(MAX_SIZE * MAX_SIZE) - 1], tmp1, tmp2;
+    int x;
 
-    int32_t res;
+    for (x = 0; x < len; x++) {
+        uint32_t tmp = state[x] + row[x];
+        state[x] = row[x];
+        row[x]   = tmp;
+    }
+}
+
+/**
+ * The horizontal and vertical state machines are evaluated a whole row at
+ * a time, one stage after the other, rather than one pixel at a time
+ * through all the stages, so that each stage is a loop over independent
+ * columns which can be done with SIMD.
+ *
+ * Output row y only depends on the input rows y - steps_y to y + steps_y,
+ * so the rows y0 to y1 are filtered on their own by starting the state
+ * machines 2 * steps_y rows early.
+ */
+static void apply_unsharp(UnsharpContext *unsharp,
+                                uint8_t *dst, int dst_stride,
+                          const uint8_t *src, int src_stride,
+                          int width, int height, int y0, int y1,
+                          FilterParam *fp, uint32_t *buf)
+{
+    const int padded_width = width + 2 * fp->steps_x;
+    uint32_t *sc = buf;
+    uint32_t *sr  = buf + 2 * fp->steps_y * padded_width;
+    uint32_t *tmp = sr + padded_width;
     int x, y, z;
-    const uint8_t *src2 = NULL;  //silence a warning
 
     if (!fp->amount) {
-        if (dst_stride == src_stride)
-            memcpy(dst, src, src_stride * height);
-        else
-            for (y = 0; y < height; y++, dst += dst_stride, src += src_stride)
-                memcpy(dst, src, width);
+        for (y = y0; y < y1; y++)
+            memcpy(dst + y * dst_stride, src + y * src_stride, width);
         return;
     }
 
-    for (y = 0; y < 2 * fp->steps_y; y++)
-        memset(sc[y], 0, sizeof(sc[y][0]) * (width + 2 * fp->steps_x));
+    memset(sc, 0, sizeof(*sc) * 2 * fp->steps_y * padded_width);
 
-    for (y = -fp->steps_y; y < height + fp->steps_y; y++) {
-        if (y < height)
-            src2 = src;
+    for (y = y0 - fp->steps_y; y < y1 + fp->steps_y; y++) {
+        const uint8_t *src2 = src + av_clip(y, 0, height - 1) * src_stride;
 
-        memset(sr, 0, sizeof(sr[0]) * (2 * fp->steps_x - 1));
-        for (x = -fp->steps_x; x < width + fp->steps_x; x++) {
-            tmp1 = x <= 0 ? src2[0] : x >= width ? src2[width-1] : src2[x];
-            for (z = 0; z < fp->steps_x * 2; z += 2) {
-                tmp2 = sr[z + 0] + tmp1; sr[z + 0] = tmp1;
-                tmp1 = sr[z + 1] + tmp2; sr[z + 1] = tmp2;
-            }
-            for (z = 0; z < fp->steps_y * 2; z += 2) {
-                tmp2 = sc[z + 0][x + fp->steps_x] + tmp1; sc[z + 0][x + fp->steps_x] = tmp1;
-                tmp1 = sc[z + 1][x + fp->steps_x] + tmp2; sc[z + 1][x + fp->steps_x] = tmp2;
-            }
-            if (x >= fp->steps_x && y >= fp->steps_y) {
-                const uint8_t *srx = src - fp->steps_y * src_stride + x - fp->steps_x;
-                uint8_t       *dsx = dst - fp->steps_y * dst_stride + x - fp->steps_x;
+        for (x = 0; x < fp->steps_x; x++)
+            sr[x] = src2[0];
+        for (x = 0; x < width; x++)
+            sr[x + fp->steps_x] = src2[x];
+        for (x = width; x < width + fp->steps_x; x++)
+            sr[x + fp->steps_x] = src2[width - 1];
 
-                res = (int32_t)*srx + ((((int32_t) * srx - (int32_t)((tmp1 + fp->halfscale) >> fp->scalebits)) * fp->amount) >> 16);
-                *dsx = av_clip_uint8(res);
-            }
+        for (z = 0; z < fp->steps_x * 2; z++) {
+            uint32_t *t;
+            unsharp->hstage(tmp, sr, padded_width);
+            t = sr; sr = tmp; tmp = t;
         }
-        if (y >= 0) {
-            dst += dst_stride;
-            src += src_stride;
+        for (z = 0; z < fp->steps_y * 2; z++)
+            unsharp->vstage(sr, sc + z * padded_width, padded_width);
+        if (y >= y0 + fp->steps_y) {
+            const uint8_t *srx = src + (y - fp->steps_y) * src_stride;
+            uint8_t       *dsx = dst + (y - fp->steps_y) * dst_stride;
+            const uint32_t *blur = sr + 2 * fp->steps_x;
+
+            for (x = 0; x < width; x++) {
+                int32_t res = (int32_t)srx[x] + ((((int32_t)srx[x] - (int32_t)((blur[x] + fp->halfscale) >> fp->scalebits)) * fp->amount) >> 16);
+                dsx[x] = av_clip_uint8(res);
+            }
         }
     }
 }
@@ -135,6 +174,7 @@ static av_cold int init(AVFilterContext *ctx, const char *args, void *opaque)
     int lmsize_x = 5, cmsize_x = 5;
     int lmsize_y = 5, cmsize_y = 5;
     double lamount = 1.0f, camount = 0.0f;
+    av_unused int cpu_flags = av_get_cpu_flags();
 
     if (args)
         sscanf(args, "%d:%d:%lf:%d:%d:%lf", &lmsize_x, &lmsize_y, &lamount,
@@ -151,6 +191,13 @@ static av_cold int init(AVFilterContext *ctx, const char *args, void *opaque)
     set_filter_param(&unsharp->luma,   lmsize_x, lmsize_y, lamount);
     set_filter_param(&unsharp->chroma, cmsize_x, cmsize_y, camount);
 
+    unsharp->hstage = ff_unsharp_hstage_c;
+    unsharp->vstage = ff_unsharp_vstage_c;
+    if (HAVE_SSE && cpu_flags & AV_CPU_FLAG_SSE2) {
+        unsharp->hstage = ff_unsharp_hstage_sse2;
+        unsharp->vstage = ff_unsharp_vstage_sse2;
+    }
+
     return 0;
 }
 
@@ -167,9 +214,10 @@ static int query_formats(AVFilterContext *ctx)
     return 0;
 }
 
-static void init_filter_param(AVFilterContext *ctx, FilterParam *fp, const char *effect_type, int width)
+static int init_filter_param(AVFilterContext *ctx, FilterParam *fp, const char *effect_type,
+                             int width, int nb_threads)
 {
-    int z;
+    int i;
     const char *effect;
 
     effect = fp->amount == 0 ? "none" : fp->amount < 0 ? "blur" : "sharpen";
@@ -177,50 +225,89 @@ static void init_filter_param(AVFilterContext *ctx, FilterParam *fp, const char
     av_log(ctx, AV_LOG_INFO, "effect:%s type:%s msize_x:%d msize_y:%d amount:%0.2f\n",
            effect, effect_type, fp->msize_x, fp->msize_y, fp->amount / 65535.0);
 
-    for (z = 0; z < 2 * fp->steps_y; z++)
-        fp->sc[z] = av_malloc(sizeof(*(fp->sc[z])) * (width + 2 * fp->steps_x));
+    if (!(fp->buf = av_mallocz(nb_threads * sizeof(*fp->buf))))
+        return AVERROR(ENOMEM);
+    for (i = 0; i < nb_threads; i++)
+        if (!(fp->buf[i] = av_malloc(sizeof(*fp->buf[i]) * (2 * fp->steps_y + 2) *
+                                                           (width + 2 * fp->steps_x))))
+            return AVERROR(ENOMEM);
+
+    return 0;
 }
 
-static int config_props(AVFilterLink *link)
+static void free_filter_param(FilterParam *fp, int nb_threads)
 {
-    UnsharpContext *unsharp = link->dst->priv;
-
-    unsharp->hsub = av_pix_fmt_descriptors[link->format].log2_chroma_w;
-    unsharp->vsub = av_pix_fmt_descriptors[link->format].log2_chroma_h;
-
-    init_filter_param(link->dst, &unsharp->luma,   "luma",   link->w);
-    init_filter_param(link->dst, &unsharp->chroma, "chroma", SHIFTUP(link->w, unsharp->hsub));
+    int i;
 
-    return 0;
+    for (i = 0; fp->buf && i < nb_threads; i++)
+        av_free(fp->buf[i]);
+    av_freep(&fp->buf);
 }
 
-static void free_filter_param(FilterParam *fp)
+static av_cold void uninit(AVFilterContext *ctx)
 {
-    int z;
+    UnsharpContext *unsharp = ctx->priv;
 
-    for (z = 0; z < 2 * fp->steps_y; z++)
-        av_free(fp->sc[z]);
+    free_filter_param(&unsharp->luma,   unsharp->nb_threads);
+    free_filter_param(&unsharp->chroma, unsharp->nb_threads);
 }
 
-static av_cold void uninit(AVFilterContext *ctx)
+static int config_props(AVFilterLink *link)
 {
+    AVFilterContext *ctx = link->dst;
     UnsharpContext *unsharp = ctx->priv;
+    int ret;
 
-    free_filter_param(&unsharp->luma);
-    free_filter_param(&unsharp->chroma);
+    unsharp->hsub = av_pix_fmt_descriptors[link->format].log2_chroma_w;
+    unsharp->vsub = av_pix_fmt_descriptors[link->format].log2_chroma_h;
+
+    uninit(ctx);
+    unsharp->nb_threads = ctx->thread_pool ?
+                          av_threadpool_get_nb_threads(ctx->thread_pool) + 1 : 1;
+    /* each band filters 2 * steps_y rows more than it outputs, so the bands
+     * are not made smaller than 32 rows */
+    unsharp->nb_bands = av_clip(link->h / 32, 1, unsharp->nb_threads);
+
+    ret = init_filter_param(ctx, &unsharp->luma,   "luma",   link->w, unsharp->nb_threads);
+    if (ret < 0)
+        return ret;
+    return init_filter_param(ctx, &unsharp->chroma, "chroma", SHIFTUP(link->w, unsharp->hsub),
+                             unsharp->nb_threads);
 }
 
-static void end_frame(AVFilterLink *link)
+/** Filter band jobnr % nb_bands of plane jobnr / nb_bands. */
+static int unsharp_job(void *ctx, void *arg, int jobnr, int threadnr)
 {
-    UnsharpContext *unsharp = link->dst->priv;
+    UnsharpContext *unsharp = ctx;
+    AVFilterLink *link = arg;
     AVFilterBufferRef *in  = link->cur_buf;
     AVFilterBufferRef *out = link->dst->outputs[0]->out_buf;
-    int cw = SHIFTUP(link->w, unsharp->hsub);
-    int ch = SHIFTUP(link->h, unsharp->vsub);
+    int plane = jobnr / unsharp->nb_bands, band = jobnr % unsharp->nb_bands;
+    int w = plane ? SHIFTUP(link->w, unsharp->hsub) : link->w;
+    int h = plane ? SHIFTUP(link->h, unsharp->vsub) : link->h;
+    FilterParam *fp = plane ? &unsharp->chroma : &unsharp->luma;
+
+    apply_unsharp(unsharp, out->data[plane], out->linesize[plane],
+                  in->data[plane], in->linesize[plane], w, h,
+                  h * band / unsharp->nb_bands, h * (band + 1) / unsharp->nb_bands,
+                  fp, fp->buf[threadnr]);
+    return 0;
+}
 
-    apply_unsharp(out->data[0], out->linesize[0], in->data[0], in->linesize[0], link->w, link->h, &unsharp->luma);
-    apply_unsharp(out->data[1], out->linesize[1], in->data[1], in->linesize[1], cw,      ch,      &unsharp->chroma);
-    apply_unsharp(out->data[2], out->linesize[2], in->data[2], in->linesize[2], cw,      ch,      &unsharp->chroma);
+static void end_frame(AVFilterLink *link)
+{
+    AVFilterContext *ctx = link->dst;
+    UnsharpContext *unsharp = ctx->priv;
+    AVFilterBufferRef *in  = link->cur_buf;
+    AVFilterBufferRef *out = ctx->outputs[0]->out_buf;
+    int i;
+
+    if (ctx->thread_pool)
+        av_threadpool_execute(ctx->thread_pool, unsharp_job, unsharp, link, NULL,
+                              3 * unsharp->nb_bands, unsharp->nb_threads);
+    else
+        for (i = 0; i < 3 * unsharp->nb_bands; i++)
+            unsharp_job(unsharp, link, i, 0);
 
     avfilter_unref_buffer(in);
     avfilter_draw_slice(link->dst->outputs[0], 0, link->h, 1);
@@ -20,6 +20,7 @@
 #include "libavutil/cpu.h"
 #include "libavutil/common.h"
 #include "libavutil/pixdesc.h"
+#include "libavutil/threadpool.h"
 #include "avfilter.h"
 #include "yadif.h"
 
@@ -32,6 +33,10 @@ typedef struct {
      * 1: send 1 frame for each field
      * 2: like 0 but skips spatial interlacing check
      * 3: like 1 but skips spatial interlacing check
+     * 4: send 1 frame for each frame, blending the lines of both fields
+     *    with a (1 2 1)/4 vertical filter
+     * 5: send 1 frame for each field, interpolating the missing lines
+     *    linearly from the current field only
      */
     int mode;
 
@@ -61,6 +66,13 @@ typedef struct {
     const AVPixFmtDescriptor *csp;
 } YADIFContext;
 
+typedef struct {
+    AVFilterBufferRef *dst;
+    int parity;
+    int tff;
+    int nb_jobs;
+} ThreadData;
+
 #define CHECK(j)\
     {   int score = FFABS(cur[mrefs-1+(j)] - cur[prefs-1-(j)])\
                   + FFABS(cur[mrefs  +(j)] - cur[prefs  -(j)])\
@@ -120,9 +132,9 @@ static void filter_line_c(uint8_t *dst,
     FILTER
 }
 
-static void filter_line_c_16bit(uint16_t *dst,
-                                uint16_t *prev, uint16_t *cur, uint16_t *next,
-                                int w, int prefs, int mrefs, int parity, int mode)
+void ff_yadif_filter_line_c_16bit(uint16_t *dst,
+                                  uint16_t *prev, uint16_t *cur, uint16_t *next,
+                                  int w, int prefs, int mrefs, int parity, int mode)
 {
     int x;
     uint16_t *prev2 = parity ? prev : cur ;
@@ -133,26 +145,80 @@ static void filter_line_c_16bit(uint16_t *dst,
     FILTER
 }
 
-static void filter(AVFilterContext *ctx, AVFilterBufferRef *dstpic,
-                   int parity, int tff)
+static void filter_line_blend(uint8_t *dst,
+                              uint8_t *prev, uint8_t *cur, uint8_t *next,
+                              int w, int prefs, int mrefs, int parity, int mode)
 {
-    YADIFContext *yadif = ctx->priv;
+    int x;
+
+    for (x = 0; x < w; x++)
+        dst[x] = (cur[mrefs + x] + 2*cur[x] + cur[prefs + x] + 2) >> 2;
+}
+
+static void filter_line_blend_16bit(uint16_t *dst,
+                                    uint16_t *prev, uint16_t *cur, uint16_t *next,
+                                    int w, int prefs, int mrefs, int parity, int mode)
+{
+    int x;
+
+    mrefs /= 2;
+    prefs /= 2;
+    for (x = 0; x < w; x++)
+        dst[x] = (cur[mrefs + x] + 2*cur[x] + cur[prefs + x] + 2) >> 2;
+}
+
+static void filter_line_linear(uint8_t *dst,
+                               uint8_t *prev, uint8_t *cur, uint8_t *next,
+                               int w, int prefs, int mrefs, int parity, int mode)
+{
+    int x;
+
+    for (x = 0; x < w; x++)
+        dst[x] = (cur[mrefs + x] + cur[prefs + x]) >> 1;
+}
+
+static void filter_line_linear_16bit(uint16_t *dst,
+                                     uint16_t *prev, uint16_t *cur, uint16_t *next,
+                                     int w, int prefs, int mrefs, int parity, int mode)
+{
+    int x;
+
+    mrefs /= 2;
+    prefs /= 2;
+    for (x = 0; x < w; x++)
+        dst[x] = (cur[mrefs + x] + cur[prefs + x]) >> 1;
+}
+
+/**
+ * Filter a horizontal band of every plane. The output lines only depend on
+ * the input frames, so the bands can be filtered concurrently.
+ */
+static int filter_slice(void *ctx, void *arg, int jobnr, int threadnr)
+{
+    YADIFContext *yadif = ctx;
+    ThreadData *td = arg;
+    AVFilterBufferRef *dstpic = td->dst;
+    int parity = td->parity, tff = td->tff;
     int y, i;
 
     for (i = 0; i < yadif->csp->nb_components; i++) {
         int w = dstpic->video->w;
         int h = dstpic->video->h;
         int refs = yadif->cur->linesize[i];
-        int df = (yadif->csp->comp[i].depth_minus1+1) / 8;
+        int df = (yadif->csp->comp[i].depth_minus1 + 8) / 8;
+        int slice_start, slice_end;
 
         if (i == 1 || i == 2) {
         /* Why is this not part of the per-plane description thing? */
             w >>= yadif->csp->log2_chroma_w;
             h >>= yadif->csp->log2_chroma_h;
         }
+        slice_start = h *  jobnr      / td->nb_jobs;
+        slice_end   = h * (jobnr + 1) / td->nb_jobs;
 
-        for (y = 0; y < h; y++) {
-            if ((y ^ parity) & 1) {
+        for (y = slice_start; y < slice_end; y++) {
+            /* the blend mode filters the lines of both fields */
+            if ((y ^ parity) & 1 || yadif->mode == 4) {
                 uint8_t *prev = &yadif->prev->data[i][y*refs];
                 uint8_t *cur  = &yadif->cur ->data[i][y*refs];
                 uint8_t *next = &yadif->next->data[i][y*refs];
@@ -168,6 +234,24 @@ static void filter(AVFilterContext *ctx, AVFilterBufferRef *dstpic,
 #if HAVE_MMX
     __asm__ volatile("emms \n\t" : : : "memory");
 #endif
+    return 0;
+}
+
+static void filter(AVFilterContext *ctx, AVFilterBufferRef *dstpic,
+                   int parity, int tff)
+{
+    YADIFContext *yadif = ctx->priv;
+    ThreadData td = { .dst = dstpic, .parity = parity, .tff = tff };
+
+    if (ctx->thread_pool) {
+        /* one band per worker of the graph pool, plus one for this thread */
+        td.nb_jobs = av_threadpool_get_nb_threads(ctx->thread_pool) + 1;
+        av_threadpool_execute(ctx->thread_pool, filter_slice, yadif, &td,
+                              NULL, td.nb_jobs, td.nb_jobs);
+    } else {
+        td.nb_jobs = 1;
+        filter_slice(yadif, &td, 0, 0);
+    }
 }
 
 static AVFilterBufferRef *get_video_buffer(AVFilterLink *link, int perms, int w, int h)
@@ -208,11 +292,6 @@ static void return_frame(AVFilterContext *ctx, int is_second)
         yadif->out->video->interlaced = 0;
     }
 
-    if (!yadif->csp)
-        yadif->csp = &av_pix_fmt_descriptors[link->format];
-    if (yadif->csp->comp[0].depth_minus1 == 15)
-        yadif->filter_line = (void*)filter_line_c_16bit;
-
     filter(ctx, yadif->out, tff ^ !is_second, tff);
 
     if (is_second) {
@@ -352,6 +431,12 @@ static int query_formats(AVFilterContext *ctx)
         AV_NE( PIX_FMT_GRAY16BE, PIX_FMT_GRAY16LE ),
         PIX_FMT_YUV440P,
         PIX_FMT_YUVJ440P,
+        AV_NE( PIX_FMT_YUV420P9BE,  PIX_FMT_YUV420P9LE  ),
+        AV_NE( PIX_FMT_YUV422P9BE,  PIX_FMT_YUV422P9LE  ),
+        AV_NE( PIX_FMT_YUV444P9BE,  PIX_FMT_YUV444P9LE  ),
+        AV_NE( PIX_FMT_YUV420P10BE, PIX_FMT_YUV420P10LE ),
+        AV_NE( PIX_FMT_YUV422P10BE, PIX_FMT_YUV422P10LE ),
+        AV_NE( PIX_FMT_YUV444P10BE, PIX_FMT_YUV444P10LE ),
         AV_NE( PIX_FMT_YUV420P16BE, PIX_FMT_YUV420P16LE ),
         AV_NE( PIX_FMT_YUV422P16BE, PIX_FMT_YUV422P16LE ),
         AV_NE( PIX_FMT_YUV444P16BE, PIX_FMT_YUV444P16LE ),
@@ -367,15 +452,32 @@ static int query_formats(AVFilterContext *ctx)
 static av_cold int init(AVFilterContext *ctx, const char *args, void *opaque)
 {
     YADIFContext *yadif = ctx->priv;
-    av_unused int cpu_flags = av_get_cpu_flags();
 
     yadif->mode = 0;
     yadif->parity = -1;
     yadif->auto_enable = 0;
-    yadif->csp = NULL;
 
     if (args) sscanf(args, "%d:%d:%d", &yadif->mode, &yadif->parity, &yadif->auto_enable);
 
+    if (yadif->mode < 0 || yadif->mode > 5) {
+        av_log(ctx, AV_LOG_ERROR, "Invalid mode %d\n", yadif->mode);
+        return AVERROR(EINVAL);
+    }
+
+    av_log(ctx, AV_LOG_INFO, "mode:%d parity:%d auto_enable:%d\n",
+           yadif->mode, yadif->parity, yadif->auto_enable);
+
+    return 0;
+}
+
+static int config_props(AVFilterLink *link)
+{
+    YADIFContext *yadif = link->dst->priv;
+    av_unused int cpu_flags = av_get_cpu_flags();
+
+    yadif->csp = &av_pix_fmt_descriptors[link->format];
+
+    /* selected here, a reconfiguration may change the bit depth */
     yadif->filter_line = filter_line_c;
     if (HAVE_SSSE3 && cpu_flags & AV_CPU_FLAG_SSSE3)
         yadif->filter_line = ff_yadif_filter_line_ssse3;
@@ -384,7 +486,18 @@ static av_cold int init(AVFilterContext *ctx, const char *args, void *opaque)
     else if (HAVE_MMX && cpu_flags & AV_CPU_FLAG_MMX)
         yadif->filter_line = ff_yadif_filter_line_mmx;
 
-    av_log(ctx, AV_LOG_INFO, "mode:%d parity:%d auto_enable:%d\n", yadif->mode, yadif->parity, yadif->auto_enable);
+    if (yadif->csp->comp[0].depth_minus1 >= 8) {
+        yadif->filter_line = (void*)ff_yadif_filter_line_c_16bit;
+        /* the SIMD version works on signed words */
+        if (HAVE_SSE && cpu_flags & AV_CPU_FLAG_SSE2 && yadif->csp->comp[0].depth_minus1 < 12)
+            yadif->filter_line = (void*)ff_yadif_filter_line_16bit_sse2;
+    }
+    if (yadif->mode == 4)
+        yadif->filter_line = yadif->csp->comp[0].depth_minus1 >= 8 ?
+                             (void*)filter_line_blend_16bit : filter_line_blend;
+    else if (yadif->mode == 5)
+        yadif->filter_line = yadif->csp->comp[0].depth_minus1 >= 8 ?
+                             (void*)filter_line_linear_16bit : filter_line_linear;
 
     return 0;
 }
@@ -404,6 +517,7 @@ AVFilter avfilter_vf_yadif = {
                                     .type             = AVMEDIA_TYPE_VIDEO,
                                     .start_frame      = start_frame,
                                     .get_video_buffer = get_video_buffer,
+                                    .config_props     = config_props,
                                     .draw_slice       = null_draw_slice,
                                     .end_frame        = end_frame, },
                                   { .name = NULL}},
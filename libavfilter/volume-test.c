@@ -0,0 +1,154 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file
+ * volume filter DSP test: prints a checksum of the output of the C sample
+ * scaling functions and checks the SIMD ones against them. With -b, also
+ * measures their speed.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "config.h"
+#include "libavutil/common.h"
+#include "libavutil/cpu.h"
+#include "libavutil/crc.h"
+#include "libavutil/intreadwrite.h"
+#include "libavutil/lfg.h"
+#include "volume.h"
+
+#undef printf
+#undef fprintf
+
+#define NB_SAMPLES 4099 ///< not a multiple of the SIMD block size, to test the tails
+#define NB_ITS     2000 ///< iterations when benchmarking
+
+static uint8_t buf_ref[NB_SAMPLES * 8], buf_test[NB_SAMPLES * 8], buf_src[NB_SAMPLES * 8];
+
+static int64_t gettime(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv,NULL);
+    return (int64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+static void fill_random(AVLFG *prng, uint8_t *tab, int size)
+{
+    int i;
+
+    for (i = 0; i < size; i++)
+        tab[i] = av_lfg_get(prng);
+}
+
+/* for the float formats fill the buffer with values in [-1, 1) */
+static void fill_random_flt(AVLFG *prng, int is_dbl)
+{
+    int i;
+
+    for (i = 0; i < NB_SAMPLES; i++) {
+        double v = (int)av_lfg_get(prng) / 2147483648.0;
+        if (is_dbl) ((double *)buf_src)[i] = v;
+        else        ((float  *)buf_src)[i] = v;
+    }
+}
+
+/* samples are checksummed in little-endian order, so that the output does
+ * not depend on the host */
+static uint32_t checksum(int size, int nb_samples)
+{
+    uint8_t le[NB_SAMPLES * 8];
+    int i;
+
+    for (i = 0; i < nb_samples; i++) {
+        switch (size) {
+        case 1: le[i] = buf_ref[i];                                    break;
+        case 2: AV_WL16(le + 2*i, ((uint16_t *)buf_ref)[i]);          break;
+        case 4: AV_WL32(le + 4*i, ((uint32_t *)buf_ref)[i]);          break;
+        case 8: AV_WL64(le + 8*i, ((uint64_t *)buf_ref)[i]);          break;
+        }
+    }
+    return av_crc(av_crc_get_table(AV_CRC_32_IEEE), 0, le, size * nb_samples);
+}
+
+#define TEST_C(name, type, ref_func, volume)                            \
+    do {                                                                \
+        memcpy(buf_ref, buf_src, NB_SAMPLES * sizeof(type));            \
+        ref_func((type *)buf_ref, NB_SAMPLES, volume);                  \
+        printf("%-4s %08x\n", name, checksum(sizeof(type), NB_SAMPLES)); \
+    } while (0)
+
+#define TEST_SCALE(name, type, ref_func, test_func, volume)             \
+    do {                                                                \
+        int64_t t_ref = 0, t_test = 0, t;                               \
+        int it, nb_its = bench ? NB_ITS : 1;                            \
+        for (it = 0; it < nb_its; it++) {                               \
+            memcpy(buf_ref,  buf_src, NB_SAMPLES * sizeof(type));       \
+            memcpy(buf_test, buf_src, NB_SAMPLES * sizeof(type));       \
+            t = gettime();                                              \
+            ref_func((type *)buf_ref, NB_SAMPLES, volume);              \
+            t_ref += gettime() - t;                                     \
+            t = gettime();                                              \
+            test_func((type *)buf_test, NB_SAMPLES, volume);            \
+            t_test += gettime() - t;                                    \
+        }                                                               \
+        if (memcmp(buf_ref, buf_test, NB_SAMPLES * sizeof(type))) {     \
+            printf("error: %s differs from C for volume %s\n", name, #volume); \
+            ret = 1;                                                    \
+        } else if (bench) {                                             \
+            fprintf(stderr, "%-6s C %6.1f  SIMD %6.1f Msamples/s\n", name, \
+                    (double)NB_ITS * NB_SAMPLES / t_ref,                \
+                    (double)NB_ITS * NB_SAMPLES / t_test);              \
+        }                                                               \
+    } while (0)
+
+int main(int argc, char **argv)
+{
+    static const int volumes[] = { 0, 77, 255, 257, 600, 32767 };
+    int cpu_flags = av_get_cpu_flags();
+    int bench = argc > 1 && !strcmp(argv[1], "-b");
+    AVLFG prng;
+    int i, ret = 0;
+
+    av_lfg_init(&prng, 1);
+
+    for (i = 0; i < FF_ARRAY_ELEMS(volumes); i++) {
+        int volume_i = volumes[i];
+
+        printf("volume_i %d\n", volume_i);
+        fill_random(&prng, buf_src, sizeof(buf_src));
+        TEST_C("u8",  uint8_t, ff_volume_scale_samples_u8_c,  volume_i);
+        TEST_C("s16", int16_t, ff_volume_scale_samples_s16_c, volume_i);
+        TEST_C("s32", int32_t, ff_volume_scale_samples_s32_c, volume_i);
+        if (HAVE_SSE && cpu_flags & AV_CPU_FLAG_SSE2) {
+            TEST_SCALE("u8",  uint8_t, ff_volume_scale_samples_u8_c,  ff_volume_scale_samples_u8_sse2,  volume_i);
+            TEST_SCALE("s16", int16_t, ff_volume_scale_samples_s16_c, ff_volume_scale_samples_s16_sse2, volume_i);
+        }
+        fill_random_flt(&prng, 0);
+        TEST_C("flt", float, ff_volume_scale_samples_flt_c, volume_i / 256.0f);
+        if (HAVE_SSE && cpu_flags & AV_CPU_FLAG_SSE)
+            TEST_SCALE("flt", float,  ff_volume_scale_samples_flt_c, ff_volume_scale_samples_flt_sse,  volume_i / 256.0f);
+        fill_random_flt(&prng, 1);
+        if (HAVE_SSE && cpu_flags & AV_CPU_FLAG_SSE2)
+            TEST_SCALE("dbl", double, ff_volume_scale_samples_dbl_c, ff_volume_scale_samples_dbl_sse2, volume_i / 256.0);
+    }
+
+    return ret;
+}
@@ -0,0 +1,49 @@
+/*
+ * Copyright (c) 2011 Stefano Sabatini
+ *
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef AVFILTER_VOLUME_H
+#define AVFILTER_VOLUME_H
+
+#include <stdint.h>
+
+typedef struct {
+    double volume;
+    int    volume_i;
+    /// DSP functions, scaling nb_samples samples in place.
+    void (*scale_samples_u8) (uint8_t *p, int nb_samples, int volume_i);
+    void (*scale_samples_s16)(int16_t *p, int nb_samples, int volume_i);
+    void (*scale_samples_s32)(int32_t *p, int nb_samples, int volume_i);
+    void (*scale_samples_flt)(float   *p, int nb_samples, float  volume);
+    void (*scale_samples_dbl)(double  *p, int nb_samples, double volume);
+} VolumeContext;
+
+void ff_volume_scale_samples_u8_c (uint8_t *p, int nb_samples, int volume_i);
+void ff_volume_scale_samples_s16_c(int16_t *p, int nb_samples, int volume_i);
+void ff_volume_scale_samples_s32_c(int32_t *p, int nb_samples, int volume_i);
+void ff_volume_scale_samples_flt_c(float   *p, int nb_samples, float  volume);
+void ff_volume_scale_samples_dbl_c(double  *p, int nb_samples, double volume);
+
+/* the integer versions require volume_i < 32768 */
+void ff_volume_scale_samples_u8_sse2 (uint8_t *p, int nb_samples, int volume_i);
+void ff_volume_scale_samples_s16_sse2(int16_t *p, int nb_samples, int volume_i);
+void ff_volume_scale_samples_flt_sse (float   *p, int nb_samples, float  volume);
+void ff_volume_scale_samples_dbl_sse2(double  *p, int nb_samples, double volume);
+
+#endif /* AVFILTER_VOLUME_H */
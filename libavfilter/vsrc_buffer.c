@@ -102,8 +102,16 @@ int av_vsrc_buffer_add_video_buffer_ref(AVFilterContext *buffer_filter,
             return ret;
     }
 
+    if (flags & AV_VSRC_BUF_FLAG_NO_COPY) {
+        if (!(c->picref = avfilter_ref_buffer(picref, ~0)))
+            return AVERROR(ENOMEM);
+        return 0;
+    }
+
     c->picref = avfilter_get_video_buffer(outlink, AV_PERM_WRITE,
                                           picref->video->w, picref->video->h);
+    if (!c->picref)
+        return AVERROR(ENOMEM);
     av_image_copy(c->picref->data, c->picref->linesize,
                   (void*)picref->data, picref->linesize,
                   picref->format, picref->video->w, picref->video->h);
@@ -35,6 +35,14 @@
  */
 #define AV_VSRC_BUF_FLAG_OVERWRITE 1
 
+/**
+ * Tell av_vsrc_buffer_add_video_buffer_ref() to send a new reference to
+ * the added buffer instead of a copy of its data. The frame must not be
+ * modified by the caller while the filters may still use it, which the
+ * caller can signal with AV_PERM_PRESERVE.
+ */
+#define AV_VSRC_BUF_FLAG_NO_COPY   2
+
 /**
  * Add video buffer data in picref to buffer_src.
  *
@@ -0,0 +1,64 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with FFmpeg; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "libavutil/cpu.h"
+#include "libavutil/x86_cpu.h"
+#include "libavfilter/boxblur.h"
+
+void ff_boxblur_blur_row_sse2(uint8_t *dst, const uint8_t *add, const uint8_t *sub,
+                              uint16_t *sum, int w, int inv)
+{
+#if HAVE_SSE
+    intptr_t x;
+    if (w & 7) {
+        x = w & ~7;
+        ff_boxblur_blur_row_c(dst + x, add + x, sub + x, sum + x, w - x, inv);
+        w = x;
+        if (!w)
+            return;
+    }
+    x = -w;
+    __asm__ volatile(
+        "movd           %5, %%xmm6 \n"
+        "pxor       %%xmm7, %%xmm7 \n"
+        "pshuflw $0,%%xmm6, %%xmm6 \n"
+        "punpcklqdq %%xmm6, %%xmm6 \n"
+        "1: \n"
+        "movq      (%2,%0), %%xmm0 \n"
+        "movq      (%3,%0), %%xmm1 \n"
+        "movdqu  (%4,%0,2), %%xmm2 \n"
+        "punpcklbw  %%xmm7, %%xmm0 \n"
+        "punpcklbw  %%xmm7, %%xmm1 \n"
+        "paddw      %%xmm0, %%xmm2 \n"
+        "psubw      %%xmm1, %%xmm2 \n" // sum += add - sub
+        "movdqu     %%xmm2, (%4,%0,2) \n"
+        "movdqa     %%xmm2, %%xmm3 \n"
+        "pmulhuw    %%xmm6, %%xmm2 \n" // sum * inv >> 16
+        "pmullw     %%xmm6, %%xmm3 \n"
+        "psrlw         $15, %%xmm3 \n" // rounding bit
+        "paddw      %%xmm3, %%xmm2 \n"
+        "packuswb   %%xmm2, %%xmm2 \n"
+        "movq       %%xmm2, (%1,%0) \n"
+        "add            $8, %0 \n"
+        "jl 1b \n"
+        :"+&r"(x)
+        :"r"(dst+w), "r"(add+w), "r"(sub+w), "r"(sum+w), "rm"(inv)
+        : XMM_CLOBBERS("%xmm0", "%xmm1", "%xmm2", "%xmm3", "%xmm6", "%xmm7",) "memory"
+    );
+#endif
+}
@@ -0,0 +1,97 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "libavutil/cpu.h"
+#include "libavutil/mem.h"
+#include "libavutil/x86_cpu.h"
+#include "libavfilter/drawtext.h"
+
+DECLARE_ALIGNED(16, static const uint16_t, pw_fe01)[8] = {0xFE01,0xFE01,0xFE01,0xFE01,0xFE01,0xFE01,0xFE01,0xFE01};
+
+/*
+ * With v = alpha * mask, the C code computes
+ * (v*129 * color + (255*255 - v)*129 * dst) >> 23,
+ * so the two products are done on 16 bits with pmullw/pmulhuw and the
+ * sum is widened to 32 bits before the multiplication by 129.
+ */
+void ff_drawtext_blend_row_sse2(uint8_t *dst, const uint8_t *mask, int w,
+                                int color, int alpha)
+{
+#if HAVE_SSE
+    intptr_t x = w & ~7;
+    if (w & 7)
+        ff_drawtext_blend_row_c(dst + x, mask + x, w - x, color, alpha);
+    if (!x)
+        return;
+    w = x;
+    x = -w;
+    __asm__ volatile(
+        "pxor        %%xmm7, %%xmm7 \n"
+        "movd           %3,  %%xmm5 \n"
+        "movd           %4,  %%xmm6 \n"
+        "pshuflw $0, %%xmm5, %%xmm5 \n"
+        "pshuflw $0, %%xmm6, %%xmm6 \n"
+        "punpcklqdq  %%xmm5, %%xmm5 \n"
+        "punpcklqdq  %%xmm6, %%xmm6 \n"
+        "1: \n"
+        "movq       (%2,%0), %%xmm0 \n"
+        "punpcklbw   %%xmm7, %%xmm0 \n"
+        "pmullw      %%xmm6, %%xmm0 \n" /* v */
+        "movdqa         %5,  %%xmm1 \n"
+        "psubw       %%xmm0, %%xmm1 \n" /* 255*255 - v */
+        "movdqa      %%xmm0, %%xmm2 \n"
+        "pmullw      %%xmm5, %%xmm0 \n"
+        "pmulhuw     %%xmm5, %%xmm2 \n"
+        "movdqa      %%xmm0, %%xmm3 \n"
+        "punpcklwd   %%xmm2, %%xmm0 \n"
+        "punpckhwd   %%xmm2, %%xmm3 \n" /* v * color */
+        "movq       (%1,%0), %%xmm2 \n"
+        "punpcklbw   %%xmm7, %%xmm2 \n"
+        "movdqa      %%xmm1, %%xmm4 \n"
+        "pmullw      %%xmm2, %%xmm1 \n"
+        "pmulhuw     %%xmm2, %%xmm4 \n"
+        "movdqa      %%xmm1, %%xmm2 \n"
+        "punpcklwd   %%xmm4, %%xmm1 \n"
+        "punpckhwd   %%xmm4, %%xmm2 \n" /* (255*255 - v) * dst */
+        "paddd       %%xmm1, %%xmm0 \n"
+        "paddd       %%xmm2, %%xmm3 \n"
+        "movdqa      %%xmm0, %%xmm1 \n"
+        "movdqa      %%xmm3, %%xmm2 \n"
+        "pslld           $7, %%xmm0 \n"
+        "pslld           $7, %%xmm3 \n"
+        "paddd       %%xmm1, %%xmm0 \n"
+        "paddd       %%xmm2, %%xmm3 \n" /* * 129 */
+        "psrld          $23, %%xmm0 \n"
+        "psrld          $23, %%xmm3 \n"
+        "packssdw    %%xmm3, %%xmm0 \n"
+        "packuswb    %%xmm0, %%xmm0 \n"
+        "movq       (%2,%0), %%xmm1 \n"
+        "movq       (%1,%0), %%xmm2 \n"
+        "pcmpeqb     %%xmm7, %%xmm1 \n" /* keep dst where the mask is 0 */
+        "pand        %%xmm1, %%xmm2 \n"
+        "pandn       %%xmm0, %%xmm1 \n"
+        "por         %%xmm2, %%xmm1 \n"
+        "movq        %%xmm1, (%1,%0) \n"
+        "add             $8, %0 \n"
+        "jl 1b \n"
+        :"+&r"(x)
+        :"r"(dst+w), "r"(mask+w), "r"(color), "r"(alpha), "m"(*pw_fe01)
+        : XMM_CLOBBERS("%xmm0", "%xmm1", "%xmm2", "%xmm3", "%xmm4", "%xmm5", "%xmm6", "%xmm7",) "memory"
+    );
+#endif
+}
@@ -0,0 +1,221 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "libavutil/cpu.h"
+#include "libavutil/mem.h"
+#include "libavutil/x86_cpu.h"
+#include "libavfilter/overlay.h"
+
+DECLARE_ALIGNED(16, static const uint16_t, pw_ff )[8] = {0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF};
+DECLARE_ALIGNED(16, static const uint16_t, pw_80 )[8] = {0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80};
+DECLARE_ALIGNED(16, static const uint16_t, pw_101)[8] = {0x101,0x101,0x101,0x101,0x101,0x101,0x101,0x101};
+
+/* dst = FAST_DIV255(dst * (255 - alpha) + src * alpha), alpha in xmm0 */
+#define BLEND_8                                                 \
+        "movq       (%1,%0), %%xmm3 \n"                         \
+        "movq       (%2,%0), %%xmm4 \n"                         \
+        "punpcklbw   %%xmm7, %%xmm3 \n"                         \
+        "punpcklbw   %%xmm7, %%xmm4 \n"                         \
+        "movdqa      %%xmm5, %%xmm1 \n"                         \
+        "psubw       %%xmm0, %%xmm1 \n" /* 255 - alpha */       \
+        "pmullw      %%xmm0, %%xmm4 \n"                         \
+        "pmullw      %%xmm1, %%xmm3 \n"                         \
+        "paddw       %%xmm4, %%xmm3 \n"                         \
+        "paddw       %%xmm6, %%xmm3 \n" /* + 128 */             \
+        "pmulhuw        %6,  %%xmm3 \n" /* * 257 >> 16 */       \
+        "packuswb    %%xmm3, %%xmm3 \n"                         \
+        "movq        %%xmm3, (%1,%0) \n"
+
+void ff_overlay_blend_row_sse2(uint8_t *dst, const uint8_t *src, const uint8_t *alpha,
+                               int alpha_linesize, int w)
+{
+#if HAVE_SSE
+    intptr_t x = w & ~7;
+    if (w & 7)
+        ff_overlay_blend_row_c(dst + x, src + x, alpha + x, alpha_linesize, w - x);
+    if (!x)
+        return;
+    w = x;
+    x = -w;
+    __asm__ volatile(
+        "pxor        %%xmm7, %%xmm7 \n"
+        "movdqa         %4,  %%xmm5 \n"
+        "movdqa         %5,  %%xmm6 \n"
+        "1: \n"
+        "movq       (%3,%0), %%xmm0 \n"
+        "punpcklbw   %%xmm7, %%xmm0 \n"
+        BLEND_8
+        "add             $8, %0 \n"
+        "jl 1b \n"
+        :"+&r"(x)
+        :"r"(dst+w), "r"(src+w), "r"(alpha+w),
+         "m"(*pw_ff), "m"(*pw_80), "m"(*pw_101)
+        : XMM_CLOBBERS("%xmm0", "%xmm5", "%xmm6", "%xmm7",) "memory"
+    );
+#endif
+}
+
+void ff_overlay_blend_row_420_sse2(uint8_t *dst, const uint8_t *src, const uint8_t *alpha,
+                                   int alpha_linesize, int w)
+{
+#if HAVE_SSE
+    intptr_t x = w & ~7;
+    if (w & 7)
+        ff_overlay_blend_row_420_c(dst + x, src + x, alpha + 2*x, alpha_linesize, w - x);
+    if (!x)
+        return;
+    w = x;
+    x = -w;
+    __asm__ volatile(
+        "pxor        %%xmm7, %%xmm7 \n"
+        "movdqa         %4,  %%xmm5 \n"
+        "movdqa         %5,  %%xmm6 \n"
+        "1: \n"
+        "movdqu   (%3,%0,2), %%xmm0 \n"
+        "movdqu   (%7,%0,2), %%xmm1 \n"
+        "movdqa      %%xmm0, %%xmm2 \n"
+        "movdqa      %%xmm1, %%xmm3 \n"
+        "psrlw           $8, %%xmm0 \n"
+        "psrlw           $8, %%xmm1 \n"
+        "pand        %%xmm5, %%xmm2 \n"
+        "pand        %%xmm5, %%xmm3 \n"
+        "paddw       %%xmm1, %%xmm0 \n"
+        "paddw       %%xmm3, %%xmm2 \n"
+        "paddw       %%xmm2, %%xmm0 \n"
+        "psrlw           $2, %%xmm0 \n" /* average of the 2x2 alpha block */
+        BLEND_8
+        "add             $8, %0 \n"
+        "jl 1b \n"
+        :"+&r"(x)
+        :"r"(dst+w), "r"(src+w), "r"(alpha+2*w),
+         "m"(*pw_ff), "m"(*pw_80), "m"(*pw_101),
+         "r"(alpha+2*w+alpha_linesize)
+        : XMM_CLOBBERS("%xmm0", "%xmm1", "%xmm2", "%xmm3", "%xmm5", "%xmm6", "%xmm7",) "memory"
+    );
+#endif
+}
+
+DECLARE_ALIGNED(16, static const uint32_t, pd_ff )[4] = {0xFF,0xFF,0xFF,0xFF};
+DECLARE_ALIGNED(16, static const uint32_t, pd_80 )[4] = {0x80,0x80,0x80,0x80};
+DECLARE_ALIGNED(16, static const uint32_t, pd_101)[4] = {0x101,0x101,0x101,0x101};
+DECLARE_ALIGNED(16, static const float, ps_255  )[4] = {255.0, 255.0, 255.0, 255.0};
+DECLARE_ALIGNED(16, static const float, ps_65025)[4] = {65025.0, 65025.0, 65025.0, 65025.0};
+/* shift counts moving the alpha byte to the top of a dword and back */
+DECLARE_ALIGNED(16, static const uint64_t, alpha_shift_up  )[4][2] = {{24}, {16}, {8}, {0}};
+DECLARE_ALIGNED(16, static const uint64_t, alpha_shift_back)[4][2] = {{0}, {8}, {16}, {24}};
+/* the bytes of each pixel which are not alpha */
+DECLARE_ALIGNED(16, static const uint32_t, color_mask)[4][4] = {
+    {0xFFFFFF00,0xFFFFFF00,0xFFFFFF00,0xFFFFFF00},
+    {0xFFFF00FF,0xFFFF00FF,0xFFFF00FF,0xFFFF00FF},
+    {0xFF00FFFF,0xFF00FFFF,0xFF00FFFF,0xFF00FFFF},
+    {0x00FFFFFF,0x00FFFFFF,0x00FFFFFF,0x00FFFFFF},
+};
+
+/* dst = FAST_DIV255(dst * (255 - alpha) + src * alpha) on 16-bit words,
+ * dst in %1, src * alpha in %0, alpha in %2 which is clobbered */
+#define BLEND_WORDS(src, dst, alpha)                            \
+        "pxor           %6,  "alpha" \n" /* 255 - alpha */      \
+        "pmullw   "alpha",     "dst" \n"                        \
+        "paddw      "src",     "dst" \n"                        \
+        "paddw          %7,    "dst" \n" /* + 128 */            \
+        "pmulhuw        %8,    "dst" \n" /* * 257 >> 16 */
+
+void ff_overlay_blend_rgba_row_sse2(uint8_t *dst, const uint8_t *src, int w, int alpha_pos)
+{
+#if HAVE_SSE
+    intptr_t x = 4 * (w & ~3);
+    if (w & 3)
+        ff_overlay_blend_rgba_row_c(dst + x, src + x, w & 3, alpha_pos);
+    if (!x)
+        return;
+    w = x;
+    x = -w;
+    __asm__ volatile(
+        "1: \n"
+        "movdqu     (%2,%0), %%xmm0 \n" /* src */
+        "movdqu     (%1,%0), %%xmm1 \n" /* dst */
+        "movdqa      %%xmm0, %%xmm2 \n"
+        "movdqa      %%xmm1, %%xmm3 \n"
+        "pslld          %3,  %%xmm2 \n"
+        "pslld          %3,  %%xmm3 \n"
+        "psrld          $24, %%xmm2 \n" /* src alpha */
+        "psrld          $24, %%xmm3 \n" /* dst alpha */
+
+        /* new dst alpha = dst alpha + FAST_DIV255((255 - dst alpha) * src alpha) */
+        "movdqa         %9,  %%xmm4 \n"
+        "psubd       %%xmm3, %%xmm4 \n"
+        "pmullw      %%xmm2, %%xmm4 \n"
+        "paddw         %10,  %%xmm4 \n"
+        "pmulhuw       %11,  %%xmm4 \n"
+        "paddd       %%xmm3, %%xmm4 \n"
+        "pslld          %4,  %%xmm4 \n"
+
+        /* un-premultiplied alpha =
+         * 255 * 255 * a / (255 * (a + dst alpha) - dst alpha * a),
+         * all terms are exact in single precision and the quotient is far
+         * enough from the next integer for the truncation to be exact */
+        "cvtdq2ps    %%xmm2, %%xmm5 \n"
+        "cvtdq2ps    %%xmm3, %%xmm6 \n"
+        "movaps      %%xmm5, %%xmm7 \n"
+        "mulps       %%xmm6, %%xmm7 \n"
+        "addps       %%xmm5, %%xmm6 \n"
+        "mulps         %12,  %%xmm6 \n"
+        "subps       %%xmm7, %%xmm6 \n"
+        "mulps         %13,  %%xmm5 \n"
+        "divps       %%xmm6, %%xmm5 \n"
+        "cvttps2dq   %%xmm5, %%xmm5 \n"
+        "pxor        %%xmm6, %%xmm6 \n"
+        "pcmpeqd     %%xmm2, %%xmm6 \n"
+        "pandn       %%xmm5, %%xmm6 \n" /* 0 where a == 0 */
+
+        /* spread the alpha of each pixel over its 4 words */
+        "packssdw    %%xmm6, %%xmm6 \n"
+        "punpcklwd   %%xmm6, %%xmm6 \n"
+        "movdqa      %%xmm6, %%xmm7 \n"
+        "punpckldq   %%xmm6, %%xmm6 \n"
+        "punpckhdq   %%xmm7, %%xmm7 \n"
+
+        "pxor        %%xmm2, %%xmm2 \n"
+        "movdqa      %%xmm1, %%xmm3 \n"
+        "movdqa      %%xmm0, %%xmm5 \n"
+        "punpcklbw   %%xmm2, %%xmm3 \n"
+        "punpcklbw   %%xmm2, %%xmm5 \n"
+        "pmullw      %%xmm6, %%xmm5 \n"
+        BLEND_WORDS("%%xmm5", "%%xmm3", "%%xmm6")
+        "punpckhbw   %%xmm2, %%xmm1 \n"
+        "punpckhbw   %%xmm2, %%xmm0 \n"
+        "pmullw      %%xmm7, %%xmm0 \n"
+        BLEND_WORDS("%%xmm0", "%%xmm1", "%%xmm7")
+        "packuswb    %%xmm1, %%xmm3 \n"
+
+        "pand           %5,  %%xmm3 \n"
+        "por         %%xmm4, %%xmm3 \n"
+        "movdqu      %%xmm3, (%1,%0) \n"
+        "add            $16, %0 \n"
+        "jl 1b \n"
+        :"+&r"(x)
+        :"r"(dst+w), "r"(src+w),
+         "m"(*alpha_shift_up[alpha_pos]), "m"(*alpha_shift_back[alpha_pos]),
+         "m"(*color_mask[alpha_pos]),
+         "m"(*pw_ff), "m"(*pw_80), "m"(*pw_101),
+         "m"(*pd_ff), "m"(*pd_80), "m"(*pd_101),
+         "m"(*ps_255), "m"(*ps_65025)
+        : XMM_CLOBBERS("%xmm0", "%xmm1", "%xmm2", "%xmm3", "%xmm4", "%xmm5", "%xmm6", "%xmm7",) "memory"
+    );
+#endif
+}
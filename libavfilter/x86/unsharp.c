@@ -0,0 +1,79 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "libavutil/cpu.h"
+#include "libavutil/x86_cpu.h"
+#include "libavfilter/unsharp.h"
+
+void ff_unsharp_hstage_sse2(uint32_t *dst, const uint32_t *src, int len)
+{
+#if HAVE_SSE
+    intptr_t x;
+    /* dst[x] for x >= 1 only depends on src, so the tail can go first */
+    if ((len - 1) & 3) {
+        x = len - ((len - 1) & 3);
+        for (; x < len; x++)
+            dst[x] = src[x] + src[x - 1];
+        len -= (len - 1) & 3;
+    }
+    dst[0] = src[0];
+    if (len <= 1)
+        return;
+    x = -4 * (intptr_t)(len - 1);
+    __asm__ volatile(
+        "1: \n"
+        "movdqu    (%2,%0), %%xmm0 \n"
+        "movdqu    (%3,%0), %%xmm1 \n"
+        "paddd      %%xmm1, %%xmm0 \n"
+        "movdqu     %%xmm0, (%1,%0) \n"
+        "add           $16, %0 \n"
+        "jl 1b \n"
+        :"+&r"(x)
+        :"r"(dst + len), "r"(src + len), "r"(src + len - 1)
+        : XMM_CLOBBERS("%xmm0", "%xmm1",) "memory"
+    );
+#endif
+}
+
+void ff_unsharp_vstage_sse2(uint32_t *row, uint32_t *state, int len)
+{
+#if HAVE_SSE
+    intptr_t x;
+    if (len & 3) {
+        x = len & ~3;
+        ff_unsharp_vstage_c(row + x, state + x, len - x);
+        len = x;
+        if (!len)
+            return;
+    }
+    x = -4 * (intptr_t)len;
+    __asm__ volatile(
+        "1: \n"
+        "movdqu    (%1,%0), %%xmm0 \n"
+        "movdqu    (%2,%0), %%xmm1 \n"
+        "movdqu     %%xmm0, (%2,%0) \n"
+        "paddd      %%xmm1, %%xmm0 \n"
+        "movdqu     %%xmm0, (%1,%0) \n"
+        "add           $16, %0 \n"
+        "jl 1b \n"
+        :"+&r"(x)
+        :"r"(row + len), "r"(state + len)
+        : XMM_CLOBBERS("%xmm0", "%xmm1",) "memory"
+    );
+#endif
+}
@@ -0,0 +1,179 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "libavutil/cpu.h"
+#include "libavutil/mem.h"
+#include "libavutil/x86_cpu.h"
+#include "libavfilter/volume.h"
+
+DECLARE_ALIGNED(16, static const uint16_t, pw_1)[8]   = {1,1,1,1,1,1,1,1};
+DECLARE_ALIGNED(16, static const uint16_t, pw_128)[8] = {128,128,128,128,128,128,128,128};
+
+/*
+ * The integer versions interleave each sample with the constant 1 and use
+ * pmaddwd against (volume_i, 128) pairs, which gives sample * volume_i + 128
+ * exactly in 32 bits as long as volume_i fits in a signed word. The
+ * saturating packs then do the clipping of the C version.
+ */
+
+void ff_volume_scale_samples_u8_sse2(uint8_t *p, int nb_samples, int volume_i)
+{
+#if HAVE_SSE
+    x86_reg x = nb_samples & ~15;
+
+    ff_volume_scale_samples_u8_c(p + x, nb_samples - x, volume_i);
+    if (!x)
+        return;
+    __asm__ volatile(
+        "movd              %2, %%xmm7 \n"
+        "pshufd    $0, %%xmm7, %%xmm7 \n"
+        "movdqa            %3, %%xmm6 \n"
+        "movdqa            %4, %%xmm5 \n"
+        "pxor          %%xmm4, %%xmm4 \n"
+        "add               %1, %0     \n"
+        "neg               %1         \n"
+        "1:                           \n"
+        "movdqu      (%0,%1), %%xmm0  \n"
+        "movdqa        %%xmm0, %%xmm2 \n"
+        "punpcklbw     %%xmm4, %%xmm0 \n"
+        "punpckhbw     %%xmm4, %%xmm2 \n"
+        "psubw         %%xmm5, %%xmm0 \n"
+        "psubw         %%xmm5, %%xmm2 \n"
+        "movdqa        %%xmm0, %%xmm1 \n"
+        "movdqa        %%xmm2, %%xmm3 \n"
+        "punpcklwd     %%xmm6, %%xmm0 \n"
+        "punpckhwd     %%xmm6, %%xmm1 \n"
+        "punpcklwd     %%xmm6, %%xmm2 \n"
+        "punpckhwd     %%xmm6, %%xmm3 \n"
+        "pmaddwd       %%xmm7, %%xmm0 \n"
+        "pmaddwd       %%xmm7, %%xmm1 \n"
+        "pmaddwd       %%xmm7, %%xmm2 \n"
+        "pmaddwd       %%xmm7, %%xmm3 \n"
+        "psrad             $8, %%xmm0 \n"
+        "psrad             $8, %%xmm1 \n"
+        "psrad             $8, %%xmm2 \n"
+        "psrad             $8, %%xmm3 \n"
+        "packssdw      %%xmm1, %%xmm0 \n"
+        "packssdw      %%xmm3, %%xmm2 \n"
+        "paddw         %%xmm5, %%xmm0 \n"
+        "paddw         %%xmm5, %%xmm2 \n"
+        "packuswb      %%xmm2, %%xmm0 \n"
+        "movdqu        %%xmm0, (%0,%1)\n"
+        "add              $16, %1     \n"
+        "jl 1b                        \n"
+        :"+r"(p), "+r"(x)
+        :"r"(volume_i | 128 << 16), "m"(*pw_1), "m"(*pw_128)
+        : XMM_CLOBBERS("%xmm0", "%xmm1", "%xmm2", "%xmm3", "%xmm4", "%xmm5", "%xmm6", "%xmm7",) "memory"
+    );
+#endif
+}
+
+void ff_volume_scale_samples_s16_sse2(int16_t *p, int nb_samples, int volume_i)
+{
+#if HAVE_SSE
+    x86_reg x = nb_samples & ~7;
+
+    ff_volume_scale_samples_s16_c(p + x, nb_samples - x, volume_i);
+    if (!x)
+        return;
+    x *= 2;
+    __asm__ volatile(
+        "movd              %2, %%xmm7 \n"
+        "pshufd    $0, %%xmm7, %%xmm7 \n"
+        "movdqa            %3, %%xmm6 \n"
+        "add               %1, %0     \n"
+        "neg               %1         \n"
+        "1:                           \n"
+        "movdqu      (%0,%1), %%xmm0  \n"
+        "movdqa        %%xmm0, %%xmm1 \n"
+        "punpcklwd     %%xmm6, %%xmm0 \n"
+        "punpckhwd     %%xmm6, %%xmm1 \n"
+        "pmaddwd       %%xmm7, %%xmm0 \n"
+        "pmaddwd       %%xmm7, %%xmm1 \n"
+        "psrad             $8, %%xmm0 \n"
+        "psrad             $8, %%xmm1 \n"
+        "packssdw      %%xmm1, %%xmm0 \n"
+        "movdqu        %%xmm0, (%0,%1)\n"
+        "add              $16, %1     \n"
+        "jl 1b                        \n"
+        :"+r"(p), "+r"(x)
+        :"r"(volume_i | 128 << 16), "m"(*pw_1)
+        : XMM_CLOBBERS("%xmm0", "%xmm1", "%xmm6", "%xmm7",) "memory"
+    );
+#endif
+}
+
+void ff_volume_scale_samples_flt_sse(float *p, int nb_samples, float volume)
+{
+#if HAVE_SSE
+    x86_reg x = nb_samples & ~7;
+
+    ff_volume_scale_samples_flt_c(p + x, nb_samples - x, volume);
+    if (!x)
+        return;
+    x *= 4;
+    __asm__ volatile(
+        "movss             %2, %%xmm7 \n"
+        "shufps    $0, %%xmm7, %%xmm7 \n"
+        "add               %1, %0     \n"
+        "neg               %1         \n"
+        "1:                           \n"
+        "movups      (%0,%1), %%xmm0  \n"
+        "movups    16(%0,%1), %%xmm1  \n"
+        "mulps         %%xmm7, %%xmm0 \n"
+        "mulps         %%xmm7, %%xmm1 \n"
+        "movups        %%xmm0, (%0,%1)\n"
+        "movups        %%xmm1, 16(%0,%1)\n"
+        "add              $32, %1     \n"
+        "jl 1b                        \n"
+        :"+r"(p), "+r"(x)
+        :"m"(volume)
+        : XMM_CLOBBERS("%xmm0", "%xmm1", "%xmm7",) "memory"
+    );
+#endif
+}
+
+void ff_volume_scale_samples_dbl_sse2(double *p, int nb_samples, double volume)
+{
+#if HAVE_SSE
+    x86_reg x = nb_samples & ~3;
+
+    ff_volume_scale_samples_dbl_c(p + x, nb_samples - x, volume);
+    if (!x)
+        return;
+    x *= 8;
+    __asm__ volatile(
+        "movsd             %2, %%xmm7 \n"
+        "unpcklpd      %%xmm7, %%xmm7 \n"
+        "add               %1, %0     \n"
+        "neg               %1         \n"
+        "1:                           \n"
+        "movupd      (%0,%1), %%xmm0  \n"
+        "movupd    16(%0,%1), %%xmm1  \n"
+        "mulpd         %%xmm7, %%xmm0 \n"
+        "mulpd         %%xmm7, %%xmm1 \n"
+        "movupd        %%xmm0, (%0,%1)\n"
+        "movupd        %%xmm1, 16(%0,%1)\n"
+        "add              $32, %1     \n"
+        "jl 1b                        \n"
+        :"+r"(p), "+r"(x)
+        :"m"(volume)
+        : XMM_CLOBBERS("%xmm0", "%xmm1", "%xmm7",) "memory"
+    );
+#endif
+}
@@ -47,3 +47,216 @@ DECLARE_ASM_CONST(16, const xmm_reg, pw_1) = {0x0001000100010001ULL, 0x000100010
 #define RENAME(a) a ## _mmx
 #include "yadif_template.c"
 #endif
+
+#if HAVE_SSE
+#define PABS(tmp,dst) \
+            "pxor      "tmp", "tmp" \n\t"\
+            "psubw     "dst", "tmp" \n\t"\
+            "pmaxsw    "tmp", "dst" \n\t"
+
+/* sum of the absolute differences cur[mrefs+j+k] - cur[prefs-j+k], k=-1..1
+ * in xmm2, (cur[mrefs+j] + cur[prefs-j])>>1 in xmm5 */
+#define CHECK(pj,mj) \
+            "movdqu  "#pj"-2(%[cur],%[mrefs]), %%xmm2 \n\t"\
+            "movdqu  "#mj"-2(%[cur],%[prefs]), %%xmm3 \n\t"\
+            "psubw     %%xmm3, %%xmm2 \n\t"\
+            PABS("%%xmm4", "%%xmm2")\
+            "movdqu  "#pj"(%[cur],%[mrefs]), %%xmm3 \n\t"\
+            "movdqu  "#mj"(%[cur],%[prefs]), %%xmm4 \n\t"\
+            "movdqa    %%xmm3, %%xmm5 \n\t"\
+            "paddw     %%xmm4, %%xmm5 \n\t"\
+            "psrlw     $1,     %%xmm5 \n\t"\
+            "psubw     %%xmm4, %%xmm3 \n\t"\
+            PABS("%%xmm4", "%%xmm3")\
+            "paddw     %%xmm3, %%xmm2 \n\t"\
+            "movdqu  "#pj"+2(%[cur],%[mrefs]), %%xmm3 \n\t"\
+            "movdqu  "#mj"+2(%[cur],%[prefs]), %%xmm4 \n\t"\
+            "psubw     %%xmm4, %%xmm3 \n\t"\
+            PABS("%%xmm4", "%%xmm3")\
+            "paddw     %%xmm3, %%xmm2 \n\t" /* score */
+
+#define CHECK1 \
+            "movdqa    %%xmm0, %%xmm3 \n\t"\
+            "pcmpgtw   %%xmm2, %%xmm3 \n\t" /* if(score < spatial_score) */\
+            "pminsw    %%xmm2, %%xmm0 \n\t" /* spatial_score= score; */\
+            "movdqa    %%xmm3, %%xmm6 \n\t"\
+            "pand      %%xmm3, %%xmm5 \n\t"\
+            "pandn     %%xmm1, %%xmm3 \n\t"\
+            "por       %%xmm5, %%xmm3 \n\t"\
+            "movdqa    %%xmm3, %%xmm1 \n\t" /* spatial_pred= (cur[x-refs+j] + cur[x+refs-j])>>1; */
+
+#define CHECK2 /* only check dir=2 if dir=1 was good, like the C version */\
+            "paddw    "MANGLE(pw_1)", %%xmm6 \n\t"\
+            "psllw     $14,    %%xmm6 \n\t"\
+            "paddsw    %%xmm6, %%xmm2 \n\t"\
+            "movdqa    %%xmm0, %%xmm3 \n\t"\
+            "pcmpgtw   %%xmm2, %%xmm3 \n\t"\
+            "pminsw    %%xmm2, %%xmm0 \n\t"\
+            "pand      %%xmm3, %%xmm5 \n\t"\
+            "pandn     %%xmm1, %%xmm3 \n\t"\
+            "por       %%xmm5, %%xmm3 \n\t"\
+            "movdqa    %%xmm3, %%xmm1 \n\t"
+
+/**
+ * Filter a line of samples stored in 16 bits, the samples must not use
+ * more than 12 bits so that the scores do not overflow the signed words.
+ * The first and last 3 samples read outside of the line, where there is no
+ * guarantee on the values, so they are left to the C version.
+ */
+void ff_yadif_filter_line_16bit_sse2(uint16_t *dst,
+                                     uint16_t *prev, uint16_t *cur, uint16_t *next,
+                                     int w, int prefs, int mrefs, int parity, int mode)
+{
+    DECLARE_ALIGNED(16, uint16_t, tmp)[4*8];
+    int x, edge = FFMIN(w, 3), end = FFMAX(w - 3 - edge, 0) & ~7;
+
+    ff_yadif_filter_line_c_16bit(dst, prev, cur, next, edge, prefs, mrefs, parity, mode);
+    ff_yadif_filter_line_c_16bit(dst + edge + end, prev + edge + end, cur + edge + end,
+                                 next + edge + end, w - edge - end, prefs, mrefs, parity, mode);
+    dst  += edge;
+    prev += edge;
+    cur  += edge;
+    next += edge;
+    w     = end;
+
+#define FILTER\
+    for (x = 0; x < w; x += 8) {\
+        __asm__ volatile(\
+            "movdqu    (%[cur],%[mrefs]), %%xmm0 \n\t" /* c = cur[x-refs] */\
+            "movdqu    (%[cur],%[prefs]), %%xmm1 \n\t" /* e = cur[x+refs] */\
+            "movdqu    (%["prev2"]), %%xmm2 \n\t" /* prev2[x] */\
+            "movdqu    (%["next2"]), %%xmm3 \n\t" /* next2[x] */\
+            "movdqa    %%xmm3, %%xmm4 \n\t"\
+            "paddw     %%xmm2, %%xmm3 \n\t"\
+            "psrlw     $1,     %%xmm3 \n\t" /* d = (prev2[x] + next2[x])>>1 */\
+            "movdqa    %%xmm0,   (%[tmp]) \n\t" /* c */\
+            "movdqa    %%xmm3, 16(%[tmp]) \n\t" /* d */\
+            "movdqa    %%xmm1, 32(%[tmp]) \n\t" /* e */\
+            "psubw     %%xmm4, %%xmm2 \n\t"\
+            PABS("%%xmm4", "%%xmm2") /* temporal_diff0 */\
+            "movdqu    (%[prev],%[mrefs]), %%xmm3 \n\t" /* prev[x-refs] */\
+            "movdqu    (%[prev],%[prefs]), %%xmm4 \n\t" /* prev[x+refs] */\
+            "psubw     %%xmm0, %%xmm3 \n\t"\
+            "psubw     %%xmm1, %%xmm4 \n\t"\
+            PABS("%%xmm5", "%%xmm3")\
+            PABS("%%xmm5", "%%xmm4")\
+            "paddw     %%xmm4, %%xmm3 \n\t" /* temporal_diff1 */\
+            "psrlw     $1,     %%xmm2 \n\t"\
+            "psrlw     $1,     %%xmm3 \n\t"\
+            "pmaxsw    %%xmm3, %%xmm2 \n\t"\
+            "movdqu    (%[next],%[mrefs]), %%xmm3 \n\t" /* next[x-refs] */\
+            "movdqu    (%[next],%[prefs]), %%xmm4 \n\t" /* next[x+refs] */\
+            "psubw     %%xmm0, %%xmm3 \n\t"\
+            "psubw     %%xmm1, %%xmm4 \n\t"\
+            PABS("%%xmm5", "%%xmm3")\
+            PABS("%%xmm5", "%%xmm4")\
+            "paddw     %%xmm4, %%xmm3 \n\t" /* temporal_diff2 */\
+            "psrlw     $1,     %%xmm3 \n\t"\
+            "pmaxsw    %%xmm3, %%xmm2 \n\t"\
+            "movdqa    %%xmm2, 48(%[tmp]) \n\t" /* diff */\
+\
+            "paddw     %%xmm0, %%xmm1 \n\t"\
+            "paddw     %%xmm0, %%xmm0 \n\t"\
+            "psubw     %%xmm1, %%xmm0 \n\t"\
+            "psrlw     $1,     %%xmm1 \n\t" /* spatial_pred */\
+            PABS("%%xmm2", "%%xmm0")        /* ABS(c-e) */\
+\
+            "movdqu    -2(%[cur],%[mrefs]), %%xmm2 \n\t" /* cur[x-refs-1] */\
+            "movdqu    -2(%[cur],%[prefs]), %%xmm3 \n\t" /* cur[x+refs-1] */\
+            "psubw     %%xmm3, %%xmm2 \n\t"\
+            PABS("%%xmm3", "%%xmm2")\
+            "paddw     %%xmm2, %%xmm0 \n\t"\
+            "movdqu     2(%[cur],%[mrefs]), %%xmm2 \n\t" /* cur[x-refs+1] */\
+            "movdqu     2(%[cur],%[prefs]), %%xmm3 \n\t" /* cur[x+refs+1] */\
+            "psubw     %%xmm3, %%xmm2 \n\t"\
+            PABS("%%xmm3", "%%xmm2")\
+            "paddw     %%xmm2, %%xmm0 \n\t"\
+            "psubw    "MANGLE(pw_1)", %%xmm0 \n\t" /* spatial_score */\
+\
+            CHECK(-2,2)\
+            CHECK1\
+            CHECK(-4,4)\
+            CHECK2\
+            CHECK(2,-2)\
+            CHECK1\
+            CHECK(4,-4)\
+            CHECK2\
+\
+            /* if(p->mode<2) ... */\
+            "movdqa  48(%[tmp]), %%xmm6 \n\t" /* diff */\
+            "cmpl      $2, %[mode] \n\t"\
+            "jge       1f \n\t"\
+            "movdqu    (%["prev2"],%[mrefs],2), %%xmm2 \n\t" /* prev2[x-2*refs] */\
+            "movdqu    (%["next2"],%[mrefs],2), %%xmm4 \n\t" /* next2[x-2*refs] */\
+            "movdqu    (%["prev2"],%[prefs],2), %%xmm3 \n\t" /* prev2[x+2*refs] */\
+            "movdqu    (%["next2"],%[prefs],2), %%xmm5 \n\t" /* next2[x+2*refs] */\
+            "paddw     %%xmm4, %%xmm2 \n\t"\
+            "paddw     %%xmm5, %%xmm3 \n\t"\
+            "psrlw     $1,     %%xmm2 \n\t" /* b */\
+            "psrlw     $1,     %%xmm3 \n\t" /* f */\
+            "movdqa    (%[tmp]), %%xmm4 \n\t" /* c */\
+            "movdqa  16(%[tmp]), %%xmm5 \n\t" /* d */\
+            "movdqa  32(%[tmp]), %%xmm7 \n\t" /* e */\
+            "psubw     %%xmm4, %%xmm2 \n\t" /* b-c */\
+            "psubw     %%xmm7, %%xmm3 \n\t" /* f-e */\
+            "movdqa    %%xmm5, %%xmm0 \n\t"\
+            "psubw     %%xmm4, %%xmm5 \n\t" /* d-c */\
+            "psubw     %%xmm7, %%xmm0 \n\t" /* d-e */\
+            "movdqa    %%xmm2, %%xmm4 \n\t"\
+            "pminsw    %%xmm3, %%xmm2 \n\t"\
+            "pmaxsw    %%xmm4, %%xmm3 \n\t"\
+            "pmaxsw    %%xmm5, %%xmm2 \n\t"\
+            "pminsw    %%xmm5, %%xmm3 \n\t"\
+            "pmaxsw    %%xmm0, %%xmm2 \n\t" /* max */\
+            "pminsw    %%xmm0, %%xmm3 \n\t" /* min */\
+            "pxor      %%xmm4, %%xmm4 \n\t"\
+            "pmaxsw    %%xmm3, %%xmm6 \n\t"\
+            "psubw     %%xmm2, %%xmm4 \n\t" /* -max */\
+            "pmaxsw    %%xmm4, %%xmm6 \n\t" /* diff= MAX3(diff, min, -max); */\
+            "1: \n\t"\
+\
+            "movdqa  16(%[tmp]), %%xmm2 \n\t" /* d */\
+            "movdqa    %%xmm2, %%xmm3 \n\t"\
+            "psubw     %%xmm6, %%xmm2 \n\t" /* d-diff */\
+            "paddw     %%xmm6, %%xmm3 \n\t" /* d+diff */\
+            "pmaxsw    %%xmm2, %%xmm1 \n\t"\
+            "pminsw    %%xmm3, %%xmm1 \n\t" /* d = clip(spatial_pred, d-diff, d+diff); */\
+            "movdqu    %%xmm1, %[dst] \n\t"\
+\
+            :[dst]  "=m"(*(xmm_reg *)dst)\
+            :[tmp]  "r"(tmp),\
+             [prev] "r"(prev),\
+             [cur]  "r"(cur),\
+             [next] "r"(next),\
+             [prefs]"r"((x86_reg)prefs),\
+             [mrefs]"r"((x86_reg)mrefs),\
+             [mode] "g"(mode)\
+            : XMM_CLOBBERS("%xmm0", "%xmm1", "%xmm2", "%xmm3",\
+                           "%xmm4", "%xmm5", "%xmm6", "%xmm7",) "memory"\
+        );\
+        dst  += 8;\
+        prev += 8;\
+        cur  += 8;\
+        next += 8;\
+    }
+
+    if (parity) {
+#define prev2 "prev"
+#define next2 "cur"
+        FILTER
+#undef prev2
+#undef next2
+    } else {
+#define prev2 "cur"
+#define next2 "next"
+        FILTER
+#undef prev2
+#undef next2
+    }
+}
+#undef PABS
+#undef CHECK
+#undef CHECK1
+#undef CHECK2
+#undef FILTER
+#endif /* HAVE_SSE */
@@ -33,4 +33,12 @@ void ff_yadif_filter_line_ssse3(uint8_t *dst,
                                 uint8_t *prev, uint8_t *cur, uint8_t *next,
                                 int w, int prefs, int mrefs, int parity, int mode);
 
+void ff_yadif_filter_line_c_16bit(uint16_t *dst,
+                                  uint16_t *prev, uint16_t *cur, uint16_t *next,
+                                  int w, int prefs, int mrefs, int parity, int mode);
+
+void ff_yadif_filter_line_16bit_sse2(uint16_t *dst,
+                                     uint16_t *prev, uint16_t *cur, uint16_t *next,
+                                     int w, int prefs, int mrefs, int parity, int mode);
+
 #endif /* AVFILTER_YADIF_H */
@@ -19,7 +19,13 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
  */
 
+#include "config.h"
+#if HAVE_PTHREADS
+#include <pthread.h>
+#endif
 #include "libavutil/md5.h"
+#include "libavutil/mem.h"
+#include "libavutil/opt.h"
 #include "avformat.h"
 
 #define PRIVSIZE 512
@@ -79,28 +85,225 @@ AVOutputFormat ff_md5_muxer = {
 #endif
 
 #if CONFIG_FRAMEMD5_MUXER
-static int framemd5_write_packet(struct AVFormatContext *s, AVPacket *pkt)
+#define FRAMEMD5_BATCH 8
+
+typedef struct FrameMD5Batch {
+    int nb;
+    int      stream_index[FRAMEMD5_BATCH];
+    int64_t  dts[FRAMEMD5_BATCH];
+    int      size[FRAMEMD5_BATCH];
+    uint8_t *data[FRAMEMD5_BATCH];
+    unsigned data_size[FRAMEMD5_BATCH];
+    uint8_t  md5[FRAMEMD5_BATCH][16];
+} FrameMD5Batch;
+
+typedef struct FrameMD5Context {
+    const AVClass *class;
+    int hash_thread;
+    FrameMD5Batch batch[2];
+    FrameMD5Batch *cur;     ///< batch being filled by write_packet
+    FrameMD5Batch *work;    ///< batch handed to the hashing thread
+#if HAVE_PTHREADS
+    int thread_started;
+    int busy, quit;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+#endif
+} FrameMD5Context;
+
+static void framemd5_hash(FrameMD5Batch *b)
+{
+    uint8_t *dst[FRAMEMD5_BATCH];
+    int i;
+
+    for (i = 0; i < b->nb; i++)
+        dst[i] = b->md5[i];
+    av_md5_sum_multi(dst, (const uint8_t * const *)b->data, b->size, b->nb);
+}
+
+static void framemd5_output(AVFormatContext *s, FrameMD5Batch *b)
 {
     char buf[256];
-    if (PRIVSIZE < av_md5_size) {
-        av_log(s, AV_LOG_ERROR, "Insuffient size for md5 context\n");
-        return -1;
+    int i, j, offset;
+
+    for (i = 0; i < b->nb; i++) {
+        offset = snprintf(buf, sizeof(buf) - 64, "%d, %"PRId64", %d, ",
+                          b->stream_index[i], b->dts[i], b->size[i]);
+        for (j = 0; j < 16; j++) {
+            snprintf(buf + offset, 3, "%02"PRIx8, b->md5[i][j]);
+            offset += 2;
+        }
+        buf[offset++] = '\n';
+        avio_write(s->pb, buf, offset);
     }
-    av_md5_init(s->priv_data);
-    av_md5_update(s->priv_data, pkt->data, pkt->size);
+    if (b->nb)
+        avio_flush(s->pb);
+    b->nb = 0;
+}
 
-    snprintf(buf, sizeof(buf) - 64, "%d, %"PRId64", %d, ", pkt->stream_index, pkt->dts, pkt->size);
-    md5_finish(s, buf);
+#if HAVE_PTHREADS
+static void *framemd5_thread(void *arg)
+{
+    FrameMD5Context *c = arg;
+
+    pthread_mutex_lock(&c->lock);
+    for (;;) {
+        while (!c->busy && !c->quit)
+            pthread_cond_wait(&c->cond, &c->lock);
+        if (!c->busy)
+            break;
+        pthread_mutex_unlock(&c->lock);
+        framemd5_hash(c->work);
+        pthread_mutex_lock(&c->lock);
+        c->busy = 0;
+        pthread_cond_signal(&c->cond);
+    }
+    pthread_mutex_unlock(&c->lock);
+    return NULL;
+}
+
+/* Wait for the hashing thread to finish its batch and write the result.
+ * All output happens on the muxing thread, the worker only hashes. */
+static void framemd5_wait(AVFormatContext *s)
+{
+    FrameMD5Context *c = s->priv_data;
+
+    pthread_mutex_lock(&c->lock);
+    while (c->busy)
+        pthread_cond_wait(&c->cond, &c->lock);
+    pthread_mutex_unlock(&c->lock);
+    framemd5_output(s, c->work);
+}
+#endif
+
+static void framemd5_flush(AVFormatContext *s)
+{
+    FrameMD5Context *c = s->priv_data;
+
+#if HAVE_PTHREADS
+    if (c->thread_started) {
+        FrameMD5Batch *tmp;
+
+        framemd5_wait(s);
+        tmp     = c->work;
+        c->work = c->cur;
+        c->cur  = tmp;
+        pthread_mutex_lock(&c->lock);
+        c->busy = 1;
+        pthread_cond_signal(&c->cond);
+        pthread_mutex_unlock(&c->lock);
+        return;
+    }
+#endif
+    framemd5_hash(c->cur);
+    framemd5_output(s, c->cur);
+}
+
+/* Hash and write out everything queued so far before returning. */
+static void framemd5_drain(AVFormatContext *s)
+{
+    FrameMD5Context *c = s->priv_data;
+
+#if HAVE_PTHREADS
+    if (c->thread_started)
+        framemd5_wait(s);
+#endif
+    framemd5_hash(c->cur);
+    framemd5_output(s, c->cur);
+}
+
+static int framemd5_write_header(struct AVFormatContext *s)
+{
+    FrameMD5Context *c = s->priv_data;
+
+    c->cur  = &c->batch[0];
+    c->work = &c->batch[1];
+#if HAVE_PTHREADS
+    if (c->hash_thread) {
+        pthread_mutex_init(&c->lock, NULL);
+        pthread_cond_init(&c->cond, NULL);
+        if (pthread_create(&c->thread, NULL, framemd5_thread, c)) {
+            av_log(s, AV_LOG_WARNING, "pthread_create failed, hashing in the muxer thread\n");
+            pthread_mutex_destroy(&c->lock);
+            pthread_cond_destroy(&c->cond);
+        } else
+            c->thread_started = 1;
+    }
+#endif
     return 0;
 }
 
+static int framemd5_write_packet(struct AVFormatContext *s, AVPacket *pkt)
+{
+    FrameMD5Context *c = s->priv_data;
+    FrameMD5Batch *b = c->cur;
+    int i = b->nb;
+
+    av_fast_malloc(&b->data[i], &b->data_size[i], FFMAX(pkt->size, 1));
+    if (!b->data[i])
+        return AVERROR(ENOMEM);
+    memcpy(b->data[i], pkt->data, pkt->size);
+    b->stream_index[i] = pkt->stream_index;
+    b->dts[i]          = pkt->dts;
+    b->size[i]         = pkt->size;
+    b->nb++;
+    /* a reader at the other end of a pipe expects each line as soon as
+     * its packet was written, only batch when writing to a file */
+    if (!s->pb->seekable)
+        framemd5_drain(s);
+    else if (b->nb == FRAMEMD5_BATCH)
+        framemd5_flush(s);
+    return 0;
+}
+
+static int framemd5_write_trailer(struct AVFormatContext *s)
+{
+    FrameMD5Context *c = s->priv_data;
+    int i, j;
+
+    framemd5_flush(s);
+#if HAVE_PTHREADS
+    if (c->thread_started) {
+        framemd5_wait(s);
+        pthread_mutex_lock(&c->lock);
+        c->quit = 1;
+        pthread_cond_signal(&c->cond);
+        pthread_mutex_unlock(&c->lock);
+        pthread_join(c->thread, NULL);
+        pthread_mutex_destroy(&c->lock);
+        pthread_cond_destroy(&c->cond);
+        c->thread_started = 0;
+    }
+#endif
+    for (j = 0; j < 2; j++)
+        for (i = 0; i < FRAMEMD5_BATCH; i++)
+            av_freep(&c->batch[j].data[i]);
+    return 0;
+}
+
+static const AVOption framemd5_options[] = {
+    { "hash_thread", "hash the packets in a separate thread", offsetof(FrameMD5Context, hash_thread), AV_OPT_TYPE_INT, {.dbl = 0}, 0, 1, AV_OPT_FLAG_ENCODING_PARAM },
+    { NULL },
+};
+
+static const AVClass framemd5_class = {
+    .class_name = "framemd5 muxer",
+    .item_name  = av_default_item_name,
+    .option     = framemd5_options,
+    .version    = LIBAVUTIL_VERSION_INT,
+};
+
 AVOutputFormat ff_framemd5_muxer = {
     .name              = "framemd5",
     .long_name         = NULL_IF_CONFIG_SMALL("Per-frame MD5 testing format"),
     .extensions        = "",
-    .priv_data_size    = PRIVSIZE,
+    .priv_data_size    = sizeof(FrameMD5Context),
     .audio_codec       = CODEC_ID_PCM_S16LE,
     .video_codec       = CODEC_ID_RAWVIDEO,
+    .write_header      = framemd5_write_header,
     .write_packet      = framemd5_write_packet,
+    .write_trailer     = framemd5_write_trailer,
+    .priv_class        = &framemd5_class,
 };
 #endif
@@ -29,8 +29,8 @@
 #include "avformat.h"
 #include "avio_internal.h"
 #include "libavutil/parseutils.h"
-#include "libavutil/fifo.h"
 #include "libavutil/intreadwrite.h"
+#include "libavutil/ringbuffer.h"
 #include <unistd.h>
 #include "internal.h"
 #include "network.h"
@@ -64,10 +64,12 @@ typedef struct {
 
     /* Circular Buffer variables for use in UDP receive code */
     int circular_buffer_size;
-    AVFifoBuffer *fifo;
-    int circular_buffer_error;
+    AVRingBuffer *fifo;
+    volatile int circular_buffer_error;
 #if HAVE_PTHREADS
     pthread_t circular_buffer_thread;
+    int thread_started;
+    volatile int close_req;
 #endif
     uint8_t tmp[UDP_MAX_PKT_SIZE+4];
     int remaining_in_dg;
@@ -315,6 +317,7 @@ static int udp_get_file_handle(URLContext *h)
     return s->udp_fd;
 }
 
+#if HAVE_PTHREADS
 static void *circular_buffer_task( void *_URLContext)
 {
     URLContext *h = _URLContext;
@@ -322,56 +325,57 @@ static void *circular_buffer_task( void *_URLContext)
     fd_set rfds;
     struct timeval tv;
 
-    for(;;) {
-        int left;
+    while (!s->close_req) {
         int ret;
         int len;
 
         if (url_interrupt_cb()) {
             s->circular_buffer_error = EINTR;
-            return NULL;
+            goto end;
         }
 
         FD_ZERO(&rfds);
         FD_SET(s->udp_fd, &rfds);
-        tv.tv_sec = 1;
-        tv.tv_usec = 0;
+        tv.tv_sec = 0;
+        tv.tv_usec = 100000;
         ret = select(s->udp_fd + 1, &rfds, NULL, NULL, &tv);
         if (ret < 0) {
             if (ff_neterrno() == AVERROR(EINTR))
                 continue;
             s->circular_buffer_error = EIO;
-            return NULL;
+            goto end;
         }
 
         if (!(ret > 0 && FD_ISSET(s->udp_fd, &rfds)))
             continue;
 
-        /* How much do we have left to the end of the buffer */
-        /* Whats the minimum we can read so that we dont comletely fill the buffer */
-        left = av_fifo_space(s->fifo);
-
-        /* No Space left, error, what do we do now */
-        if(left < UDP_MAX_PKT_SIZE + 4) {
-            av_log(h, AV_LOG_ERROR, "circular_buffer: OVERRUN\n");
-            s->circular_buffer_error = EIO;
-            return NULL;
-        }
-        left = FFMIN(left, s->fifo->end - s->fifo->wptr);
-        len = recv(s->udp_fd, s->tmp+4, sizeof(s->tmp)-4, 0);
-        if (len < 0) {
-            if (ff_neterrno() != AVERROR(EAGAIN) && ff_neterrno() != AVERROR(EINTR)) {
+        /* Drain everything the socket has queued before going back to
+         * select(), the reader is only woken up when it waits for data. */
+        for (;;) {
+            /* No Space left, error, what do we do now */
+            if (av_ringbuffer_space(s->fifo) < UDP_MAX_PKT_SIZE + 4) {
+                av_log(h, AV_LOG_ERROR, "circular_buffer: OVERRUN\n");
                 s->circular_buffer_error = EIO;
-                return NULL;
+                goto end;
             }
-            continue;
+            len = recv(s->udp_fd, s->tmp+4, sizeof(s->tmp)-4, 0);
+            if (len < 0) {
+                if (ff_neterrno() != AVERROR(EAGAIN) && ff_neterrno() != AVERROR(EINTR)) {
+                    s->circular_buffer_error = EIO;
+                    goto end;
+                }
+                break;
+            }
+            AV_WL32(s->tmp, len);
+            av_ringbuffer_write(s->fifo, s->tmp, len+4);
         }
-        AV_WL32(s->tmp, len);
-        av_fifo_generic_write(s->fifo, s->tmp, len+4, NULL);
     }
 
+end:
+    av_ringbuffer_wake(s->fifo);
     return NULL;
 }
+#endif
 
 /* put it in UDP context */
 /* return non zero if error */
@@ -515,11 +519,14 @@ static int udp_open(URLContext *h, const char *uri, int flags)
 #if HAVE_PTHREADS
     if (!is_output && s->circular_buffer_size) {
         /* start the task going */
-        s->fifo = av_fifo_alloc(s->circular_buffer_size);
+        s->fifo = av_ringbuffer_alloc(s->circular_buffer_size);
+        if (!s->fifo)
+            goto fail;
         if (pthread_create(&s->circular_buffer_thread, NULL, circular_buffer_task, h)) {
             av_log(h, AV_LOG_ERROR, "pthread_create failed\n");
             goto fail;
         }
+        s->thread_started = 1;
     }
 #endif
 
@@ -527,7 +534,7 @@ static int udp_open(URLContext *h, const char *uri, int flags)
  fail:
     if (udp_fd >= 0)
         closesocket(udp_fd);
-    av_fifo_free(s->fifo);
+    av_ringbuffer_free(&s->fifo);
     av_free(s);
     return AVERROR(EIO);
 }
@@ -537,36 +544,30 @@ static int udp_read(URLContext *h, uint8_t *buf, int size)
     UDPContext *s = h->priv_data;
     int ret;
     int avail;
-    fd_set rfds;
-    struct timeval tv;
 
     if (s->fifo) {
-
-        do {
-            avail = av_fifo_size(s->fifo);
-            if (avail) { // >=size) {
+        for (;;) {
+            if (av_ringbuffer_size(s->fifo)) {
                 uint8_t tmp[4];
 
-                av_fifo_generic_read(s->fifo, tmp, 4, NULL);
+                av_ringbuffer_read(s->fifo, tmp, 4);
                 avail= AV_RL32(tmp);
                 if(avail > size){
                     av_log(h, AV_LOG_WARNING, "Part of datagram lost due to insufficient buffer size\n");
-                    avail= size;
+                    av_ringbuffer_read(s->fifo, buf, size);
+                    av_ringbuffer_read(s->fifo, NULL, avail - size);
+                    return size;
                 }
 
-                av_fifo_generic_read(s->fifo, buf, avail, NULL);
+                av_ringbuffer_read(s->fifo, buf, avail);
                 return avail;
             }
-            else {
-                FD_ZERO(&rfds);
-                FD_SET(s->udp_fd, &rfds);
-                tv.tv_sec = 1;
-                tv.tv_usec = 0;
-                ret = select(s->udp_fd + 1, &rfds, NULL, NULL, &tv);
-                if (ret<0)
-                    return ret;
-            }
-        } while( 1);
+            if (s->circular_buffer_error)
+                return AVERROR(s->circular_buffer_error);
+            if (h->flags & AVIO_FLAG_NONBLOCK)
+                return AVERROR(EAGAIN);
+            av_ringbuffer_wait_read(s->fifo, 4, 1000000);
+        }
     }
 
     if (!(h->flags & AVIO_FLAG_NONBLOCK)) {
@@ -606,8 +607,14 @@ static int udp_close(URLContext *h)
 
     if (s->is_multicast && (h->flags & AVIO_FLAG_READ))
         udp_leave_multicast_group(s->udp_fd, (struct sockaddr *)&s->dest_addr);
+#if HAVE_PTHREADS
+    if (s->thread_started) {
+        s->close_req = 1;
+        pthread_join(s->circular_buffer_thread, NULL);
+    }
+#endif
     closesocket(s->udp_fd);
-    av_fifo_free(s->fifo);
+    av_ringbuffer_free(&s->fifo);
     av_free(s);
     return 0;
 }
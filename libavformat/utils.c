@@ -33,6 +33,7 @@
 #include "id3v2.h"
 #include "libavutil/avstring.h"
 #include "libavutil/mathematics.h"
+#include "libavutil/trace.h"
 #include "riff.h"
 #include "audiointerleave.h"
 #include "url.h"
@@ -3251,6 +3252,15 @@ static int compute_pkt_fields2(AVFormatContext *s, AVStream *st, AVPacket *pkt){
     return 0;
 }
 
+static int write_packet(AVFormatContext *s, AVPacket *pkt)
+{
+    uint64_t t = av_trace_begin();
+    int ret = s->oformat->write_packet(s, pkt);
+
+    av_trace_end(t, s->oformat->name, "mux");
+    return ret;
+}
+
 int av_write_frame(AVFormatContext *s, AVPacket *pkt)
 {
     int ret = compute_pkt_fields2(s, s->streams[pkt->stream_index], pkt);
@@ -3258,7 +3268,7 @@ int av_write_frame(AVFormatContext *s, AVPacket *pkt)
     if(ret<0 && !(s->oformat->flags & AVFMT_NOTIMESTAMPS))
         return ret;
 
-    ret= s->oformat->write_packet(s, pkt);
+    ret= write_packet(s, pkt);
 
     if (ret >= 0)
         s->streams[pkt->stream_index]->nb_frames++;
@@ -3408,7 +3418,7 @@ int av_interleaved_write_frame(AVFormatContext *s, AVPacket *pkt){
         if(ret<=0) //FIXME cleanup needed for ret<0 ?
             return ret;
 
-        ret= s->oformat->write_packet(s, &opkt);
+        ret= write_packet(s, &opkt);
         if (ret >= 0)
             s->streams[opkt.stream_index]->nb_frames++;
 
@@ -3434,7 +3444,7 @@ int av_write_trailer(AVFormatContext *s)
         if(!ret)
             break;
 
-        ret= s->oformat->write_packet(s, &pkt);
+        ret= write_packet(s, &pkt);
         if (ret >= 0)
             s->streams[pkt.stream_index]->nb_frames++;
 
@@ -23,6 +23,10 @@
 
 #include "config.h"
 #include "adler32.h"
+#include "cpu.h"
+#if HAVE_SSSE3
+#include "x86/adler32.h"
+#endif
 
 #define BASE 65521L /* largest prime smaller than 65536 */
 
@@ -33,8 +37,18 @@
 unsigned long av_adler32_update(unsigned long adler, const uint8_t * buf,
                                 unsigned int len)
 {
-    unsigned long s1 = adler & 0xffff;
-    unsigned long s2 = adler >> 16;
+    unsigned long s1, s2;
+
+#if HAVE_SSSE3
+    if (len >= 64 && av_get_cpu_flags() & AV_CPU_FLAG_SSSE3) {
+        unsigned int blocks = len & ~15;
+        adler = ff_adler32_update_ssse3(adler, buf, blocks);
+        buf  += blocks;
+        len  -= blocks;
+    }
+#endif
+    s1 = adler & 0xffff;
+    s2 = adler >> 16;
 
     while (len > 0) {
 #if CONFIG_SMALL
@@ -61,9 +75,22 @@ unsigned long av_adler32_update(unsigned long adler, const uint8_t * buf,
 #include "timer.h"
 #define LEN 7001
 volatile int checksum;
+
+static unsigned long adler32_ref(unsigned long adler, const uint8_t *buf, int len)
+{
+    unsigned long s1 = adler & 0xffff, s2 = adler >> 16;
+
+    while (len--) {
+        s1 = (s1 + *buf++) % BASE;
+        s2 = (s2 + s1)     % BASE;
+    }
+    return (s2 << 16) | s1;
+}
+
 int main(int argc, char **argv)
 {
-    int i;
+    int i, j, ret = 0;
+    static uint8_t big[3 * 5552 + 64];
     char data[LEN];
 
     av_log_set_level(AV_LOG_DEBUG);
@@ -71,6 +98,21 @@ int main(int argc, char **argv)
     for (i = 0; i < LEN; i++)
         data[i] = ((i * i) >> 3) + 123 * i;
 
+    /* all 0xFF gives the largest intermediate sums */
+    for (j = 0; j < 2; j++) {
+        for (i = 0; i < sizeof(big); i++)
+            big[i] = j ? 0xFF : i * 7 + (i >> 5);
+        for (i = 0; i < sizeof(big) - 16; i += 1 + i / 8) {
+            int offset = i & 15;
+            if (av_adler32_update(0xfff0fff0, big + offset, i) !=
+                adler32_ref      (0xfff0fff0, big + offset, i)) {
+                av_log(NULL, AV_LOG_ERROR, "mismatch for length %d\n", i);
+                ret = 1;
+                break;
+            }
+        }
+    }
+
     if (argc > 1 && !strcmp(argv[1], "-t")) {
         for (i = 0; i < 1000; i++) {
             START_TIMER;
@@ -82,6 +124,6 @@ int main(int argc, char **argv)
     }
 
     av_log(NULL, AV_LOG_DEBUG, "%X (expected 50E6E508)\n", checksum);
-    return checksum == 0x50e6e508 ? 0 : 1;
+    return checksum == 0x50e6e508 ? ret : 1;
 }
 #endif
@@ -22,7 +22,11 @@
 
 #include "common.h"
 #include "aes.h"
+#include "cpu.h"
 #include "intreadwrite.h"
+#if HAVE_AESNI
+#include "x86/aes.h"
+#endif
 
 typedef union {
     uint64_t u64[2];
@@ -37,6 +41,7 @@ typedef struct AVAES {
     av_aes_block round_key[15];
     av_aes_block state[2];
     int rounds;
+    int aesni;  ///< use the AES-NI instructions
 } AVAES;
 
 const int av_aes_size= sizeof(AVAES);
@@ -137,6 +142,12 @@ static inline void crypt(AVAES *a, int s, const uint8_t *sbox,
 void av_aes_crypt(AVAES *a, uint8_t *dst, const uint8_t *src,
                   int count, uint8_t *iv, int decrypt)
 {
+#if HAVE_AESNI
+    if (a->aesni) {
+        ff_aes_crypt_aesni(a->round_key[0].u8, a->rounds, dst, src, count, iv, decrypt);
+        return;
+    }
+#endif
     while (count--) {
         addkey_s(&a->state[1], src, &a->round_key[a->rounds]);
         if (decrypt) {
@@ -159,6 +170,29 @@ void av_aes_crypt(AVAES *a, uint8_t *dst, const uint8_t *src,
     }
 }
 
+void av_aes_crypt_ctr(AVAES *a, uint8_t *dst, const uint8_t *src,
+                      int count, uint8_t *counter)
+{
+    av_aes_block ks;
+    int i;
+
+#if HAVE_AESNI
+    if (a->aesni) {
+        ff_aes_crypt_ctr_aesni(a->round_key[0].u8, a->rounds, dst, src, count, counter);
+        return;
+    }
+#endif
+    while (count--) {
+        av_aes_crypt(a, ks.u8, counter, 1, NULL, 0);
+        addkey_s(&ks, src, &ks);
+        memcpy(dst, ks.u8, 16);
+        for (i = 15; i >= 0 && !++counter[i]; i--)
+            ;
+        src += 16;
+        dst += 16;
+    }
+}
+
 static void init_multbl2(uint32_t tbl[][256], const int c[4],
                          const uint8_t *log8, const uint8_t *alog8,
                          const uint8_t *sbox)
@@ -220,6 +254,7 @@ int av_aes_init(AVAES *a, const uint8_t *key, int key_bits, int decrypt)
         return -1;
 
     a->rounds = rounds;
+    a->aesni  = HAVE_AESNI && av_get_cpu_flags() & AV_CPU_FLAG_AESNI;
 
     memcpy(tk, key, KC * 4);
 
@@ -260,9 +295,139 @@ int av_aes_init(AVAES *a, const uint8_t *key, int key_bits, int decrypt)
 
 #ifdef TEST
 #include <string.h>
+#include <time.h>
 #include "lfg.h"
 #include "log.h"
 
+/* NIST SP 800-38A, F.2.1 and F.5.1 */
+static const uint8_t sp800_key[16] = {
+    0x2b, 0x7e, 0x15, 0x16, 0x28, 0xae, 0xd2, 0xa6,
+    0xab, 0xf7, 0x15, 0x88, 0x09, 0xcf, 0x4f, 0x3c
+};
+static const uint8_t sp800_pt[64] = {
+    0x6b, 0xc1, 0xbe, 0xe2, 0x2e, 0x40, 0x9f, 0x96, 0xe9, 0x3d, 0x7e, 0x11, 0x73, 0x93, 0x17, 0x2a,
+    0xae, 0x2d, 0x8a, 0x57, 0x1e, 0x03, 0xac, 0x9c, 0x9e, 0xb7, 0x6f, 0xac, 0x45, 0xaf, 0x8e, 0x51,
+    0x30, 0xc8, 0x1c, 0x46, 0xa3, 0x5c, 0xe4, 0x11, 0xe5, 0xfb, 0xc1, 0x19, 0x1a, 0x0a, 0x52, 0xef,
+    0xf6, 0x9f, 0x24, 0x45, 0xdf, 0x4f, 0x9b, 0x17, 0xad, 0x2b, 0x41, 0x7b, 0xe6, 0x6c, 0x37, 0x10
+};
+static const uint8_t sp800_cbc_iv[16] = {
+    0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
+    0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f
+};
+static const uint8_t sp800_cbc_ct[64] = {
+    0x76, 0x49, 0xab, 0xac, 0x81, 0x19, 0xb2, 0x46, 0xce, 0xe9, 0x8e, 0x9b, 0x12, 0xe9, 0x19, 0x7d,
+    0x50, 0x86, 0xcb, 0x9b, 0x50, 0x72, 0x19, 0xee, 0x95, 0xdb, 0x11, 0x3a, 0x91, 0x76, 0x78, 0xb2,
+    0x73, 0xbe, 0xd6, 0xb8, 0xe3, 0xc1, 0x74, 0x3b, 0x71, 0x16, 0xe6, 0x9e, 0x22, 0x22, 0x95, 0x16,
+    0x3f, 0xf1, 0xca, 0xa1, 0x68, 0x1f, 0xac, 0x09, 0x12, 0x0e, 0xca, 0x30, 0x75, 0x86, 0xe1, 0xa7
+};
+static const uint8_t sp800_ctr_counter[16] = {
+    0xf0, 0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7,
+    0xf8, 0xf9, 0xfa, 0xfb, 0xfc, 0xfd, 0xfe, 0xff
+};
+static const uint8_t sp800_ctr_ct[64] = {
+    0x87, 0x4d, 0x61, 0x91, 0xb6, 0x20, 0xe3, 0x26, 0x1b, 0xef, 0x68, 0x64, 0x99, 0x0d, 0xb6, 0xce,
+    0x98, 0x06, 0xf6, 0x6b, 0x79, 0x70, 0xfd, 0xff, 0x86, 0x17, 0x18, 0x7b, 0xb9, 0xff, 0xfd, 0xff,
+    0x5a, 0xe4, 0xdf, 0x3e, 0xdb, 0xd5, 0xd3, 0x5e, 0x5b, 0x4f, 0x09, 0x02, 0x0d, 0xb0, 0x3e, 0xab,
+    0x1e, 0x03, 0x1d, 0xda, 0x2f, 0xbe, 0x03, 0xd1, 0x79, 0x21, 0x70, 0xa0, 0xf3, 0x00, 0x9c, 0xee
+};
+
+static int check_modes(AVAES *a, int use_aesni, const char *name)
+{
+    uint8_t buf[64], iv[16];
+    int err = 0;
+
+    av_aes_init(a, sp800_key, 128, 0);
+    a->aesni &= use_aesni;
+    memcpy(iv, sp800_cbc_iv, 16);
+    av_aes_crypt(a, buf, sp800_pt, 4, iv, 0);
+    err |= memcmp(buf, sp800_cbc_ct, 64);
+    memcpy(iv, sp800_ctr_counter, 16);
+    av_aes_crypt_ctr(a, buf, sp800_pt, 4, iv);
+    err |= memcmp(buf, sp800_ctr_ct, 64);
+
+    av_aes_init(a, sp800_key, 128, 1);
+    a->aesni &= use_aesni;
+    memcpy(iv, sp800_cbc_iv, 16);
+    memcpy(buf, sp800_cbc_ct, 64);
+    av_aes_crypt(a, buf, buf, 4, iv, 1);
+    err |= memcmp(buf, sp800_pt, 64);
+
+    if (err)
+        av_log(NULL, AV_LOG_ERROR, "%s: CBC/CTR test vectors failed\n", name);
+    return !!err;
+}
+
+/* run all modes on random data with the optimized and the C code */
+static int compare_c(AVLFG *prng)
+{
+    static const char *modes[5] = { "ECB enc", "ECB dec", "CBC enc", "CBC dec", "CTR" };
+    uint8_t key[32], src[16 * 9], ref[16 * 9], out[16 * 9], iv[2][16];
+    AVAES a, c;
+    int key_bits, mode, count, i, err = 0;
+
+    for (key_bits = 128; key_bits <= 256; key_bits += 64)
+        for (mode = 0; mode < 5; mode++)
+            for (count = 1; count <= 9; count++) {
+                int decrypt = mode == 1 || mode == 3;
+                for (i = 0; i < sizeof(key); i++)
+                    key[i] = av_lfg_get(prng);
+                for (i = 0; i < sizeof(src); i++)
+                    src[i] = av_lfg_get(prng);
+                for (i = 0; i < 16; i++)
+                    iv[0][i] = iv[1][i] = av_lfg_get(prng);
+                av_aes_init(&a, key, key_bits, decrypt);
+                av_aes_init(&c, key, key_bits, decrypt);
+                c.aesni = 0;
+                memcpy(out, src, sizeof(src));
+                if (mode == 4) {
+                    av_aes_crypt_ctr(&c, ref, src, count, iv[0]);
+                    av_aes_crypt_ctr(&a, out, out, count, iv[1]);
+                } else {
+                    av_aes_crypt(&c, ref, src, count, mode < 2 ? NULL : iv[0], decrypt);
+                    av_aes_crypt(&a, out, out, count, mode < 2 ? NULL : iv[1], decrypt);
+                }
+                if (memcmp(ref, out, 16 * count) || memcmp(iv[0], iv[1], 16)) {
+                    av_log(NULL, AV_LOG_ERROR, "%s with a %d bit key differs from C for %d blocks\n",
+                           modes[mode], key_bits, count);
+                    err = 1;
+                }
+            }
+    return err;
+}
+
+static void benchmark(AVLFG *prng)
+{
+    static uint8_t buf[1 << 16];
+    uint8_t key[16], iv[16] = { 0 };
+    AVAES a;
+    int i, t, mode;
+
+    for (i = 0; i < sizeof(buf); i++)
+        buf[i] = av_lfg_get(prng);
+    for (i = 0; i < sizeof(key); i++)
+        key[i] = av_lfg_get(prng);
+
+    for (t = 0; t < 1 + HAVE_AESNI; t++)
+        for (mode = 0; mode < 3; mode++) {
+            clock_t c;
+            av_aes_init(&a, key, 128, mode == 1);
+            if (!t)
+                a.aesni = 0;
+            else if (!a.aesni)
+                break;
+            c = clock();
+            for (i = 0; i < 1024; i++) {
+                if (mode == 2)
+                    av_aes_crypt_ctr(&a, buf, buf, sizeof(buf) / 16, iv);
+                else
+                    av_aes_crypt(&a, buf, buf, sizeof(buf) / 16, iv, mode);
+            }
+            av_log(NULL, AV_LOG_INFO, "%s %s: %.1f MB/s\n", t ? "aesni" : "c",
+                   mode == 2 ? "CTR" : mode ? "CBC decrypt" : "CBC encrypt",
+                   64.0 * CLOCKS_PER_SEC / FFMAX(clock() - c, 1));
+        }
+}
+
 int main(int argc, char **argv)
 {
     int i, j;
@@ -285,8 +450,10 @@ int main(int argc, char **argv)
     };
     uint8_t temp[16];
     int err = 0;
+    AVLFG prng;
 
     av_log_set_level(AV_LOG_DEBUG);
+    av_lfg_init(&prng, 1);
 
     for (i = 0; i < 2; i++) {
         av_aes_init(&b, rkey[i], 128, 1);
@@ -300,9 +467,14 @@ int main(int argc, char **argv)
         }
     }
 
+    err |= check_modes(&b, 1, "default");
+    err |= check_modes(&b, 0, "C");
+    err |= compare_c(&prng);
+
     if (argc > 1 && !strcmp(argv[1], "-t")) {
         AVAES ae, ad;
-        AVLFG prng;
+
+        benchmark(&prng);
 
         av_aes_init(&ae, "PI=3.141592654..", 128, 0);
         av_aes_init(&ad, "PI=3.141592654..", 128, 1);
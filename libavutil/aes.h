@@ -44,4 +44,15 @@ int av_aes_init(struct AVAES *a, const uint8_t *key, int key_bits, int decrypt);
  */
 void av_aes_crypt(struct AVAES *a, uint8_t *dst, const uint8_t *src, int count, uint8_t *iv, int decrypt);
 
+/**
+ * Encrypt or decrypt a buffer in counter (CTR) mode, using a context
+ * initialized for encryption.
+ * @param count number of 16 byte blocks
+ * @param dst destination array, can be equal to src
+ * @param src source array, can be equal to dst
+ * @param counter 16 byte counter block, incremented as a big-endian number
+ *                for every block and updated on return
+ */
+void av_aes_crypt_ctr(struct AVAES *a, uint8_t *dst, const uint8_t *src, int count, uint8_t *counter);
+
 #endif /* AVUTIL_AES_H */
@@ -67,6 +67,8 @@ static const struct {
     { AV_CPU_FLAG_AVX,       "avx"        },
     { AV_CPU_FLAG_XOP,       "xop"        },
     { AV_CPU_FLAG_FMA4,      "fma4"       },
+    { AV_CPU_FLAG_PCLMUL,    "pclmul"     },
+    { AV_CPU_FLAG_AESNI,     "aesni"      },
     { AV_CPU_FLAG_3DNOW,     "3dnow"      },
     { AV_CPU_FLAG_3DNOWEXT,  "3dnowext"   },
 #endif
@@ -21,12 +21,13 @@
 #include "config.h"
 #include "common.h"
 #include "bswap.h"
+#include "cpu.h"
 #include "crc.h"
+#if HAVE_PCLMUL
+#include "x86/crc.h"
+#endif
 
-#if CONFIG_HARDCODED_TABLES
-#include "crc_data.h"
-#else
-static struct {
+static const struct {
     uint8_t  le;
     uint8_t  bits;
     uint32_t poly;
@@ -37,9 +38,48 @@ static struct {
     [AV_CRC_32_IEEE]    = { 0, 32, 0x04C11DB7 },
     [AV_CRC_32_IEEE_LE] = { 1, 32, 0xEDB88320 },
 };
-static AVCRC av_crc_table[AV_CRC_MAX][257];
+
+#if CONFIG_HARDCODED_TABLES
+#include "crc_data.h"
+#else
+/* the standard tables hold 8 slicing tables, av_crc_init() only allows 4 */
+#define CRC_TABLE_SIZE (CONFIG_SMALL ? 257 : 8*256)
+static AVCRC av_crc_table[AV_CRC_MAX][CRC_TABLE_SIZE];
 #endif
 
+#if HAVE_PCLMUL
+static CRCPclmulContext av_crc_pclmul[AV_CRC_MAX];
+/* set once the constants of av_crc_pclmul are complete; x86 keeps stores
+ * and loads in order, so only the compiler has to be kept from moving the
+ * accesses to the constants across the accesses to the flag */
+static volatile int av_crc_pclmul_ready[AV_CRC_MAX];
+#define compiler_barrier() __asm__ volatile("" ::: "memory")
+#endif
+
+static void crc_init(AVCRC *ctx, int le, int bits, uint32_t poly, int nb_tables)
+{
+    unsigned i, j;
+    uint32_t c;
+
+    for (i = 0; i < 256; i++) {
+        if (le) {
+            for (c = i, j = 0; j < 8; j++)
+                c = (c>>1)^(poly & (-(c&1)));
+            ctx[i] = c;
+        } else {
+            for (c = i << 24, j = 0; j < 8; j++)
+                c = (c<<1) ^ ((poly<<(32-bits)) & (((int32_t)c)>>31) );
+            ctx[i] = av_bswap32(c);
+        }
+    }
+    ctx[256]=1;
+#if !CONFIG_SMALL
+    for (i = 0; i < 256; i++)
+        for(j=0; j<nb_tables-1; j++)
+            ctx[256*(j+1) + i]= (ctx[256*j + i]>>8) ^ ctx[ ctx[256*j + i]&0xFF ];
+#endif
+}
+
 /**
  * Initialize a CRC table.
  * @param ctx must be an array of size sizeof(AVCRC)*257 or sizeof(AVCRC)*1024
@@ -57,32 +97,12 @@ static AVCRC av_crc_table[AV_CRC_MAX][257];
  * @return <0 on failure
  */
 int av_crc_init(AVCRC *ctx, int le, int bits, uint32_t poly, int ctx_size){
-    unsigned i, j;
-    uint32_t c;
-
     if (bits < 8 || bits > 32 || poly >= (1LL<<bits))
         return -1;
     if (ctx_size != sizeof(AVCRC)*257 && ctx_size != sizeof(AVCRC)*1024)
         return -1;
 
-    for (i = 0; i < 256; i++) {
-        if (le) {
-            for (c = i, j = 0; j < 8; j++)
-                c = (c>>1)^(poly & (-(c&1)));
-            ctx[i] = c;
-        } else {
-            for (c = i << 24, j = 0; j < 8; j++)
-                c = (c<<1) ^ ((poly<<(32-bits)) & (((int32_t)c)>>31) );
-            ctx[i] = av_bswap32(c);
-        }
-    }
-    ctx[256]=1;
-#if !CONFIG_SMALL
-    if(ctx_size >= sizeof(AVCRC)*1024)
-        for (i = 0; i < 256; i++)
-            for(j=0; j<3; j++)
-                ctx[256*(j+1) + i]= (ctx[256*j + i]>>8) ^ ctx[ ctx[256*j + i]&0xFF ];
-#endif
+    crc_init(ctx, le, bits, poly, ctx_size >= sizeof(AVCRC)*1024 ? 4 : 1);
 
     return 0;
 }
@@ -95,12 +115,24 @@ int av_crc_init(AVCRC *ctx, int le, int bits, uint32_t poly, int ctx_size){
 const AVCRC *av_crc_get_table(AVCRCId crc_id){
 #if !CONFIG_HARDCODED_TABLES
     if (!av_crc_table[crc_id][FF_ARRAY_ELEMS(av_crc_table[crc_id])-1])
-        if (av_crc_init(av_crc_table[crc_id],
-                        av_crc_table_params[crc_id].le,
-                        av_crc_table_params[crc_id].bits,
-                        av_crc_table_params[crc_id].poly,
-                        sizeof(av_crc_table[crc_id])) < 0)
-            return NULL;
+        crc_init(av_crc_table[crc_id],
+                 av_crc_table_params[crc_id].le,
+                 av_crc_table_params[crc_id].bits,
+                 av_crc_table_params[crc_id].poly,
+                 CRC_TABLE_SIZE / 256);
+#endif
+#if HAVE_PCLMUL
+    if (!av_crc_pclmul_ready[crc_id] &&
+        (av_get_cpu_flags() & (AV_CPU_FLAG_SSSE3|AV_CPU_FLAG_PCLMUL)) ==
+                              (AV_CPU_FLAG_SSSE3|AV_CPU_FLAG_PCLMUL)) {
+        /* concurrent callers write the same values */
+        ff_crc_init_pclmul(&av_crc_pclmul[crc_id],
+                           av_crc_table_params[crc_id].le,
+                           av_crc_table_params[crc_id].bits,
+                           av_crc_table_params[crc_id].poly);
+        compiler_barrier();
+        av_crc_pclmul_ready[crc_id] = 1;
+    }
 #endif
     return av_crc_table[crc_id];
 }
@@ -116,6 +148,35 @@ uint32_t av_crc(const AVCRC *ctx, uint32_t crc, const uint8_t *buffer, size_t le
     const uint8_t *end= buffer+length;
 
 #if !CONFIG_SMALL
+    /* the standard tables from av_crc_get_table() */
+    if ((uintptr_t)ctx - (uintptr_t)av_crc_table < sizeof(av_crc_table)) {
+#if HAVE_PCLMUL
+        int id = ((uintptr_t)ctx - (uintptr_t)av_crc_table) / sizeof(av_crc_table[0]);
+        if (length >= 64 && av_crc_pclmul_ready[id]) {
+            compiler_barrier();
+            return ff_crc_pclmul(&av_crc_pclmul[id], ctx, crc, buffer, length);
+        }
+#endif
+#if !CONFIG_HARDCODED_TABLES
+        while(((intptr_t) buffer & 7) && buffer < end)
+            crc = ctx[((uint8_t)crc) ^ *buffer++] ^ (crc >> 8);
+
+        while(buffer<end-7){
+            uint32_t a = crc ^ av_le2ne32(((const uint32_t*)buffer)[0]);
+            uint32_t b =       av_le2ne32(((const uint32_t*)buffer)[1]);
+            buffer+=8;
+            crc =  ctx[7*256 + ( a     &0xFF)]
+                  ^ctx[6*256 + ((a>>8 )&0xFF)]
+                  ^ctx[5*256 + ((a>>16)&0xFF)]
+                  ^ctx[4*256 + ((a>>24)     )]
+                  ^ctx[3*256 + ( b     &0xFF)]
+                  ^ctx[2*256 + ((b>>8 )&0xFF)]
+                  ^ctx[1*256 + ((b>>16)&0xFF)]
+                  ^ctx[0*256 + ((b>>24)     )];
+        }
+#endif
+    }
+
     if(!ctx[256]) {
         while(((intptr_t) buffer & 3) && buffer < end)
             crc = ctx[((uint8_t)crc) ^ *buffer++] ^ (crc >> 8);
@@ -136,15 +197,21 @@ uint32_t av_crc(const AVCRC *ctx, uint32_t crc, const uint8_t *buffer, size_t le
 }
 
 #ifdef TEST
+#include <string.h>
+#include <time.h>
+#include "lfg.h"
 #undef printf
-int main(void){
+int main(int argc, char **argv){
     uint8_t buf[1999];
     int i;
-    int p[4][3]={{AV_CRC_32_IEEE_LE, 0xEDB88320, 0x3D5CDD04},
+    int p[5][3]={{AV_CRC_32_IEEE_LE, 0xEDB88320, 0x3D5CDD04},
                  {AV_CRC_32_IEEE   , 0x04C11DB7, 0xC0F5BAE0},
                  {AV_CRC_16_ANSI   , 0x8005,     0x1FBB    },
-                 {AV_CRC_8_ATM     , 0x07,       0xE3      },};
+                 {AV_CRC_8_ATM     , 0x07,       0xE3      },
+                 {AV_CRC_16_CCITT  , 0x1021,     0         },};
     const AVCRC *ctx;
+    AVCRC ref[257];
+    int ret = 0;
 
     for(i=0; i<sizeof(buf); i++)
         buf[i]= i+i*i;
@@ -153,6 +220,57 @@ int main(void){
         ctx = av_crc_get_table(p[i][0]);
         printf("crc %08X =%X\n", p[i][1], av_crc(ctx, 0, buf, sizeof(buf)));
     }
-    return 0;
+
+    /* check the standard tables against plain byte by byte computation,
+     * for all alignments and the lengths around the block sizes */
+    for(i=0; i<5; i++){
+        int off, len;
+        ctx = av_crc_get_table(p[i][0]);
+        av_crc_init(ref, av_crc_table_params[p[i][0]].le,
+                    av_crc_table_params[p[i][0]].bits,
+                    av_crc_table_params[p[i][0]].poly, sizeof(ref));
+        for(off=0; off<16 && !ret; off++)
+            for(len=0; len<300 && !ret; len++)
+                if (av_crc(ctx, 0x12345678 & ref[255], buf + off, len) !=
+                    av_crc(ref, 0x12345678 & ref[255], buf + off, len)) {
+                    printf("crc %08X mismatch, offset %d length %d\n", p[i][1], off, len);
+                    ret = 1;
+                }
+    }
+
+    if (argc > 1 && !strcmp(argv[1], "-t")) {
+        static uint8_t data[1 << 20];
+        AVLFG prng;
+        av_lfg_init(&prng, 1);
+        for(i=0; i<sizeof(data); i++)
+            data[i]= av_lfg_get(&prng);
+
+        for(i=0; i<5; i++){
+            static AVCRC ref4[1024];
+            const AVCRC *tabs[3] = { av_crc_get_table(p[i][0]), ref4, ref };
+            static const char *names[3] = { "standard", "sliced", "bytewise" };
+            int t;
+            av_crc_init(ref, av_crc_table_params[p[i][0]].le,
+                        av_crc_table_params[p[i][0]].bits,
+                        av_crc_table_params[p[i][0]].poly, sizeof(ref));
+            av_crc_init(ref4, av_crc_table_params[p[i][0]].le,
+                        av_crc_table_params[p[i][0]].bits,
+                        av_crc_table_params[p[i][0]].poly, sizeof(ref4));
+            for(t=0; t<3; t++){
+                clock_t c = clock();
+                uint32_t crc = 0;
+                int it, len, n = 0;
+                for(len=64; len<=sizeof(data); len*=16) {
+                    for(it=0; it<(1<<28)/len; it++)
+                        crc = av_crc(tabs[t], crc, data, len);
+                    n += it * len >> 20;
+                }
+                printf("crc %08X %-9s %6.2f GB/s (%X)\n", p[i][1],
+                       names[t], n / 1024.0 * CLOCKS_PER_SEC /
+                       FFMAX(clock() - c, 1), crc);
+            }
+        }
+    }
+    return ret;
 }
 #endif
@@ -24,10 +24,85 @@
 #include "internal.h"
 #include "mem.h"
 
+/*
+ * Dictionaries with more than HASH_MIN_COUNT entries get an open addressing
+ * hash index of the case folded keys next to the ordered elems array. Each
+ * slot holds 0 (empty), HASH_DELETED or the elems index + 1. Exact lookups
+ * then only compare the keys with a matching hash; prefix lookups
+ * (AV_DICT_IGNORE_SUFFIX) and iteration still walk elems in order.
+ */
+#define HASH_MIN_COUNT 8
+#define HASH_DELETED   UINT_MAX
+
+static unsigned hash_key(const char *key)
+{
+    unsigned h = 0;
+    int j;
+
+    /* must fold exactly like the comparison in dict_match() */
+    for (j = 0; key[j]; j++)
+        h = h * 31 + toupper(key[j]);
+    return h ^ (h >> 15);
+}
+
+static int dict_match(const char *s, const char *key, int flags)
+{
+    unsigned int j;
+
+    if(flags & AV_DICT_MATCH_CASE) for(j=0;         s[j]  ==         key[j]  && key[j]; j++);
+    else                               for(j=0; toupper(s[j]) == toupper(key[j]) && key[j]; j++);
+    if(key[j])
+        return 0;
+    if(s[j] && !(flags & AV_DICT_IGNORE_SUFFIX))
+        return 0;
+    return 1;
+}
+
+static void hash_insert(AVDictionary *m, unsigned idx)
+{
+    unsigned mask = m->hash_size - 1;
+    unsigned i    = hash_key(m->elems[idx].key) & mask;
+
+    while (m->hash[i] && m->hash[i] != HASH_DELETED)
+        i = (i + 1) & mask;
+    if (!m->hash[i])
+        m->hash_used++;
+    m->hash[i] = idx + 1;
+}
+
+/** Find the slot referring to elems[idx]. */
+static unsigned *hash_find(AVDictionary *m, unsigned idx)
+{
+    unsigned mask = m->hash_size - 1;
+    unsigned i    = hash_key(m->elems[idx].key) & mask;
+
+    while (m->hash[i] != idx + 1)
+        i = (i + 1) & mask;
+    return &m->hash[i];
+}
+
+static void hash_rebuild(AVDictionary *m, unsigned count)
+{
+    unsigned size = 16, i;
+    unsigned *hash;
+
+    while (size < 4 * count)
+        size <<= 1;
+    hash = av_mallocz(size * sizeof(*hash));
+    av_freep(&m->hash);
+    m->hash_size = m->hash_used = 0;
+    if (!hash)
+        return; // fall back to linear scans
+    m->hash      = hash;
+    m->hash_size = size;
+    for (i = 0; i < m->count; i++)
+        hash_insert(m, i);
+}
+
 AVDictionaryEntry *
 av_dict_get(AVDictionary *m, const char *key, const AVDictionaryEntry *prev, int flags)
 {
-    unsigned int i, j;
+    unsigned int i;
 
     if(!m)
         return NULL;
@@ -35,15 +110,26 @@ av_dict_get(AVDictionary *m, const char *key, const AVDictionaryEntry *prev, int
     if(prev) i= prev - m->elems + 1;
     else     i= 0;
 
+    if (m->hash && !(flags & AV_DICT_IGNORE_SUFFIX)) {
+        unsigned mask = m->hash_size - 1;
+        unsigned h    = hash_key(key) & mask;
+        unsigned best = UINT_MAX;
+
+        /* keys differing only in case may be stored several times, so
+         * return the first match after prev in elems order */
+        for (; m->hash[h]; h = (h + 1) & mask) {
+            unsigned idx = m->hash[h] - 1;
+            if (m->hash[h] == HASH_DELETED || idx < i || idx >= best)
+                continue;
+            if (dict_match(m->elems[idx].key, key, flags))
+                best = idx;
+        }
+        return best == UINT_MAX ? NULL : &m->elems[best];
+    }
+
     for(; i<m->count; i++){
-        const char *s= m->elems[i].key;
-        if(flags & AV_DICT_MATCH_CASE) for(j=0;         s[j]  ==         key[j]  && key[j]; j++);
-        else                               for(j=0; toupper(s[j]) == toupper(key[j]) && key[j]; j++);
-        if(key[j])
-            continue;
-        if(s[j] && !(flags & AV_DICT_IGNORE_SUFFIX))
-            continue;
-        return &m->elems[i];
+        if (dict_match(m->elems[i].key, key, flags))
+            return &m->elems[i];
     }
     return NULL;
 }
@@ -64,8 +150,15 @@ int av_dict_set(AVDictionary **pm, const char *key, const char *value, int flags
             oldval = tag->value;
         else
             av_free(tag->value);
+        m->count--;
+        if (m->hash) {
+            unsigned idx = tag - m->elems;
+            *hash_find(m, idx) = HASH_DELETED;
+            if (idx != m->count)
+                *hash_find(m, m->count) = idx + 1;
+        }
         av_free(tag->key);
-        *tag = m->elems[--m->count];
+        *tag = m->elems[m->count];
     } else {
         AVDictionaryEntry *tmp = av_realloc(m->elems, (m->count+1) * sizeof(*m->elems));
         if(tmp) {
@@ -89,9 +182,17 @@ int av_dict_set(AVDictionary **pm, const char *key, const char *value, int flags
         } else
             m->elems[m->count].value = av_strdup(value);
         m->count++;
+        /* an existing index must always either take the new entry or be
+         * rebuilt, also once the dictionary shrank below HASH_MIN_COUNT */
+        if (m->hash_used >= m->hash_size / 2) {
+            if (m->hash || m->count > HASH_MIN_COUNT)
+                hash_rebuild(m, m->count);
+        } else
+            hash_insert(m, m->count - 1);
     }
     if (!m->count) {
         av_free(m->elems);
+        av_free(m->hash);
         av_freep(pm);
     }
 
@@ -108,6 +209,7 @@ void av_dict_free(AVDictionary **pm)
             av_free(m->elems[m->count].value);
         }
         av_free(m->elems);
+        av_free(m->hash);
     }
     av_freep(pm);
 }
@@ -119,3 +221,119 @@ void av_dict_copy(AVDictionary **dst, AVDictionary *src, int flags)
     while ((t = av_dict_get(src, "", t, AV_DICT_IGNORE_SUFFIX)))
         av_dict_set(dst, t->key, t->value, flags);
 }
+
+#ifdef TEST
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "lfg.h"
+#include "log.h"
+
+/* reference implementation without the hash index */
+static AVDictionaryEntry *linear_get(AVDictionary *m, const char *key,
+                                     const AVDictionaryEntry *prev, int flags)
+{
+    unsigned i = prev ? prev - m->elems + 1 : 0;
+
+    for (; m && i < m->count; i++)
+        if (dict_match(m->elems[i].key, key, flags))
+            return &m->elems[i];
+    return NULL;
+}
+
+static int check_dict(AVDictionary *m, AVLFG *prng)
+{
+    static const int get_flags[] = { 0, AV_DICT_MATCH_CASE };
+    char key[8];
+    int i, j, k;
+
+    for (i = 0; m && i < m->count; i++)
+        if (m->hash && *hash_find(m, i) != i + 1)
+            return 1;
+    for (i = 0; i < 64; i++) {
+        for (j = 0; j < 3; j++)
+            key[j] = "aBcA"[av_lfg_get(prng) & 3];
+        key[j] = 0;
+        for (k = 0; k < FF_ARRAY_ELEMS(get_flags); k++) {
+            AVDictionaryEntry *t = NULL, *r = NULL;
+            do {
+                t = av_dict_get(m, key, t, get_flags[k]);
+                r = linear_get(m, key, r, get_flags[k]);
+                if (t != r)
+                    return 1;
+            } while (t);
+        }
+    }
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    static const int set_flags[] = {
+        0, AV_DICT_MATCH_CASE, AV_DICT_DONT_OVERWRITE, AV_DICT_APPEND,
+        AV_DICT_IGNORE_SUFFIX,
+    };
+    AVDictionary *m = NULL;
+    AVLFG prng;
+    char key[8], val[8];
+    int i, j;
+
+    av_lfg_init(&prng, 1);
+
+    /* short keys over a tiny alphabet give plenty of case-only duplicates,
+     * overwrites, deletions and hash collisions */
+    for (i = 0; i < 20000; i++) {
+        int len = 1 + av_lfg_get(&prng) % 3;
+        for (j = 0; j < len; j++)
+            key[j] = "aBcA"[av_lfg_get(&prng) & 3];
+        key[j] = 0;
+        snprintf(val, sizeof(val), "%d", i);
+        av_dict_set(&m, key, av_lfg_get(&prng) % 5 ? val : NULL,
+                    set_flags[av_lfg_get(&prng) % FF_ARRAY_ELEMS(set_flags)]);
+        if (check_dict(m, &prng)) {
+            av_log(NULL, AV_LOG_ERROR, "hashed and linear lookup differ after %d insertions\n", i);
+            return 1;
+        }
+    }
+    av_dict_free(&m);
+
+    /* shrink below HASH_MIN_COUNT with the index half full of deleted
+     * slots, then keep adding and removing entries */
+    for (i = 0; i < 9; i++) {
+        snprintf(key, sizeof(key), "k%d", i);
+        av_dict_set(&m, key, "v", 0);
+    }
+    for (i = 0; i < 5; i++) {
+        snprintf(key, sizeof(key), "k%d", i);
+        av_dict_set(&m, key, NULL, 0);
+    }
+    for (i = 0; i < 100; i++) {
+        snprintf(key, sizeof(key), "n%d", i);
+        av_dict_set(&m, key, "v", 0);
+        if (!av_dict_get(m, key, NULL, 0) || check_dict(m, &prng)) {
+            av_log(NULL, AV_LOG_ERROR, "lookup failed in set/delete cycle %d\n", i);
+            return 1;
+        }
+        av_dict_set(&m, key, NULL, 0);
+    }
+    av_dict_free(&m);
+
+    if (argc > 1 && !strcmp(argv[1], "-t")) {
+        for (i = 16; i <= 16384; i <<= 2) {
+            clock_t c = clock();
+            for (j = 0; j < i; j++) {
+                snprintf(key, sizeof(key), "k%d", j);
+                av_dict_set(&m, key, "v", 0);
+            }
+            for (j = 0; j < i; j++) {
+                snprintf(key, sizeof(key), "K%d", j);
+                av_dict_get(m, key, NULL, 0);
+            }
+            av_log(NULL, AV_LOG_INFO, "%5d entries: %.3f ms\n", i,
+                   (clock() - c) * 1000.0 / CLOCKS_PER_SEC);
+            av_dict_free(&m);
+        }
+    }
+    return 0;
+}
+#endif
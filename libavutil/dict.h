@@ -21,9 +21,9 @@
  * @file
  * Public dictionary API.
  * @deprecated
- *  AVDictionary is provided for compatibility with libav. It is both in
- *  implementation as well as API inefficient. It does not scale and is
- *  extremely slow with large dictionaries.
+ *  AVDictionary is provided for compatibility with libav. Exact key
+ *  lookups are hashed once a dictionary grows beyond a few entries, but
+ *  prefix lookups (AV_DICT_IGNORE_SUFFIX) still scan all entries.
  *  It is recommended that new code uses our tree container from tree.c/h
  *  where applicable, which uses AVL trees to achieve O(log n) performance.
  */
@@ -146,6 +146,10 @@ struct AVExpr {
     } a;
     struct AVExpr *param[2];
     double *var;
+    struct ExprInsn *code;  ///< compiled form of the expression, only set in the root node
+    int code_size;
+    int stack_size;         ///< evaluation stack depth needed by code
+    int batch;              ///< code is free of side effects and loops, see av_expr_eval_batch()
 };
 
 static double eval_expr(Parser *p, AVExpr *e)
@@ -210,6 +214,7 @@ void av_expr_free(AVExpr *e)
     av_expr_free(e->param[0]);
     av_expr_free(e->param[1]);
     av_freep(&e->var);
+    av_freep(&e->code);
     av_freep(&e);
 }
 
@@ -499,6 +504,342 @@ static int verify_expr(AVExpr *e)
     }
 }
 
+/*
+ * After parsing, the tree is constant folded and flattened into code for a
+ * simple stack machine. Each instruction pops its operands and pushes its
+ * result, performing exactly the same floating point operations as
+ * eval_expr() in the same order, so that both give identical results.
+ */
+enum ExprOp {
+    OP_VALUE, OP_CONST, OP_JZ, OP_JMP,
+    /* unary, operate on the top of the stack */
+    OP_LD, OP_FUNC0, OP_FUNC1, OP_SQUISH, OP_GAUSS, OP_ISNAN, OP_FLOOR,
+    OP_CEIL, OP_TRUNC, OP_SQRT, OP_NOT, OP_RANDOM,
+    /* binary */
+    OP_FUNC2, OP_MOD, OP_GCD, OP_MAX, OP_MIN, OP_EQ, OP_GT, OP_GTE,
+    OP_POW, OP_MUL, OP_DIV, OP_ADD, OP_LAST, OP_ST, OP_HYPOT,
+    /* added to a binary op if the second operand is the constant imm */
+    OP_IMM,
+};
+
+typedef struct ExprInsn {
+    int op;                 ///< ExprOp, + OP_IMM for binary ops
+    int arg;                ///< constant index or jump target
+    double value;
+    double imm;
+    union {
+        double (*func0)(double);
+        double (*func1)(void *, double);
+        double (*func2)(void *, double, double);
+    } a;
+} ExprInsn;
+
+#define MAX_STACK 256
+
+/* process this many values per instruction in av_expr_eval_batch() */
+#define BATCH_SIZE   64
+#define BATCH_STACK  16
+#define BATCH_CONSTS 64
+
+static int is_constant(AVExpr *e)
+{
+    switch (e->type) {
+    case e_value:
+        return 1;
+    case e_const: case e_func1: case e_func2: case e_ld:
+    case e_st: case e_random: case e_while:
+        return 0;
+    default:
+        return (!e->param[0] || e->param[0]->type == e_value) &&
+               (!e->param[1] || e->param[1]->type == e_value);
+    }
+}
+
+static void fold_constants(AVExpr *e)
+{
+    if (!e)
+        return;
+    fold_constants(e->param[0]);
+    fold_constants(e->param[1]);
+    if (e->type != e_value && is_constant(e)) {
+        Parser p = { 0 };
+        e->value = eval_expr(&p, e);
+        e->type  = e_value;
+        av_expr_free(e->param[0]);
+        av_expr_free(e->param[1]);
+        e->param[0] = e->param[1] = NULL;
+    }
+}
+
+typedef struct Compiler {
+    ExprInsn *code;
+    int size, allocated;
+    int depth, max_depth;
+    int batch;
+} Compiler;
+
+static ExprInsn *emit(Compiler *c, int op, double value, int depth_change)
+{
+    ExprInsn *insn;
+
+    if (c->size == c->allocated) {
+        int allocated = FFMAX(16, 2 * c->allocated);
+        ExprInsn *code = av_realloc(c->code, allocated * sizeof(*code));
+        if (!code)
+            return NULL;
+        c->code      = code;
+        c->allocated = allocated;
+    }
+    c->depth    += depth_change;
+    c->max_depth = FFMAX(c->max_depth, c->depth);
+    insn = &c->code[c->size++];
+    memset(insn, 0, sizeof(*insn));
+    insn->op    = op;
+    insn->value = value;
+    return insn;
+}
+
+static int compile_expr(Compiler *c, AVExpr *e)
+{
+    static const enum ExprOp unary_ops[] = {
+        [e_func0] = OP_FUNC0, [e_func1] = OP_FUNC1, [e_squish] = OP_SQUISH,
+        [e_gauss] = OP_GAUSS, [e_ld]    = OP_LD,    [e_isnan]  = OP_ISNAN,
+        [e_floor] = OP_FLOOR, [e_ceil]  = OP_CEIL,  [e_trunc]  = OP_TRUNC,
+        [e_sqrt]  = OP_SQRT,  [e_not]   = OP_NOT,   [e_random] = OP_RANDOM,
+    };
+    static const enum ExprOp binary_ops[] = {
+        [e_func2] = OP_FUNC2, [e_mod] = OP_MOD, [e_gcd] = OP_GCD,
+        [e_max]   = OP_MAX,   [e_min] = OP_MIN, [e_eq]  = OP_EQ,
+        [e_gt]    = OP_GT,    [e_gte] = OP_GTE, [e_pow] = OP_POW,
+        [e_mul]   = OP_MUL,   [e_div] = OP_DIV, [e_add] = OP_ADD,
+        [e_last]  = OP_LAST,  [e_st]  = OP_ST,  [e_hypot] = OP_HYPOT,
+    };
+    ExprInsn *insn;
+    int loop, jz;
+
+    switch (e->type) {
+    case e_value:
+        return emit(c, OP_VALUE, e->value, 1) ? 0 : AVERROR(ENOMEM);
+    case e_const:
+        if (!(insn = emit(c, OP_CONST, e->value, 1)))
+            return AVERROR(ENOMEM);
+        insn->arg = e->a.const_index;
+        if (insn->arg >= BATCH_CONSTS)
+            c->batch = 0;
+        return 0;
+    case e_while:
+        /* NAN; loop: cond; jz end; body; last; jmp loop; end: */
+        c->batch = 0;
+        if (!emit(c, OP_VALUE, NAN, 1))
+            return AVERROR(ENOMEM);
+        loop = c->size;
+        if (compile_expr(c, e->param[0]) < 0 || !emit(c, OP_JZ, 1, -1))
+            return AVERROR(ENOMEM);
+        jz = c->size - 1;
+        if (compile_expr(c, e->param[1]) < 0 || !emit(c, OP_LAST, 1, -1) ||
+            !(insn = emit(c, OP_JMP, 1, 0)))
+            return AVERROR(ENOMEM);
+        insn->arg        = loop;
+        c->code[jz].arg = c->size;
+        return 0;
+    case e_squish:
+    case e_gauss:
+    case e_func0:
+    case e_func1:
+    case e_ld:
+    case e_isnan:
+    case e_floor:
+    case e_ceil:
+    case e_trunc:
+    case e_sqrt:
+    case e_not:
+    case e_random:
+        if (compile_expr(c, e->param[0]) < 0 ||
+            !(insn = emit(c, unary_ops[e->type], e->value, 0)))
+            return AVERROR(ENOMEM);
+        break;
+    default:
+        if (compile_expr(c, e->param[0]) < 0)
+            return AVERROR(ENOMEM);
+        if (e->param[1]->type == e_value) {
+            if (!(insn = emit(c, binary_ops[e->type] + OP_IMM, e->value, 0)))
+                return AVERROR(ENOMEM);
+            insn->imm = e->param[1]->value;
+        } else if (compile_expr(c, e->param[1]) < 0 ||
+                   !(insn = emit(c, binary_ops[e->type], e->value, -1)))
+            return AVERROR(ENOMEM);
+        break;
+    }
+    if      (e->type == e_func0) insn->a.func0 = e->a.func0;
+    else if (e->type == e_func1) insn->a.func1 = e->a.func1;
+    else if (e->type == e_func2) insn->a.func2 = e->a.func2;
+    if (e->type == e_func1 || e->type == e_func2 ||
+        e->type == e_st    || e->type == e_random)
+        c->batch = 0;
+    return 0;
+}
+
+static int max_const_index(AVExpr *e)
+{
+    if (!e)
+        return -1;
+    if (e->type == e_const)
+        return e->a.const_index;
+    return FFMAX(max_const_index(e->param[0]), max_const_index(e->param[1]));
+}
+
+static void compile(AVExpr *e)
+{
+    Compiler c = { .batch = 1 };
+
+    fold_constants(e);
+    if (compile_expr(&c, e) < 0 || c.max_depth > MAX_STACK) {
+        /* keep evaluating the tree */
+        av_free(c.code);
+        return;
+    }
+    e->code       = c.code;
+    e->code_size  = c.size;
+    e->stack_size = c.max_depth;
+    e->batch      = c.batch;
+}
+
+#define BINARY_OP(op, x)                                                 \
+    case op:          d = sp[-2]; d2 = sp[-1]; sp--; sp[-1] = (x); break; \
+    case op + OP_IMM: d = sp[-1]; d2 = insn->imm;    sp[-1] = (x); break
+
+static av_always_inline double run_code(const AVExpr *e, const double *const_values,
+                                        const double * const *const_arrays, int idx,
+                                        void *opaque)
+{
+    double stack[MAX_STACK], *sp = stack, d, d2;
+    const ExprInsn *insn = e->code, *end = e->code + e->code_size;
+    double *var = e->var;
+
+    for (; insn < end; insn++) {
+        double v = insn->value;
+        switch (insn->op) {
+        case OP_VALUE:  *sp++ = v; break;
+        case OP_CONST:
+            if (const_arrays && const_arrays[insn->arg])
+                *sp++ = v * const_arrays[insn->arg][idx];
+            else
+                *sp++ = v * const_values[insn->arg];
+            break;
+        case OP_JZ:     if (!*--sp) insn = e->code + insn->arg - 1; break;
+        case OP_JMP:    insn = e->code + insn->arg - 1; break;
+        case OP_LD:     sp[-1] = v * var[av_clip(sp[-1], 0, VARS-1)]; break;
+        case OP_FUNC0:  sp[-1] = v * insn->a.func0(sp[-1]); break;
+        case OP_FUNC1:  sp[-1] = v * insn->a.func1(opaque, sp[-1]); break;
+        case OP_SQUISH: sp[-1] = 1/(1+exp(4*sp[-1])); break;
+        case OP_GAUSS:  d = sp[-1]; sp[-1] = exp(-d*d/2)/sqrt(2*M_PI); break;
+        case OP_ISNAN:  sp[-1] = v * !!isnan(sp[-1]); break;
+        case OP_FLOOR:  sp[-1] = v * floor(sp[-1]); break;
+        case OP_CEIL:   sp[-1] = v * ceil (sp[-1]); break;
+        case OP_TRUNC:  sp[-1] = v * trunc(sp[-1]); break;
+        case OP_SQRT:   sp[-1] = v * sqrt (sp[-1]); break;
+        case OP_NOT:    sp[-1] = v * (sp[-1] == 0); break;
+        case OP_RANDOM: {
+            int i = av_clip(sp[-1], 0, VARS-1);
+            uint64_t r = isnan(var[i]) ? 0 : var[i];
+            r = r*1664525+1013904223;
+            var[i] = r;
+            sp[-1] = v * (r * (1.0/UINT64_MAX));
+            break;
+        }
+        BINARY_OP(OP_FUNC2,  v * insn->a.func2(opaque, d, d2));
+        BINARY_OP(OP_MOD,    v * (d - floor(d/d2)*d2));
+        BINARY_OP(OP_GCD,    v * av_gcd(d,d2));
+        BINARY_OP(OP_MAX,    v * (d >  d2 ?   d : d2));
+        BINARY_OP(OP_MIN,    v * (d <  d2 ?   d : d2));
+        BINARY_OP(OP_EQ,     v * (d == d2 ? 1.0 : 0.0));
+        BINARY_OP(OP_GT,     v * (d >  d2 ? 1.0 : 0.0));
+        BINARY_OP(OP_GTE,    v * (d >= d2 ? 1.0 : 0.0));
+        BINARY_OP(OP_POW,    v * pow(d, d2));
+        BINARY_OP(OP_MUL,    v * (d * d2));
+        BINARY_OP(OP_DIV,    v * (d / d2));
+        BINARY_OP(OP_ADD,    v * (d + d2));
+        BINARY_OP(OP_LAST,   v * d2);
+        BINARY_OP(OP_ST,     v * (var[av_clip(d, 0, VARS-1)] = d2));
+        BINARY_OP(OP_HYPOT,  v * (sqrt(d*d + d2*d2)));
+        }
+    }
+    return sp[-1];
+}
+
+#define BATCH_UNARY(x)  for (i = 0; i < n; i++) { d = sp[-1][i]; sp[-1][i] = (x); } break
+#define BATCH_BINARY(op, x)                                             \
+    case op:                                                            \
+        sp--;                                                           \
+        for (i = 0; i < n; i++) {                                       \
+            d = sp[-1][i]; d2 = sp[0][i]; sp[-1][i] = (x);              \
+        }                                                               \
+        break;                                                          \
+    case op + OP_IMM:                                                   \
+        d2 = insn->imm;                                                 \
+        for (i = 0; i < n; i++) {                                       \
+            d = sp[-1][i]; sp[-1][i] = (x);                             \
+        }                                                               \
+        break
+
+static void run_code_batch(const AVExpr *e, double *dst, int n,
+                           const double *const_values,
+                           const double * const *const_arrays)
+{
+    double stack[BATCH_STACK][BATCH_SIZE], (*sp)[BATCH_SIZE] = stack, d, d2;
+    const ExprInsn *insn = e->code, *end = e->code + e->code_size;
+    const double *var = e->var;
+    int i;
+
+    for (; insn < end; insn++) {
+        double v = insn->value;
+        switch (insn->op) {
+        case OP_VALUE:
+            for (i = 0; i < n; i++)
+                sp[0][i] = v;
+            sp++;
+            break;
+        case OP_CONST:
+            if (const_arrays && const_arrays[insn->arg]) {
+                const double *src = const_arrays[insn->arg];
+                for (i = 0; i < n; i++)
+                    sp[0][i] = v * src[i];
+            } else {
+                d = v * const_values[insn->arg];
+                for (i = 0; i < n; i++)
+                    sp[0][i] = d;
+            }
+            sp++;
+            break;
+        case OP_LD:     BATCH_UNARY(v * var[av_clip(d, 0, VARS-1)]);
+        case OP_FUNC0:  BATCH_UNARY(v * insn->a.func0(d));
+        case OP_SQUISH: BATCH_UNARY(1/(1+exp(4*d)));
+        case OP_GAUSS:  BATCH_UNARY(exp(-d*d/2)/sqrt(2*M_PI));
+        case OP_ISNAN:  BATCH_UNARY(v * !!isnan(d));
+        case OP_FLOOR:  BATCH_UNARY(v * floor(d));
+        case OP_CEIL:   BATCH_UNARY(v * ceil (d));
+        case OP_TRUNC:  BATCH_UNARY(v * trunc(d));
+        case OP_SQRT:   BATCH_UNARY(v * sqrt (d));
+        case OP_NOT:    BATCH_UNARY(v * (d == 0));
+        BATCH_BINARY(OP_MOD,    v * (d - floor(d/d2)*d2));
+        BATCH_BINARY(OP_GCD,    v * av_gcd(d,d2));
+        BATCH_BINARY(OP_MAX,    v * (d >  d2 ?   d : d2));
+        BATCH_BINARY(OP_MIN,    v * (d <  d2 ?   d : d2));
+        BATCH_BINARY(OP_EQ,     v * (d == d2 ? 1.0 : 0.0));
+        BATCH_BINARY(OP_GT,     v * (d >  d2 ? 1.0 : 0.0));
+        BATCH_BINARY(OP_GTE,    v * (d >= d2 ? 1.0 : 0.0));
+        BATCH_BINARY(OP_POW,    v * pow(d, d2));
+        BATCH_BINARY(OP_MUL,    v * (d * d2));
+        BATCH_BINARY(OP_DIV,    v * (d / d2));
+        BATCH_BINARY(OP_ADD,    v * (d + d2));
+        BATCH_BINARY(OP_LAST,   v * d2);
+        BATCH_BINARY(OP_HYPOT,  v * (sqrt(d*d + d2*d2)));
+        default:        break; // excluded by compile()
+        }
+    }
+    memcpy(dst, sp[-1], n * sizeof(*dst));
+}
+
 int av_expr_parse(AVExpr **expr, const char *s,
                   const char * const *const_names,
                   const char * const *func1_names, double (* const *funcs1)(void *, double),
@@ -544,6 +885,7 @@ int av_expr_parse(AVExpr **expr, const char *s,
         goto end;
     }
     e->var= av_mallocz(sizeof(double) *VARS);
+    compile(e);
     *expr = e;
 end:
     av_free(w);
@@ -553,13 +895,71 @@ end:
 double av_expr_eval(AVExpr *e, const double *const_values, void *opaque)
 {
     Parser p = { 0 };
-    p.var= e->var;
 
+    if (e->code)
+        return run_code(e, const_values, NULL, 0, opaque);
+
+    p.var= e->var;
     p.const_values = const_values;
     p.opaque     = opaque;
     return eval_expr(&p, e);
 }
 
+void av_expr_eval_batch(AVExpr *e, double *dst, int nb,
+                        const double *const_values,
+                        const double * const *const_arrays, void *opaque)
+{
+    int i;
+
+    if (e->code && e->batch && e->stack_size <= BATCH_STACK) {
+        for (i = 0; i < nb; i += BATCH_SIZE) {
+            int n = FFMIN(nb - i, BATCH_SIZE);
+            const double *arrays[BATCH_CONSTS];
+            const double * const *a = NULL;
+            int j;
+
+            if (const_arrays) {
+                /* only the constants referenced by the code are accessed */
+                for (j = 0; j < e->code_size; j++)
+                    if (e->code[j].op == OP_CONST) {
+                        int k = e->code[j].arg;
+                        arrays[k] = const_arrays[k] ? const_arrays[k] + i : NULL;
+                    }
+                a = arrays;
+            }
+            run_code_batch(e, dst + i, n, const_values, a);
+        }
+    } else if (e->code) {
+        for (i = 0; i < nb; i++)
+            dst[i] = run_code(e, const_values, const_arrays, i, opaque);
+    } else {
+        Parser p = { 0 };
+        double *values = NULL;
+        int nb_values = 0;
+
+        if (const_arrays) {
+            /* eval_expr() only knows about const_values, so substitute the
+             * array elements into a copy of it */
+            nb_values = max_const_index(e) + 1;
+            if (!(values = av_malloc(nb_values * sizeof(*values))))
+                nb_values = 0;
+            else
+                memcpy(values, const_values, nb_values * sizeof(*values));
+        }
+        p.var          = e->var;
+        p.const_values = values ? values : const_values;
+        p.opaque       = opaque;
+        for (i = 0; i < nb; i++) {
+            int j;
+            for (j = 0; j < nb_values; j++)
+                if (const_arrays[j])
+                    values[j] = const_arrays[j][i];
+            dst[i] = eval_expr(&p, e);
+        }
+        av_free(values);
+    }
+}
+
 int av_expr_parse_and_eval(double *d, const char *s,
                            const char * const *const_names, const double *const_values,
                            const char * const *func1_names, double (* const *funcs1)(void *, double),
@@ -613,6 +1013,7 @@ void av_free_expr(AVExpr *e)
 #ifdef TEST
 #undef printf
 #include <string.h>
+#include <time.h>
 
 static double const_values[] = {
     M_PI,
@@ -626,9 +1027,106 @@ static const char *const_names[] = {
     0
 };
 
+static const char *var_names[] = { "x", "y", NULL };
+
+static double twice(void *opaque, double a) { return 2 * a; }
+static double (* const funcs1[])(void *, double) = { twice, NULL };
+static const char * const func1_names[] = { "twice", NULL };
+
+/**
+ * Check that the compiled code, the batch evaluation and the tree give
+ * the same results. Errors are logged and returned, the reference output
+ * is unchanged.
+ */
+static int compare_eval(int benchmark)
+{
+    static const char *exprs[] = {
+        "sin(x*2*PI*440/44100)*0.5+y",
+        "-x^2+3*-y-(-x)",
+        "max(x,y)-min(x,-y)+mod(x,7)+gcd(x,12)+hypot(x,y)",
+        "eq(x,3)+gt(x,y)+gte(x,y)+lt(x,y)+lte(x,y)+not(x)+isnan(x/y)",
+        "floor(x/3)+ceil(x/3)+trunc(-x/3)+sqrt(x)+squish(x/100)+gauss(x/10)",
+        "abs(x-y);exp(x/100)+log(x+1)+1/2",
+        "st(0,x);st(1,ld(0)*2);ld(1)+ld(0)+ld(5)",
+        "st(0,0);st(1,1);while(lte(ld(1),x),st(0,ld(0)+ld(1));st(1,ld(1)+1));ld(0)",
+        "random(0)+random(0)",
+        "twice(x)+twice(y+1)",
+        "pow(x,1.5)+pow(-2,y)+PI*E",
+        NULL
+    };
+    enum { N = 1000 };
+    double x[N], ref[N], out[N], values[3] = { 0 };
+    const double *arrays[2] = { x, NULL };
+    int i, j, err = 0;
+
+    for (i = 0; i < N; i++)
+        x[i] = i - 100;
+
+    for (j = 0; exprs[j]; j++) {
+        AVExpr *e;
+        Parser p = { 0 };
+
+        if (av_expr_parse(&e, exprs[j], var_names, func1_names, funcs1,
+                          NULL, NULL, 0, NULL) < 0) {
+            av_log(NULL, AV_LOG_ERROR, "failed to parse '%s'\n", exprs[j]);
+            err = 1;
+            continue;
+        }
+        values[1] = 0.25;
+        p.var          = e->var;
+        p.const_values = values;
+        for (i = 0; i < N; i++) {
+            values[0] = x[i];
+            ref[i] = eval_expr(&p, e);
+        }
+        memset(e->var, 0, sizeof(*e->var) * VARS);
+        for (i = 0; i < N; i++) {
+            values[0] = x[i];
+            out[i] = av_expr_eval(e, values, NULL);
+        }
+        if (memcmp(ref, out, sizeof(ref))) {
+            av_log(NULL, AV_LOG_ERROR, "av_expr_eval() differs for '%s'\n", exprs[j]);
+            err = 1;
+        }
+        memset(e->var, 0, sizeof(*e->var) * VARS);
+        av_expr_eval_batch(e, out, N, values, arrays, NULL);
+        if (memcmp(ref, out, sizeof(ref))) {
+            av_log(NULL, AV_LOG_ERROR, "av_expr_eval_batch() differs for '%s'\n", exprs[j]);
+            err = 1;
+        }
+
+        if (benchmark) {
+            clock_t t[4];
+            int k;
+            t[0] = clock();
+            for (k = 0; k < 1000; k++)
+                for (i = 0; i < N; i++) {
+                    values[0] = x[i];
+                    ref[i] = eval_expr(&p, e);
+                }
+            t[1] = clock();
+            for (k = 0; k < 1000; k++)
+                for (i = 0; i < N; i++) {
+                    values[0] = x[i];
+                    out[i] = av_expr_eval(e, values, NULL);
+                }
+            t[2] = clock();
+            for (k = 0; k < 1000; k++)
+                av_expr_eval_batch(e, out, N, values, arrays, NULL);
+            t[3] = clock();
+            av_log(NULL, AV_LOG_INFO, "%-70s tree %5.1f code %5.1f batch %5.1f ns/eval\n", exprs[j],
+                    (t[1] - t[0]) * 1e9 / (1000.0 * N * CLOCKS_PER_SEC),
+                    (t[2] - t[1]) * 1e9 / (1000.0 * N * CLOCKS_PER_SEC),
+                    (t[3] - t[2]) * 1e9 / (1000.0 * N * CLOCKS_PER_SEC));
+        }
+        av_expr_free(e);
+    }
+    return err;
+}
+
 int main(int argc, char **argv)
 {
-    int i;
+    int i, err;
     double d;
     const char **expr, *exprs[] = {
         "",
@@ -711,6 +1209,8 @@ int main(int argc, char **argv)
                            NULL, NULL, NULL, NULL, NULL, 0, NULL);
     printf("%f == 0.931322575\n", d);
 
+    err = compare_eval(argc > 1 && !strcmp(argv[1], "-t"));
+
     if (argc > 1 && !strcmp(argv[1], "-t")) {
         for (i = 0; i < 1050; i++) {
             START_TIMER;
@@ -721,6 +1221,6 @@ int main(int argc, char **argv)
         }
     }
 
-    return 0;
+    return err;
 }
 #endif
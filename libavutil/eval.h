@@ -86,6 +86,22 @@ int av_expr_parse(AVExpr **expr, const char *s,
  */
 double av_expr_eval(AVExpr *e, const double *const_values, void *opaque);
 
+/**
+ * Evaluate a previously parsed expression for nb sets of constant values.
+ * This gives the same results as calling av_expr_eval() nb times, but
+ * expressions without loops, stores or user functions are evaluated for
+ * many values at once, which is much faster.
+ * @param dst array where the nb results are stored
+ * @param const_values a zero terminated array of values for the identifiers from av_expr_parse() const_names
+ * @param const_arrays NULL, or an array with one entry per const_values
+ * entry. A non-NULL entry points to nb values which are used in turn
+ * instead of the respective const_values entry.
+ * @param opaque a pointer which will be passed to all functions from funcs1 and funcs2
+ */
+void av_expr_eval_batch(AVExpr *e, double *dst, int nb,
+                        const double *const_values,
+                        const double * const *const_arrays, void *opaque);
+
 /**
  * Free a parsed expression previously created with av_expr_parse().
  */
@@ -43,6 +43,9 @@
 struct AVDictionary {
     int count;
     AVDictionaryEntry *elems;
+    unsigned *hash;         ///< open addressing index into elems, see dict.c
+    unsigned hash_size;     ///< number of slots in hash, 0 or a power of 2
+    unsigned hash_used;     ///< number of used and deleted slots
 };
 
 #ifndef attribute_align_arg
@@ -24,13 +24,65 @@
  * logging functions
  */
 
+#include "config.h"
 #include <unistd.h>
+#include <stddef.h>
 #include <stdlib.h>
+#include <sys/time.h>
+#if HAVE_PTHREADS
+#include <pthread.h>
+#endif
 #include "avutil.h"
 #include "log.h"
+#include "mem.h"
+#include "ringbuffer.h"
+
+#define LINE_SIZE 1024
 
 static int av_log_level = AV_LOG_INFO;
 static int flags;
+static int max_rate;
+
+/**
+ * Line being assembled by one thread; it is only output when complete, so
+ * that the pieces of lines logged by different threads do not mix.
+ */
+typedef struct ThreadLog {
+    char line[LINE_SIZE];
+    int len;
+    int level;
+    int dropping;           ///< rest of a rate limited line is dropped
+} ThreadLog;
+
+typedef struct RateLimit {
+    void *ctx;
+    int64_t second;
+    int count;
+    int dropped;
+    char prefix[128];       ///< line prefix of ctx, which may be freed before dropped is reported
+} RateLimit;
+
+static RateLimit rate_limits[64];
+
+#if HAVE_PTHREADS
+/* protects rate_limits and writing to log_rb */
+static pthread_mutex_t log_lock    = PTHREAD_MUTEX_INITIALIZER;
+/* held by the thread writing to stderr */
+static pthread_mutex_t output_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  flush_cond  = PTHREAD_COND_INITIALIZER;
+static pthread_once_t  key_once    = PTHREAD_ONCE_INIT;
+static pthread_key_t   key;
+static pthread_t       writer_thread;
+static AVRingBuffer   *log_rb;      ///< lines for the writer thread if async
+static volatile int    writer_quit;
+static unsigned        posted, written, async_dropped;
+#define LOCK(l)   pthread_mutex_lock(&l)
+#define UNLOCK(l) pthread_mutex_unlock(&l)
+#else
+static ThreadLog single_log;
+#define LOCK(l)
+#define UNLOCK(l)
+#endif
 
 #if defined(_WIN32) && !defined(__MINGW32CE__)
 #include <windows.h>
@@ -87,31 +139,13 @@ static void sanitize(uint8_t *line){
     }
 }
 
-void av_log_default_callback(void* ptr, int level, const char* fmt, va_list vl)
+/* Write a complete line to stderr, called with output_lock held. */
+static void output(int level, char *line)
 {
-    static int print_prefix=1;
     static int count;
-    static char prev[1024];
-    char line[1024];
+    static char prev[LINE_SIZE];
     static int is_atty;
-    AVClass* avc= ptr ? *(AVClass**)ptr : NULL;
-    if(level>av_log_level)
-        return;
-    line[0]=0;
-#undef fprintf
-    if(print_prefix && avc) {
-        if (avc->parent_log_context_offset) {
-            AVClass** parent= *(AVClass***)(((uint8_t*)ptr) + avc->parent_log_context_offset);
-            if(parent && *parent){
-                snprintf(line, sizeof(line), "[%s @ %p] ", (*parent)->item_name(parent), parent);
-            }
-        }
-        snprintf(line + strlen(line), sizeof(line) - strlen(line), "[%s @ %p] ", avc->item_name(ptr), ptr);
-    }
-
-    vsnprintf(line + strlen(line), sizeof(line) - strlen(line), fmt, vl);
-
-    print_prefix = strlen(line) && line[strlen(line)-1] == '\n';
+    int print_prefix = strlen(line) && line[strlen(line)-1] == '\n';
 
 #if HAVE_ISATTY
     if(!is_atty) is_atty= isatty(2) ? 1 : -1;
@@ -132,15 +166,216 @@ void av_log_default_callback(void* ptr, int level, const char* fmt, va_list vl)
     colored_fputs(av_clip(level>>3, 0, 6), line);
 }
 
+#if HAVE_PTHREADS
+typedef struct LogRecord {
+    int level;
+    int size;
+    char line[LINE_SIZE];
+} LogRecord;
+
+#define RECORD_HEADER offsetof(LogRecord, line)
+
+static void *writer(void *arg)
+{
+    LogRecord rec;
+
+    while (!writer_quit) {
+        if (av_ringbuffer_wait_read(log_rb, RECORD_HEADER, -1) < RECORD_HEADER)
+            continue;
+        /* a record is published as a whole */
+        av_ringbuffer_read(log_rb, &rec, RECORD_HEADER);
+        av_ringbuffer_read(log_rb, rec.line, rec.size);
+        LOCK(output_lock);
+        output(rec.level, rec.line);
+        written++;
+        pthread_cond_broadcast(&flush_cond);
+        UNLOCK(output_lock);
+    }
+    return NULL;
+}
+
+/* Queue a line for the writer thread, called with log_lock held. */
+static int post(int level, const char *line)
+{
+    LogRecord rec;
+
+    rec.level = level;
+    rec.size  = FFMIN(strlen(line) + 1, sizeof(rec.line));
+    memcpy(rec.line, line, rec.size);
+    rec.line[rec.size - 1] = 0;
+    if (av_ringbuffer_write(log_rb, &rec, RECORD_HEADER + rec.size) < 0)
+        return -1;
+    posted++;
+    return 0;
+}
+#endif
+
+static void emit(int level, char *line)
+{
+#if HAVE_PTHREADS
+    if (flags & AV_LOG_ASYNC) {
+        LOCK(log_lock);
+        if (log_rb && (flags & AV_LOG_ASYNC)) {
+            if (async_dropped) {
+                char note[64];
+                snprintf(note, sizeof(note), "    %u log lines dropped\n", async_dropped);
+                if (!post(AV_LOG_WARNING, note))
+                    async_dropped = 0;
+            }
+            /* never block the logging thread on a slow stderr */
+            if (async_dropped || post(level, line) < 0)
+                async_dropped++;
+            UNLOCK(log_lock);
+            return;
+        }
+        UNLOCK(log_lock);
+    }
+#endif
+    LOCK(output_lock);
+    output(level, line);
+    UNLOCK(output_lock);
+}
+
+static int format_prefix(char *line, int size, void *ptr)
+{
+    AVClass* avc= ptr ? *(AVClass**)ptr : NULL;
+
+    line[0]=0;
+    if(avc) {
+        if (avc->parent_log_context_offset) {
+            AVClass** parent= *(AVClass***)(((uint8_t*)ptr) + avc->parent_log_context_offset);
+            if(parent && *parent){
+                snprintf(line, size, "[%s @ %p] ", (*parent)->item_name(parent), parent);
+            }
+        }
+        snprintf(line + strlen(line), size - strlen(line), "[%s @ %p] ", avc->item_name(ptr), ptr);
+    }
+    return strlen(line);
+}
+
+/**
+ * Write the report of the lines suppressed for r to note, if any, and
+ * reset the count. Called with log_lock held.
+ */
+static void take_dropped(RateLimit *r, char *note, int size)
+{
+    note[0] = 0;
+    if (r->dropped)
+        snprintf(note, size, "%s%d log lines suppressed\n", r->prefix, r->dropped);
+    r->dropped = 0;
+}
+
+/**
+ * Check the rate limit of ptr for a new line.
+ * @return 1 if the line has to be dropped
+ */
+static int rate_limit(void *ptr, int level)
+{
+    RateLimit *r;
+    struct timeval tv;
+    char note[LINE_SIZE] = "";
+    uintptr_t key = (uintptr_t)ptr;
+    int drop;
+
+    /* lines without a context, such as the status output of the tools,
+     * are never limited */
+    if (!max_rate || level <= AV_LOG_FATAL || !ptr)
+        return 0;
+    gettimeofday(&tv, NULL);
+    LOCK(log_lock);
+    r = &rate_limits[(key >> 4 ^ key >> 10 ^ key >> 16) % FF_ARRAY_ELEMS(rate_limits)];
+    if (r->ctx != ptr || r->second != tv.tv_sec) {
+        /* also reports the count of another context sharing the slot */
+        take_dropped(r, note, sizeof(note));
+        r->ctx     = ptr;
+        r->second  = tv.tv_sec;
+        r->count   = 0;
+    }
+    drop = ++r->count > max_rate;
+    if (drop && !r->dropped++)
+        format_prefix(r->prefix, sizeof(r->prefix), ptr);
+    UNLOCK(log_lock);
+
+    if (note[0])
+        emit(AV_LOG_WARNING, note);
+    return drop;
+}
+
+#if HAVE_PTHREADS
+static void thread_exit(void *arg)
+{
+    ThreadLog *tl = arg;
+    if (tl->len)
+        emit(tl->level, tl->line);
+    av_free(tl);
+}
+
+static void make_key(void)
+{
+    pthread_key_create(&key, thread_exit);
+}
+#endif
+
+static ThreadLog *get_thread_log(void)
+{
+#if HAVE_PTHREADS
+    ThreadLog *tl;
+
+    pthread_once(&key_once, make_key);
+    tl = pthread_getspecific(key);
+    if (!tl && (tl = av_mallocz(sizeof(*tl))))
+        pthread_setspecific(key, tl);
+    return tl;
+#else
+    return &single_log;
+#endif
+}
+
+void av_log_default_callback(void* ptr, int level, const char* fmt, va_list vl)
+{
+    ThreadLog tmp, *tl;
+    int fmt_len = strlen(fmt), ends_line;
+
+    if(level>av_log_level)
+        return;
+    if (!(tl = get_thread_log())) {
+        tl = &tmp;
+        tl->len = tl->dropping = 0;
+    }
+    ends_line = fmt_len && (fmt[fmt_len-1] == '\n' || fmt[fmt_len-1] == '\r');
+
+    if (!tl->len) {
+        /* a rate limited line is dropped without being formatted */
+        if (tl->dropping || rate_limit(ptr, level)) {
+            tl->dropping = !ends_line;
+            return;
+        }
+        tl->len   = format_prefix(tl->line, sizeof(tl->line), ptr);
+        tl->level = level;
+    }
+
+    vsnprintf(tl->line + tl->len, sizeof(tl->line) - tl->len, fmt, vl);
+    tl->len += strlen(tl->line + tl->len);
+
+    if (!tl->len || tl->line[tl->len-1] == '\n' || tl->line[tl->len-1] == '\r' ||
+        tl->len >= sizeof(tl->line) - 1 || tl == &tmp) {
+        emit(tl->level, tl->line);
+        tl->len = 0;
+    }
+}
+
 static void (*av_log_callback)(void*, int, const char*, va_list) = av_log_default_callback;
 
 void av_log(void* avcl, int level, const char *fmt, ...)
 {
     AVClass* avc= avcl ? *(AVClass**)avcl : NULL;
     va_list vl;
-    va_start(vl, fmt);
     if(avc && avc->version >= (50<<16 | 15<<8 | 2) && avc->log_level_offset_offset && level>=AV_LOG_FATAL)
         level += *(int*)(((uint8_t*)avcl) + avc->log_level_offset_offset);
+    /* do not even set up the arguments for a message that is not shown */
+    if (level > av_log_level && av_log_callback == av_log_default_callback)
+        return;
+    va_start(vl, fmt);
     av_vlog(avcl, level, fmt, vl);
     va_end(vl);
 }
@@ -162,9 +397,67 @@ void av_log_set_level(int level)
 
 void av_log_set_flags(int arg)
 {
+#if HAVE_PTHREADS
+    if ((arg & AV_LOG_ASYNC) && !log_rb) {
+        AVRingBuffer *rb = av_ringbuffer_alloc(1 << 16);
+        writer_quit = 0;
+        log_rb = rb;
+        if (!rb || pthread_create(&writer_thread, NULL, writer, NULL)) {
+            av_ringbuffer_free(&log_rb);
+            arg &= ~AV_LOG_ASYNC;
+        }
+    } else if (!(arg & AV_LOG_ASYNC) && log_rb) {
+        /* new lines are output directly, wait for the queued ones */
+        LOCK(log_lock);
+        flags = arg;
+        UNLOCK(log_lock);
+        av_log_flush();
+        writer_quit = 1;
+        av_ringbuffer_wake(log_rb);
+        pthread_join(writer_thread, NULL);
+        LOCK(log_lock);
+        av_ringbuffer_free(&log_rb);
+        UNLOCK(log_lock);
+    }
+#else
+    arg &= ~AV_LOG_ASYNC;
+#endif
     flags= arg;
 }
 
+void av_log_set_rate_limit(int lines_per_second)
+{
+    max_rate = FFMAX(lines_per_second, 0);
+}
+
+void av_log_flush(void)
+{
+    char note[LINE_SIZE];
+    int i;
+#if HAVE_PTHREADS
+    unsigned target;
+#endif
+
+    /* report the lines suppressed during the current second */
+    for (i = 0; i < FF_ARRAY_ELEMS(rate_limits); i++) {
+        LOCK(log_lock);
+        take_dropped(&rate_limits[i], note, sizeof(note));
+        UNLOCK(log_lock);
+        if (note[0])
+            emit(AV_LOG_WARNING, note);
+    }
+
+#if HAVE_PTHREADS
+    LOCK(log_lock);
+    target = posted;
+    UNLOCK(log_lock);
+    LOCK(output_lock);
+    while (log_rb && (int)(written - target) < 0)
+        pthread_cond_wait(&flush_cond, &output_lock);
+    UNLOCK(output_lock);
+#endif
+}
+
 void av_log_set_callback(void (*callback)(void*, int, const char*, va_list))
 {
     av_log_callback = callback;
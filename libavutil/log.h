@@ -167,6 +167,30 @@ const char* av_default_item_name(void* ctx);
  * call av_log(NULL, AV_LOG_QUIET, "%s", ""); at the end
  */
 #define AV_LOG_SKIP_REPEATED 1
+
+/**
+ * Let the default callback write the log from a separate thread, so that
+ * threads logging many messages are not slowed down by a slow stderr.
+ * If the queue is full, lines are dropped and their number is reported.
+ * Call av_log_flush() before writing to stderr directly and before exiting,
+ * or queued lines may be lost. Ignored without thread support.
+ */
+#define AV_LOG_ASYNC 2
 void av_log_set_flags(int arg);
 
+/**
+ * Limit the number of lines the default callback outputs for each context
+ * per second; the number of suppressed lines is output afterwards, or by
+ * av_log_flush(). Lines of level AV_LOG_FATAL and below and lines logged
+ * without a context are never suppressed.
+ * @param lines_per_second maximum number of lines, 0 for no limit (default)
+ */
+void av_log_set_rate_limit(int lines_per_second);
+
+/**
+ * Output the pending counts of lines suppressed by the rate limit, and
+ * wait until the lines queued with AV_LOG_ASYNC have been written.
+ */
+void av_log_flush(void);
+
 #endif /* AVUTIL_LOG_H */
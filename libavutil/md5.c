@@ -31,9 +31,16 @@
  */
 
 #include <stdint.h>
+#include <string.h>
 #include "bswap.h"
+#include "common.h"
+#include "cpu.h"
 #include "intreadwrite.h"
+#include "mem.h"
 #include "md5.h"
+#if HAVE_SSE
+#include "x86/md5.h"
+#endif
 
 typedef struct AVMD5{
     uint64_t len;
@@ -86,19 +93,18 @@ static const uint32_t T[64] = { // T[i]= fabs(sin(i+1)<<32)
         a = b + (a << t | a >> (32 - t));                               \
     } while (0)
 
-static void body(uint32_t ABCD[4], uint32_t X[16])
+static void body(uint32_t ABCD[4], const uint8_t *src)
 {
     int t;
-    int i av_unused;
+    int i;
     unsigned int a = ABCD[3];
     unsigned int b = ABCD[2];
     unsigned int c = ABCD[1];
     unsigned int d = ABCD[0];
+    uint32_t X[16];
 
-#if HAVE_BIGENDIAN
     for (i = 0; i < 16; i++)
-        X[i] = av_bswap32(X[i]);
-#endif
+        X[i] = AV_RL32(src + 4*i);
 
 #if CONFIG_SMALL
     for (i = 0; i < 64; i++) {
@@ -135,18 +141,23 @@ void av_md5_init(AVMD5 *ctx)
 
 void av_md5_update(AVMD5 *ctx, const uint8_t *src, const int len)
 {
-    int i, j;
+    const uint8_t *end = src + len;
+    int j;
 
     j = ctx->len & 63;
     ctx->len += len;
 
-    for (i = 0; i < len; i++) {
-        ctx->block[j++] = src[i];
-        if (j == 64) {
-            body(ctx->ABCD, (uint32_t *) ctx->block);
-            j = 0;
-        }
+    if (j) {
+        int n = FFMIN(len, 64 - j);
+        memcpy(ctx->block + j, src, n);
+        src += n;
+        if (j + n < 64)
+            return;
+        body(ctx->ABCD, ctx->block);
     }
+    for (; end - src >= 64; src += 64)
+        body(ctx->ABCD, src);
+    memcpy(ctx->block, src, end - src);
 }
 
 void av_md5_final(AVMD5 *ctx, uint8_t *dst)
@@ -173,9 +184,124 @@ void av_md5_sum(uint8_t *dst, const uint8_t *src, const int len)
     av_md5_final(&ctx, dst);
 }
 
+#if HAVE_SSE
+typedef struct MD5Lane {
+    const uint8_t *src;
+    uint8_t *dst;
+    int block, full_blocks, nb_blocks;
+    uint8_t tail[128];          ///< the padded last one or two blocks
+} MD5Lane;
+
+static void lane_start(MD5Lane *l, uint32_t state[4][4], int lane,
+                       uint8_t *dst, const uint8_t *src, int len)
+{
+    int rest = len & 63;
+
+    l->src         = src;
+    l->dst         = dst;
+    l->block       = 0;
+    l->full_blocks = len >> 6;
+    l->nb_blocks   = l->full_blocks + 1 + (rest >= 56);
+    memcpy(l->tail, src + len - rest, rest);
+    l->tail[rest] = 0x80;
+    memset(l->tail + rest + 1, 0, 128 - rest - 1);
+    AV_WL64(l->tail + 64 * (rest >= 56) + 56, (uint64_t)len << 3);
+
+    state[0][lane] = 0x67452301;
+    state[1][lane] = 0xefcdab89;
+    state[2][lane] = 0x98badcfe;
+    state[3][lane] = 0x10325476;
+}
+
+static const uint8_t *lane_block(const MD5Lane *l)
+{
+    if (l->block < l->full_blocks)
+        return l->src + 64 * l->block;
+    return l->tail + 64 * (l->block - l->full_blocks);
+}
+
+/**
+ * Hash the messages in the four lanes of ff_md5_block4_sse2(), starting the
+ * next message in a lane as soon as it becomes free. The last message is
+ * finished with the scalar code once it is the only one left.
+ */
+static void md5_sum_multi_sse2(uint8_t * const *dst, const uint8_t * const *src,
+                               const int *len, int nb)
+{
+    DECLARE_ALIGNED(16, uint32_t, state)[4][4];
+    DECLARE_ALIGNED(16, uint32_t, W)[16][4];
+    MD5Lane lanes[4];
+    int active = 0, next = 0;
+    int i, lane;
+
+    for (lane = 0; lane < 4; lane++) {
+        lanes[lane].src = NULL;
+        if (next < nb) {
+            lane_start(&lanes[lane], state, lane, dst[next], src[next], len[next]);
+            next++;
+            active++;
+        }
+    }
+
+    while (active > 1 || next < nb) {
+        for (lane = 0; lane < 4; lane++) {
+            const uint8_t *block = lanes[lane].src ? lane_block(&lanes[lane]) : NULL;
+            for (i = 0; i < 16; i++)
+                W[i][lane] = block ? AV_RL32(block + 4*i) : 0;
+        }
+        ff_md5_block4_sse2(state, W);
+
+        for (lane = 0; lane < 4; lane++) {
+            MD5Lane *l = &lanes[lane];
+            if (!l->src || ++l->block < l->nb_blocks)
+                continue;
+            for (i = 0; i < 4; i++)
+                AV_WL32(l->dst + 4*i, state[i][lane]);
+            l->src = NULL;
+            active--;
+            if (next < nb) {
+                lane_start(l, state, lane, dst[next], src[next], len[next]);
+                next++;
+                active++;
+            }
+        }
+    }
+
+    for (lane = 0; lane < 4; lane++) {
+        MD5Lane *l = &lanes[lane];
+        uint32_t ABCD[4];
+        if (!l->src)
+            continue;
+        for (i = 0; i < 4; i++)
+            ABCD[3 - i] = state[i][lane];
+        for (; l->block < l->nb_blocks; l->block++)
+            body(ABCD, lane_block(l));
+        for (i = 0; i < 4; i++)
+            AV_WL32(l->dst + 4*i, ABCD[3 - i]);
+    }
+}
+#endif
+
+void av_md5_sum_multi(uint8_t * const *dst, const uint8_t * const *src,
+                      const int *len, int nb)
+{
+    int i;
+
+#if HAVE_SSE
+    if (nb > 1 && av_get_cpu_flags() & AV_CPU_FLAG_SSE2) {
+        md5_sum_multi_sse2(dst, src, len, nb);
+        return;
+    }
+#endif
+    for (i = 0; i < nb; i++)
+        av_md5_sum(dst[i], src[i], len[i]);
+}
+
 #ifdef TEST
 #undef printf
 #include <stdio.h>
+#include <time.h>
+#include "log.h"
 
 static void print_md5(uint8_t *md5)
 {
@@ -185,7 +311,63 @@ static void print_md5(uint8_t *md5)
     printf("\n");
 }
 
-int main(void){
+/* compare av_md5_sum_multi() with av_md5_sum() on buffers of mixed sizes */
+static int check_multi(void)
+{
+    static uint8_t buf[70000];
+    uint8_t digests[2][40][16], *dst[40];
+    const uint8_t *src[40];
+    int len[40], i, nb, ret = 0;
+
+    for (i = 0; i < sizeof(buf); i++)
+        buf[i] = i * 13 + (i >> 9);
+    for (nb = 1; nb <= 40; nb += 3) {
+        for (i = 0; i < nb; i++) {
+            len[i] = (i * 37 + nb * 11) % 200;
+            if (i % 7 == 3)
+                len[i] += 60000;
+            src[i] = buf + i;
+            dst[i] = digests[0][i];
+            av_md5_sum(digests[1][i], src[i], len[i]);
+        }
+        av_md5_sum_multi(dst, src, len, nb);
+        if (memcmp(digests[0], digests[1], 16 * nb)) {
+            av_log(NULL, AV_LOG_ERROR, "av_md5_sum_multi() mismatch for %d buffers\n", nb);
+            ret = 1;
+        }
+    }
+    return ret;
+}
+
+static void benchmark(void)
+{
+    enum { N = 16, SIZE = 64 * 1024 };
+    static uint8_t buf[N][SIZE], digests[N][16];
+    uint8_t *dst[N];
+    const uint8_t *src[N];
+    int len[N], i, j;
+    clock_t t;
+
+    for (i = 0; i < N; i++) {
+        dst[i] = digests[i];
+        src[i] = buf[i];
+        len[i] = SIZE;
+    }
+    t = clock();
+    for (j = 0; j < 32; j++)
+        for (i = 0; i < N; i++)
+            av_md5_sum(dst[i], src[i], len[i]);
+    t = clock() - t;
+    av_log(NULL, AV_LOG_INFO, "av_md5_sum:       %.1f MB/s\n", 32.0 * CLOCKS_PER_SEC / FFMAX(t, 1));
+    t = clock();
+    for (j = 0; j < 32; j++)
+        av_md5_sum_multi(dst, src, len, N);
+    t = clock() - t;
+    av_log(NULL, AV_LOG_INFO, "av_md5_sum_multi: %.1f MB/s\n", 32.0 * CLOCKS_PER_SEC / FFMAX(t, 1));
+}
+
+int main(int argc, char **argv)
+{
     uint8_t md5val[16];
     int i;
     uint8_t in[1000];
@@ -200,6 +382,8 @@ int main(void){
         in[i] = i % 127;
     av_md5_sum(md5val, in,  999); print_md5(md5val);
 
-    return 0;
+    if (argc > 1 && !strcmp(argv[1], "-t"))
+        benchmark();
+    return check_multi();
 }
 #endif
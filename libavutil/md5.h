@@ -32,5 +32,17 @@ void av_md5_update(struct AVMD5 *ctx, const uint8_t *src, const int len);
 void av_md5_final(struct AVMD5 *ctx, uint8_t *dst);
 void av_md5_sum(uint8_t *dst, const uint8_t *src, const int len);
 
+/**
+ * Compute the MD5 sums of several independent buffers, as if calling
+ * av_md5_sum() for each of them. With SIMD, several buffers are hashed
+ * at once, so this is faster than hashing the buffers one by one.
+ *
+ * @param dst array of nb pointers to 16 byte digests
+ * @param src array of nb pointers to the buffers
+ * @param len array of nb buffer sizes
+ */
+void av_md5_sum_multi(uint8_t * const *dst, const uint8_t * const *src,
+                      const int *len, int nb);
+
 #endif /* AVUTIL_MD5_H */
 
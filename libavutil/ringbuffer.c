@@ -0,0 +1,358 @@
+/*
+ * lock-free single-producer/single-consumer ring buffer
+ *
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "config.h"
+#include <string.h>
+#if HAVE_PTHREADS
+#include <pthread.h>
+#include <sys/time.h>
+#elif HAVE_MEMORYBARRIER
+#include <windows.h>
+#endif
+#include "common.h"
+#include "error.h"
+#include "mem.h"
+#include "ringbuffer.h"
+
+#if HAVE_SYNC_SYNCHRONIZE
+#define memory_barrier() __sync_synchronize()
+#elif HAVE_MEMORYBARRIER
+#define memory_barrier() MemoryBarrier()
+#elif HAVE_PTHREADS
+static pthread_mutex_t barrier_lock = PTHREAD_MUTEX_INITIALIZER;
+static void memory_barrier(void)
+{
+    pthread_mutex_lock(&barrier_lock);
+    pthread_mutex_unlock(&barrier_lock);
+}
+#else
+#define memory_barrier() do { } while (0)
+#endif
+
+struct AVRingBuffer {
+    uint8_t *buffer;
+    unsigned mask;
+#if HAVE_PTHREADS
+    pthread_mutex_t lock;
+    pthread_cond_t  cond;
+#endif
+    /* The indexes run freely and are only masked on access. Each one is
+     * written by one side only; keep them on separate cache lines. */
+    uint8_t pad0[64];
+    volatile unsigned wpos;
+    volatile int reader_waiting;    ///< min_size the consumer waits for, 0 if none
+    volatile int wake_writer;
+    uint8_t pad1[64];
+    volatile unsigned rpos;
+    volatile int writer_waiting;    ///< min_space the producer waits for, 0 if none
+    volatile int wake_reader;
+    uint8_t pad2[64];
+};
+
+AVRingBuffer *av_ringbuffer_alloc(unsigned int size)
+{
+    AVRingBuffer *rb;
+    unsigned cap = 1;
+
+    if (!size || size > INT_MAX / 2)
+        return NULL;
+    while (cap < size)
+        cap <<= 1;
+    rb = av_mallocz(sizeof(*rb));
+    if (!rb)
+        return NULL;
+    rb->buffer = av_malloc(cap);
+    if (!rb->buffer) {
+        av_free(rb);
+        return NULL;
+    }
+    rb->mask = cap - 1;
+#if HAVE_PTHREADS
+    pthread_mutex_init(&rb->lock, NULL);
+    pthread_cond_init(&rb->cond, NULL);
+#endif
+    return rb;
+}
+
+void av_ringbuffer_free(AVRingBuffer **rbp)
+{
+    AVRingBuffer *rb = *rbp;
+
+    if (!rb)
+        return;
+#if HAVE_PTHREADS
+    pthread_mutex_destroy(&rb->lock);
+    pthread_cond_destroy(&rb->cond);
+#endif
+    av_free(rb->buffer);
+    av_freep(rbp);
+}
+
+int av_ringbuffer_size(AVRingBuffer *rb)
+{
+    return rb->wpos - rb->rpos;
+}
+
+int av_ringbuffer_space(AVRingBuffer *rb)
+{
+    return rb->mask + 1 - (rb->wpos - rb->rpos);
+}
+
+#if HAVE_PTHREADS
+static void wake_up(AVRingBuffer *rb)
+{
+    pthread_mutex_lock(&rb->lock);
+    pthread_cond_broadcast(&rb->cond);
+    pthread_mutex_unlock(&rb->lock);
+}
+#endif
+
+int av_ringbuffer_write(AVRingBuffer *rb, const void *src, int size)
+{
+    unsigned wpos = rb->wpos;
+    unsigned off  = wpos & rb->mask;
+    int len;
+
+    if (size < 0 || size > av_ringbuffer_space(rb))
+        return AVERROR(EAGAIN);
+    /* the consumer is done with the space it released */
+    memory_barrier();
+    len = FFMIN(size, rb->mask + 1 - off);
+    memcpy(rb->buffer + off, src, len);
+    memcpy(rb->buffer, (const uint8_t *)src + len, size - len);
+    /* publish the data before the index, and the index before checking
+     * whether the consumer sleeps; it sets the flag before checking the
+     * index, so one of the two sides always sees the other */
+    memory_barrier();
+    rb->wpos = wpos + size;
+    memory_barrier();
+#if HAVE_PTHREADS
+    if (rb->reader_waiting && av_ringbuffer_size(rb) >= rb->reader_waiting)
+        wake_up(rb);
+#endif
+    return size;
+}
+
+int av_ringbuffer_read(AVRingBuffer *rb, void *dst, int size)
+{
+    unsigned rpos = rb->rpos;
+    unsigned off  = rpos & rb->mask;
+    int len;
+
+    size = FFMIN(size, av_ringbuffer_size(rb));
+    if (size <= 0)
+        return 0;
+    /* do not read the data before the index that published it */
+    memory_barrier();
+    if (dst) {
+        len = FFMIN(size, rb->mask + 1 - off);
+        memcpy(dst, rb->buffer + off, len);
+        memcpy((uint8_t *)dst + len, rb->buffer, size - len);
+    }
+    memory_barrier();
+    rb->rpos = rpos + size;
+    memory_barrier();
+#if HAVE_PTHREADS
+    if (rb->writer_waiting && av_ringbuffer_space(rb) >= rb->writer_waiting)
+        wake_up(rb);
+#endif
+    return size;
+}
+
+#if HAVE_PTHREADS
+static int wait_for(AVRingBuffer *rb, int (*avail_fn)(AVRingBuffer *),
+                    volatile int *waiting, volatile int *wake,
+                    int min, int64_t timeout)
+{
+    struct timespec ts;
+    int avail;
+
+    if (timeout >= 0) {
+        struct timeval tv;
+        int64_t t;
+
+        gettimeofday(&tv, NULL);
+        t = tv.tv_sec * 1000000LL + tv.tv_usec + timeout;
+        ts.tv_sec  = t / 1000000;
+        ts.tv_nsec = t % 1000000 * 1000;
+    }
+
+    pthread_mutex_lock(&rb->lock);
+    *waiting = min;
+    memory_barrier();
+    while ((avail = avail_fn(rb)) < min && !*wake) {
+        if (timeout < 0)
+            pthread_cond_wait(&rb->cond, &rb->lock);
+        else if (pthread_cond_timedwait(&rb->cond, &rb->lock, &ts)) {
+            avail = avail_fn(rb);
+            break;
+        }
+    }
+    *waiting = 0;
+    *wake    = 0;
+    pthread_mutex_unlock(&rb->lock);
+    return avail;
+}
+#endif
+
+int av_ringbuffer_wait_read(AVRingBuffer *rb, int min_size, int64_t timeout)
+{
+    int avail = av_ringbuffer_size(rb);
+#if HAVE_PTHREADS
+    if (avail < min_size)
+        avail = wait_for(rb, av_ringbuffer_size, &rb->reader_waiting,
+                         &rb->wake_reader, min_size, timeout);
+#endif
+    return avail;
+}
+
+int av_ringbuffer_wait_write(AVRingBuffer *rb, int min_space, int64_t timeout)
+{
+    int avail = av_ringbuffer_space(rb);
+#if HAVE_PTHREADS
+    if (avail < min_space)
+        avail = wait_for(rb, av_ringbuffer_space, &rb->writer_waiting,
+                         &rb->wake_writer, min_space, timeout);
+#endif
+    return avail;
+}
+
+void av_ringbuffer_wake(AVRingBuffer *rb)
+{
+#if HAVE_PTHREADS
+    pthread_mutex_lock(&rb->lock);
+    rb->wake_reader = 1;
+    rb->wake_writer = 1;
+    pthread_cond_broadcast(&rb->cond);
+    pthread_mutex_unlock(&rb->lock);
+#endif
+}
+
+#ifdef TEST
+
+#include "intreadwrite.h"
+#include "lfg.h"
+#include "log.h"
+
+#define RECORDS 200000
+
+static int check_record(const uint8_t *buf, int len, unsigned seq)
+{
+    int i;
+    for (i = 0; i < len; i++)
+        if (buf[i] != (uint8_t)(seq + i))
+            return -1;
+    return 0;
+}
+
+static int make_record(uint8_t *buf, AVLFG *lfg, unsigned seq)
+{
+    int i, len = av_lfg_get(lfg) % 300 + 1;
+
+    AV_WL16(buf, len);
+    for (i = 0; i < len; i++)
+        buf[i + 2] = seq + i;
+    return len + 2;
+}
+
+#if HAVE_PTHREADS
+static void *producer(void *arg)
+{
+    AVRingBuffer *rb = arg;
+    uint8_t buf[302];
+    unsigned seq;
+    AVLFG lfg;
+
+    av_lfg_init(&lfg, 1);
+    for (seq = 0; seq < RECORDS; seq++) {
+        int len = make_record(buf, &lfg, seq);
+        while (av_ringbuffer_write(rb, buf, len) < 0)
+            av_ringbuffer_wait_write(rb, len, -1);
+    }
+    return NULL;
+}
+#endif
+
+int main(void)
+{
+    AVRingBuffer *rb = av_ringbuffer_alloc(1000);
+    uint8_t buf[302], ref[302];
+    unsigned seq;
+    AVLFG lfg;
+    int ret = 0;
+
+    /* single thread: wraparound and all-or-nothing writes */
+    av_lfg_init(&lfg, 1);
+    for (seq = 0; seq < 10000; seq++) {
+        int len = make_record(buf, &lfg, seq);
+        if (av_ringbuffer_write(rb, buf, len) != len ||
+            av_ringbuffer_read(rb, buf, 2) != 2 ||
+            av_ringbuffer_read(rb, buf, 400) != len - 2 ||
+            check_record(buf, len - 2, seq)) {
+            av_log(NULL, AV_LOG_ERROR, "single thread mismatch at %u\n", seq);
+            ret = 1;
+            break;
+        }
+    }
+    memset(buf, 0, sizeof(buf));
+    while (av_ringbuffer_write(rb, buf, 300) > 0);
+    if (av_ringbuffer_space(rb) >= 300 || av_ringbuffer_size(rb) != 1024 - av_ringbuffer_space(rb)) {
+        av_log(NULL, AV_LOG_ERROR, "overfull write accepted\n");
+        ret = 1;
+    }
+    av_ringbuffer_read(rb, NULL, INT_MAX);
+
+#if HAVE_PTHREADS
+    {
+        pthread_t thread;
+
+        av_lfg_init(&lfg, 1);
+        pthread_create(&thread, NULL, producer, rb);
+        for (seq = 0; seq < RECORDS; seq++) {
+            int len, check;
+
+            av_ringbuffer_wait_read(rb, 2, -1);
+            av_ringbuffer_read(rb, buf, 2);
+            len   = AV_RL16(buf);
+            check = make_record(ref, &lfg, seq) - 2;
+            /* records are published as a whole */
+            if (len != check || av_ringbuffer_read(rb, buf, len) != len ||
+                check_record(buf, len, seq)) {
+                av_log(NULL, AV_LOG_ERROR, "two threads mismatch at %u\n", seq);
+                ret = 1;
+                break;
+            }
+        }
+        if (!ret && av_ringbuffer_wait_read(rb, 1, 10000) != 0) {
+            av_log(NULL, AV_LOG_ERROR, "trailing data\n");
+            ret = 1;
+        }
+        /* let the producer finish after a failure */
+        while (av_ringbuffer_wait_read(rb, 1, 100000) > 0)
+            av_ringbuffer_read(rb, NULL, INT_MAX);
+        pthread_join(thread, NULL);
+    }
+#endif
+
+    av_ringbuffer_free(&rb);
+    return ret;
+}
+
+#endif
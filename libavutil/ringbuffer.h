@@ -0,0 +1,112 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file
+ * lock-free single-producer/single-consumer ring buffer
+ *
+ * Unlike AVFifoBuffer, an AVRingBuffer may be written by one thread and
+ * read by another one without any external locking. Exactly one thread
+ * may call the producer functions (av_ringbuffer_write(),
+ * av_ringbuffer_wait_write()) and exactly one thread the consumer
+ * functions (av_ringbuffer_read(), av_ringbuffer_wait_read()) at a time.
+ *
+ * A side that runs out of data or space can block in the wait functions.
+ * The other side only takes a lock and signals it when it is actually
+ * waiting and enough data or space for it has become available, so there
+ * is no system call per transfer as long as neither side has to wait.
+ */
+
+#ifndef AVUTIL_RINGBUFFER_H
+#define AVUTIL_RINGBUFFER_H
+
+#include <stdint.h>
+
+typedef struct AVRingBuffer AVRingBuffer;
+
+/**
+ * Allocate an AVRingBuffer.
+ * @param size minimum capacity in bytes, it is rounded up to a power of 2
+ * @return the ring buffer or NULL in case of failure
+ */
+AVRingBuffer *av_ringbuffer_alloc(unsigned int size);
+
+/**
+ * Free an AVRingBuffer and set the pointer to it to NULL.
+ * Neither side may be using it anymore.
+ */
+void av_ringbuffer_free(AVRingBuffer **rb);
+
+/**
+ * Return the amount of data in bytes that can currently be read.
+ * If called from the producer, the actual amount may already be smaller.
+ */
+int av_ringbuffer_size(AVRingBuffer *rb);
+
+/**
+ * Return the amount of space in bytes that can currently be written.
+ * If called from the consumer, the actual amount may already be smaller.
+ */
+int av_ringbuffer_space(AVRingBuffer *rb);
+
+/**
+ * Write data into the ring buffer. Producer only.
+ * The data is either written completely or not at all, and becomes
+ * visible to the consumer as one unit.
+ *
+ * @return size on success, AVERROR(EAGAIN) if there is not enough space
+ */
+int av_ringbuffer_write(AVRingBuffer *rb, const void *src, int size);
+
+/**
+ * Read data from the ring buffer. Consumer only.
+ *
+ * @param dst  destination buffer, or NULL to discard the data
+ * @param size maximum number of bytes to read
+ * @return number of bytes read, 0 if the ring buffer is empty
+ */
+int av_ringbuffer_read(AVRingBuffer *rb, void *dst, int size);
+
+/**
+ * Wait until at least min_size bytes can be read. Consumer only.
+ *
+ * @param timeout maximum time to wait in microseconds, negative to wait
+ *                without limit
+ * @return the amount of data that can be read, it is smaller than
+ *         min_size if the wait timed out or was interrupted with
+ *         av_ringbuffer_wake()
+ */
+int av_ringbuffer_wait_read(AVRingBuffer *rb, int min_size, int64_t timeout);
+
+/**
+ * Wait until at least min_space bytes can be written. Producer only.
+ *
+ * @param timeout maximum time to wait in microseconds, negative to wait
+ *                without limit
+ * @return the space that can be written, it is smaller than min_space if
+ *         the wait timed out or was interrupted with av_ringbuffer_wake()
+ */
+int av_ringbuffer_wait_write(AVRingBuffer *rb, int min_space, int64_t timeout);
+
+/**
+ * Interrupt the waits of both sides. A side that is not waiting returns
+ * immediately from its next wait. May be called from any thread.
+ */
+void av_ringbuffer_wake(AVRingBuffer *rb);
+
+#endif /* AVUTIL_RINGBUFFER_H */
@@ -0,0 +1,392 @@
+/*
+ * thread pool shared between several users
+ *
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "config.h"
+#if HAVE_PTHREADS
+#include <pthread.h>
+#endif
+#include "common.h"
+#include "error.h"
+#include "mem.h"
+#include "threadpool.h"
+
+/**
+ * A batch submitted by av_threadpool_execute(); it lives on the stack of
+ * the submitting thread and is linked into the pool while it has jobs left.
+ */
+typedef struct Batch {
+    AVThreadPoolFunc *func;
+    void *ctx;
+    void *arg;
+    int *ret;
+    int nb_jobs;
+    int max_threads;
+    int next_job;       ///< next job to hand out
+    int nb_threads;     ///< threads that joined, gives the threadnr
+    int active;         ///< workers currently inside the batch
+    struct Batch *next;
+#if HAVE_PTHREADS
+    pthread_cond_t done_cond;
+#endif
+} Batch;
+
+struct AVThreadPoolTask {
+    void *(*func)(void *arg);
+    void *arg;
+    void *ret;
+    int done;
+    struct AVThreadPoolTask *next;
+#if HAVE_PTHREADS
+    pthread_cond_t done_cond;
+#endif
+};
+
+struct AVThreadPool {
+    int nb_threads;
+    int nb_reserved;    ///< workers reserved for tasks
+    Batch *batches;     ///< batches that still have jobs to hand out
+    AVThreadPoolTask *tasks; ///< started tasks waiting for a worker
+#if HAVE_PTHREADS
+    pthread_t *threads;
+    pthread_mutex_t lock;
+    pthread_cond_t work_cond;
+    int quit;
+#endif
+};
+
+#if HAVE_PTHREADS
+static void unlink_batch(AVThreadPool *pool, Batch *b)
+{
+    Batch **p = &pool->batches;
+
+    while (*p && *p != b)
+        p = &(*p)->next;
+    if (*p)
+        *p = b->next;
+}
+
+/* Run jobs of b until none are left; called and returns with the lock held. */
+static void run_jobs(AVThreadPool *pool, Batch *b, int threadnr)
+{
+    while (b->next_job < b->nb_jobs) {
+        int job = b->next_job++, r;
+
+        if (b->next_job == b->nb_jobs)
+            unlink_batch(pool, b);
+        pthread_mutex_unlock(&pool->lock);
+        r = b->func(b->ctx, b->arg, job, threadnr);
+        if (b->ret)
+            b->ret[job] = r;
+        pthread_mutex_lock(&pool->lock);
+    }
+}
+
+static void *worker(void *arg)
+{
+    AVThreadPool *pool = arg;
+
+    pthread_mutex_lock(&pool->lock);
+    while (!pool->quit) {
+        AVThreadPoolTask *t = pool->tasks;
+        Batch *b;
+
+        if (t) {
+            pool->tasks = t->next;
+            pthread_mutex_unlock(&pool->lock);
+            t->ret = t->func(t->arg);
+            pthread_mutex_lock(&pool->lock);
+            t->done = 1;
+            pthread_cond_signal(&t->done_cond);
+            continue;
+        }
+        for (b = pool->batches; b; b = b->next)
+            if (b->nb_threads < b->max_threads)
+                break;
+        if (!b) {
+            pthread_cond_wait(&pool->work_cond, &pool->lock);
+            continue;
+        }
+        b->active++;
+        run_jobs(pool, b, b->nb_threads++);
+        if (!--b->active)
+            pthread_cond_signal(&b->done_cond);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+#endif
+
+AVThreadPool *av_threadpool_alloc(int nb_threads)
+{
+    AVThreadPool *pool = av_mallocz(sizeof(*pool));
+
+    if (!pool)
+        return NULL;
+#if HAVE_PTHREADS
+    pool->threads = av_mallocz(FFMAX(nb_threads, 1) * sizeof(*pool->threads));
+    if (!pool->threads) {
+        av_free(pool);
+        return NULL;
+    }
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->work_cond, NULL);
+    for (; pool->nb_threads < nb_threads; pool->nb_threads++)
+        if (pthread_create(&pool->threads[pool->nb_threads], NULL, worker, pool)) {
+            av_threadpool_free(&pool);
+            return NULL;
+        }
+#endif
+    return pool;
+}
+
+void av_threadpool_free(AVThreadPool **ppool)
+{
+    AVThreadPool *pool = *ppool;
+#if HAVE_PTHREADS
+    int i;
+#endif
+
+    if (!pool)
+        return;
+#if HAVE_PTHREADS
+    pthread_mutex_lock(&pool->lock);
+    pool->quit = 1;
+    pthread_cond_broadcast(&pool->work_cond);
+    pthread_mutex_unlock(&pool->lock);
+    for (i = 0; i < pool->nb_threads; i++)
+        pthread_join(pool->threads[i], NULL);
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->work_cond);
+    av_free(pool->threads);
+#endif
+    av_freep(ppool);
+}
+
+int av_threadpool_get_nb_threads(AVThreadPool *pool)
+{
+    return pool->nb_threads;
+}
+
+int av_threadpool_reserve(AVThreadPool *pool, int nb_tasks)
+{
+#if HAVE_PTHREADS
+    pthread_mutex_lock(&pool->lock);
+    nb_tasks = av_clip(nb_tasks, 0, pool->nb_threads - pool->nb_reserved);
+    pool->nb_reserved += nb_tasks;
+    pthread_mutex_unlock(&pool->lock);
+    return nb_tasks;
+#else
+    return 0;
+#endif
+}
+
+void av_threadpool_release(AVThreadPool *pool, int nb_tasks)
+{
+#if HAVE_PTHREADS
+    pthread_mutex_lock(&pool->lock);
+    pool->nb_reserved -= nb_tasks;
+    pthread_mutex_unlock(&pool->lock);
+#endif
+}
+
+int av_threadpool_start(AVThreadPool *pool, AVThreadPoolTask **task,
+                        void *(*func)(void *arg), void *arg)
+{
+#if HAVE_PTHREADS
+    AVThreadPoolTask *t = av_mallocz(sizeof(*t)), **p;
+
+    if (!t)
+        return AVERROR(ENOMEM);
+    t->func = func;
+    t->arg  = arg;
+    pthread_cond_init(&t->done_cond, NULL);
+
+    pthread_mutex_lock(&pool->lock);
+    for (p = &pool->tasks; *p; p = &(*p)->next);
+    *p = t;
+    pthread_cond_signal(&pool->work_cond);
+    pthread_mutex_unlock(&pool->lock);
+    *task = t;
+    return 0;
+#else
+    return AVERROR(ENOSYS);
+#endif
+}
+
+void *av_threadpool_join(AVThreadPool *pool, AVThreadPoolTask **task)
+{
+    AVThreadPoolTask *t = *task;
+    void *ret = NULL;
+
+    if (!t)
+        return NULL;
+#if HAVE_PTHREADS
+    pthread_mutex_lock(&pool->lock);
+    while (!t->done)
+        pthread_cond_wait(&t->done_cond, &pool->lock);
+    pool->nb_reserved--;
+    pthread_mutex_unlock(&pool->lock);
+    pthread_cond_destroy(&t->done_cond);
+    ret = t->ret;
+#endif
+    av_freep(task);
+    return ret;
+}
+
+int av_threadpool_execute(AVThreadPool *pool, AVThreadPoolFunc *func,
+                          void *ctx, void *arg, int *ret,
+                          int nb_jobs, int max_threads)
+{
+#if HAVE_PTHREADS
+    Batch b = { 0 };
+#endif
+    int i;
+
+    if (nb_jobs <= 0)
+        return 0;
+    if (max_threads <= 1 || !pool->nb_threads || nb_jobs == 1) {
+        for (i = 0; i < nb_jobs; i++) {
+            int r = func(ctx, arg, i, 0);
+            if (ret)
+                ret[i] = r;
+        }
+        return 0;
+    }
+
+#if HAVE_PTHREADS
+    b.func        = func;
+    b.ctx         = ctx;
+    b.arg         = arg;
+    b.ret         = ret;
+    b.nb_jobs     = nb_jobs;
+    b.max_threads = FFMIN(max_threads, nb_jobs);
+    b.nb_threads  = 1;
+    pthread_cond_init(&b.done_cond, NULL);
+
+    pthread_mutex_lock(&pool->lock);
+    b.next = pool->batches;
+    pool->batches = &b;
+    if (b.max_threads > 2)
+        pthread_cond_broadcast(&pool->work_cond);
+    else
+        pthread_cond_signal(&pool->work_cond);
+    run_jobs(pool, &b, 0);
+    while (b.active)
+        pthread_cond_wait(&b.done_cond, &pool->lock);
+    pthread_mutex_unlock(&pool->lock);
+
+    pthread_cond_destroy(&b.done_cond);
+#endif
+    return 0;
+}
+
+#ifdef TEST
+
+#include "log.h"
+
+#define NB_JOBS 1000
+
+typedef struct TestContext {
+    AVThreadPool *pool;
+    int busy[8];
+    int counts[NB_JOBS];
+    int errors;
+} TestContext;
+
+static int nested_job(void *ctx, void *arg, int jobnr, int threadnr)
+{
+    int *counts = arg;
+    counts[jobnr]++;
+    return jobnr;
+}
+
+static int test_job(void *ctx, void *arg, int jobnr, int threadnr)
+{
+    TestContext *t = ctx;
+    int counts[4] = { 0 }, rets[4], i;
+
+    if (threadnr >= 4 || t->busy[threadnr]++)
+        t->errors++;
+    if (!(jobnr % 100)) {
+        av_threadpool_execute(t->pool, nested_job, NULL, counts, rets, 4, 3);
+        for (i = 0; i < 4; i++)
+            if (counts[i] != 1 || rets[i] != i)
+                t->errors++;
+    }
+    t->counts[jobnr]++;
+    t->busy[threadnr]--;
+    return jobnr * 2;
+}
+
+static void *test_task(void *arg)
+{
+    TestContext *t = arg;
+    int counts[4] = { 0 }, rets[4], i;
+
+    av_threadpool_execute(t->pool, nested_job, NULL, counts, rets, 4, 2);
+    for (i = 0; i < 4; i++)
+        if (counts[i] != 1 || rets[i] != i)
+            return NULL;
+    return t;
+}
+
+int main(void)
+{
+    static TestContext t;
+    static int rets[NB_JOBS];
+    AVThreadPoolTask *tasks[2];
+    int i, n, nb, ret = 0;
+
+    for (n = 0; n <= 3; n++) {
+        memset(&t, 0, sizeof(t));
+        t.pool = av_threadpool_alloc(n);
+        if (!t.pool)
+            return 1;
+        av_threadpool_execute(t.pool, test_job, &t, NULL, rets, NB_JOBS, 4);
+        for (i = 0; i < NB_JOBS; i++)
+            if (t.counts[i] != 1 || rets[i] != 2 * i)
+                t.errors++;
+
+        nb = av_threadpool_reserve(t.pool, 2);
+        if (nb != FFMIN(n, 2) * HAVE_PTHREADS ||
+            av_threadpool_reserve(t.pool, 2) != FFMIN(n - nb, 2) * HAVE_PTHREADS)
+            t.errors++;
+        av_threadpool_release(t.pool, FFMAX(n - 2, 0) * HAVE_PTHREADS);
+        for (i = 0; i < nb; i++)
+            if (av_threadpool_start(t.pool, &tasks[i], test_task, &t) < 0)
+                t.errors++;
+        /* the pool still runs batches while the tasks hold two workers */
+        av_threadpool_execute(t.pool, test_job, &t, NULL, rets, NB_JOBS, 4);
+        for (i = 0; i < nb; i++)
+            if (av_threadpool_join(t.pool, &tasks[i]) != &t)
+                t.errors++;
+        if (av_threadpool_reserve(t.pool, n + 1) != n * HAVE_PTHREADS)
+            t.errors++;
+
+        if (t.errors) {
+            av_log(NULL, AV_LOG_ERROR, "%d errors with %d threads\n", t.errors, n);
+            ret = 1;
+        }
+        av_threadpool_free(&t.pool);
+    }
+    return ret;
+}
+
+#endif
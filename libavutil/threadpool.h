@@ -0,0 +1,117 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file
+ * thread pool shared between several users
+ *
+ * A pool owns a fixed number of worker threads. Any number of threads may
+ * submit batches of jobs to it at the same time; idle workers pick up jobs
+ * from whichever batch still has some, and the submitting thread works on
+ * its own batch too. Sharing one pool between codecs and other users puts
+ * a cap on the total number of threads in a process.
+ *
+ * Workers can also be reserved for long-running tasks, such as the frame
+ * threads of a decoder, which keep a worker until they return.
+ */
+
+#ifndef AVUTIL_THREADPOOL_H
+#define AVUTIL_THREADPOOL_H
+
+typedef struct AVThreadPool AVThreadPool;
+typedef struct AVThreadPoolTask AVThreadPoolTask;
+
+/**
+ * Job function.
+ * @param ctx      context passed to av_threadpool_execute()
+ * @param arg      argument passed to av_threadpool_execute()
+ * @param jobnr    index of the job, 0 <= jobnr < nb_jobs
+ * @param threadnr index of the thread running it, 0 <= threadnr < max_threads;
+ *                 no two jobs of the same batch run at the same time with
+ *                 the same threadnr, so it can select per-thread scratch data
+ * @return a value stored in the ret array of av_threadpool_execute()
+ */
+typedef int (AVThreadPoolFunc)(void *ctx, void *arg, int jobnr, int threadnr);
+
+/**
+ * Create a thread pool.
+ * @param nb_threads number of worker threads; if the system does not support
+ *                   threads, the pool runs all jobs in the submitting thread
+ * @return the pool or NULL on failure
+ */
+AVThreadPool *av_threadpool_alloc(int nb_threads);
+
+/**
+ * Stop the workers and free the pool. No batch or task may be running.
+ */
+void av_threadpool_free(AVThreadPool **pool);
+
+/**
+ * Run func for each of nb_jobs jobs and wait until all of them are done.
+ *
+ * May be called from several threads at once, including from inside a job
+ * of the same pool.
+ *
+ * @param max_threads maximum number of threads working on this batch at
+ *                    the same time, including the calling thread
+ * @param ret         array of nb_jobs return values, may be NULL
+ * @return 0
+ */
+int av_threadpool_execute(AVThreadPool *pool, AVThreadPoolFunc *func,
+                          void *ctx, void *arg, int *ret,
+                          int nb_jobs, int max_threads);
+
+/**
+ * Return the number of worker threads of the pool.
+ */
+int av_threadpool_get_nb_threads(AVThreadPool *pool);
+
+/**
+ * Reserve workers for long-running tasks.
+ *
+ * A reserved worker no longer picks up batches once its task runs, so the
+ * sum of all reservations is limited to the number of workers.
+ *
+ * @param nb_tasks number of workers wanted
+ * @return number of workers actually reserved, 0 <= ret <= nb_tasks
+ */
+int av_threadpool_reserve(AVThreadPool *pool, int nb_tasks);
+
+/**
+ * Give back reservations which were not used by av_threadpool_start().
+ */
+void av_threadpool_release(AVThreadPool *pool, int nb_tasks);
+
+/**
+ * Run func(arg) on a reserved worker. The task uses up one reservation,
+ * which is given back by av_threadpool_join().
+ *
+ * @param task set to the started task
+ * @return 0 on success, a negative AVERROR code on failure, in which case
+ *         the reservation is kept
+ */
+int av_threadpool_start(AVThreadPool *pool, AVThreadPoolTask **task,
+                        void *(*func)(void *arg), void *arg);
+
+/**
+ * Wait until a task returned and free it.
+ * @return the value returned by the task function
+ */
+void *av_threadpool_join(AVThreadPool *pool, AVThreadPoolTask **task);
+
+#endif /* AVUTIL_THREADPOOL_H */
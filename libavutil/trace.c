@@ -0,0 +1,386 @@
+/*
+ * lightweight tracing of named time spans
+ *
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "config.h"
+#include <stdio.h>
+#include <string.h>
+#include <sys/time.h>
+#if HAVE_PTHREADS
+#include <pthread.h>
+#elif HAVE_MEMORYBARRIER
+#include <windows.h>
+#endif
+#include "common.h"
+#include "error.h"
+#include "mem.h"
+#include "timer.h"
+#include "trace.h"
+
+#if HAVE_SYNC_SYNCHRONIZE
+#define memory_barrier() __sync_synchronize()
+#elif HAVE_MEMORYBARRIER
+#define memory_barrier() MemoryBarrier()
+#elif HAVE_PTHREADS
+static pthread_mutex_t barrier_lock = PTHREAD_MUTEX_INITIALIZER;
+static void memory_barrier(void)
+{
+    pthread_mutex_lock(&barrier_lock);
+    pthread_mutex_unlock(&barrier_lock);
+}
+#else
+#define memory_barrier() do { } while (0)
+#endif
+
+typedef struct TraceSpan {
+    uint64_t start, end;
+    const char *name;
+    const char *cat;
+} TraceSpan;
+
+/**
+ * Spans of one thread. Only the owning thread writes to it; the index runs
+ * freely and is masked on access.
+ */
+typedef struct TraceBuffer {
+    TraceSpan *spans;
+    unsigned mask;
+    volatile unsigned wpos;
+    int generation;         ///< trace session the spans belong to
+    int tid;
+    int orphaned;           ///< the owning thread has exited
+    struct TraceBuffer *next;
+} TraceBuffer;
+
+static volatile int enabled;
+static int generation;
+static unsigned buffer_size;
+static int next_tid;
+static TraceBuffer *buffers;
+static uint64_t start_ticks;
+static int64_t  start_us;
+
+#if HAVE_PTHREADS
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t key_once = PTHREAD_ONCE_INIT;
+static pthread_key_t key;
+#define LOCK()   pthread_mutex_lock(&lock)
+#define UNLOCK() pthread_mutex_unlock(&lock)
+#else
+static TraceBuffer *single_buffer;
+#define LOCK()
+#define UNLOCK()
+#endif
+
+static int64_t wallclock(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec * 1000000LL + tv.tv_usec;
+}
+
+static inline uint64_t now(void)
+{
+#ifdef AV_READ_TIME
+    return AV_READ_TIME();
+#else
+    return wallclock();
+#endif
+}
+
+#if HAVE_PTHREADS
+static void thread_exit(void *arg)
+{
+    TraceBuffer *buf = arg;
+    LOCK();
+    buf->orphaned = 1;
+    UNLOCK();
+}
+
+static void make_key(void)
+{
+    pthread_key_create(&key, thread_exit);
+}
+#endif
+
+/* Return the buffer of the calling thread for the current session. */
+static TraceBuffer *get_buffer(void)
+{
+    TraceBuffer *buf;
+
+#if HAVE_PTHREADS
+    pthread_once(&key_once, make_key);
+    buf = pthread_getspecific(key);
+#else
+    buf = single_buffer;
+#endif
+    if (buf && buf->generation == generation)
+        return buf;
+
+    LOCK();
+    if (!buf) {
+        buf = av_mallocz(sizeof(*buf));
+        if (!buf)
+            goto end;
+        buf->tid  = next_tid++;
+        buf->next = buffers;
+        buffers   = buf;
+#if HAVE_PTHREADS
+        pthread_setspecific(key, buf);
+#else
+        single_buffer = buf;
+#endif
+    }
+    if (buf->mask + 1 != buffer_size) {
+        av_freep(&buf->spans);
+        buf->spans = av_malloc(buffer_size * sizeof(*buf->spans));
+        buf->mask  = buffer_size - 1;
+    }
+    buf->wpos       = 0;
+    buf->generation = buf->spans ? generation : -1;
+end:
+    UNLOCK();
+    return buf && buf->spans ? buf : NULL;
+}
+
+int av_trace_start(int nb_spans)
+{
+    TraceBuffer **p;
+    unsigned size = 1;
+
+    if (nb_spans <= 0 || nb_spans > INT_MAX / 2 / sizeof(TraceSpan))
+        return AVERROR(EINVAL);
+    while (size < nb_spans)
+        size <<= 1;
+
+    LOCK();
+    /* buffers of exited threads are not needed anymore */
+    for (p = &buffers; *p;) {
+        TraceBuffer *buf = *p;
+        if (buf->orphaned) {
+            *p = buf->next;
+            av_free(buf->spans);
+            av_free(buf);
+        } else
+            p = &buf->next;
+    }
+    buffer_size = size;
+    generation++;
+    start_us    = wallclock();
+    start_ticks = now();
+    memory_barrier();
+    enabled = 1;
+    UNLOCK();
+    return 0;
+}
+
+void av_trace_stop(void)
+{
+    enabled = 0;
+}
+
+int av_trace_enabled(void)
+{
+    return enabled;
+}
+
+uint64_t av_trace_begin(void)
+{
+    if (!enabled)
+        return 0;
+    return now();
+}
+
+void av_trace_end(uint64_t start, const char *name, const char *cat)
+{
+    TraceBuffer *buf;
+    TraceSpan *span;
+    unsigned wpos;
+
+    if (!start || !enabled || !(buf = get_buffer()))
+        return;
+    wpos = buf->wpos;
+    span = &buf->spans[wpos & buf->mask];
+    span->start = start;
+    span->end   = now();
+    span->name  = name;
+    span->cat   = cat;
+    /* publish the span before the index */
+    memory_barrier();
+    buf->wpos = wpos + 1;
+}
+
+static void put_escaped(FILE *f, const char *s)
+{
+    for (; s && *s; s++) {
+        if (*s == '"' || *s == '\\')
+            fputc('\\', f);
+        if ((unsigned char)*s >= 0x20)
+            fputc(*s, f);
+    }
+}
+
+int av_trace_dump(const char *filename)
+{
+    TraceBuffer *buf;
+    FILE *f;
+    double ticks_per_us;
+    int64_t elapsed_us;
+    char line[128];
+    int first = 1, ret = 0;
+
+    if (!(f = fopen(filename, "w")))
+        return AVERROR(errno);
+
+    LOCK();
+    elapsed_us   = wallclock() - start_us;
+    ticks_per_us = elapsed_us > 0 ? (double)(now() - start_ticks) / elapsed_us : 1;
+#ifndef AV_READ_TIME
+    ticks_per_us = 1;
+#endif
+    fputs("{\"traceEvents\":[\n", f);
+    for (buf = buffers; buf; buf = buf->next) {
+        unsigned wpos, first_pos, i;
+
+        if (buf->generation != generation)
+            continue;
+        wpos      = buf->wpos;
+        first_pos = wpos - FFMIN(wpos, buf->mask + 1);
+        memory_barrier();
+        for (i = first_pos; i != wpos; i++) {
+            TraceSpan span = buf->spans[i & buf->mask];
+
+            /* skip the span if the owner has overwritten it meanwhile */
+            memory_barrier();
+            if (buf->wpos - i > buf->mask + 1)
+                continue;
+            if (!first)
+                fputs(",\n", f);
+            first = 0;
+            fputs("{\"name\":\"", f);
+            put_escaped(f, span.name);
+            fputs("\",\"cat\":\"", f);
+            put_escaped(f, span.cat);
+            snprintf(line, sizeof(line),
+                     "\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":0,\"tid\":%d}",
+                     (int64_t)(span.start - start_ticks) / ticks_per_us,
+                     (int64_t)(span.end   - span.start)  / ticks_per_us,
+                     buf->tid);
+            fputs(line, f);
+        }
+    }
+    fputs("\n]}\n", f);
+    UNLOCK();
+
+    if (ferror(f))
+        ret = AVERROR(EIO);
+    if (fclose(f) && !ret)
+        ret = AVERROR(errno);
+    return ret;
+}
+
+#ifdef TEST
+
+#include "log.h"
+
+#define NB_THREADS 4
+#define NB_SPANS   1000
+
+static void *trace_thread(void *arg)
+{
+    int i;
+
+    for (i = 0; i < NB_SPANS; i++) {
+        uint64_t outer = av_trace_begin();
+        uint64_t inner = av_trace_begin();
+        av_trace_end(inner, "inner", "test");
+        av_trace_end(outer, "outer\"quoted\"", "test");
+    }
+    return NULL;
+}
+
+static int count_spans(const char *filename)
+{
+    FILE *f = fopen(filename, "r");
+    char line[256];
+    int n = 0;
+
+    if (!f)
+        return -1;
+    while (fgets(line, sizeof(line), f))
+        if (strstr(line, "\"ph\":\"X\""))
+            n++;
+    fclose(f);
+    return n;
+}
+
+int main(int argc, char **argv)
+{
+    const char *filename = argc > 1 ? argv[1] : "trace-test.json";
+    int n, expected, ret = 0;
+
+    /* disabled: nothing is recorded */
+    av_trace_end(av_trace_begin(), "disabled", "test");
+
+    if (av_trace_start(64) < 0)
+        return 1;
+#if HAVE_PTHREADS
+    {
+        pthread_t threads[NB_THREADS];
+        int i;
+
+        for (i = 0; i < NB_THREADS; i++)
+            pthread_create(&threads[i], NULL, trace_thread, NULL);
+        for (i = 0; i < NB_THREADS; i++)
+            pthread_join(threads[i], NULL);
+        expected = NB_THREADS * 64;
+    }
+#else
+    trace_thread(NULL);
+    expected = 64;
+#endif
+    av_trace_stop();
+    av_trace_end(av_trace_begin(), "stopped", "test");
+
+    if (av_trace_dump(filename) < 0) {
+        av_log(NULL, AV_LOG_ERROR, "could not write %s\n", filename);
+        return 1;
+    }
+    /* every ring buffer wrapped around and holds its last 64 spans */
+    n = count_spans(filename);
+    if (n != expected) {
+        av_log(NULL, AV_LOG_ERROR, "%d spans dumped, expected %d\n", n, expected);
+        ret = 1;
+    }
+
+    /* a new session discards the old spans */
+    av_trace_start(64);
+    av_trace_end(av_trace_begin(), "single", "test");
+    av_trace_stop();
+    av_trace_dump(filename);
+    n = count_spans(filename);
+    if (n != 1) {
+        av_log(NULL, AV_LOG_ERROR, "%d spans after restart, expected 1\n", n);
+        ret = 1;
+    }
+    remove(filename);
+    return ret;
+}
+
+#endif
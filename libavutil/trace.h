@@ -0,0 +1,79 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file
+ * lightweight tracing of named time spans
+ *
+ * The libraries mark decoded and encoded frames, slice thread jobs, filter
+ * callbacks and muxer writes as spans. While tracing is enabled, every
+ * thread records its finished spans into its own ring buffer without taking
+ * any lock; when a buffer is full, its oldest spans are overwritten. The
+ * spans can be written out in the Chrome trace event format, which can be
+ * loaded into chrome://tracing and similar viewers.
+ *
+ * While tracing is disabled, marking a span costs two function calls that
+ * return immediately.
+ */
+
+#ifndef AVUTIL_TRACE_H
+#define AVUTIL_TRACE_H
+
+#include <stdint.h>
+
+/**
+ * Start recording spans, discarding all spans recorded before.
+ * @param nb_spans size of the ring buffer of each thread, in spans
+ * @return 0 on success, a negative AVERROR code on failure
+ */
+int av_trace_start(int nb_spans);
+
+/**
+ * Stop recording spans. The recorded spans are kept for av_trace_dump().
+ */
+void av_trace_stop(void);
+
+/**
+ * Return 1 if spans are being recorded, 0 otherwise.
+ */
+int av_trace_enabled(void);
+
+/**
+ * Mark the beginning of a span in the calling thread.
+ * @return a timestamp to pass to av_trace_end(), 0 if tracing is disabled
+ */
+uint64_t av_trace_begin(void);
+
+/**
+ * Mark the end of a span in the calling thread and record it.
+ * @param start value returned by the matching av_trace_begin()
+ * @param name  name of the span; the string is not copied and must stay
+ *              valid until the spans are dumped
+ * @param cat   category of the span, e.g. the library; same lifetime as name
+ */
+void av_trace_end(uint64_t start, const char *name, const char *cat);
+
+/**
+ * Write the recorded spans of all threads to a file as Chrome trace event
+ * JSON. Tracing should be stopped or all traced threads idle; spans that
+ * are overwritten while they are dumped are left out.
+ * @return 0 on success, a negative AVERROR code on failure
+ */
+int av_trace_dump(const char *filename);
+
+#endif /* AVUTIL_TRACE_H */
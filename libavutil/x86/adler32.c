@@ -0,0 +1,88 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file
+ * Adler-32 on 16 byte blocks.
+ *
+ * For a block b[0..15], s1 grows by the sum of the bytes and s2 by
+ * 16 * s1 + sum((16 - i) * b[i]). psadbw gives the former, pmaddubsw with
+ * the weights 16..1 followed by pmaddwd the latter. The sums are reduced
+ * modulo BASE every BLOCKS blocks, which keeps them within 32 bits.
+ */
+
+#include "libavutil/common.h"
+#include "libavutil/mem.h"
+#include "libavutil/x86_cpu.h"
+#include "adler32.h"
+
+#define BASE   65521
+#define BLOCKS (5552 / 16)
+
+DECLARE_ASM_CONST(16, uint8_t, weights)[16] = {
+    16, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1
+};
+DECLARE_ASM_CONST(16, uint16_t, ones)[8] = { 1, 1, 1, 1, 1, 1, 1, 1 };
+
+unsigned long ff_adler32_update_ssse3(unsigned long adler, const uint8_t *buf,
+                                      unsigned int len)
+{
+    DECLARE_ALIGNED(16, uint32_t, sums)[3][4];
+    uint64_t s1 = adler & 0xffff;
+    uint64_t s2 = adler >> 16;
+
+    while (len) {
+        x86_reg n = FFMIN(len / 16, BLOCKS);
+
+        len -= n * 16;
+        s2  += s1 * n * 16;
+        __asm__ volatile(
+            "pxor            %%xmm7, %%xmm7     \n\t"
+            "pxor            %%xmm0, %%xmm0     \n\t" // sum of the bytes
+            "pxor            %%xmm1, %%xmm1     \n\t" // sum of xmm0 before each block
+            "pxor            %%xmm2, %%xmm2     \n\t" // weighted sum within the blocks
+            "movdqa             %3, %%xmm6      \n\t"
+            "movdqa             %4, %%xmm5      \n\t"
+            "1:                                 \n\t"
+            "movdqu            (%0), %%xmm3     \n\t"
+            "paddd           %%xmm0, %%xmm1     \n\t"
+            "movdqa          %%xmm3, %%xmm4     \n\t"
+            "psadbw          %%xmm7, %%xmm3     \n\t"
+            "pmaddubsw       %%xmm6, %%xmm4     \n\t"
+            "paddd           %%xmm3, %%xmm0     \n\t"
+            "pmaddwd         %%xmm5, %%xmm4     \n\t"
+            "paddd           %%xmm4, %%xmm2     \n\t"
+            "add                $16, %0         \n\t"
+            "sub                 $1, %1         \n\t"
+            "jnz 1b                             \n\t"
+            "movdqa          %%xmm0,   (%2)     \n\t"
+            "movdqa          %%xmm1, 16(%2)     \n\t"
+            "movdqa          %%xmm2, 32(%2)     \n\t"
+            : "+r"(buf), "+r"(n)
+            : "r"(sums), "m"(*weights), "m"(*ones)
+            : XMM_CLOBBERS("%xmm0", "%xmm1", "%xmm2", "%xmm3",
+                           "%xmm4", "%xmm5", "%xmm6", "%xmm7",) "memory"
+        );
+        s2 += 16 * ((uint64_t)sums[1][0] + sums[1][2]) +
+              sums[2][0] + sums[2][1] + sums[2][2] + sums[2][3];
+        s1 += sums[0][0] + sums[0][2];
+        s1 %= BASE;
+        s2 %= BASE;
+    }
+    return (s2 << 16) | s1;
+}
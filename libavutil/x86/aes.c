@@ -0,0 +1,185 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file
+ * AES using the AES-NI instructions.
+ * The round keys set up by av_aes_init() can be used as they are: they are
+ * stored in the order they are applied, from the last to the first, and
+ * the decryption keys already have InvMixColumns applied as aesdec expects.
+ * Independent blocks are processed 4 at a time to hide the latency of the
+ * round instructions.
+ */
+
+#include <string.h>
+#include "libavutil/common.h"
+#include "libavutil/intreadwrite.h"
+#include "libavutil/mem.h"
+#include "libavutil/x86_cpu.h"
+#include "aes.h"
+
+#define AES_1(name, op)                                                 \
+static void name(const uint8_t *rk, int rounds, uint8_t *dst,           \
+                 const uint8_t *src)                                    \
+{                                                                       \
+    const uint8_t *key = rk + 16 * rounds;                              \
+    __asm__ volatile(                                                   \
+        "movdqu       (%0), %%xmm4    \n\t"                             \
+        "movdqu       (%2), %%xmm0    \n\t"                             \
+        "pxor       %%xmm4, %%xmm0    \n\t"                             \
+        "1:                           \n\t"                             \
+        "sub           $16, %0        \n\t"                             \
+        "movdqu       (%0), %%xmm4    \n\t"                             \
+        "cmp            %3, %0        \n\t"                             \
+        "je 2f                        \n\t"                             \
+        op"         %%xmm4, %%xmm0    \n\t"                             \
+        "jmp 1b                       \n\t"                             \
+        "2:                           \n\t"                             \
+        op"last     %%xmm4, %%xmm0    \n\t"                             \
+        "movdqu     %%xmm0, (%1)      \n\t"                             \
+        : "+r"(key)                                                     \
+        : "r"(dst), "r"(src), "r"(rk)                                   \
+        : XMM_CLOBBERS("%xmm0", "%xmm4",) "memory"                      \
+    );                                                                  \
+}
+
+#define AES_4(name, op)                                                 \
+static void name(const uint8_t *rk, int rounds, uint8_t *dst,           \
+                 const uint8_t *src)                                    \
+{                                                                       \
+    const uint8_t *key = rk + 16 * rounds;                              \
+    __asm__ volatile(                                                   \
+        "movdqu       (%0), %%xmm4    \n\t"                             \
+        "movdqu       (%2), %%xmm0    \n\t"                             \
+        "movdqu     16(%2), %%xmm1    \n\t"                             \
+        "movdqu     32(%2), %%xmm2    \n\t"                             \
+        "movdqu     48(%2), %%xmm3    \n\t"                             \
+        "pxor       %%xmm4, %%xmm0    \n\t"                             \
+        "pxor       %%xmm4, %%xmm1    \n\t"                             \
+        "pxor       %%xmm4, %%xmm2    \n\t"                             \
+        "pxor       %%xmm4, %%xmm3    \n\t"                             \
+        "1:                           \n\t"                             \
+        "sub           $16, %0        \n\t"                             \
+        "movdqu       (%0), %%xmm4    \n\t"                             \
+        "cmp            %3, %0        \n\t"                             \
+        "je 2f                        \n\t"                             \
+        op"         %%xmm4, %%xmm0    \n\t"                             \
+        op"         %%xmm4, %%xmm1    \n\t"                             \
+        op"         %%xmm4, %%xmm2    \n\t"                             \
+        op"         %%xmm4, %%xmm3    \n\t"                             \
+        "jmp 1b                       \n\t"                             \
+        "2:                           \n\t"                             \
+        op"last     %%xmm4, %%xmm0    \n\t"                             \
+        op"last     %%xmm4, %%xmm1    \n\t"                             \
+        op"last     %%xmm4, %%xmm2    \n\t"                             \
+        op"last     %%xmm4, %%xmm3    \n\t"                             \
+        "movdqu     %%xmm0,   (%1)    \n\t"                             \
+        "movdqu     %%xmm1, 16(%1)    \n\t"                             \
+        "movdqu     %%xmm2, 32(%1)    \n\t"                             \
+        "movdqu     %%xmm3, 48(%1)    \n\t"                             \
+        : "+r"(key)                                                     \
+        : "r"(dst), "r"(src), "r"(rk)                                   \
+        : XMM_CLOBBERS("%xmm0", "%xmm1", "%xmm2", "%xmm3", "%xmm4",)    \
+          "memory"                                                      \
+    );                                                                  \
+}
+
+AES_1(aes_encrypt_1, "aesenc")
+AES_1(aes_decrypt_1, "aesdec")
+AES_4(aes_encrypt_4, "aesenc")
+AES_4(aes_decrypt_4, "aesdec")
+
+static inline void xor_block(uint8_t *dst, const uint8_t *a, const uint8_t *b)
+{
+    AV_WN64(dst,     AV_RN64(a)     ^ AV_RN64(b));
+    AV_WN64(dst + 8, AV_RN64(a + 8) ^ AV_RN64(b + 8));
+}
+
+void ff_aes_crypt_aesni(const uint8_t *rk, int rounds, uint8_t *dst,
+                        const uint8_t *src, int count, uint8_t *iv, int decrypt)
+{
+    DECLARE_ALIGNED(16, uint8_t, tmp)[64];
+
+    if (decrypt) {
+        for (; count >= 4; count -= 4, src += 64, dst += 64) {
+            aes_decrypt_4(rk, rounds, tmp, src);
+            if (iv) {
+                xor_block(tmp,      tmp,      iv);
+                xor_block(tmp + 16, tmp + 16, src);
+                xor_block(tmp + 32, tmp + 32, src + 16);
+                xor_block(tmp + 48, tmp + 48, src + 32);
+                memcpy(iv, src + 48, 16);
+            }
+            memcpy(dst, tmp, 64);
+        }
+        for (; count > 0; count--, src += 16, dst += 16) {
+            aes_decrypt_1(rk, rounds, tmp, src);
+            if (iv) {
+                xor_block(tmp, tmp, iv);
+                memcpy(iv, src, 16);
+            }
+            memcpy(dst, tmp, 16);
+        }
+    } else if (iv) {
+        /* CBC encryption is serial */
+        for (; count > 0; count--, src += 16, dst += 16) {
+            xor_block(tmp, src, iv);
+            aes_encrypt_1(rk, rounds, dst, tmp);
+            memcpy(iv, dst, 16);
+        }
+    } else {
+        for (; count >= 4; count -= 4, src += 64, dst += 64)
+            aes_encrypt_4(rk, rounds, dst, src);
+        for (; count > 0; count--, src += 16, dst += 16)
+            aes_encrypt_1(rk, rounds, dst, src);
+    }
+}
+
+static inline void increment_counter(uint8_t *counter)
+{
+    int i;
+
+    for (i = 15; i >= 0 && !++counter[i]; i--)
+        ;
+}
+
+void ff_aes_crypt_ctr_aesni(const uint8_t *rk, int rounds, uint8_t *dst,
+                            const uint8_t *src, int count, uint8_t *counter)
+{
+    DECLARE_ALIGNED(16, uint8_t, ctr)[64];
+    int i, n;
+
+    while (count > 0) {
+        n = FFMIN(count, 4);
+        for (i = 0; i < n; i++) {
+            memcpy(ctr + 16 * i, counter, 16);
+            increment_counter(counter);
+        }
+        if (n == 4) {
+            aes_encrypt_4(rk, rounds, ctr, ctr);
+        } else {
+            for (i = 0; i < n; i++)
+                aes_encrypt_1(rk, rounds, ctr + 16 * i, ctr + 16 * i);
+        }
+        for (i = 0; i < n; i++)
+            xor_block(dst + 16 * i, src + 16 * i, ctr + 16 * i);
+        src   += 16 * n;
+        dst   += 16 * n;
+        count -= n;
+    }
+}
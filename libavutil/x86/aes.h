@@ -0,0 +1,38 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef AVUTIL_X86_AES_H
+#define AVUTIL_X86_AES_H
+
+#include <stdint.h>
+
+/**
+ * Same as av_aes_crypt(), using the AES-NI instructions.
+ * @param round_key the rounds + 1 round keys, used from the last to the
+ *                  first, as set up by av_aes_init()
+ */
+void ff_aes_crypt_aesni(const uint8_t *round_key, int rounds, uint8_t *dst,
+                        const uint8_t *src, int count, uint8_t *iv, int decrypt);
+
+/**
+ * Same as av_aes_crypt_ctr(), using the AES-NI instructions.
+ */
+void ff_aes_crypt_ctr_aesni(const uint8_t *round_key, int rounds, uint8_t *dst,
+                            const uint8_t *src, int count, uint8_t *counter);
+
+#endif /* AVUTIL_X86_AES_H */
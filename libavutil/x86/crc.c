@@ -0,0 +1,174 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file
+ * CRC computation by folding 128-bit blocks with carry-less multiplication,
+ * see "Fast CRC Computation for Generic Polynomials Using PCLMULQDQ
+ * Instruction" by Gopal et al.
+ *
+ * A block X = H*x^64 + L followed by n more bits of data contributes
+ * X*x^n = H*x^(n+64) + L*x^n to the message, which is congruent to
+ * H*(x^(n+64) mod P) + L*(x^n mod P), a polynomial shorter than 128 bits.
+ * The last remaining block has the same CRC as the whole message and is
+ * passed to the table based code together with the tail.
+ */
+
+#include "libavutil/common.h"
+#include "libavutil/x86_cpu.h"
+#include "crc.h"
+
+/**
+ * Compute x^n mod P, P being x^bits + poly, in the normal bit order.
+ */
+static uint32_t xpow_mod(int n, uint32_t poly, int bits)
+{
+    uint32_t mask = bits == 32 ? 0xFFFFFFFF : (1U << bits) - 1;
+    uint32_t r = 1;
+
+    while (n--) {
+        uint32_t carry = (r >> (bits - 1)) & 1;
+        r = (r << 1) & mask;
+        if (carry)
+            r ^= poly;
+    }
+    return r;
+}
+
+static uint64_t bitrev64(uint64_t v)
+{
+    uint64_t r = 0;
+    int i;
+
+    for (i = 0; i < 64; i++)
+        r |= ((v >> i) & 1) << (63 - i);
+    return r;
+}
+
+void ff_crc_init_pclmul(CRCPclmulContext *c, int le, int bits, uint32_t poly)
+{
+    int i;
+
+    if (le) {
+        /* The loaded blocks have the first bit in the LSB and are used as is.
+         * The high degree half H is the low quadword, and pclmulqdq of two
+         * reflected operands yields the reflected product one bit too low,
+         * which is compensated for by using x^(n-1) mod P. */
+        uint32_t p = 0;
+        for (i = 0; i < bits; i++)
+            p |= ((poly >> i) & 1) << (bits - 1 - i);
+        c->k512[0] = bitrev64(xpow_mod(512 + 63, p, bits));
+        c->k512[1] = bitrev64(xpow_mod(512 - 1,  p, bits));
+        c->k128[0] = bitrev64(xpow_mod(128 + 63, p, bits));
+        c->k128[1] = bitrev64(xpow_mod(128 - 1,  p, bits));
+        for (i = 0; i < 16; i++)
+            c->shuf[i] = i;
+    } else {
+        /* The tables compute the CRC modulo x^(32-bits)*P in a byte swapped
+         * register, the loaded blocks are byte reversed to get the first bit
+         * at the top, and H is the high quadword. */
+        uint32_t p = poly << (32 - bits);
+        c->k512[0] = xpow_mod(512,      p, 32);
+        c->k512[1] = xpow_mod(512 + 64, p, 32);
+        c->k128[0] = xpow_mod(128,      p, 32);
+        c->k128[1] = xpow_mod(128 + 64, p, 32);
+        for (i = 0; i < 16; i++)
+            c->shuf[i] = 15 - i;
+    }
+}
+
+#define FOLD(k, x, t)                            \
+        "movdqa     "#x", "#t"              \n\t"\
+        "pclmulqdq $0x00, "#k", "#x"        \n\t"\
+        "pclmulqdq $0x11, "#k", "#t"        \n\t"\
+        "pxor       "#t", "#x"              \n\t"
+
+uint32_t ff_crc_pclmul(const CRCPclmulContext *c, const AVCRC *ctx,
+                       uint32_t crc, const uint8_t *buffer, size_t length)
+{
+    DECLARE_ALIGNED(16, uint8_t, rest)[16];
+    x86_reg blocks64 = length / 64 - 1;
+    x86_reg blocks16 = (length & 63) / 16;
+    const uint8_t *end = buffer + (length & ~15);
+
+    __asm__ volatile(
+        "movd                %5, %%xmm4     \n\t"
+        "movdqa           32(%4), %%xmm7     \n\t"
+        "movdqu            (%0), %%xmm0     \n\t"
+        "movdqu          16(%0), %%xmm1     \n\t"
+        "movdqu          32(%0), %%xmm2     \n\t"
+        "movdqu          48(%0), %%xmm3     \n\t"
+        "pxor            %%xmm4, %%xmm0     \n\t"
+        "pshufb          %%xmm7, %%xmm0     \n\t"
+        "pshufb          %%xmm7, %%xmm1     \n\t"
+        "pshufb          %%xmm7, %%xmm2     \n\t"
+        "pshufb          %%xmm7, %%xmm3     \n\t"
+        "movdqa            (%4), %%xmm6     \n\t"
+        "add                $64, %0         \n\t"
+        "test                %1, %1         \n\t"
+        "jz 2f                              \n\t"
+        "1:                                 \n\t"
+        FOLD(%%xmm6, %%xmm0, %%xmm4)
+        FOLD(%%xmm6, %%xmm1, %%xmm5)
+        "movdqu            (%0), %%xmm4     \n\t"
+        "movdqu          16(%0), %%xmm5     \n\t"
+        "pshufb          %%xmm7, %%xmm4     \n\t"
+        "pshufb          %%xmm7, %%xmm5     \n\t"
+        "pxor            %%xmm4, %%xmm0     \n\t"
+        "pxor            %%xmm5, %%xmm1     \n\t"
+        FOLD(%%xmm6, %%xmm2, %%xmm4)
+        FOLD(%%xmm6, %%xmm3, %%xmm5)
+        "movdqu          32(%0), %%xmm4     \n\t"
+        "movdqu          48(%0), %%xmm5     \n\t"
+        "pshufb          %%xmm7, %%xmm4     \n\t"
+        "pshufb          %%xmm7, %%xmm5     \n\t"
+        "pxor            %%xmm4, %%xmm2     \n\t"
+        "pxor            %%xmm5, %%xmm3     \n\t"
+        "add                $64, %0         \n\t"
+        "sub                 $1, %1         \n\t"
+        "jnz 1b                             \n\t"
+        "2:                                 \n\t"
+        "movdqa          16(%4), %%xmm6     \n\t"
+        FOLD(%%xmm6, %%xmm0, %%xmm4)
+        "pxor            %%xmm0, %%xmm1     \n\t"
+        FOLD(%%xmm6, %%xmm1, %%xmm4)
+        "pxor            %%xmm1, %%xmm2     \n\t"
+        FOLD(%%xmm6, %%xmm2, %%xmm4)
+        "pxor            %%xmm2, %%xmm3     \n\t"
+        "test                %2, %2         \n\t"
+        "jz 4f                              \n\t"
+        "3:                                 \n\t"
+        FOLD(%%xmm6, %%xmm3, %%xmm4)
+        "movdqu            (%0), %%xmm4     \n\t"
+        "pshufb          %%xmm7, %%xmm4     \n\t"
+        "pxor            %%xmm4, %%xmm3     \n\t"
+        "add                $16, %0         \n\t"
+        "sub                 $1, %2         \n\t"
+        "jnz 3b                             \n\t"
+        "4:                                 \n\t"
+        "pshufb          %%xmm7, %%xmm3     \n\t"
+        "movdqa          %%xmm3, %3         \n\t"
+        : "+r"(buffer), "+r"(blocks64), "+r"(blocks16), "=m"(*(uint8_t (*)[16])rest)
+        : "r"(c), "r"(crc)
+        : XMM_CLOBBERS("%xmm0", "%xmm1", "%xmm2", "%xmm3",
+                       "%xmm4", "%xmm5", "%xmm6", "%xmm7",) "memory"
+    );
+
+    crc = av_crc(ctx, 0, rest, 16);
+    return av_crc(ctx, crc, end, length & 15);
+}
@@ -0,0 +1,48 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef AVUTIL_X86_CRC_H
+#define AVUTIL_X86_CRC_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "libavutil/crc.h"
+#include "libavutil/mem.h"
+
+/**
+ * Folding constants for the carry-less multiplication CRC of one table.
+ */
+typedef struct CRCPclmulContext {
+    DECLARE_ALIGNED(16, uint64_t, k512)[2]; ///< multipliers folding a block 512 bits forward
+    DECLARE_ALIGNED(16, uint64_t, k128)[2]; ///< multipliers folding a block 128 bits forward
+    DECLARE_ALIGNED(16, uint8_t,  shuf)[16];///< pshufb mask putting the bits in polynomial order
+} CRCPclmulContext;
+
+/**
+ * Compute the folding constants for a CRC with the av_crc_init() parameters.
+ */
+void ff_crc_init_pclmul(CRCPclmulContext *c, int le, int bits, uint32_t poly);
+
+/**
+ * Same as av_crc(), using carry-less multiplication.
+ * Requires SSSE3 and PCLMULQDQ, and length >= 64.
+ */
+uint32_t ff_crc_pclmul(const CRCPclmulContext *c, const AVCRC *ctx,
+                       uint32_t crc, const uint8_t *buffer, size_t length);
+
+#endif /* AVUTIL_X86_CRC_H */
@@ -0,0 +1,176 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file
+ * MD5 of four independent messages at once, one per 32-bit lane.
+ */
+
+#include "libavutil/common.h"
+#include "libavutil/mem.h"
+#include "libavutil/x86_cpu.h"
+#include "md5.h"
+
+#define T4(x) { x, x, x, x }
+
+DECLARE_ASM_CONST(16, uint32_t, T)[64][4] = {
+    T4(0xd76aa478), T4(0xe8c7b756), T4(0x242070db), T4(0xc1bdceee),
+    T4(0xf57c0faf), T4(0x4787c62a), T4(0xa8304613), T4(0xfd469501),
+    T4(0x698098d8), T4(0x8b44f7af), T4(0xffff5bb1), T4(0x895cd7be),
+    T4(0x6b901122), T4(0xfd987193), T4(0xa679438e), T4(0x49b40821),
+    T4(0xf61e2562), T4(0xc040b340), T4(0x265e5a51), T4(0xe9b6c7aa),
+    T4(0xd62f105d), T4(0x02441453), T4(0xd8a1e681), T4(0xe7d3fbc8),
+    T4(0x21e1cde6), T4(0xc33707d6), T4(0xf4d50d87), T4(0x455a14ed),
+    T4(0xa9e3e905), T4(0xfcefa3f8), T4(0x676f02d9), T4(0x8d2a4c8a),
+    T4(0xfffa3942), T4(0x8771f681), T4(0x6d9d6122), T4(0xfde5380c),
+    T4(0xa4beea44), T4(0x4bdecfa9), T4(0xf6bb4b60), T4(0xbebfbc70),
+    T4(0x289b7ec6), T4(0xeaa127fa), T4(0xd4ef3085), T4(0x04881d05),
+    T4(0xd9d4d039), T4(0xe6db99e5), T4(0x1fa27cf8), T4(0xc4ac5665),
+    T4(0xf4292244), T4(0x432aff97), T4(0xab9423a7), T4(0xfc93a039),
+    T4(0x655b59c3), T4(0x8f0ccc92), T4(0xffeff47d), T4(0x85845dd1),
+    T4(0x6fa87e4f), T4(0xfe2ce6e0), T4(0xa3014314), T4(0x4e0811a1),
+    T4(0xf7537e82), T4(0xbd3af235), T4(0x2ad7d2bb), T4(0xeb86d391),
+};
+
+#define A "%%xmm0"
+#define B "%%xmm1"
+#define C "%%xmm2"
+#define D "%%xmm3"
+
+/* the round functions, result in xmm4 */
+#define F1(b, c, d)                                      \
+        "movdqa   "c", %%xmm4                       \n\t"\
+        "pxor     "d", %%xmm4                       \n\t"\
+        "pand     "b", %%xmm4                       \n\t"\
+        "pxor     "d", %%xmm4                       \n\t"
+#define F2(b, c, d)                                      \
+        "movdqa   "c", %%xmm4                       \n\t"\
+        "pxor     "b", %%xmm4                       \n\t"\
+        "pand     "d", %%xmm4                       \n\t"\
+        "pxor     "c", %%xmm4                       \n\t"
+#define F3(b, c, d)                                      \
+        "movdqa   "b", %%xmm4                       \n\t"\
+        "pxor     "c", %%xmm4                       \n\t"\
+        "pxor     "d", %%xmm4                       \n\t"
+#define F4(b, c, d)                                      \
+        "movdqa   "d", %%xmm4                       \n\t"\
+        "pxor     %%xmm7, %%xmm4                    \n\t"\
+        "por      "b", %%xmm4                       \n\t"\
+        "pxor     "c", %%xmm4                       \n\t"
+
+/* a = b + ((a + F(b, c, d) + T[t] + W[w]) <<< s) */
+#define STEP(F, a, b, c, d, t, w, s)                     \
+        F(b, c, d)                                       \
+        "paddd    "#t"(%2), "a"                     \n\t"\
+        "paddd    "#w"(%1), "a"                     \n\t"\
+        "paddd    %%xmm4, "a"                       \n\t"\
+        "movdqa   "a", %%xmm5                       \n\t"\
+        "pslld    $"#s", "a"                        \n\t"\
+        "psrld    $32-"#s", %%xmm5                  \n\t"\
+        "por      %%xmm5, "a"                       \n\t"\
+        "paddd    "b", "a"                          \n\t"
+
+void ff_md5_block4_sse2(uint32_t state[4][4], const uint32_t W[16][4])
+{
+    __asm__ volatile(
+        "movdqa     (%0), %%xmm0                    \n\t"
+        "movdqa   16(%0), %%xmm1                    \n\t"
+        "movdqa   32(%0), %%xmm2                    \n\t"
+        "movdqa   48(%0), %%xmm3                    \n\t"
+        "pcmpeqd  %%xmm7, %%xmm7                    \n\t"
+        STEP(F1, A, B, C, D,    0,   0,  7)
+        STEP(F1, D, A, B, C,   16,  16, 12)
+        STEP(F1, C, D, A, B,   32,  32, 17)
+        STEP(F1, B, C, D, A,   48,  48, 22)
+        STEP(F1, A, B, C, D,   64,  64,  7)
+        STEP(F1, D, A, B, C,   80,  80, 12)
+        STEP(F1, C, D, A, B,   96,  96, 17)
+        STEP(F1, B, C, D, A,  112, 112, 22)
+        STEP(F1, A, B, C, D,  128, 128,  7)
+        STEP(F1, D, A, B, C,  144, 144, 12)
+        STEP(F1, C, D, A, B,  160, 160, 17)
+        STEP(F1, B, C, D, A,  176, 176, 22)
+        STEP(F1, A, B, C, D,  192, 192,  7)
+        STEP(F1, D, A, B, C,  208, 208, 12)
+        STEP(F1, C, D, A, B,  224, 224, 17)
+        STEP(F1, B, C, D, A,  240, 240, 22)
+
+        STEP(F2, A, B, C, D,  256,  16,  5)
+        STEP(F2, D, A, B, C,  272,  96,  9)
+        STEP(F2, C, D, A, B,  288, 176, 14)
+        STEP(F2, B, C, D, A,  304,   0, 20)
+        STEP(F2, A, B, C, D,  320,  80,  5)
+        STEP(F2, D, A, B, C,  336, 160,  9)
+        STEP(F2, C, D, A, B,  352, 240, 14)
+        STEP(F2, B, C, D, A,  368,  64, 20)
+        STEP(F2, A, B, C, D,  384, 144,  5)
+        STEP(F2, D, A, B, C,  400, 224,  9)
+        STEP(F2, C, D, A, B,  416,  48, 14)
+        STEP(F2, B, C, D, A,  432, 128, 20)
+        STEP(F2, A, B, C, D,  448, 208,  5)
+        STEP(F2, D, A, B, C,  464,  32,  9)
+        STEP(F2, C, D, A, B,  480, 112, 14)
+        STEP(F2, B, C, D, A,  496, 192, 20)
+
+        STEP(F3, A, B, C, D,  512,  80,  4)
+        STEP(F3, D, A, B, C,  528, 128, 11)
+        STEP(F3, C, D, A, B,  544, 176, 16)
+        STEP(F3, B, C, D, A,  560, 224, 23)
+        STEP(F3, A, B, C, D,  576,  16,  4)
+        STEP(F3, D, A, B, C,  592,  64, 11)
+        STEP(F3, C, D, A, B,  608, 112, 16)
+        STEP(F3, B, C, D, A,  624, 160, 23)
+        STEP(F3, A, B, C, D,  640, 208,  4)
+        STEP(F3, D, A, B, C,  656,   0, 11)
+        STEP(F3, C, D, A, B,  672,  48, 16)
+        STEP(F3, B, C, D, A,  688,  96, 23)
+        STEP(F3, A, B, C, D,  704, 144,  4)
+        STEP(F3, D, A, B, C,  720, 192, 11)
+        STEP(F3, C, D, A, B,  736, 240, 16)
+        STEP(F3, B, C, D, A,  752,  32, 23)
+
+        STEP(F4, A, B, C, D,  768,   0,  6)
+        STEP(F4, D, A, B, C,  784, 112, 10)
+        STEP(F4, C, D, A, B,  800, 224, 15)
+        STEP(F4, B, C, D, A,  816,  80, 21)
+        STEP(F4, A, B, C, D,  832, 192,  6)
+        STEP(F4, D, A, B, C,  848,  48, 10)
+        STEP(F4, C, D, A, B,  864, 160, 15)
+        STEP(F4, B, C, D, A,  880,  16, 21)
+        STEP(F4, A, B, C, D,  896, 128,  6)
+        STEP(F4, D, A, B, C,  912, 240, 10)
+        STEP(F4, C, D, A, B,  928,  96, 15)
+        STEP(F4, B, C, D, A,  944, 208, 21)
+        STEP(F4, A, B, C, D,  960,  64,  6)
+        STEP(F4, D, A, B, C,  976, 176, 10)
+        STEP(F4, C, D, A, B,  992,  32, 15)
+        STEP(F4, B, C, D, A, 1008, 144, 21)
+        "paddd      (%0), %%xmm0                    \n\t"
+        "paddd    16(%0), %%xmm1                    \n\t"
+        "paddd    32(%0), %%xmm2                    \n\t"
+        "paddd    48(%0), %%xmm3                    \n\t"
+        "movdqa   %%xmm0,   (%0)                    \n\t"
+        "movdqa   %%xmm1, 16(%0)                    \n\t"
+        "movdqa   %%xmm2, 32(%0)                    \n\t"
+        "movdqa   %%xmm3, 48(%0)                    \n\t"
+        :
+        : "r"(state), "r"(W), "r"(T)
+        : XMM_CLOBBERS("%xmm0", "%xmm1", "%xmm2", "%xmm3",
+                       "%xmm4", "%xmm5", "%xmm7",) "memory"
+    );
+}
@@ -0,0 +1,31 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef AVUTIL_X86_MD5_H
+#define AVUTIL_X86_MD5_H
+
+#include <stdint.h>
+
+/**
+ * Process one 64 byte block of four messages.
+ * @param state the A, B, C and D words of the four messages, 16-byte aligned
+ * @param W     the 16 little-endian words of each block, W[i][lane], 16-byte aligned
+ */
+void ff_md5_block4_sse2(uint32_t state[4][4], const uint32_t W[16][4]);
+
+#endif /* AVUTIL_X86_MD5_H */
@@ -87,6 +87,7 @@ try to unroll inner for(x=0 ... loop to avoid these damn if(x ... checks
 #include "postprocess.h"
 #include "postprocess_internal.h"
 #include "libavutil/avstring.h"
+#include "libavutil/threadpool.h"
 
 unsigned postproc_version(void)
 {
@@ -112,6 +113,8 @@ const char *postproc_license(void)
 #define OPTIONS_ARRAY_SIZE 10
 #define BLOCK_SIZE 8
 #define TEMP_STRIDE 8
+#define BAND_OVERLAP 16     ///< rows of context above and below a band filtered in a thread
+#define BAND_MIN_HEIGHT 64
 //#define NUM_BLOCKS_AT_ONCE 16 //not used yet
 
 #if ARCH_X86
@@ -532,6 +535,45 @@ static av_always_inline void do_a_deblock_C(uint8_t *src, int step, int stride,
 }*/
 }
 
+/**
+ * Find the black and white levels for the brightness correction of the
+ * current frame in the luma histogram of the previous frames.
+ */
+static void getLevels(PPContext *c, int width, int height)
+{
+    uint64_t * const yHistogram= c->yHistogram;
+    uint64_t sum= 0;
+    uint64_t maxClipped;
+    uint64_t clipped;
+    int i, black, white;
+
+    c->frameNum++;
+    // first frame is fscked so we ignore it
+    if(c->frameNum == 1) yHistogram[0]= width*height/64*15/256;
+
+    for(i=0; i<256; i++){
+        sum+= yHistogram[i];
+    }
+
+    /* We always get a completely black picture first. */
+    maxClipped= (uint64_t)(sum * c->ppMode.maxClippedThreshold);
+
+    clipped= sum;
+    for(black=255; black>0; black--){
+        if(clipped < maxClipped) break;
+        clipped-= yHistogram[black];
+    }
+
+    clipped= sum;
+    for(white=0; white<256; white++){
+        if(clipped < maxClipped) break;
+        clipped-= yHistogram[white];
+    }
+
+    c->blackLevel= black;
+    c->whiteLevel= white;
+}
+
 //Note: we have C, MMX, MMX2, 3DNOW version there is no 3DNOW+MMX2 one
 //Plain C versions
 #if !(HAVE_MMX || HAVE_ALTIVEC) || CONFIG_RUNTIME_CPUDETECT
@@ -555,6 +597,10 @@ static av_always_inline void do_a_deblock_C(uint8_t *src, int step, int stride,
 #if (HAVE_AMD3DNOW && !HAVE_MMX2) || CONFIG_RUNTIME_CPUDETECT
 #define COMPILE_3DNOW
 #endif
+
+#if (HAVE_MMX2 && HAVE_SSE) || CONFIG_RUNTIME_CPUDETECT
+#define COMPILE_SSE2
+#endif
 #endif /* ARCH_X86 */
 
 #undef HAVE_MMX
@@ -563,6 +609,8 @@ static av_always_inline void do_a_deblock_C(uint8_t *src, int step, int stride,
 #define HAVE_MMX2 0
 #undef HAVE_AMD3DNOW
 #define HAVE_AMD3DNOW 0
+#undef HAVE_SSE2
+#define HAVE_SSE2 0
 #undef HAVE_ALTIVEC
 #define HAVE_ALTIVEC 0
 
@@ -600,6 +648,21 @@ static av_always_inline void do_a_deblock_C(uint8_t *src, int step, int stride,
 #include "postprocess_template.c"
 #endif
 
+//SSE2 versions, MMX2 with xmm registers for the deblocking and deringing filters
+#ifdef COMPILE_SSE2
+#undef RENAME
+#undef HAVE_MMX
+#undef HAVE_MMX2
+#undef HAVE_SSE2
+#define HAVE_MMX 1
+#define HAVE_MMX2 1
+#define HAVE_SSE2 1
+#define RENAME(a) a ## _SSE2
+#include "postprocess_template.c"
+#undef HAVE_SSE2
+#define HAVE_SSE2 0
+#endif
+
 //3DNOW versions
 #ifdef COMPILE_3DNOW
 #undef RENAME
@@ -628,7 +691,9 @@ static inline void postProcess(const uint8_t src[], int srcStride, uint8_t dst[]
 #if CONFIG_RUNTIME_CPUDETECT
 #if ARCH_X86
     // ordered per speed fastest first
-    if(c->cpuCaps & PP_CPU_CAPS_MMX2)
+    if(c->cpuCaps & PP_CPU_CAPS_SSE2)
+        postProcess_SSE2(src, srcStride, dst, dstStride, width, height, QPs, QPStride, isColor, c);
+    else if(c->cpuCaps & PP_CPU_CAPS_MMX2)
         postProcess_MMX2(src, srcStride, dst, dstStride, width, height, QPs, QPStride, isColor, c);
     else if(c->cpuCaps & PP_CPU_CAPS_3DNOW)
         postProcess_3DNow(src, srcStride, dst, dstStride, width, height, QPs, QPStride, isColor, c);
@@ -646,6 +711,11 @@ static inline void postProcess(const uint8_t src[], int srcStride, uint8_t dst[]
 #endif
 #else //CONFIG_RUNTIME_CPUDETECT
 #if   HAVE_MMX2
+#ifdef COMPILE_SSE2
+        if(c->cpuCaps & PP_CPU_CAPS_SSE2)
+            postProcess_SSE2(src, srcStride, dst, dstStride, width, height, QPs, QPStride, isColor, c);
+        else
+#endif
             postProcess_MMX2(src, srcStride, dst, dstStride, width, height, QPs, QPStride, isColor, c);
 #elif HAVE_AMD3DNOW
             postProcess_3DNow(src, srcStride, dst, dstStride, width, height, QPs, QPStride, isColor, c);
@@ -952,6 +1022,60 @@ pp_context *pp_get_context(int width, int height, int cpuCaps){
     return c;
 }
 
+static void freeThreads(PPContext *c){
+    int i;
+
+    for(i=0; i<c->nbThreads; i++){
+        PPThreadContext *t= &c->threads[i];
+        av_free(t->tempBlocks);
+        av_free(t->tempDst);
+        av_free(t->tempSrc);
+        av_free(t->deintTemp);
+        av_free(t->yHistogram);
+        av_free(t->bandDst);
+    }
+    av_freep(&c->threads);
+    c->nbThreads= 0;
+}
+
+/**
+ * Make sure there are buffers for nbThreads threads filtering bands of up
+ * to bandHeight rows plus context rows.
+ * @return 0 on success, a negative value on allocation failure
+ */
+static int reallocThreads(PPContext *c, int nbThreads, int width, int bandHeight){
+    int i;
+
+    if(nbThreads <= c->nbThreads && width <= c->threadWidth &&
+       c->stride == c->threadStride && bandHeight <= c->threadBandHeight)
+        return 0;
+
+    freeThreads(c);
+    c->threads= av_mallocz(nbThreads*sizeof(PPThreadContext));
+    if(!c->threads)
+        return -1;
+    c->nbThreads       = nbThreads;
+    c->threadWidth     = width;
+    c->threadStride    = c->stride;
+    c->threadBandHeight= bandHeight;
+
+    for(i=0; i<nbThreads; i++){
+        PPThreadContext *t= &c->threads[i];
+        t->tempBlocks= av_mallocz(2*16*8);
+        t->tempDst   = av_mallocz(c->stride*24);
+        t->tempSrc   = av_mallocz(c->stride*24);
+        t->deintTemp = av_mallocz(2*width+32);
+        t->yHistogram= av_mallocz(256*sizeof(uint64_t));
+        t->bandDst   = av_mallocz(c->stride*(bandHeight + 2*BAND_OVERLAP) + 16);
+        if(!t->tempBlocks || !t->tempDst || !t->tempSrc || !t->deintTemp ||
+           !t->yHistogram || !t->bandDst){
+            freeThreads(c);
+            return -1;
+        }
+    }
+    return 0;
+}
+
 void pp_free_context(void *vc){
     PPContext *c = (PPContext*)vc;
     int i;
@@ -959,6 +1083,7 @@ void pp_free_context(void *vc){
     for(i=0; i<3; i++) av_free(c->tempBlurred[i]);
     for(i=0; i<3; i++) av_free(c->tempBlurredPast[i]);
 
+    freeThreads(c);
     av_free(c->tempBlocks);
     av_free(c->yHistogram);
     av_free(c->tempDst);
@@ -973,16 +1098,17 @@ void pp_free_context(void *vc){
     av_free(c);
 }
 
-void  pp_postprocess(const uint8_t * src[3], const int srcStride[3],
-                     uint8_t * dst[3], const int dstStride[3],
-                     int width, int height,
-                     const QP_STORE_T *QP_store,  int QPStride,
-                     pp_mode *vm,  void *vc, int pict_type)
+/**
+ * Set up the quantizer tables of the context for a frame.
+ */
+static void prepareFrame(PPContext *c, PPMode *mode, int width, int height,
+                         const int srcStride[3], const int dstStride[3],
+                         const QP_STORE_T **QP_storep, int *QPStridep, int pict_type)
 {
     int mbWidth = (width+15)>>4;
     int mbHeight= (height+15)>>4;
-    PPMode *mode = (PPMode*)vm;
-    PPContext *c = (PPContext*)vc;
+    const QP_STORE_T *QP_store= *QP_storep;
+    int QPStride= *QPStridep;
     int minStride= FFMAX(FFABS(srcStride[0]), FFABS(dstStride[0]));
     int absQPStride = FFABS(QPStride);
 
@@ -1049,6 +1175,38 @@ void  pp_postprocess(const uint8_t * src[3], const int srcStride[3],
     av_log(c, AV_LOG_DEBUG, "using npp filters 0x%X/0x%X\n",
            mode->lumMode, mode->chromMode);
 
+    *QP_storep= QP_store;
+    *QPStridep= QPStride;
+}
+
+static void copyChroma(const uint8_t * src[3], const int srcStride[3],
+                       uint8_t * dst[3], const int dstStride[3],
+                       int width, int height)
+{
+    if(srcStride[1] == dstStride[1] && srcStride[2] == dstStride[2]){
+        linecpy(dst[1], src[1], height, srcStride[1]);
+        linecpy(dst[2], src[2], height, srcStride[2]);
+    }else{
+        int y;
+        for(y=0; y<height; y++){
+            memcpy(&(dst[1][y*dstStride[1]]), &(src[1][y*srcStride[1]]), width);
+            memcpy(&(dst[2][y*dstStride[2]]), &(src[2][y*srcStride[2]]), width);
+        }
+    }
+}
+
+void  pp_postprocess(const uint8_t * src[3], const int srcStride[3],
+                     uint8_t * dst[3], const int dstStride[3],
+                     int width, int height,
+                     const QP_STORE_T *QP_store,  int QPStride,
+                     pp_mode *vm,  void *vc, int pict_type)
+{
+    PPMode *mode = (PPMode*)vm;
+    PPContext *c = (PPContext*)vc;
+
+    prepareFrame(c, mode, width, height, srcStride, dstStride,
+                 &QP_store, &QPStride, pict_type);
+
     postProcess(src[0], srcStride[0], dst[0], dstStride[0],
                 width, height, QP_store, QPStride, 0, mode, c);
 
@@ -1060,15 +1218,152 @@ void  pp_postprocess(const uint8_t * src[3], const int srcStride[3],
                     width, height, QP_store, QPStride, 1, mode, c);
         postProcess(src[2], srcStride[2], dst[2], dstStride[2],
                     width, height, QP_store, QPStride, 2, mode, c);
+    }else
+        copyChroma(src, srcStride, dst, dstStride, width, height);
+}
+
+typedef struct BandJobArg{
+    const uint8_t **src;
+    const int *srcStride;
+    uint8_t **dst;
+    const int *dstStride;
+    int width[3];
+    int height[3];
+    int bandHeight[3];
+    int nbBands[3];
+    const QP_STORE_T *QP_store;
+    int QPStride;
+    PPMode *mode;
+}BandJobArg;
+
+/**
+ * Filter one band of a plane. The band is filtered together with
+ * BAND_OVERLAP rows above and below it, so that the vertical deblocking,
+ * deringing and deinterlacing filters see about the same context at its
+ * edges as in a single pass. Only the rows of the band are written to dst.
+ */
+static int bandJob(void *ctx, void *arg, int jobnr, int threadnr){
+    PPContext *c= ctx;
+    BandJobArg *t= arg;
+    PPThreadContext *tc= &c->threads[threadnr];
+    PPContext bc;
+    int plane, top, bottom, start, end, qpVShift, y;
+
+    for(plane=0; jobnr >= t->nbBands[plane]; plane++)
+        jobnr-= t->nbBands[plane];
+    qpVShift= plane ? 4-c->vChromaSubSample : 4;
+
+    top   = jobnr*t->bandHeight[plane];
+    bottom= FFMIN(top + t->bandHeight[plane], t->height[plane]);
+    start = FFMAX(top - BAND_OVERLAP, 0);
+    end   = FFMIN(bottom + BAND_OVERLAP, t->height[plane]);
+
+    bc= *c;
+    bc.tempBlocks = tc->tempBlocks;
+    bc.tempDst    = tc->tempDst;
+    bc.tempSrc    = tc->tempSrc;
+    bc.deintTemp  = tc->deintTemp;
+    bc.yHistogram = tc->yHistogram;
+    bc.nonBQPTable= c->nonBQPTable + (start>>qpVShift)*FFABS(t->QPStride);
+    bc.isBand     = 1;
+    bc.bandStart  = top - start;
+    bc.bandEnd    = bottom - start;
+
+    /* dering reads one pixel left and right of the plane, make it
+     * independent of what the previous job of this thread left there */
+    if(c->stride > t->width[plane])
+        for(y=0; y<end-start; y++)
+            memset(tc->bandDst + y*c->stride + t->width[plane], 0,
+                   c->stride - t->width[plane]);
+
+    postProcess(t->src[plane] + start*t->srcStride[plane], t->srcStride[plane],
+                tc->bandDst, c->stride, t->width[plane], end - start,
+                t->QP_store + (start>>qpVShift)*t->QPStride, t->QPStride,
+                plane, t->mode, &bc);
+
+    for(y=top; y<bottom; y++)
+        memcpy(t->dst[plane] + y*t->dstStride[plane],
+               tc->bandDst + (y-start)*c->stride, t->width[plane]);
+    return 0;
+}
+
+/**
+ * Split a plane into at most nbThreads bands of at least BAND_MIN_HEIGHT
+ * rows, multiples of 16 so that they start on a quantizer row.
+ * @return the number of bands
+ */
+static int splitPlane(int height, int nbThreads, int *bandHeight){
+    int nb= av_clip(height / BAND_MIN_HEIGHT, 1, nbThreads);
+
+    *bandHeight= FFALIGN((height + nb - 1) / nb, 16);
+    return (height + *bandHeight - 1) / *bandHeight;
+}
+
+void  pp_postprocess_threaded(const uint8_t * src[3], const int srcStride[3],
+                              uint8_t * dst[3], const int dstStride[3],
+                              int width, int height,
+                              const QP_STORE_T *QP_store,  int QPStride,
+                              pp_mode *vm,  void *vc, int pict_type,
+                              struct AVThreadPool *pool)
+{
+    PPMode *mode = (PPMode*)vm;
+    PPContext *c = (PPContext*)vc;
+    int nbThreads= pool ? av_threadpool_get_nb_threads(pool) + 1 : 1;
+    BandJobArg arg;
+    int i, j;
+
+    arg.width[0]  = width;
+    arg.height[0] = height;
+    arg.width[1]  = arg.width[2]  = width  >> c->hChromaSubSample;
+    arg.height[1] = arg.height[2] = height >> c->vChromaSubSample;
+    arg.nbBands[0]= splitPlane(height, nbThreads, &arg.bandHeight[0]);
+    arg.nbBands[1]= arg.nbBands[2]=
+        splitPlane(arg.height[1], nbThreads, &arg.bandHeight[1]);
+    arg.bandHeight[2]= arg.bandHeight[1];
+    if(!mode->chromMode)
+        arg.nbBands[1]= arg.nbBands[2]= 0;
+
+    /* When filtering in place, a band would read source rows its
+     * neighbour has already filtered, and the temporal noise reducer
+     * would update the state of the context rows a second time. */
+    if(arg.nbBands[0] < 2 ||
+       src[0] == dst[0] || src[1] == dst[1] || src[2] == dst[2] ||
+       ((mode->lumMode | mode->chromMode) & TEMP_NOISE_FILTER)){
+        pp_postprocess(src, srcStride, dst, dstStride, width, height,
+                       QP_store, QPStride, vm, vc, pict_type);
+        return;
     }
-    else if(srcStride[1] == dstStride[1] && srcStride[2] == dstStride[2]){
-        linecpy(dst[1], src[1], height, srcStride[1]);
-        linecpy(dst[2], src[2], height, srcStride[2]);
-    }else{
-        int y;
-        for(y=0; y<height; y++){
-            memcpy(&(dst[1][y*dstStride[1]]), &(src[1][y*srcStride[1]]), width);
-            memcpy(&(dst[2][y*dstStride[2]]), &(src[2][y*srcStride[2]]), width);
-        }
+
+    prepareFrame(c, mode, width, height, srcStride, dstStride,
+                 &QP_store, &QPStride, pict_type);
+
+    if(reallocThreads(c, nbThreads, width, arg.bandHeight[0]) < 0){
+        pp_postprocess(src, srcStride, dst, dstStride, width, height,
+                       QP_store, QPStride, vm, vc, pict_type);
+        return;
     }
+
+    /* the brightness correction uses the same levels for all bands */
+    c->ppMode= *mode;
+    getLevels(c, width, height);
+
+    arg.src      = src;
+    arg.srcStride= srcStride;
+    arg.dst      = dst;
+    arg.dstStride= dstStride;
+    arg.QP_store = QP_store;
+    arg.QPStride = QPStride;
+    arg.mode     = mode;
+    av_threadpool_execute(pool, bandJob, c, &arg, NULL,
+                          arg.nbBands[0] + arg.nbBands[1] + arg.nbBands[2],
+                          nbThreads);
+
+    for(i=0; i<nbThreads; i++){
+        for(j=0; j<256; j++)
+            c->yHistogram[j]+= c->threads[i].yHistogram[j];
+        memset(c->threads[i].yHistogram, 0, 256*sizeof(uint64_t));
+    }
+
+    if(!mode->chromMode)
+        copyChroma(src, srcStride, dst, dstStride, arg.width[1], arg.height[1]);
 }
@@ -30,7 +30,7 @@
 #include "libavutil/avutil.h"
 
 #define LIBPOSTPROC_VERSION_MAJOR 51
-#define LIBPOSTPROC_VERSION_MINOR  2
+#define LIBPOSTPROC_VERSION_MINOR  3
 #define LIBPOSTPROC_VERSION_MICRO  0
 
 #define LIBPOSTPROC_VERSION_INT AV_VERSION_INT(LIBPOSTPROC_VERSION_MAJOR, \
@@ -81,6 +81,24 @@ void  pp_postprocess(const uint8_t * src[3], const int srcStride[3],
                      const QP_STORE_T *QP_store,  int QP_stride,
                      pp_mode *mode, pp_context *ppContext, int pict_type);
 
+struct AVThreadPool;
+
+/**
+ * Like pp_postprocess(), but split the planes into horizontal bands which
+ * are filtered by the threads of pool. Each band is filtered with a few
+ * rows of context of its neighbours, so the output can differ slightly
+ * from pp_postprocess() near the band edges. The brightness correction
+ * still uses the levels of the whole frame.
+ * Falls back to pp_postprocess() if pool is NULL, when filtering in place
+ * or with the temporal noise reducer.
+ */
+void  pp_postprocess_threaded(const uint8_t * src[3], const int srcStride[3],
+                              uint8_t * dst[3], const int dstStride[3],
+                              int horizontalSize, int verticalSize,
+                              const QP_STORE_T *QP_store,  int QP_stride,
+                              pp_mode *mode, pp_context *ppContext, int pict_type,
+                              struct AVThreadPool *pool);
+
 
 /**
  * returns a pp_mode or NULL if an error occurred
@@ -97,6 +115,7 @@ void pp_free_context(pp_context *ppContext);
 #define PP_CPU_CAPS_MMX2  0x20000000
 #define PP_CPU_CAPS_3DNOW 0x40000000
 #define PP_CPU_CAPS_ALTIVEC 0x10000000
+#define PP_CPU_CAPS_SSE2  0x08000000
 
 #define PP_FORMAT         0x00000008
 #define PP_FORMAT_420    (0x00000011|PP_FORMAT)
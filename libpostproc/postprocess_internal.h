@@ -165,8 +165,38 @@ typedef struct PPContext{
     int vChromaSubSample;
 
     PPMode ppMode;
+
+    int blackLevel;               ///< luma levels of the current frame, found in yHistogram
+    int whiteLevel;
+
+    /**
+     * Set while a horizontal band of a plane is filtered by
+     * pp_postprocess_threaded(). The rows from bandStart to bandEnd-1 belong
+     * to the band, the others are only filtered as context.
+     */
+    int isBand;
+    int bandStart;
+    int bandEnd;
+
+    struct PPThreadContext *threads; ///< per thread buffers of pp_postprocess_threaded()
+    int nbThreads;
+    int threadWidth;              ///< size the per thread buffers were allocated for
+    int threadStride;
+    int threadBandHeight;
 } PPContext;
 
+/**
+ * Buffers of one thread filtering bands in pp_postprocess_threaded().
+ */
+typedef struct PPThreadContext{
+    uint8_t *tempBlocks;
+    uint8_t *tempDst;
+    uint8_t *tempSrc;
+    uint8_t *deintTemp;
+    uint64_t *yHistogram;         ///< luma histogram of the bands filtered by this thread
+    uint8_t *bandDst;             ///< a band is filtered here together with its context rows
+} PPThreadContext;
+
 
 static inline void linecpy(void *dest, const void *src, int lines, int stride) {
     if (stride > 0) {
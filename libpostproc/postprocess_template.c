@@ -1040,7 +1040,152 @@ static inline void RENAME(doVertDefFilter)(uint8_t src[], int stride, PPContext
 #if !HAVE_ALTIVEC
 static inline void RENAME(dering)(uint8_t src[], int stride, PPContext *c)
 {
-#if HAVE_MMX2 || HAVE_AMD3DNOW
+#if HAVE_SSE2
+    DECLARE_ALIGNED(16, uint64_t, tmp)[6]; // a, QP/2+1 and 8 for all 16 bytes
+    int range;
+
+    tmp[4]= tmp[5]= 0x0808080808080808LL;
+    __asm__ volatile(
+        "lea (%2, %3), %%"REG_a"                \n\t"
+// two lines per register, 1/2 3/4 5/6 7/8
+        "movq (%%"REG_a"), %%xmm0               \n\t"
+        "movhps (%%"REG_a", %3), %%xmm0         \n\t"
+        "movq (%%"REG_a", %3, 2), %%xmm1        \n\t"
+        "movhps (%2, %3, 4), %%xmm1             \n\t"
+        "lea (%%"REG_a", %3, 4), %%"REG_a"      \n\t"
+        "movq (%%"REG_a"), %%xmm2               \n\t"
+        "movhps (%%"REG_a", %3), %%xmm2         \n\t"
+        "movq (%%"REG_a", %3, 2), %%xmm3        \n\t"
+        "movhps (%2, %3, 8), %%xmm3             \n\t"
+        "movdqa %%xmm0, %%xmm4                  \n\t"
+        "pminub %%xmm1, %%xmm0                  \n\t"
+        "pmaxub %%xmm1, %%xmm4                  \n\t"
+        "pminub %%xmm2, %%xmm0                  \n\t"
+        "pmaxub %%xmm2, %%xmm4                  \n\t"
+        "pminub %%xmm3, %%xmm0                  \n\t"
+        "pmaxub %%xmm3, %%xmm4                  \n\t"
+
+        "pshufd $0x4E, %%xmm0, %%xmm1           \n\t"
+        "pshufd $0x4E, %%xmm4, %%xmm5           \n\t"
+        "pminub %%xmm1, %%xmm0                  \n\t"
+        "pmaxub %%xmm5, %%xmm4                  \n\t"
+        "pshuflw $0x4E, %%xmm0, %%xmm1          \n\t"
+        "pshuflw $0x4E, %%xmm4, %%xmm5          \n\t"
+        "pminub %%xmm1, %%xmm0                  \n\t"
+        "pmaxub %%xmm5, %%xmm4                  \n\t"
+        "pshuflw $0xE1, %%xmm0, %%xmm1          \n\t"
+        "pshuflw $0xE1, %%xmm4, %%xmm5          \n\t"
+        "pminub %%xmm1, %%xmm0                  \n\t"
+        "pmaxub %%xmm5, %%xmm4                  \n\t"
+        "movdqa %%xmm0, %%xmm1                  \n\t"
+        "movdqa %%xmm4, %%xmm5                  \n\t"
+        "psrlw $8, %%xmm1                       \n\t"
+        "psrlw $8, %%xmm5                       \n\t"
+        "pminub %%xmm1, %%xmm0                  \n\t" // min of pixels
+        "pmaxub %%xmm5, %%xmm4                  \n\t" // max of pixels
+
+        "movdqa %%xmm4, %%xmm5                  \n\t"
+        "psubb %%xmm0, %%xmm5                   \n\t" // max - min
+        "movd %%xmm5, %0                        \n\t"
+        "pavgb %%xmm4, %%xmm0                   \n\t" // a=(max + min)/2
+        "punpcklbw %%xmm0, %%xmm0               \n\t"
+        "pshuflw $0, %%xmm0, %%xmm0             \n\t"
+        "punpcklqdq %%xmm0, %%xmm0              \n\t"
+        "movdqa %%xmm0, (%1)                    \n\t"
+
+        "pxor %%xmm6, %%xmm6                    \n\t"
+        "pcmpeqb %%xmm7, %%xmm7                 \n\t"
+        "movq %4, %%xmm1                        \n\t"
+        "punpcklbw %%xmm6, %%xmm1               \n\t"
+        "psrlw $1, %%xmm1                       \n\t"
+        "psubw %%xmm7, %%xmm1                   \n\t"
+        "packuswb %%xmm1, %%xmm1                \n\t" // QP/2+1
+        "movdqa %%xmm1, 16(%1)                  \n\t"
+        : "=&r" (range)
+        : "r" (tmp), "r" (src), "r" ((x86_reg)stride), "m" (c->pQPb)
+        : XMM_CLOBBERS("%xmm0", "%xmm1", "%xmm2", "%xmm3",
+                       "%xmm4", "%xmm5", "%xmm6", "%xmm7",)
+          "%"REG_a, "memory"
+    );
+    if((range & 0xFF) < deringThreshold)
+        return;
+
+// h = (src[-1] + 2src[0] + src[+1])/4 of 2 lines, s = -(number of these 3 pixels <= a)
+#define REAL_DERING_H_SSE2(addr0, addr1, h, s)\
+        "movq -1" #addr0 ", %%xmm4              \n\t"\
+        "movhps -1" #addr1 ", %%xmm4            \n\t" /* src[-1] */\
+        "movq 1" #addr0 ", %%xmm5               \n\t"\
+        "movhps 1" #addr1 ", %%xmm5             \n\t" /* src[+1] */\
+        "movq " #addr0 ", " #s "                \n\t"\
+        "movhps " #addr1 ", " #s "              \n\t" /* src[0] */\
+        "movdqa %%xmm4, " #h "                  \n\t"\
+        "pavgb %%xmm5, " #h "                   \n\t" /* (src[-1] + src[+1])/2 */\
+        "pavgb " #s ", " #h "                   \n\t" /* (src[-1] + 2src[0] + src[+1])/4 */\
+        "psubusb %%xmm7, %%xmm4                 \n\t"\
+        "psubusb %%xmm7, %%xmm5                 \n\t"\
+        "psubusb %%xmm7, " #s "                 \n\t"\
+        "pcmpeqb %%xmm6, %%xmm4                 \n\t" /* src[-1] > a ? 0 : -1*/\
+        "pcmpeqb %%xmm6, %%xmm5                 \n\t" /* src[+1] > a ? 0 : -1*/\
+        "pcmpeqb %%xmm6, " #s "                 \n\t" /* src[0]  > a ? 0 : -1*/\
+        "paddb %%xmm4, %%xmm5                   \n\t"\
+        "paddb %%xmm5, " #s "                   \n\t"
+
+// filter the 2 lines between the line pairs of ph/ps and h/s
+#define REAL_DERING_CORE_SSE2(dst0, dst1, ph, ps, h, s)\
+        "movdqa " #ps ", %%xmm4                 \n\t"\
+        "shufpd $1, " #s ", %%xmm4              \n\t" /* s of the 2 lines */\
+        "paddb " #ps ", %%xmm4                  \n\t"\
+        "paddb " #s ", %%xmm4                   \n\t"\
+        "pand 32(%2), %%xmm4                    \n\t"\
+        "pcmpeqb %%xmm6, %%xmm4                 \n\t" /* all or none of the 9 pixels > a */\
+        "movdqa " #ph ", %%xmm5                 \n\t"\
+        "shufpd $1, " #h ", %%xmm5              \n\t" /* h of the 2 lines */\
+        "pavgb " #h ", " #ph "                  \n\t"\
+        "pavgb %%xmm5, " #ph "                  \n\t" /* filtered */\
+        "movq " #dst0 ", %%xmm5                 \n\t"\
+        "movhps " #dst1 ", %%xmm5               \n\t" /* dst */\
+        "movdqa %%xmm5, " #ps "                 \n\t"\
+        "psubusb 16(%2), " #ps "                \n\t"\
+        "pmaxub " #ps ", " #ph "                \n\t"\
+        "movdqa %%xmm5, " #ps "                 \n\t"\
+        "paddusb 16(%2), " #ps "                \n\t"\
+        "pminub " #ps ", " #ph "                \n\t"\
+        "pand %%xmm4, " #ph "                   \n\t"\
+        "pandn %%xmm5, %%xmm4                   \n\t"\
+        "por " #ph ", %%xmm4                    \n\t"\
+        "movq %%xmm4, " #dst0 "                 \n\t"\
+        "movhps %%xmm4, " #dst1 "               \n\t"
+
+#define DERING_H_SSE2(addr0, addr1, h, s) \
+   REAL_DERING_H_SSE2(addr0, addr1, h, s)
+#define DERING_CORE_SSE2(dst0, dst1, ph, ps, h, s) \
+   REAL_DERING_CORE_SSE2(dst0, dst1, ph, ps, h, s)
+
+    __asm__ volatile(
+        "lea (%0, %1), %%"REG_a"                \n\t"
+        "lea (%%"REG_a", %1, 4), %%"REG_d"      \n\t"
+        "movdqa (%2), %%xmm7                    \n\t" // a
+        "pxor %%xmm6, %%xmm6                    \n\t"
+
+//        0        1        2        3        4        5        6        7        8        9
+//        %0        eax        eax+%1        eax+2%1        %0+4%1        edx        edx+%1        edx+2%1        %0+8%1        edx+4%1
+
+DERING_H_SSE2((%0)           ,(%%REGa)        ,%%xmm0,%%xmm1)
+DERING_H_SSE2((%%REGa, %1)   ,(%%REGa, %1, 2) ,%%xmm2,%%xmm3)
+DERING_CORE_SSE2((%%REGa)    ,(%%REGa, %1)    ,%%xmm0,%%xmm1,%%xmm2,%%xmm3)
+DERING_H_SSE2((%0, %1, 4)    ,(%%REGd)        ,%%xmm0,%%xmm1)
+DERING_CORE_SSE2((%%REGa, %1, 2),(%0, %1, 4)  ,%%xmm2,%%xmm3,%%xmm0,%%xmm1)
+DERING_H_SSE2((%%REGd, %1)   ,(%%REGd, %1, 2) ,%%xmm2,%%xmm3)
+DERING_CORE_SSE2((%%REGd)    ,(%%REGd, %1)    ,%%xmm0,%%xmm1,%%xmm2,%%xmm3)
+DERING_H_SSE2((%0, %1, 8)    ,(%%REGd, %1, 4) ,%%xmm0,%%xmm1)
+DERING_CORE_SSE2((%%REGd, %1, 2),(%0, %1, 8)  ,%%xmm2,%%xmm3,%%xmm0,%%xmm1)
+
+        : : "r" (src), "r" ((x86_reg)stride), "r" (tmp)
+        : XMM_CLOBBERS("%xmm0", "%xmm1", "%xmm2", "%xmm3",
+                       "%xmm4", "%xmm5", "%xmm6", "%xmm7",)
+          "%"REG_a, "%"REG_d, "memory"
+    );
+#elif HAVE_MMX2 || HAVE_AMD3DNOW
     DECLARE_ALIGNED(8, uint64_t, tmp)[3];
     __asm__ volatile(
         "pxor %%mm6, %%mm6                      \n\t"
@@ -2468,7 +2613,7 @@ Switch between
  */
 static av_always_inline void RENAME(do_a_deblock)(uint8_t *src, int step, int stride, PPContext *c){
     int64_t dc_mask, eq_mask, both_masks;
-    int64_t sums[10*8*2];
+    DECLARE_ALIGNED(16, int64_t, sums)[10*8*2];
     src+= step*3; // src points to begin of the 8x8 Block
 //START_TIMER
     __asm__ volatile(
@@ -2582,6 +2727,117 @@ static av_always_inline void RENAME(do_a_deblock)(uint8_t *src, int step, int st
         x86_reg offset= -8*step;
         int64_t *temp_sums= sums;
 
+#if HAVE_SSE2
+        __asm__ volatile(
+            "movq %2, %%xmm0                        \n\t"  // QP,..., QP
+            "pxor %%xmm4, %%xmm4                    \n\t"
+
+            "movq (%0), %%xmm6                      \n\t"
+            "movq (%0, %1), %%xmm5                  \n\t"
+            "movdqa %%xmm5, %%xmm1                  \n\t"
+            "movdqa %%xmm6, %%xmm2                  \n\t"
+            "psubusb %%xmm6, %%xmm5                 \n\t"
+            "psubusb %%xmm1, %%xmm2                 \n\t"
+            "por %%xmm5, %%xmm2                     \n\t" // ABS Diff of lines
+            "psubusb %%xmm2, %%xmm0                 \n\t" // diff >= QP -> 0
+            "pcmpeqb %%xmm4, %%xmm0                 \n\t" // diff >= QP -> FF
+
+            "pxor %%xmm6, %%xmm1                    \n\t"
+            "pand %%xmm0, %%xmm1                    \n\t"
+            "pxor %%xmm1, %%xmm6                    \n\t"
+            // 0:QP  6:First
+
+            "movq (%0, %1, 8), %%xmm5               \n\t"
+            "add %1, %0                             \n\t" // %0 points to line 1 not 0
+            "movq (%0, %1, 8), %%xmm7               \n\t"
+            "movdqa %%xmm5, %%xmm1                  \n\t"
+            "movdqa %%xmm7, %%xmm2                  \n\t"
+            "psubusb %%xmm7, %%xmm5                 \n\t"
+            "psubusb %%xmm1, %%xmm2                 \n\t"
+            "por %%xmm5, %%xmm2                     \n\t" // ABS Diff of lines
+            "movq %2, %%xmm0                        \n\t"  // QP,..., QP
+            "psubusb %%xmm2, %%xmm0                 \n\t" // diff >= QP -> 0
+            "pcmpeqb %%xmm4, %%xmm0                 \n\t" // diff >= QP -> FF
+
+            "pxor %%xmm7, %%xmm1                    \n\t"
+            "pand %%xmm0, %%xmm1                    \n\t"
+            "pxor %%xmm1, %%xmm7                    \n\t"
+
+            "punpcklbw %%xmm4, %%xmm6               \n\t"
+            "punpcklbw %%xmm4, %%xmm7               \n\t"
+            // 4:0 6:First 7:Last
+
+            "pcmpeqw %%xmm1, %%xmm1                 \n\t"
+            "psrlw $15, %%xmm1                      \n\t"
+            "psllw $2, %%xmm1                       \n\t" // 4
+            "movdqa %%xmm6, %%xmm0                  \n\t"
+            "psllw $2, %%xmm0                       \n\t"
+            "paddw %%xmm1, %%xmm0                   \n\t"
+
+#define NEXT_SSE2\
+            "movq (%0), %%xmm2                      \n\t"\
+            "add %1, %0                             \n\t"\
+            "punpcklbw %%xmm4, %%xmm2               \n\t"\
+            "paddw %%xmm2, %%xmm0                   \n\t"
+
+#define PREV_SSE2\
+            "movq (%0), %%xmm2                      \n\t"\
+            "add %1, %0                             \n\t"\
+            "punpcklbw %%xmm4, %%xmm2               \n\t"\
+            "psubw %%xmm2, %%xmm0                   \n\t"
+
+
+            NEXT_SSE2 //0
+            NEXT_SSE2 //1
+            NEXT_SSE2 //2
+            "movdqa %%xmm0, (%3)                    \n\t"
+
+            NEXT_SSE2 //3
+            "psubw %%xmm6, %%xmm0                   \n\t"
+            "movdqa %%xmm0, 16(%3)                  \n\t"
+
+            NEXT_SSE2 //4
+            "psubw %%xmm6, %%xmm0                   \n\t"
+            "movdqa %%xmm0, 32(%3)                  \n\t"
+
+            NEXT_SSE2 //5
+            "psubw %%xmm6, %%xmm0                   \n\t"
+            "movdqa %%xmm0, 48(%3)                  \n\t"
+
+            NEXT_SSE2 //6
+            "psubw %%xmm6, %%xmm0                   \n\t"
+            "movdqa %%xmm0, 64(%3)                  \n\t"
+
+            NEXT_SSE2 //7
+            "mov %4, %0                             \n\t"
+            "add %1, %0                             \n\t"
+            PREV_SSE2 //0
+            "movdqa %%xmm0, 80(%3)                  \n\t"
+
+            PREV_SSE2 //1
+            "paddw %%xmm7, %%xmm0                   \n\t"
+            "movdqa %%xmm0, 96(%3)                  \n\t"
+
+            PREV_SSE2 //2
+            "paddw %%xmm7, %%xmm0                   \n\t"
+            "movdqa %%xmm0, 112(%3)                 \n\t"
+
+            PREV_SSE2 //3
+            "paddw %%xmm7, %%xmm0                   \n\t"
+            "movdqa %%xmm0, 128(%3)                 \n\t"
+
+            PREV_SSE2 //4
+            "paddw %%xmm7, %%xmm0                   \n\t"
+            "movdqa %%xmm0, 144(%3)                 \n\t"
+
+            "mov %4, %0                             \n\t" //FIXME
+
+            : "+&r"(src)
+            : "r" ((x86_reg)step), "m" (c->pQPb), "r"(sums), "g"(src)
+            : XMM_CLOBBERS("%xmm0", "%xmm1", "%xmm2", "%xmm4",
+                           "%xmm5", "%xmm6", "%xmm7",) "memory"
+        );
+#else
         __asm__ volatile(
             "movq %2, %%mm0                         \n\t"  // QP,..., QP
             "pxor %%mm4, %%mm4                      \n\t"
@@ -2718,9 +2974,41 @@ static av_always_inline void RENAME(do_a_deblock)(uint8_t *src, int step, int st
             : "+&r"(src)
             : "r" ((x86_reg)step), "m" (c->pQPb), "r"(sums), "g"(src)
         );
+#endif
 
         src+= step; // src points to begin of the 8x8 Block
 
+#if HAVE_SSE2
+        __asm__ volatile(
+            "movq %4, %%xmm6                        \n\t"
+            "pcmpeqb %%xmm5, %%xmm5                 \n\t"
+            "pxor %%xmm6, %%xmm5                    \n\t"
+            "pxor %%xmm7, %%xmm7                    \n\t"
+
+            "1:                                     \n\t"
+            "movdqa (%1), %%xmm0                    \n\t"
+            "paddw 32(%1), %%xmm0                   \n\t"
+            "movq (%0, %3), %%xmm2                  \n\t"
+            "movdqa %%xmm2, %%xmm4                  \n\t"
+            "punpcklbw %%xmm7, %%xmm2               \n\t"
+            "paddw %%xmm2, %%xmm0                   \n\t"
+            "paddw %%xmm2, %%xmm0                   \n\t"
+            "psrlw $4, %%xmm0                       \n\t"
+            "packuswb %%xmm0, %%xmm0                \n\t"
+            "pand %%xmm6, %%xmm0                    \n\t"
+            "pand %%xmm5, %%xmm4                    \n\t"
+            "por %%xmm4, %%xmm0                     \n\t"
+            "movq %%xmm0, (%0, %3)                  \n\t"
+            "add $16, %1                            \n\t"
+            "add %2, %0                             \n\t"
+            " js 1b                                 \n\t"
+
+            : "+r"(offset), "+r"(temp_sums)
+            : "r" ((x86_reg)step), "r"(src - offset), "m"(both_masks)
+            : XMM_CLOBBERS("%xmm0", "%xmm2", "%xmm4", "%xmm5",
+                           "%xmm6", "%xmm7",) "memory"
+        );
+#else
         __asm__ volatile(
             "movq %4, %%mm6                         \n\t"
             "pcmpeqb %%mm5, %%mm5                   \n\t"
@@ -2755,11 +3043,123 @@ static av_always_inline void RENAME(do_a_deblock)(uint8_t *src, int step, int st
             : "+r"(offset), "+r"(temp_sums)
             : "r" ((x86_reg)step), "r"(src - offset), "m"(both_masks)
         );
+#endif
     }else
         src+= step; // src points to begin of the 8x8 Block
 
     if(eq_mask != -1LL){
         uint8_t *temp_src= src;
+#if HAVE_SSE2
+        __asm__ volatile(
+            "pxor %%xmm7, %%xmm7                    \n\t"
+//      0       1       2       3       4       5       6       7       8       9
+//      %0      eax     eax+%1  eax+2%1 %0+4%1  ecx     ecx+%1  ecx+2%1 %1+8%1  ecx+4%1
+
+            "movq (%0), %%xmm1                      \n\t"
+            "punpcklbw %%xmm7, %%xmm1               \n\t" // line 0
+            "movq (%0, %1), %%xmm2                  \n\t"
+            "lea (%0, %1, 2), %%"REG_a"             \n\t"
+            "punpcklbw %%xmm7, %%xmm2               \n\t" // line 1
+            "movq (%%"REG_a"), %%xmm4               \n\t"
+            "punpcklbw %%xmm7, %%xmm4               \n\t" // line 2
+
+            "paddw %%xmm1, %%xmm1                   \n\t" // 2L0
+            "psubw %%xmm4, %%xmm2                   \n\t" // L1 - L2
+            "psubw %%xmm2, %%xmm1                   \n\t" // 2L0 - L1 + L2
+            "psllw $2, %%xmm2                       \n\t" // 4L1 - 4L2
+            "psubw %%xmm2, %%xmm1                   \n\t" // 2L0 - 5L1 + 5L2
+
+            "movq (%%"REG_a", %1), %%xmm2           \n\t"
+            "punpcklbw %%xmm7, %%xmm2               \n\t" // L3
+            "psubw %%xmm2, %%xmm1                   \n\t" // 2L0 - 5L1 + 5L2 - L3
+            "psubw %%xmm2, %%xmm1                   \n\t" // 2L0 - 5L1 + 5L2 - 2L3
+
+            "movq (%%"REG_a", %1, 2), %%xmm0        \n\t"
+            "punpcklbw %%xmm7, %%xmm0               \n\t" // L4
+            "psubw %%xmm0, %%xmm2                   \n\t" // L3 - L4
+            "movdqa %%xmm2, %%xmm3                  \n\t" // L3 - L4
+            "paddw %%xmm4, %%xmm4                   \n\t" // 2L2
+            "psubw %%xmm2, %%xmm4                   \n\t" // 2L2 - L3 + L4
+
+            "lea (%%"REG_a", %1), %0                \n\t"
+            "psllw $2, %%xmm2                       \n\t" // 4L3 - 4L4
+            "psubw %%xmm2, %%xmm4                   \n\t" // 2L2 - 5L3 + 5L4
+
+            "movq (%0, %1, 2), %%xmm2               \n\t"
+            "punpcklbw %%xmm7, %%xmm2               \n\t" // L5
+            "psubw %%xmm2, %%xmm4                   \n\t" // 2L2 - 5L3 + 5L4 - L5
+            "psubw %%xmm2, %%xmm4                   \n\t" // 2L2 - 5L3 + 5L4 - 2L5
+
+            "movq (%%"REG_a", %1, 4), %%xmm6        \n\t"
+            "punpcklbw %%xmm7, %%xmm6               \n\t" // L6
+            "psubw %%xmm6, %%xmm2                   \n\t" // L5 - L6
+            "paddw %%xmm0, %%xmm0                   \n\t" // 2L4
+            "psubw %%xmm2, %%xmm0                   \n\t" // 2L4 - L5 + L6
+            "psllw $2, %%xmm2                       \n\t" // 4L5 - 4L6
+            "psubw %%xmm2, %%xmm0                   \n\t" // 2L4 - 5L5 + 5L6
+
+            "movq (%0, %1, 4), %%xmm2               \n\t"
+            "punpcklbw %%xmm7, %%xmm2               \n\t" // L7
+            "paddw %%xmm2, %%xmm2                   \n\t" // 2L7
+            "psubw %%xmm2, %%xmm0                   \n\t" // 2L4 - 5L5 + 5L6 - 2L7
+
+            "movdqa %%xmm7, %%xmm6                  \n\t" // 0
+            "psubw %%xmm0, %%xmm6                   \n\t"
+            "pmaxsw %%xmm6, %%xmm0                  \n\t" // |2L4 - 5L5 + 5L6 - 2L7|
+            "movdqa %%xmm7, %%xmm6                  \n\t" // 0
+            "psubw %%xmm1, %%xmm6                   \n\t"
+            "pmaxsw %%xmm6, %%xmm1                  \n\t" // |2L0 - 5L1 + 5L2 - 2L3|
+            "pminsw %%xmm1, %%xmm0                  \n\t"
+
+            "movq %2, %%xmm2                        \n\t" // QP
+            "punpcklbw %%xmm7, %%xmm2               \n\t"
+
+            "movdqa %%xmm7, %%xmm6                  \n\t" // 0
+            "pcmpgtw %%xmm4, %%xmm6                 \n\t" // sign(2L2 - 5L3 + 5L4 - 2L5)
+            "pxor %%xmm6, %%xmm4                    \n\t"
+            "psubw %%xmm6, %%xmm4                   \n\t" // |2L2 - 5L3 + 5L4 - 2L5|
+            "psllw $3, %%xmm2                       \n\t" // 8QP
+            "pcmpgtw %%xmm4, %%xmm2                 \n\t"
+            "pand %%xmm2, %%xmm4                    \n\t"
+
+            "psubusw %%xmm0, %%xmm4                 \n\t" // d
+
+            "movdqa %%xmm4, %%xmm2                  \n\t"
+            "psllw $2, %%xmm4                       \n\t"
+            "paddw %%xmm2, %%xmm4                   \n\t" // 5d
+            "pcmpeqw %%xmm2, %%xmm2                 \n\t"
+            "psrlw $15, %%xmm2                      \n\t"
+            "psllw $5, %%xmm2                       \n\t" // 32
+            "paddw %%xmm2, %%xmm4                   \n\t"
+            "psrlw $6, %%xmm4                       \n\t"
+
+            "pxor %%xmm2, %%xmm2                    \n\t"
+            "pcmpgtw %%xmm3, %%xmm2                 \n\t" // sign (L3-L4)
+            "pxor %%xmm2, %%xmm3                    \n\t"
+            "psubw %%xmm2, %%xmm3                   \n\t" // |L3-L4|
+            "psrlw $1, %%xmm3                       \n\t" // |L3 - L4|/2
+
+            "pxor %%xmm6, %%xmm2                    \n\t"
+            "pand %%xmm2, %%xmm4                    \n\t"
+            "pminsw %%xmm3, %%xmm4                  \n\t"
+            "pxor %%xmm6, %%xmm4                    \n\t"
+            "psubw %%xmm6, %%xmm4                   \n\t"
+            "packsswb %%xmm4, %%xmm4                \n\t"
+            "movq %3, %%xmm1                        \n\t"
+            "pandn %%xmm4, %%xmm1                   \n\t"
+            "movq (%0), %%xmm0                      \n\t"
+            "paddb   %%xmm1, %%xmm0                 \n\t"
+            "movq %%xmm0, (%0)                      \n\t"
+            "movq (%0, %1), %%xmm0                  \n\t"
+            "psubb %%xmm1, %%xmm0                   \n\t"
+            "movq %%xmm0, (%0, %1)                  \n\t"
+
+            : "+r" (temp_src)
+            : "r" ((x86_reg)step), "m" (c->pQPb), "m"(eq_mask)
+            : XMM_CLOBBERS("%xmm0", "%xmm1", "%xmm2", "%xmm3",
+                           "%xmm4", "%xmm6", "%xmm7",) "%"REG_a
+        );
+#else
         DECLARE_ALIGNED(8, uint64_t, tmp)[4]; // make space for 4 8-byte vars
         __asm__ volatile(
             "pxor %%mm7, %%mm7                      \n\t"
@@ -2990,6 +3390,7 @@ static av_always_inline void RENAME(do_a_deblock)(uint8_t *src, int step, int st
             : "r" ((x86_reg)step), "m" (c->pQPb), "m"(eq_mask), "r"(tmp)
             : "%"REG_a
         );
+#endif
     }
 /*if(step==16){
     STOP_TIMER("step16")
@@ -3216,34 +3617,13 @@ static void RENAME(postProcess)(const uint8_t src[], int srcStride, uint8_t dst[
     copyAhead-= 8;
 
     if(!isColor){
-        uint64_t sum= 0;
-        int i;
-        uint64_t maxClipped;
-        uint64_t clipped;
         double scale;
 
-        c.frameNum++;
-        // first frame is fscked so we ignore it
-        if(c.frameNum == 1) yHistogram[0]= width*height/64*15/256;
-
-        for(i=0; i<256; i++){
-            sum+= yHistogram[i];
-        }
-
-        /* We always get a completely black picture first. */
-        maxClipped= (uint64_t)(sum * c.ppMode.maxClippedThreshold);
-
-        clipped= sum;
-        for(black=255; black>0; black--){
-            if(clipped < maxClipped) break;
-            clipped-= yHistogram[black];
-        }
-
-        clipped= sum;
-        for(white=0; white<256; white++){
-            if(clipped < maxClipped) break;
-            clipped-= yHistogram[white];
-        }
+        // the levels of a band were already found for the whole frame
+        if(!c.isBand)
+            getLevels(&c, width, height);
+        black= c.blackLevel;
+        white= c.whiteLevel;
 
         scale= (double)(c.ppMode.maxAllowedY - c.ppMode.minAllowedY) / (double)(white-black);
 
@@ -3360,6 +3740,8 @@ static void RENAME(postProcess)(const uint8_t src[], int srcStride, uint8_t dst[
         const int8_t *QPptr= &QPs[(y>>qpVShift)*QPStride];
         int8_t *nonBQPptr= &c.nonBQPTable[(y>>qpVShift)*FFABS(QPStride)];
         int QP=0;
+        // rows filtered only as context of a band belong to the histogram of the neighbouring band
+        const int countLevels= !c.isBand || (y >= c.bandStart && y < c.bandEnd);
         /* can we mess with a 8x16 block from srcBlock/dstBlock downwards and 1 line upwards
            if not than use a temporary buffer */
         if(y+15 >= height){
@@ -3400,7 +3782,8 @@ static void RENAME(postProcess)(const uint8_t src[], int srcStride, uint8_t dst[
                 QP= (QP* QPCorrecture + 256*128)>>16;
                 c.nonBQP= nonBQPptr[x>>4];
                 c.nonBQP= (c.nonBQP* QPCorrecture + 256*128)>>16;
-                yHistogram[ srcBlock[srcStride*12 + 4] ]++;
+                if(countLevels)
+                    yHistogram[ srcBlock[srcStride*12 + 4] ]++;
             }
             c.QP= QP;
 #if HAVE_MMX
@@ -0,0 +1,3 @@
+FATE_TESTS-$(HAVE_MMX) += fate-volume
+fate-volume: libavfilter/volume-test$(EXESUF)
+fate-volume: CMD = run libavfilter/volume-test
@@ -21,6 +21,11 @@ fate-des: libavutil/des-test$(EXESUF)
 fate-des: CMD = run libavutil/des-test
 fate-des: REF = /dev/null
 
+FATE_TESTS += fate-dict
+fate-dict: libavutil/dict-test$(EXESUF)
+fate-dict: CMD = run libavutil/dict-test
+fate-dict: REF = /dev/null
+
 FATE_TESTS += fate-eval
 fate-eval: libavutil/eval-test$(EXESUF)
 fate-eval: CMD = run libavutil/eval-test
@@ -33,6 +38,21 @@ FATE_TESTS += fate-md5
 fate-md5: libavutil/md5-test$(EXESUF)
 fate-md5: CMD = run libavutil/md5-test
 
+FATE_TESTS += fate-ringbuffer
+fate-ringbuffer: libavutil/ringbuffer-test$(EXESUF)
+fate-ringbuffer: CMD = run libavutil/ringbuffer-test
+fate-ringbuffer: REF = /dev/null
+
 FATE_TESTS += fate-sha
 fate-sha: libavutil/sha-test$(EXESUF)
 fate-sha: CMD = run libavutil/sha-test
+
+FATE_TESTS += fate-threadpool
+fate-threadpool: libavutil/threadpool-test$(EXESUF)
+fate-threadpool: CMD = run libavutil/threadpool-test
+fate-threadpool: REF = /dev/null
+
+FATE_TESTS += fate-trace
+fate-trace: libavutil/trace-test$(EXESUF)
+fate-trace: CMD = run libavutil/trace-test
+fate-trace: REF = /dev/null
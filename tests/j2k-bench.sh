@@ -0,0 +1,60 @@
+#!/bin/sh
+#
+# JPEG 2000 decoder benchmark on a set of conformance codestreams
+# (e.g. the ITU-T T.803 vectors). Every codestream is decoded with each
+# thread count; the script fails if the decoded frames depend on the
+# thread count, and prints the user time of each decode.
+#
+# usage: j2k-bench.sh <ffmpeg> <vector dir> [thread counts]
+
+LC_ALL=C
+export LC_ALL
+
+ffmpeg="$1"
+vectors="$2"
+threads="${3:-1 2 4}"
+
+. $(dirname $0)/md5.sh
+
+if [ ! -d "$vectors" ]; then
+    echo "no conformance vectors in '$vectors'"
+    exit 1
+fi
+
+tmpfile=j2k-bench.$$.md5
+trap 'rm -f $tmpfile' EXIT
+errors=0
+
+printf '%-32s' "vector"
+for t in $threads; do printf '%12s' "$t thr"; done
+echo
+
+for f in "$vectors"/*.j2k "$vectors"/*.j2c "$vectors"/*.jp2; do
+    [ -f "$f" ] || continue
+    ref=
+    printf '%-32s' "$(basename $f)"
+    for t in $threads; do
+        utime=$("$ffmpeg" -v error -benchmark -strict experimental -threads $t \
+                -i "$f" -f framemd5 -y $tmpfile 2>/dev/null |
+                sed -n 's/^bench: utime=\([0-9.]*\)s.*/\1/p')
+        md5=$(do_md5sum $tmpfile | cut -d' ' -f1)
+        if [ -z "$utime" ]; then
+            printf '%12s' "failed"
+            errors=$((errors + 1))
+            continue
+        fi
+        if [ -z "$ref" ]; then
+            ref=$md5
+        elif [ "$md5" != "$ref" ]; then
+            utime="$utime!"
+            errors=$((errors + 1))
+        fi
+        printf '%12s' "${utime}s"
+    done
+    echo
+done
+
+if [ $errors -ne 0 ]; then
+    echo "$errors decodes failed or differed from the single-threaded output (!)"
+    exit 1
+fi
@@ -0,0 +1,49 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*
+ * Run the libavcodec DSP function benchmark and list the implementation
+ * chosen for every function that has more than one. With a cache file,
+ * a cached result is listed instead if it matches this CPU.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "libavcodec/avcodec.h"
+#include "libavutil/error.h"
+#include "libavutil/log.h"
+
+int main(int argc, char **argv)
+{
+    int ret;
+
+    if (argc > 2 || (argc == 2 && !strcmp(argv[1], "-h"))) {
+        fprintf(stderr, "usage: %s [cache_file]\n", argv[0]);
+        return 1;
+    }
+
+    av_log_set_level(AV_LOG_VERBOSE);
+    ret = avcodec_dsp_tune(argc > 1 ? argv[1] : NULL);
+    if (ret < 0) {
+        char errbuf[128];
+        av_strerror(ret, errbuf, sizeof(errbuf));
+        fprintf(stderr, "DSP tuning failed: %s\n", errbuf);
+        return 1;
+    }
+    return 0;
+}